@@ -113,7 +113,11 @@
 #define PACKAGE_VERSION ""
 
 /* The size of a `void*', as computed by sizeof. */
-#define SIZEOF_VOIDP 4
+#if defined(__SIZEOF_POINTER__) /* GCC, when built for the Linux host */
+# define SIZEOF_VOIDP __SIZEOF_POINTER__
+#else
+# define SIZEOF_VOIDP 4
+#endif
 
 /* Define to 1 if you have the ANSI C header files. */
 #define STDC_HEADERS 1
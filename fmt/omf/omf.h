@@ -106,7 +106,6 @@ enum {
 #define OMF_RECTYPE_LPUBDEF     (0xB6)
 #define OMF_RECTYPE_LPUBDEF32   (0xB7)
 
-extern char                             omf_temp_str[255+1/*NUL*/];
 
 struct omf_record_t {
     unsigned char           rectype;
@@ -116,6 +115,40 @@ struct omf_record_t {
     size_t                  data_alloc;         // amount of data allocated if data != NULL or amount TO alloc if data == NULL
 
     unsigned long           rec_file_offset;    // file offset of record (~0UL if undefined)
+    unsigned char           data_ref;           // data points into an omf_image_t, not owned by the record
+};
+
+// whole file input source. the file is mmap()ed (Linux) or loaded into memory once and
+// records are parsed in place, the record data pointer points directly into the image.
+// if the file cannot be loaded, reading falls back to the file descriptor.
+struct omf_image_t {
+    unsigned char*          data;               // file contents, or NULL to read from fd
+    unsigned long           length;             // length of data
+    unsigned long           pos;                // read position
+    int                     fd;                 // file descriptor (fallback)
+    unsigned char           mapped;             // data is mmap()ed, not malloc()ed
+};
+
+// .LIB dictionary, to find which module defines a public name without parsing every module
+#define OMF_LIBDICT_BLOCK_SIZE          512
+#define OMF_LIBDICT_BUCKETS             37
+#define OMF_LIBDICT_FLAG_CASE_SENSITIVE 0x01
+
+struct omf_libdict_hash_t {
+    unsigned short          block_x;            // starting block
+    unsigned short          block_d;            // block step
+    unsigned short          bucket_x;           // starting bucket
+    unsigned short          bucket_d;           // bucket step
+};
+
+struct omf_libdict_t {
+    unsigned long           offset;             // file offset of dictionary
+    unsigned short          blocks;             // number of 512-byte dictionary blocks
+    unsigned short          page_size;          // module alignment (LIBHDR record size)
+    unsigned char           flags;              // LIBHDR flags
+    struct omf_image_t*     img;                // library image (or fd fallback)
+    unsigned short          block_num;          // block in block[] (fd fallback only)
+    unsigned char           block[OMF_LIBDICT_BLOCK_SIZE];
 };
 
 // this is filled in by a utility function after reading the OMF record from the beginning.
@@ -277,6 +310,7 @@ struct omf_context_t {
     struct {
         unsigned int                    verbose:1;
     } flags;
+    char                                temp_str[255+1/*NUL*/];// scratch for names while parsing, per context so contexts are reentrant
 };
 
 void omf_extdefs_context_init_extdef(struct omf_extdef_t * const ctx);
@@ -394,8 +428,21 @@ static inline unsigned int omf_lnames_context_get_next_add_index(const struct om
 }
 
 int omf_context_read_fd(struct omf_context_t * const ctx,int fd);
+int omf_context_read_finish(struct omf_context_t * const ctx);
 int omf_context_next_lib_module_fd(struct omf_context_t * const ctx,int fd);
 
+void omf_image_init(struct omf_image_t * const img);
+int omf_image_open_fd(struct omf_image_t * const img,int fd);
+void omf_image_close(struct omf_image_t * const img);
+int omf_context_read_image(struct omf_context_t * const ctx,struct omf_image_t * const img);
+int omf_context_next_lib_module_image(struct omf_context_t * const ctx,struct omf_image_t * const img);
+int omf_context_seek_image(struct omf_context_t * const ctx,struct omf_image_t * const img,const unsigned long ofs);
+
+void omf_libdict_init(struct omf_libdict_t * const d);
+void omf_libdict_hash(struct omf_libdict_hash_t * const h,const char * const name,const unsigned short blocks);
+int omf_libdict_open(struct omf_libdict_t * const d,struct omf_image_t * const img);
+unsigned long omf_libdict_lookup(struct omf_libdict_t * const d,const char * const name);
+
 const char *omf_context_get_grpdef_name(const struct omf_context_t * const ctx,unsigned int i);
 const char *omf_context_get_grpdef_name_safe(const struct omf_context_t * const ctx,unsigned int i);
 const char *omf_context_get_segdef_name(const struct omf_context_t * const ctx,unsigned int i);
@@ -0,0 +1,59 @@
+
+#include <fmt/omf/omf.h>
+#include <fmt/omf/omfcstr.h>
+
+int omf_context_next_lib_module_image(struct omf_context_t * const ctx,struct omf_image_t * const img) {
+    unsigned long ofs;
+
+    if (img->data == NULL)
+        return omf_context_next_lib_module_fd(ctx,img->fd);
+
+    // if the last record was a LIBEND, then stop reading.
+    // non-OMF junk usually follows.
+    if (ctx->record.rectype == 0xF1)
+        return 0;
+
+    // if the last record was not a MODEND, then stop reading.
+    if ((ctx->record.rectype&0xFE) != 0x8A) { // Not 0x8A or 0x8B
+        errno = EIO;
+        return -1;
+    }
+
+    // if we don't have a block size, then we cannot advance
+    if (ctx->library_block_size == 0UL)
+        return 0;
+
+    // where does the next block size start?
+    ofs = ctx->record.rec_file_offset + 3 + ctx->record.reclen + 1/*checksum*/;
+    ofs += ctx->library_block_size - 1UL;
+    ofs -= ofs % ctx->library_block_size;
+    img->pos = ofs;
+
+    ctx->record.rec_file_offset = ofs;
+    ctx->record.rectype = 0;
+    ctx->record.reclen = 0;
+    return 1;
+}
+
+// position the reader at a file offset, such as a library module found through the dictionary
+// (omf_libdict_lookup) or the start of the file to read it again
+int omf_context_seek_image(struct omf_context_t * const ctx,struct omf_image_t * const img,const unsigned long ofs) {
+    if (img->data != NULL) {
+        if (ofs >= img->length) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        img->pos = ofs;
+    }
+    else {
+        if (lseek(img->fd,(off_t)ofs,SEEK_SET) != (off_t)ofs)
+            return -1;
+    }
+
+    ctx->record.rec_file_offset = ofs;
+    ctx->record.rectype = 0;
+    ctx->record.reclen = 0;
+    return 0;
+}
+
@@ -3,9 +3,7 @@
 #include <fmt/omf/omfcstr.h>
 
 int omf_context_read_fd(struct omf_context_t * const ctx,int fd) {
-    unsigned char sum = 0;
     unsigned char tmp[3];
-    unsigned int i;
     int ret;
 
     // if the last record was a LIBEND, then stop reading.
@@ -19,6 +17,8 @@ int omf_context_read_fd(struct omf_context_t * const ctx,int fd) {
 
     ctx->last_error = NULL;
     omf_record_clear(&ctx->record);
+    if (ctx->record.data_ref) // last record came from an omf_image_t
+        omf_record_data_free(&ctx->record);
     if (ctx->record.data == NULL && omf_record_data_alloc(&ctx->record,0) < 0)
         return -1; // sets errno
     if (ctx->record.data_alloc < 16) {
@@ -53,10 +53,20 @@ int omf_context_read_fd(struct omf_context_t * const ctx,int fd) {
         return -1;
     }
 
+    return omf_context_read_finish(ctx);
+}
+
+// common to all input sources: record type, length (including checksum) and data have been
+// read into ctx->record. validate checksum, note LIBHEAD, and strip the checksum from reclen.
+int omf_context_read_finish(struct omf_context_t * const ctx) {
+    unsigned char sum;
+    unsigned int i;
+
     /* check checksum */
     if (ctx->record.data[ctx->record.reclen-1] != 0/*optional*/) {
-        for (i=0;i < 3;i++)
-            sum += tmp[i];
+        sum  = ctx->record.rectype;
+        sum += (unsigned char)(ctx->record.reclen & 0xFFu);
+        sum += (unsigned char)(ctx->record.reclen >> 8u);
         for (i=0;i < ctx->record.reclen;i++)
             sum += ctx->record.data[i];
 
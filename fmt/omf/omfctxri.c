@@ -0,0 +1,56 @@
+
+#include <fmt/omf/omf.h>
+#include <fmt/omf/omfcstr.h>
+
+// same as omf_context_read_fd() but from an in-memory image. no data is copied,
+// ctx->record.data points into the image until the next record is read.
+int omf_context_read_image(struct omf_context_t * const ctx,struct omf_image_t * const img) {
+    const unsigned char *hdr;
+    unsigned short reclen;
+
+    if (img->data == NULL)
+        return omf_context_read_fd(ctx,img->fd);
+
+    // if the last record was a LIBEND, then stop reading.
+    // non-OMF junk usually follows.
+    if (ctx->record.rectype == 0xF1)
+        return 0;
+
+    // if the last record was a MODEND, then stop reading, make caller move to next module with another function
+    if ((ctx->record.rectype&0xFE) == 0x8A) // 0x8A or 0x8B
+        return 0;
+
+    ctx->last_error = NULL;
+    omf_record_clear(&ctx->record);
+    if (ctx->record.data != NULL && !ctx->record.data_ref) {
+        omf_record_data_free(&ctx->record);
+        ctx->record.data_alloc = 0;
+    }
+
+    ctx->record.rec_file_offset = img->pos;
+
+    if (img->pos > img->length || (img->length - img->pos) < 3ul)
+        return 0; // EOF
+
+    hdr = img->data + img->pos;
+    reclen = (unsigned short)hdr[1] + ((unsigned short)hdr[2] << 8u); // length (including checksum)
+    img->pos += 3ul;
+
+    ctx->record.rectype = hdr[0];
+    ctx->record.reclen = reclen;
+    if (ctx->record.rectype == 0 || ctx->record.reclen == 0)
+        return 0;
+    if ((unsigned long)reclen > (img->length - img->pos)) {
+        ctx->last_error = "Reading OMF record contents failed";
+        errno = EIO;
+        return -1;
+    }
+
+    ctx->record.data = img->data + img->pos;
+    ctx->record.data_alloc = reclen;
+    ctx->record.data_ref = 1;
+    img->pos += (unsigned long)reclen;
+
+    return omf_context_read_finish(ctx);
+}
+
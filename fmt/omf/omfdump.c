@@ -114,6 +114,7 @@ int main(int argc,char **argv) {
     unsigned char dumpstate = 0;
     unsigned char diddump = 0;
     unsigned char verbose = 0;
+    struct omf_image_t img;
     int i,fd,ret;
     char *a;
 
@@ -161,11 +162,15 @@ int main(int argc,char **argv) {
         fprintf(stderr,"Failed to open input file %s\n",strerror(errno));
         return 1;
     }
+    if (omf_image_open_fd(&img,fd) < 0) {
+        fprintf(stderr,"Failed to read input file %s\n",strerror(errno));
+        return 1;
+    }
 
     omf_context_begin_file(omf_state);
 
     do {
-        ret = omf_context_read_fd(omf_state,fd);
+        ret = omf_context_read_image(omf_state,&img);
         if (ret == 0) {
             if (omf_record_is_modend(&omf_state->record)) {
                 if (dumpstate && !diddump) {
@@ -175,7 +180,7 @@ int main(int argc,char **argv) {
 
                 printf("----- next module -----\n");
 
-                ret = omf_context_next_lib_module_fd(omf_state,fd);
+                ret = omf_context_next_lib_module_image(omf_state,&img);
                 if (ret < 0) {
                     printf("Unable to advance to next .LIB module, %s\n",strerror(errno));
                     if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
@@ -372,6 +377,7 @@ int main(int argc,char **argv) {
 
     omf_context_clear(omf_state);
     omf_state = omf_context_destroy(omf_state);
+    omf_image_close(&img);
     close(fd);
     return 0;
 }
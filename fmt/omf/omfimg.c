@@ -0,0 +1,99 @@
+
+#include <fmt/omf/omf.h>
+
+#if defined(LINUX)
+# include <sys/mman.h>
+#endif
+
+void omf_image_init(struct omf_image_t * const img) {
+    img->data = NULL;
+    img->length = 0;
+    img->pos = 0;
+    img->fd = -1;
+    img->mapped = 0;
+}
+
+// load the entire file into memory, starting from the current file position.
+// if that's not possible (no memory, too large for a 16-bit build) the image
+// is left empty and reading falls back to the file descriptor.
+int omf_image_open_fd(struct omf_image_t * const img,int fd) {
+    unsigned long start,len;
+    struct stat st;
+
+    omf_image_init(img);
+    img->fd = fd;
+
+    if (fstat(fd,&st) < 0)
+        return -1; // fstat sets errno
+
+    start = (unsigned long)lseek(fd,0,SEEK_CUR);
+    if ((unsigned long)st.st_size <= start)
+        return 0;
+
+    // NTS: the image always covers the file from offset 0 so that rec_file_offset
+    //      and library block offsets mean the same thing as with the fd reader.
+    len = (unsigned long)st.st_size;
+    if ((unsigned long)((size_t)len) != len)
+        return 0;
+
+#if defined(LINUX)
+    {
+        void *p = mmap(NULL,(size_t)len,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+        if (p != MAP_FAILED) {
+            img->data = (unsigned char*)p;
+            img->length = len;
+            img->pos = start;
+            img->mapped = 1;
+            return 0;
+        }
+    }
+#endif
+
+    img->data = malloc((size_t)len);
+    if (img->data == NULL)
+        return 0;
+
+    if (lseek(fd,0,SEEK_SET) == 0) {
+        unsigned long ofs = 0;
+        unsigned int rd;
+        int ret;
+
+        while (ofs < len) {
+            rd = (len - ofs) > 0x4000ul ? 0x4000u : (unsigned int)(len - ofs);
+            ret = read(fd,img->data+ofs,rd);
+            if (ret <= 0) break;
+            ofs += (unsigned long)ret;
+        }
+
+        if (ofs == len) {
+            img->length = len;
+            img->pos = start;
+            return 0;
+        }
+    }
+
+    // could not read it in, fall back to reading from the file descriptor
+    free(img->data);
+    img->data = NULL;
+    lseek(fd,(off_t)start,SEEK_SET);
+    return 0;
+}
+
+// NTS: does not close the file descriptor, that belongs to the caller
+void omf_image_close(struct omf_image_t * const img) {
+    if (img->data != NULL) {
+#if defined(LINUX)
+        if (img->mapped)
+            munmap(img->data,(size_t)img->length);
+        else
+#endif
+            free(img->data);
+
+        img->data = NULL;
+    }
+
+    img->length = 0;
+    img->pos = 0;
+    img->mapped = 0;
+}
+
@@ -0,0 +1,193 @@
+
+#include <fmt/omf/omf.h>
+
+#if defined(_MSC_VER)
+# define strncasecmp strnicmp
+#endif
+
+// OMF library dictionary (TIS OMF spec, Appendix 2: Microsoft MS-DOS Library Format).
+//
+// The LIBHDR record (0xF0) is the first record in the .LIB file:
+//   +0x00  rectype 0xF0
+//   +0x01  record length (page size - 3)
+//   +0x03  dictionary offset (dword)
+//   +0x07  dictionary size in 512-byte blocks (word)
+//   +0x09  flags (bit 0 = case sensitive)
+//
+// Each dictionary block has 37 bucket bytes (word offset of entry within block,
+// 0 if empty), then a "free space" byte (word offset, 0xFF if the block is full),
+// then entries: length-prefixed name followed by the module page number (word).
+
+static inline unsigned short omf_libdict_rol16(const unsigned short x,const unsigned int n) {
+    return (unsigned short)((x << n) | (x >> (16u - n)));
+}
+
+static inline unsigned short omf_libdict_ror16(const unsigned short x,const unsigned int n) {
+    return (unsigned short)((x >> n) | (x << (16u - n)));
+}
+
+void omf_libdict_init(struct omf_libdict_t * const d) {
+    d->offset = 0;
+    d->blocks = 0;
+    d->page_size = 0;
+    d->flags = 0;
+    d->img = NULL;
+    d->block_num = (unsigned short)(~0u);
+}
+
+// compute the starting block/bucket and the block/bucket step for a name.
+// the name is processed from both ends as the length prefixed string stored in the dictionary.
+// the back pass covers all len characters, last to first. the front pass starts at the length
+// byte (the initial block_x/bucket_d), then the first len-1 characters, so it never reaches the last.
+void omf_libdict_hash(struct omf_libdict_hash_t * const h,const char * const name,const unsigned short blocks) {
+    const unsigned char *pb = (const unsigned char*)name;
+    const unsigned char *pe;
+    unsigned int len = (unsigned int)strlen(name);
+    unsigned short c;
+
+    if (len > 255u) len = 255u;
+    pe = pb + len;
+
+    h->block_x = (unsigned short)(len | 0x20u);
+    h->bucket_d = (unsigned short)(len | 0x20u);
+    h->block_d = 0;
+    h->bucket_x = 0;
+
+    while (len != 0u) {
+        c = (unsigned short)(*(--pe) | 0x20u);
+        h->bucket_x = omf_libdict_ror16(h->bucket_x,2) ^ c;
+        h->block_d = omf_libdict_rol16(h->block_d,2) ^ c;
+        if (--len == 0u) break;
+
+        c = (unsigned short)(*(pb++) | 0x20u);
+        h->block_x = omf_libdict_rol16(h->block_x,2) ^ c;
+        h->bucket_d = omf_libdict_ror16(h->bucket_d,2) ^ c;
+    }
+
+    h->block_x %= blocks;
+    h->block_d %= blocks;
+    if (h->block_d == 0) h->block_d = 1;
+
+    h->bucket_x %= OMF_LIBDICT_BUCKETS;
+    h->bucket_d %= OMF_LIBDICT_BUCKETS;
+    if (h->bucket_d == 0) h->bucket_d = 1;
+}
+
+// read the LIBHDR at the start of the file. returns 0 if the file is a library with
+// a dictionary, -1 (errno EINVAL) if not.
+int omf_libdict_open(struct omf_libdict_t * const d,struct omf_image_t * const img) {
+    unsigned char tmp[10];
+
+    omf_libdict_init(d);
+
+    if (img->data != NULL) {
+        if (img->length < 10ul) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(tmp,img->data,10);
+    }
+    else {
+        if (lseek(img->fd,0,SEEK_SET) != 0 || read(img->fd,tmp,10) != 10) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (tmp[0] != 0xF0/*LIBHDR*/) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    d->page_size = (unsigned short)((tmp[1] + ((unsigned short)tmp[2] << 8u)) + 3u);
+    d->offset = (unsigned long)tmp[3] + ((unsigned long)tmp[4] << 8ul) + ((unsigned long)tmp[5] << 16ul) + ((unsigned long)tmp[6] << 24ul);
+    d->blocks = (unsigned short)(tmp[7] + ((unsigned short)tmp[8] << 8u));
+    d->flags = tmp[9];
+    d->img = img;
+
+    if (d->blocks == 0 || d->offset == 0ul || d->page_size < 16u) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (img->data != NULL && (d->offset > img->length || ((img->length - d->offset) / OMF_LIBDICT_BLOCK_SIZE) < d->blocks)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+// NTS: With an in-memory image this points directly into the image. With the fd fallback
+//      the block is read into d->block and stays valid until the next call.
+static const unsigned char *omf_libdict_get_block(struct omf_libdict_t * const d,const unsigned short b) {
+    unsigned long ofs = d->offset + ((unsigned long)b * OMF_LIBDICT_BLOCK_SIZE);
+
+    if (d->img->data != NULL)
+        return d->img->data + ofs;
+
+    if (d->block_num != b) {
+        if ((unsigned long)lseek(d->img->fd,(off_t)ofs,SEEK_SET) != ofs)
+            return NULL;
+        if (read(d->img->fd,d->block,OMF_LIBDICT_BLOCK_SIZE) != OMF_LIBDICT_BLOCK_SIZE)
+            return NULL;
+
+        d->block_num = b;
+    }
+
+    return d->block;
+}
+
+static int omf_libdict_name_match(const struct omf_libdict_t * const d,const unsigned char *ent,const char * const name,const unsigned int len) {
+    if (ent[0] != len)
+        return 0;
+
+    if (d->flags & OMF_LIBDICT_FLAG_CASE_SENSITIVE)
+        return !memcmp(ent+1,name,len);
+
+    return !strncasecmp((const char*)ent+1,name,len);
+}
+
+// look up a public name. returns the file offset of the module that defines it,
+// or 0 if the name is not in the dictionary (offset 0 is the LIBHDR, never a module).
+unsigned long omf_libdict_lookup(struct omf_libdict_t * const d,const char * const name) {
+    const unsigned int len = (unsigned int)strlen(name);
+    struct omf_libdict_hash_t h;
+    const unsigned char *blk;
+    const unsigned char *ent;
+    unsigned short block,bucket;
+    unsigned int bi,ui,eo;
+
+    if (d->blocks == 0 || len == 0u || len > 255u)
+        return 0;
+
+    omf_libdict_hash(&h,name,d->blocks);
+
+    block = h.block_x;
+    for (bi=0;bi < d->blocks;bi++) {
+        if ((blk=omf_libdict_get_block(d,block)) == NULL)
+            return 0;
+
+        bucket = h.bucket_x;
+        for (ui=0;ui < OMF_LIBDICT_BUCKETS;ui++) {
+            eo = (unsigned int)blk[bucket] * 2u;
+            if (eo == 0u) {
+                // empty bucket. if the block has room then the name would have gone here
+                if (blk[OMF_LIBDICT_BUCKETS] != 0xFF)
+                    return 0;
+
+                break;
+            }
+
+            ent = blk + eo;
+            if ((eo + 1u + len + 2u) <= OMF_LIBDICT_BLOCK_SIZE && omf_libdict_name_match(d,ent,name,len))
+                return (unsigned long)(ent[1+len] + ((unsigned int)ent[2+len] << 8u)) * (unsigned long)d->page_size;
+
+            bucket = (unsigned short)((bucket + h.bucket_d) % OMF_LIBDICT_BUCKETS);
+        }
+
+        block = (unsigned short)((block + h.block_d) % d->blocks);
+    }
+
+    return 0;
+}
+
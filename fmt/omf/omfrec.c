@@ -11,13 +11,15 @@ void omf_record_init(struct omf_record_t * const rec) {
     rec->data = NULL;
     rec->data_alloc = 4096; // OMF spec says 1024
     rec->rec_file_offset = (~0UL);
+    rec->data_ref = 0;
 }
 
 void omf_record_data_free(struct omf_record_t * const rec) {
     if (rec->data != NULL) {
-        free(rec->data);
+        if (!rec->data_ref) free(rec->data);
         rec->data = NULL;
     }
+    rec->data_ref = 0;
     rec->reclen = 0;
     rec->rectype = 0;
 }
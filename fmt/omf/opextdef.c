@@ -18,10 +18,10 @@ int omf_context_parse_EXTDEF(struct omf_context_t * const ctx,struct omf_record_
         if (extdef == NULL)
             return -1;
 
-        len = omf_record_get_lenstr(omf_temp_str,sizeof(omf_temp_str),rec);
+        len = omf_record_get_lenstr(ctx->temp_str,sizeof(ctx->temp_str),rec);
         if (len < 0) return -1;
 
-        if (omf_extdefs_context_set_extdef_name(&ctx->EXTDEFs,extdef,omf_temp_str,len) < 0)
+        if (omf_extdefs_context_set_extdef_name(&ctx->EXTDEFs,extdef,ctx->temp_str,len) < 0)
             return -1;
 
         if (omf_record_eof(rec))
@@ -9,6 +9,7 @@
  *
  * Compiles for intended target environments:
  *   - MS-DOS [pure DOS mode, or Windows or OS/2 DOS Box]
+ *   - Linux host [register encoding only, writes go to adlib_write_capture]
  *
  * On most Sound Blaster compatible cards all the way up to the late 1990s, a
  * Yamaha OPL2 or OPL3 chipset exists (or may be emulated on PCI cards) that
@@ -21,15 +22,21 @@
  *       other than 388h */
  
 #include <stdio.h>
+#if !defined(LINUX)
 #include <conio.h> /* this is where Open Watcom hides the outp() etc. functions */
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#if !defined(LINUX)
 #include <malloc.h>
+#endif
 #include <fcntl.h>
+#if !defined(LINUX)
 #include <dos.h>
 
 #include <hw/8254/8254.h>		/* 8254 timer */
+#endif
 #include <hw/adlib/adlib.h>
 
 unsigned short			adlib_voice_to_op_opl2[9] = {0x00,0x01,0x02, 0x08,0x09,0x0A, 0x10,0x11,0x12};
@@ -42,6 +49,21 @@ struct adlib_fm_channel		adlib_fm[ADLIB_FM_VOICES];
 int				adlib_fm_voices = 0;
 unsigned char			adlib_flags = 0;
 
+/* if set, adlib_write() hands every register write here instead of the chip.
+ * midi2imf records them into an IMF file this way, no card needed */
+void				(*adlib_write_capture)(unsigned short i,unsigned char d) = NULL;
+
+/* Shadow register file. While it is on, adlib_write() drops writes that would not change
+ * what the chip already has, which saves the port I/O and its delays on real hardware
+ * and entries in a captured IMF file. In deferred mode writes are only noted, and
+ * adlib_shadow_flush() (once per tick) writes out the registers whose final value
+ * differs from the chip: operator and channel settings first, key on (B0-B8, BD) last.
+ * Keying a voice off goes out at once, so that a note stopped and started again within
+ * the same tick is still retriggered. A note started and stopped within the same tick
+ * has its key on (and the voice's settings) written out ahead of the key off, so it is
+ * still heard. */
+struct adlib_shadow		adlib_shadow;
+
 struct adlib_fm_channel adlib_fm_preset_violin_opl3 = {
 	.mod = {0,	1,	1,	1,	1,	1,	42,	6,	1,	1,	4,	0,
 		3,	456,	1,	1,	1,	1,	4,	0,	5},
@@ -140,6 +162,7 @@ struct adlib_fm_channel adlib_fm_preset_small_drum = {
 	.car = {0,	0,	1,	1,	1,	1,	52,	15,	7,	15,	15,	0,  2,	456,	1,	1,	1,	1,	1,	0,	0}
 };
 
+#if !defined(LINUX)
 unsigned char adlib_read(unsigned short i) {
 	unsigned char c;
 	outp(ADLIB_IO_INDEX+((i>>8)*2),(unsigned char)i);
@@ -148,18 +171,177 @@ unsigned char adlib_read(unsigned short i) {
 	adlib_wait();
 	return c;
 }
+#endif
 
-void adlib_write(unsigned short i,unsigned char d) {
+static void adlib_write_chip(unsigned short i,unsigned char d) {
+	if (adlib_write_capture != NULL) {
+		adlib_write_capture(i,d);
+		return;
+	}
+
+#if !defined(LINUX)
 	outp(ADLIB_IO_INDEX+((i>>8)*2),(unsigned char)i);
 	adlib_wait();
 	outp(ADLIB_IO_DATA+((i>>8)*2),d);
 	adlib_wait();
+#endif
+}
+
+/* timer and IRQ control act on every write, and the OPL3 mode bits change what the
+ * other registers mean, so these always go through */
+static unsigned char adlib_shadow_passthru(unsigned short i) {
+	return (i >= 0x02 && i <= 0x04) || i == 0x104 || i == 0x105;
+}
+
+static unsigned char adlib_shadow_key_reg(unsigned short i) {
+	i &= 0xFF;
+	return (i >= 0xB0 && i <= 0xB8) || i == 0xBD;
+}
+
+/* does writing d clear a key on (or percussion) bit the chip has set? */
+static unsigned char adlib_shadow_key_off(unsigned short i,unsigned char d) {
+	unsigned char b = (unsigned char)(1U << (i & 7U));
+	unsigned char mask = ((i & 0xFF) == 0xBD) ? 0x1F : 0x20;
+
+	if (!adlib_shadow_key_reg(i) || !(adlib_shadow.known[i>>3] & b)) return 0;
+	return (adlib_shadow.value[i] & ~d & mask) != 0;
+}
+
+static void adlib_shadow_put(unsigned short i,unsigned char d) {
+	unsigned char b = (unsigned char)(1U << (i & 7U));
+
+	adlib_shadow.dirty[i>>3] &= ~b;
+	if ((adlib_shadow.known[i>>3] & b) && adlib_shadow.value[i] == d) {
+		adlib_shadow.elided++;
+		return;
+	}
+
+	adlib_shadow.known[i>>3] |= b;
+	adlib_shadow.value[i] = d;
+	adlib_shadow.issued++;
+	adlib_write_chip(i,d);
+}
+
+static void adlib_shadow_put_pending(unsigned short i) {
+	if (adlib_shadow.dirty[i>>3] & (1U << (i & 7U)))
+		adlib_shadow_put(i,adlib_shadow.pending[i]);
+}
+
+/* pass 0: everything but key on, pass 1: key on */
+static void adlib_shadow_flush_pass(unsigned char pass) {
+	unsigned short i;
+
+	for (i=0;i < ADLIB_SHADOW_REGS;i++) {
+		if (adlib_shadow.dirty[i>>3] == 0) {
+			i |= 7;
+			continue;
+		}
+
+		if (adlib_shadow_key_reg(i) == pass)
+			adlib_shadow_put_pending(i);
+	}
+}
+
+/* would writing d take back a key on (or percussion) bit that is still pending, and so
+ * has never reached the chip? */
+static unsigned char adlib_shadow_key_lost(unsigned short i,unsigned char d) {
+	unsigned char b = (unsigned char)(1U << (i & 7U));
+	unsigned char mask = ((i & 0xFF) == 0xBD) ? 0x1F : 0x20;
+	unsigned char chip = (adlib_shadow.known[i>>3] & b) ? adlib_shadow.value[i] : 0;
+
+	if (!adlib_shadow_key_reg(i) || !(adlib_shadow.dirty[i>>3] & b)) return 0;
+	return (adlib_shadow.pending[i] & ~chip & ~d & mask) != 0;
+}
+
+/* write out the pending key on at i, and before it the pending settings of the voice it
+ * keys on (for percussion, all pending settings) */
+static void adlib_shadow_key_on_now(unsigned short i) {
+	static const unsigned char op_regs[5] = {0x20,0x40,0x60,0x80,0xE0};
+	unsigned short bank = i & 0x100;
+	unsigned short ch = (i & 0xFF) - 0xB0;
+	unsigned short op;
+	unsigned char k;
+
+	if (ch < 9) {
+		op = bank + adlib_voice_to_op_opl2[ch];
+		for (k=0;k < 5;k++) {
+			adlib_shadow_put_pending(op_regs[k] + op);		/* modulator */
+			adlib_shadow_put_pending(op_regs[k] + op + 3);	/* carrier */
+		}
+		adlib_shadow_put_pending(bank + 0xA0 + ch);
+		adlib_shadow_put_pending(bank + 0xC0 + ch);
+	}
+	else {
+		adlib_shadow_flush_pass(0);
+	}
+
+	adlib_shadow_put_pending(i);
+}
+
+void adlib_write(unsigned short i,unsigned char d) {
+	unsigned char b;
+
+	if (!adlib_shadow.enabled) {
+		adlib_write_chip(i,d);
+		return;
+	}
+
+	i &= ADLIB_SHADOW_REGS - 1;
+	if (adlib_shadow_passthru(i)) {
+		adlib_shadow.issued++;
+		adlib_write_chip(i,d);
+		return;
+	}
+
+	b = (unsigned char)(1U << (i & 7U));
+	if (adlib_shadow.deferred) {
+		/* a note started and stopped within the tick: let it sound */
+		if (adlib_shadow_key_lost(i,d))
+			adlib_shadow_key_on_now(i);
+		/* an earlier write this tick that never reached the chip */
+		else if (adlib_shadow.dirty[i>>3] & b)
+			adlib_shadow.elided++;
+
+		if (!adlib_shadow_key_off(i,d)) {
+			adlib_shadow.dirty[i>>3] |= b;
+			adlib_shadow.pending[i] = d;
+			return;
+		}
+	}
+
+	adlib_shadow_put(i,d);
+}
+
+/* deferred: 1 to hold writes until adlib_shadow_flush(), 0 to only drop the redundant ones */
+void adlib_shadow_init(unsigned char deferred) {
+	memset(&adlib_shadow,0,sizeof(adlib_shadow));
+	adlib_shadow.deferred = deferred;
+	adlib_shadow.enabled = 1;
+}
+
+/* forget what the chip has, so that the next write to each register goes through */
+void adlib_shadow_invalidate() {
+	memset(adlib_shadow.known,0,sizeof(adlib_shadow.known));
+}
+
+void adlib_shadow_flush() {
+	if (!adlib_shadow.enabled) return;
+
+	adlib_shadow_flush_pass(0);
+	adlib_shadow_flush_pass(1);
+}
+
+/* flush anything pending and go back to writing straight to the chip */
+void adlib_shadow_shutdown() {
+	adlib_shadow_flush();
+	adlib_shadow.enabled = 0;
 }
 
 /* TODO: adlib_write_imm_1() and adlib_write_imm_2()
  *       this would allow DOS programs to use this ADLIB library from within
  *       an interrupt routine */
 
+#if !defined(LINUX)
 int probe_adlib(unsigned char sec) {
 	unsigned char a,b,retry=3;
 	unsigned short bas = sec ? 0x100 : 0;
@@ -230,6 +412,7 @@ void shutdown_adlib_opl3() {
 void shutdown_adlib() {
 	shutdown_adlib_opl3();
 }
+#endif
 
 void adlib_update_group20(unsigned int op,struct adlib_fm_operator *f) {
 	adlib_write(0x20+op,	(f->am << 7) |
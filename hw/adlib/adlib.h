@@ -10,7 +10,9 @@
  * Compiles for intended target environments:
  *   - MS-DOS [pure DOS mode, or Windows or OS/2 DOS Box] */
  
+#if !defined(LINUX)
 #include <hw/cpu/cpu.h>
+#endif
 #include <stdint.h>
 
 #define ADLIB_FM_VOICES			18
@@ -79,6 +81,20 @@ struct adlib_reg_bd {
 	uint8_t			hi_hat_on:1;
 };
 
+/* shadow copy of the OPL registers, see adlib.c */
+#define ADLIB_SHADOW_REGS		0x200
+
+struct adlib_shadow {
+	uint8_t			value[ADLIB_SHADOW_REGS];	/* last value written to the chip */
+	uint8_t			pending[ADLIB_SHADOW_REGS];	/* deferred mode: value to write at the next flush */
+	uint8_t			known[ADLIB_SHADOW_REGS/8];	/* bit set if value[] is what the chip has */
+	uint8_t			dirty[ADLIB_SHADOW_REGS/8];	/* bit set if pending[] has not been flushed */
+	unsigned char		enabled;
+	unsigned char		deferred;
+	unsigned long		issued;				/* writes that reached the chip */
+	unsigned long		elided;				/* writes dropped because they changed nothing */
+};
+
 int init_adlib();
 void shutdown_adlib();
 void shutdown_adlib_opl3();
@@ -97,6 +113,10 @@ void adlib_freq_to_fm_op(struct adlib_fm_operator *f,double freq);
 double adlib_fm_op_to_freq(struct adlib_fm_operator *f);
 void adlib_update_bd(struct adlib_reg_bd *b);
 void adlib_apply_all();
+void adlib_shadow_init(unsigned char deferred);
+void adlib_shadow_invalidate();
+void adlib_shadow_flush();
+void adlib_shadow_shutdown();
 
 extern unsigned short			adlib_voice_to_op_opl2[9];
 extern unsigned short			adlib_voice_to_op_opl3[18];
@@ -107,6 +127,9 @@ extern struct adlib_fm_channel		adlib_fm[ADLIB_FM_VOICES];
 extern int				adlib_fm_voices;
 extern unsigned char			adlib_flags;
 
+extern void				(*adlib_write_capture)(unsigned short i,unsigned char d);
+extern struct adlib_shadow		adlib_shadow;
+
 extern struct adlib_fm_channel		adlib_fm_preset_deep_bass_drum;
 extern struct adlib_fm_channel		adlib_fm_preset_violin_opl3;
 extern struct adlib_fm_channel		adlib_fm_preset_violin_opl2;
@@ -123,6 +146,7 @@ extern struct adlib_fm_channel      adlib_fm_preset_synth_chiff_lead;
 extern struct adlib_fm_channel      adlib_fm_preset_synth_lead_1_square;
 extern struct adlib_fm_channel      adlib_fm_preset_synth_lead_2_sawtooth;
 
+#if !defined(LINUX)
 /* NTS: I have a Creative CT1350B card where we really do have to wait at least
  *      33us per I/O access, because the OPL2 chip on it really is that slow.
  *      
@@ -142,4 +166,5 @@ static inline unsigned char adlib_status(unsigned char which) {
 static inline unsigned char adlib_status_imm(unsigned char which) {
 	return inp(ADLIB_IO_STATUS+(which*2));
 }
+#endif
 
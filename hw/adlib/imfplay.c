@@ -191,6 +191,7 @@ int main(int argc,char **argv) {
 
 	adlib_shut_up();
 	shutdown_adlib_opl3(); // NTS: Apparently the music won't play otherwise
+	adlib_shadow_init(/*deferred*/0); /* IMF timing is exact, only drop writes that change nothing */
 	_cli();
 	irq0_ticks = ptick = 0;
 	_sti();
@@ -221,9 +222,12 @@ int main(int argc,char **argv) {
 
 	imf_free_music();
 	adlib_shut_up();
+	adlib_shadow_shutdown();
 	shutdown_adlib();
 	_dos_setvect(8,old_irq0);
 	write_8254_system_timer(0); /* back to normal 18.2Hz */
+
+	printf("OPL writes: %lu issued, %lu dropped as redundant\n",adlib_shadow.issued,adlib_shadow.elided);
 	return 0;
 }
 
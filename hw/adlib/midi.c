@@ -1064,9 +1064,12 @@ int main(int argc,char **argv) {
 	old_irq0 = _dos_getvect(8);/*IRQ0*/
 	_dos_setvect(8,irq0);
 
+	/* hold the writes of each tick and send only what changed */
+	adlib_shadow_init(/*deferred*/1);
 	adlib_shut_up();
 	midi_reset_channels();
 	midi_reset_tracks();
+	adlib_shadow_flush();
 	_cli();
 	irq0_ticks = ptick = 0;
 	_sti();
@@ -1083,6 +1086,7 @@ int main(int argc,char **argv) {
 
 		while (adv != 0) {
 			midi_tick();
+			adlib_shadow_flush();
 			adv--;
 		}
 
@@ -1098,10 +1102,13 @@ int main(int argc,char **argv) {
 
 	midi_playing = 0;
 	adlib_shut_up();
+	adlib_shadow_shutdown();
 	shutdown_adlib();
 	_dos_setvect(8,old_irq0);
 	write_8254_system_timer(0); /* back to normal 18.2Hz */
 
+	printf("OPL writes: %lu issued, %lu dropped as redundant\n",adlib_shadow.issued,adlib_shadow.elided);
+
 	for (i=0;i < MIDI_MAX_TRACKS;i++) {
 		if (midi_trk[i].raw) {
 #if TARGET_MSDOS == 16 && (defined(__LARGE__) || defined(__COMPACT__) || defined(__HUGE__))
@@ -11,26 +11,41 @@
  *
  * Compiles for intended target environments:
  *   - MS-DOS [pure DOS mode, or Windows or OS/2 DOS Box]
+ *   - Linux host
+ *
+ * The MIDI file is not played. Ticks come from a virtual clock, one per IMF tick, and the
+ * OPL register writes the FM code makes are captured (adlib_write_capture) into the IMF
+ * file instead of going to a card, so conversion runs as fast as the CPU allows and does
+ * not need a card or the timer at all.
  */
  
 #include <stdio.h>
-#include <conio.h> /* this is where Open Watcom hides the outp() etc. functions */
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#if !defined(LINUX)
 #include <malloc.h>
+#endif
+#include <assert.h>
 #include <ctype.h>
 #include <fcntl.h>
 #include <math.h>
+#include <time.h>
+#if !defined(LINUX)
 #include <dos.h>
 
 #include <hw/dos/dos.h>
-#include <hw/8254/8254.h>		/* 8254 timer */
-#include <hw/8259/8259.h>
+#else
+#include <hw/dos/exebatch.h>
+#endif
 #include <hw/adlib/adlib.h>
 
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
 int imf_fd = -1;
-int imf_ticks_per_quarter_note = 700;
+int imf_ticks_per_quarter_note = 700; /* IMF ticks per second */
 
 #pragma pack(push,1)
 struct imf_entry {
@@ -72,15 +87,61 @@ struct midi_note		midi_notes[ADLIB_FM_VOICES];
 struct midi_channel		midi_ch[MIDI_MAX_CHANNELS];
 struct midi_track		midi_trk[MIDI_MAX_TRACKS];
 static unsigned int		midi_trk_count=0;
-static volatile unsigned char	midi_playing=0;
 
 /* MIDI params. Nobody ever said it was a straightforward standard!
  * NTS: These are for reading reference. Internally we convert everything to 100Hz time base. */
 static unsigned int ticks_per_quarter_note=0;	/* "Ticks per beat" */
 
-static void (interrupt *old_irq0)();
-static volatile unsigned long irq0_ticks=0;
-static volatile unsigned int irq0_cnt=0,irq0_add=0,irq0_max=0;
+/* IMF output, written out a buffer at a time. Each entry is a register write and the
+ * number of IMF ticks to wait after it, so a tick with nothing to write adds to the delay
+ * of the last entry instead of becoming an entry of its own. */
+#define IMF_BUF_ENTRIES			2048
+
+static struct imf_entry		imf_buf[IMF_BUF_ENTRIES];
+static unsigned int		imf_buf_len=0;
+static unsigned long		imf_entries=0;
+static unsigned long		imf_ticks=0;
+static unsigned char		imf_write_error=0;
+
+static void imf_flush(unsigned int count) {
+	if (count == 0) return;
+	if (write(imf_fd,imf_buf,count * sizeof(struct imf_entry)) != (int)(count * sizeof(struct imf_entry)))
+		imf_write_error = 1;
+
+	imf_buf_len -= count;
+	if (imf_buf_len != 0) memmove(imf_buf,imf_buf+count,imf_buf_len * sizeof(struct imf_entry));
+}
+
+static void imf_put(unsigned char reg,unsigned char data) {
+	struct imf_entry *e;
+
+	/* keep the last entry, its delay can still grow */
+	if (imf_buf_len >= IMF_BUF_ENTRIES) imf_flush(imf_buf_len - 1);
+
+	e = &imf_buf[imf_buf_len++];
+	e->reg = reg;
+	e->data = data;
+	e->delay = 0;
+	imf_entries++;
+}
+
+/* adlib_write() comes here instead of going to the card */
+static void imf_capture(unsigned short i,unsigned char d) {
+	/* IMF register numbers are one byte, there is no second OPL3 bank */
+	if (i > 0xFF) return;
+	imf_put((unsigned char)i,d);
+}
+
+/* the virtual clock: one IMF tick has passed */
+static void imf_tick() {
+	imf_ticks++;
+
+	/* a write to register 0 (test register) is the usual IMF filler */
+	if (imf_buf_len == 0 || imf_buf[imf_buf_len-1].delay == 0xFFFFU)
+		imf_put(0x00,0x00);
+
+	imf_buf[imf_buf_len-1].delay++;
+}
 
 #if TARGET_MSDOS == 16 && (defined(__LARGE__) || defined(__COMPACT__) || defined(__HUGE__))
 static inline unsigned long farptr2phys(unsigned char far *p) { /* take 16:16 pointer convert to physical memory address */
@@ -274,25 +335,26 @@ static const uint32_t midikeys_freqs[0x80] = {
 };
 
 static uint32_t midi_note_freq(struct midi_channel *ch,unsigned char key) {
+	(void)ch;
 	return midikeys_freqs[key&0x7F];
 }
 
 static struct midi_note *get_fm_note(struct midi_track *t,struct midi_channel *ch,unsigned char key,unsigned char do_alloc) {
 	unsigned int tch = (unsigned int)(t - midi_trk); /* pointer math */
 	unsigned int ach = (unsigned int)(ch - midi_ch); /* pointer math */
-	unsigned int i,freen=~0;
+	unsigned int i,freen=~0U;
 
-	for (i=0;i < ADLIB_FM_VOICES;i++) {
+	for (i=0;i < (unsigned int)adlib_fm_voices;i++) {
 		if (midi_notes[i].busy) {
 			if (midi_notes[i].note_channel == ach && midi_notes[i].note_track == tch && midi_notes[i].note_number == key)
 				return &midi_notes[i];
 		}
 		else {
-			if (freen == ~0) freen = i;
+			if (freen == ~0U) freen = i;
 		}
 	}
 
-	if (do_alloc && freen != ~0) return &midi_notes[freen];
+	if (do_alloc && freen != ~0U) return &midi_notes[freen];
 	return NULL;
 }
 
@@ -300,7 +362,9 @@ static void drop_fm_note(struct midi_channel *ch,unsigned char key) {
 	unsigned int ach = (unsigned int)(ch - midi_ch); /* pointer math */
 	unsigned int i;
 
-	for (i=0;i < ADLIB_FM_VOICES;i++) {
+	(void)key;
+
+	for (i=0;i < (unsigned int)adlib_fm_voices;i++) {
 		if (midi_notes[i].busy && midi_notes[i].note_channel == ach) {
 			midi_notes[i].busy = 0;
 			break;
@@ -376,16 +440,27 @@ static inline void on_key_off(struct midi_track *t,struct midi_channel *ch,unsig
 }
 
 static inline void on_control_change(struct midi_track *t,struct midi_channel *ch,unsigned char num,unsigned char val) {
+	(void)t;
+	(void)ch;
+	(void)num;
+	(void)val;
 }
 
 static inline void on_program_change(struct midi_track *t,struct midi_channel *ch,unsigned char inst) {
+	(void)t;
 	ch->program = inst;
 }
 
 static inline void on_channel_aftertouch(struct midi_track *t,struct midi_channel *ch,unsigned char velocity) {
+	(void)t;
+	(void)ch;
+	(void)velocity;
 }
 
 static inline void on_pitch_bend(struct midi_track *t,struct midi_channel *ch,int bend/*-8192 to 8192*/) {
+	(void)t;
+	(void)ch;
+	(void)bend;
 }
 
 unsigned long midi_trk_read_delta(struct midi_track *t) {
@@ -469,13 +544,16 @@ void midi_tick_track(unsigned int i) {
 					on_control_change(t,ch,c,d);
 					} break;
 				case 0xC: { /* program change */
+					ch = midi_ch + (b&0xF);
 					on_program_change(t,ch,c); /* c=instrument d=not used */
 					} break;
 				case 0xD: { /* channel aftertouch */
+					ch = midi_ch + (b&0xF);
 					on_channel_aftertouch(t,ch,c); /* c=velocity d=not used */
 					} break;
 				case 0xE: { /* pitch bend */
 					d = midi_trk_read(t);
+					ch = midi_ch + (b&0xF);
 					on_pitch_bend(t,ch,((c&0x7F)|((d&0x7F)<<7))-8192); /* c=LSB d=MSB */
 					} break;
 				case 0xF: { /* event */
@@ -505,7 +583,7 @@ void midi_tick_track(unsigned int i) {
 
                                 /* tempo changes affect all tracks */
 								{
-									int j;
+									unsigned int j;
 
 									for (j=0;j < midi_trk_count;j++) {
 										if (j != i) midi_trk[j].us_per_quarter_note =
@@ -543,39 +621,17 @@ void midi_tick_track(unsigned int i) {
 	}
 }
 
-void adlib_shut_up();
-void midi_reset_tracks();
-void midi_reset_channels();
-
-void midi_tick() {
-	if (midi_playing) {
-		unsigned int i;
-		int eof=0;
-
-		for (i=0;i < midi_trk_count;i++) {
-			midi_tick_track(i);
-			eof += midi_trk[i].eof?1:0;
-		}
+/* one IMF tick. returns 1 once every track has reached the end */
+int midi_tick() {
+	unsigned int i;
+	unsigned int eof=0;
 
-		if (eof >= midi_trk_count) {
-            fprintf(stderr,"MIDI EOF. Restarting\n");
-			adlib_shut_up();
-			midi_reset_tracks();
-			midi_reset_channels();
-		}
+	for (i=0;i < midi_trk_count;i++) {
+		midi_tick_track(i);
+		eof += midi_trk[i].eof?1:0;
 	}
-}
 
-/* WARNING: subroutine call in interrupt handler. make sure you compile with -zu flag for large/compact memory models */
-void interrupt irq0() {
-	irq0_ticks++;
-	if ((irq0_cnt += irq0_add) >= irq0_max) {
-		irq0_cnt -= irq0_max;
-		old_irq0();
-	}
-	else {
-		p8259_OCW2(0,P8259_OCW2_NON_SPECIFIC_EOI);
-	}
+	return (eof >= midi_trk_count);
 }
 
 void adlib_shut_up() {
@@ -639,7 +695,7 @@ void midi_reset_track(unsigned int i) {
 }
 
 void midi_reset_tracks() {
-	int i;
+	unsigned int i;
 
 	for (i=0;i < midi_trk_count;i++)
 		midi_reset_track(i);
@@ -661,7 +717,7 @@ int load_midi_file(const char *path) {
 
 	fd = open(path,O_RDONLY|O_BINARY);
 	if (fd < 0) {
-		printf("Failed to load file %s\n",path);
+		fprintf(stderr,"Failed to load file %s\n",path);
 		return 0;
 	}
 
@@ -713,7 +769,7 @@ int load_midi_file(const char *path) {
 			if (sz == 0UL) continue;
 #if TARGET_MSDOS == 16 && (defined(__LARGE__) || defined(__COMPACT__) || defined(__HUGE__))
 			if (sz > (640UL << 10UL)) goto err; /* 640KB */
-#elif TARGET_MSDOS == 32
+#elif TARGET_MSDOS == 32 || defined(LINUX)
 			if (sz > (1UL << 20UL)) goto err; /* 1MB */
 #else
 			if (sz > (60UL << 10UL)) goto err; /* 60KB */
@@ -782,101 +838,180 @@ err:
 	return 0;
 }
 
+/* timestamp in microseconds, for the conversion speed report */
+unsigned long imf_time_us(void) {
+#if defined(LINUX)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ((unsigned long)ts.tv_sec * 1000000ul) + ((unsigned long)ts.tv_nsec / 1000ul);
+#else
+	return (unsigned long)(((double)clock() * 1000000.0) / CLOCKS_PER_SEC);
+#endif
+}
+
+static void help(void) {
+	fprintf(stderr,"MIDI2IMF [options] <source .mid file> <output .imf file>\n");
+	fprintf(stderr,"  -t <sec>     Stop after this many seconds of music\n");
+	fprintf(stderr,"  -noshadow    Record every register write, even those that change nothing\n");
+#if defined(LINUX)
+	fprintf(stderr,"  -batch <list> Convert each .mid file named in the list (- for stdin)\n");
+	fprintf(stderr,"  -o <dir>     Where -batch writes the .imf files and index (default .)\n");
+	fprintf(stderr,"  -j <n>       Convert this many files at once in -batch mode\n");
+#endif
+}
+
 int main(int argc,char **argv) {
-	unsigned long ptick;
-	int i,c;
+	const char *src_file = NULL,*dst_file = NULL;
+	unsigned long max_ticks = 0,t0,t1;
+	unsigned char shadow = 1;
+#if defined(LINUX)
+	const char *batch_list = NULL;
+	struct exe_batch batch;
+#endif
+	char *a;
+	int i;
 
 	printf("MIDI to IMF converter\n");
-	if (argc < 3) {
-		printf("MIDI2IMF <source .mid file> <output .imf file>\n");
-		return 1;
+
+#if defined(LINUX)
+	exe_batch_init(&batch);
+	batch.suffix = ".imf";
+	batch.errsuffix = ".txt";
+#endif
+
+	for (i=1;i < argc;) {
+		a = argv[i++];
+
+		if (*a == '-') {
+			do { a++; } while (*a == '-');
+
+			if (!strcmp(a,"h") || !strcmp(a,"help")) {
+				help();
+				return 1;
+			}
+			else if (!strcmp(a,"t")) {
+				if (i >= argc) return 1;
+				max_ticks = strtoul(argv[i++],NULL,0) * (unsigned long)imf_ticks_per_quarter_note;
+			}
+			else if (!strcmp(a,"noshadow")) {
+				shadow = 0;
+			}
+#if defined(LINUX)
+			else if (!strcmp(a,"batch")) {
+				if (i >= argc) return 1;
+				batch_list = argv[i++];
+			}
+			else if (!strcmp(a,"o")) {
+				if (i >= argc) return 1;
+				batch.outdir = argv[i++];
+			}
+			else if (!strcmp(a,"j")) {
+				if (i >= argc) return 1;
+				batch.jobs = (unsigned int)strtoul(argv[i++],NULL,0);
+			}
+#endif
+			else {
+				fprintf(stderr,"Unknown switch %s\n",a);
+				return 1;
+			}
+		}
+		else if (src_file == NULL) {
+			src_file = a;
+		}
+		else if (dst_file == NULL) {
+			dst_file = a;
+		}
+		else {
+			fprintf(stderr,"Unknown arg %s\n",a);
+			return 1;
+		}
 	}
 
-	if (!init_adlib()) {
-		printf("Cannot init library\n");
-		return 1;
+#if defined(LINUX)
+	if (batch_list != NULL) {
+		int r;
+
+		if (exe_batch_load_list(&batch,batch_list) < 0)
+			return 1;
+
+		/* the parent comes back when all are done, each child comes back with its file,
+		 * stdout going to the .imf file and stderr to the .txt file beside it */
+		if ((r=exe_batch_run(&batch)) <= 0) {
+			exe_batch_free(&batch);
+			return (r < 0) ? 1 : 0;
+		}
+
+		src_file = batch.current;
+		imf_fd = 1;
 	}
-	if (!probe_8254()) { /* we need the timer to keep time with the music */
-		printf("8254 timer not found\n");
+	else
+#endif
+	if (src_file == NULL || dst_file == NULL) {
+		help();
 		return 1;
 	}
 
+	assert(sizeof(struct imf_entry) == 4);
+
+	/* no card: the writes only go into the IMF file, which can only describe an OPL2 */
+	adlib_flags = 0;
+	adlib_fm_voices = 9;
+	adlib_voice_to_op = adlib_voice_to_op_opl2;
+	adlib_write_capture = imf_capture;
+
+	/* only what changed by the end of each tick goes into the IMF file */
+	if (shadow) adlib_shadow_init(/*deferred*/1);
+
 	for (i=0;i < MIDI_MAX_TRACKS;i++) {
 		midi_trk[i].raw = NULL;
 		midi_trk[i].read = NULL;
 		midi_trk[i].fence = NULL;
 	}
 
-	if (load_midi_file(argv[1]) == 0) {
-		printf("Failed to load MIDI\n");
+	if (load_midi_file(src_file) == 0) {
+		fprintf(stderr,"Failed to load MIDI %s\n",src_file);
 		return 1;
 	}
 
-    imf_fd = open(argv[2],O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644);
-    if (imf_fd < 0) {
-        printf("Failed to open IMF\n");
-        return 1;
-    }
-
-    /* right away, issue OPL3 commands to key off all notes as fast as possible */
-    {
-        struct imf_entry ent;
-        unsigned int i;
-
-        assert(sizeof(ent) == 4);
-
-        ent.delay = 1;
-        for (i=0;i < 9;i++) {
-            ent.reg = 0xB0 + i;
-            ent.data = 0x00;        /* KEY OFF, block number 0 */
-            write(imf_fd,&ent,sizeof(ent));
-        }
-    }
-
-	write_8254_system_timer(T8254_REF_CLOCK_HZ / imf_ticks_per_quarter_note); /* tick faster at IMF tick rate please */
-	irq0_cnt = 0;
-	irq0_add = 182;
-	irq0_max = 10 * imf_ticks_per_quarter_note; /* about 18.2Hz */
-	old_irq0 = _dos_getvect(8);/*IRQ0*/
-	_dos_setvect(8,irq0);
+	if (imf_fd < 0) {
+		imf_fd = open(dst_file,O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644);
+		if (imf_fd < 0) {
+			fprintf(stderr,"Failed to open IMF %s\n",dst_file);
+			return 1;
+		}
+	}
+
+	t0 = imf_time_us();
 
+	/* right away, key off all notes */
+	for (i=0;i < 9;i++)
+		adlib_write(0xB0 + i,0x00);	/* KEY OFF, block number 0 */
+
+	adlib_write(0x01,0x20);	/* enable waveform select */
 	adlib_shut_up();
 	midi_reset_channels();
 	midi_reset_tracks();
-	_cli();
-	irq0_ticks = ptick = 0;
-	_sti();
-	midi_playing = 1;
-
-	while (1) {
-		unsigned long adv;
-
-		_cli();
-		adv = irq0_ticks - ptick;
-		if (adv >= 100UL) adv = 100UL;
-		ptick = irq0_ticks;
-		_sti();
-
-		while (adv != 0) {
-			midi_tick();
-			adv--;
-		}
+	adlib_shadow_flush();
 
-		if (kbhit()) {
-			c = getch();
-			if (c == 0) c = getch() << 8;
+	while (!midi_tick()) {
+		adlib_shadow_flush();
+		imf_tick();
 
-			if (c == 27) {
-				break;
-			}
+		if (max_ticks != 0UL && imf_ticks >= max_ticks) {
+			fprintf(stderr,"Stopping at %lu seconds\n",max_ticks / (unsigned long)imf_ticks_per_quarter_note);
+			break;
 		}
 	}
 
-	midi_playing = 0;
+	/* silence at the end, and the IMF file is done */
 	adlib_shut_up();
-	shutdown_adlib();
-	_dos_setvect(8,old_irq0);
-	write_8254_system_timer(0); /* back to normal 18.2Hz */
+	adlib_shadow_shutdown();
+	imf_flush(imf_buf_len);
+
+	t1 = imf_time_us();
+
+	adlib_write_capture = NULL;
 
 	for (i=0;i < MIDI_MAX_TRACKS;i++) {
 		if (midi_trk[i].raw) {
@@ -891,7 +1026,26 @@ int main(int argc,char **argv) {
 		midi_trk[i].read = NULL;
 	}
 
-    close(imf_fd);
+	if (imf_fd != 1) close(imf_fd);
+
+	if (imf_write_error) {
+		fprintf(stderr,"Error writing IMF\n");
+		return 1;
+	}
+
+	{
+		double music = (double)imf_ticks / imf_ticks_per_quarter_note;
+		double took = (double)(t1 - t0) / 1000000.0;
+
+		fprintf(stderr,"%s: %.1f seconds of music, %lu IMF entries, converted in %.3f seconds",
+			src_file,music,imf_entries,took);
+		if (took > 0) fprintf(stderr," (%.0fx realtime)",music / took);
+		fprintf(stderr,"\n");
+		if (shadow) fprintf(stderr,"OPL writes: %lu recorded, %lu dropped as redundant\n",adlib_shadow.issued,adlib_shadow.elided);
+	}
+
+#if defined(LINUX)
+	exe_batch_free(&batch);
+#endif
 	return 0;
 }
-
@@ -0,0 +1,292 @@
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <hw/dos/exebatch.h>
+
+struct exe_batch_slot {
+    pid_t                                           pid;
+    unsigned int                                    index;
+    struct timespec                                 start;
+};
+
+static double exe_batch_elapsed(const struct timespec * const a,const struct timespec * const b) {
+    return (double)(b->tv_sec - a->tv_sec) + ((double)(b->tv_nsec - a->tv_nsec) / 1000000000.0);
+}
+
+void exe_batch_init(struct exe_batch * const b) {
+    memset(b,0,sizeof(*b));
+    b->jobs = 1;
+    b->outdir = ".";
+    b->suffix = ".txt";
+}
+
+void exe_batch_free(struct exe_batch * const b) {
+    unsigned int i;
+
+    if (b->files) {
+        for (i=0;i < b->count;i++) free(b->files[i]);
+        free(b->files);
+    }
+    if (b->output) {
+        for (i=0;i < b->count;i++) free(b->output[i]);
+        free(b->output);
+    }
+    if (b->result) free(b->result);
+
+    b->files = NULL;
+    b->output = NULL;
+    b->result = NULL;
+    b->count = 0;
+    b->alloc = 0;
+}
+
+/* one file per line, "-" reads the list from stdin. blank lines and # comments are skipped */
+int exe_batch_load_list(struct exe_batch * const b,const char * const list) {
+    char line[1024],*s,*e;
+    FILE *fp;
+
+    if (!strcmp(list,"-"))
+        fp = stdin;
+    else if ((fp=fopen(list,"r")) == NULL) {
+        fprintf(stderr,"Unable to open list %s, %s\n",list,strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line,sizeof(line),fp) != NULL) {
+        s = line;
+        while (*s == ' ' || *s == '\t') s++;
+        e = s + strlen(s);
+        while (e > s && (e[-1] == '\r' || e[-1] == '\n' || e[-1] == ' ' || e[-1] == '\t')) *(--e) = 0;
+        if (*s == 0 || *s == '#') continue;
+
+        if (b->count >= b->alloc) {
+            unsigned int na = (b->alloc != 0) ? (b->alloc * 2) : 64;
+            char **nf = (char**)realloc(b->files,na * sizeof(char*));
+
+            if (nf == NULL) break;
+            b->files = nf;
+            b->alloc = na;
+        }
+
+        if ((b->files[b->count] = strdup(s)) == NULL) break;
+        b->count++;
+    }
+
+    if (fp != stdin) fclose(fp);
+
+    if (b->count == 0) {
+        fprintf(stderr,"No files listed in %s\n",list);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* path with the directory separators turned into '_', so files of the same name from different
+ * directories don't overwrite each other's output */
+static void exe_batch_output_name(char *dst,size_t dstmax,const struct exe_batch * const b,const char *src) {
+    size_t o;
+
+    o = (size_t)snprintf(dst,dstmax,"%s/",b->outdir);
+    if (o >= dstmax) return;
+
+    while (*src == '.' && src[1] == '/') src += 2;
+    while (*src == '/') src++;
+
+    while (*src != 0 && (o+1) < dstmax) {
+        dst[o++] = (*src == '/' || *src == '\\' || *src == ':') ? '_' : *src;
+        src++;
+    }
+    dst[o] = 0;
+}
+
+static int exe_batch_write_index(const struct exe_batch * const b,const double wall) {
+    char path[1024];
+    unsigned int i,ok = 0;
+    double total = 0;
+    FILE *fp;
+
+    /* the index is text, binary output names it after the messages instead */
+    snprintf(path,sizeof(path),"%s/index%s",b->outdir,(b->errsuffix != NULL) ? b->errsuffix : b->suffix);
+    if ((fp=fopen(path,"w")) == NULL) {
+        fprintf(stderr,"Unable to write %s, %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp,"# status       seconds      bytes  input -> output\n");
+    for (i=0;i < b->count;i++) {
+        const struct exe_batch_result *r = &b->result[i];
+        char st[16];
+
+        if (r->status == -1)
+            strcpy(st,"not run");
+        else if (WIFEXITED(r->status) && WEXITSTATUS(r->status) == 0) {
+            strcpy(st,"ok");
+            ok++;
+        }
+        else if (WIFEXITED(r->status))
+            sprintf(st,"exit %d",WEXITSTATUS(r->status));
+        else if (WIFSIGNALED(r->status))
+            sprintf(st,"signal %d",WTERMSIG(r->status));
+        else
+            strcpy(st,"?");
+
+        fprintf(fp,"%-10s %10.3f %10lu  %s -> %s\n",st,r->seconds,r->out_size,b->files[i],b->output[i]);
+        total += r->seconds;
+    }
+
+    fprintf(fp,"# %u files, %u ok, %u failed, %.3f seconds total, %.3f seconds wall clock with %u jobs\n",
+        b->count,ok,b->count - ok,total,wall,b->jobs);
+    fclose(fp);
+
+    printf("Batch: %u files, %u ok, %u failed, %.3f seconds total, %.3f seconds wall clock with %u jobs\n",
+        b->count,ok,b->count - ok,total,wall,b->jobs);
+    printf("Index written to %s\n",path);
+    return 0;
+}
+
+/* Returns 1 in a child process: stdout and stderr now go to the output file (stderr to a file
+ * of its own if errsuffix is set), b->current names the input, and the caller should process
+ * it and exit (status 0 for success). Returns 0 in the parent when every file has been done
+ * and the index written, -1 on error. */
+int exe_batch_run(struct exe_batch * const b) {
+    struct exe_batch_slot *slot;
+    struct timespec t0,now;
+    unsigned int next = 0,done = 0,running = 0,i,j;
+    char name[1024];
+    struct stat st;
+    pid_t pid;
+    int status;
+
+    if (b->count == 0) return -1;
+    if (b->jobs == 0) b->jobs = 1;
+
+    if (mkdir(b->outdir,0777) < 0 && errno != EEXIST) {
+        fprintf(stderr,"Unable to create %s, %s\n",b->outdir,strerror(errno));
+        return -1;
+    }
+
+    b->result = (struct exe_batch_result*)calloc(b->count,sizeof(struct exe_batch_result));
+    b->output = (char**)calloc(b->count,sizeof(char*));
+    slot = (struct exe_batch_slot*)calloc(b->jobs,sizeof(struct exe_batch_slot));
+    if (b->result == NULL || b->output == NULL || slot == NULL) {
+        fprintf(stderr,"Out of memory\n");
+        return -1;
+    }
+
+    /* the same file listed twice (or as "x" and "./x") must not have two children writing one output */
+    for (i=0;i < b->count;i++) {
+        size_t l;
+
+        exe_batch_output_name(name,sizeof(name),b,b->files[i]);
+        l = strlen(name);
+        snprintf(name+l,sizeof(name)-l,"%s",b->suffix);
+        for (j=0;j < i && strcmp(b->output[j],name) != 0;j++);
+        if (j < i) snprintf(name+l,sizeof(name)-l,".%u%s",i,b->suffix);
+
+        if ((b->output[i]=strdup(name)) == NULL) {
+            fprintf(stderr,"Out of memory\n");
+            return -1;
+        }
+    }
+
+    for (i=0;i < b->count;i++)
+        b->result[i].status = -1;
+
+    clock_gettime(CLOCK_MONOTONIC,&t0);
+
+    while (done < b->count) {
+        while (running < b->jobs && next < b->count) {
+            for (i=0;i < b->jobs && slot[i].pid != 0;i++);
+
+            /* anything still buffered would otherwise be written again by the child */
+            fflush(stdout);
+            fflush(stderr);
+
+            clock_gettime(CLOCK_MONOTONIC,&slot[i].start);
+            pid = fork();
+            if (pid < 0) {
+                fprintf(stderr,"fork failed for %s, %s\n",b->files[next],strerror(errno));
+                b->result[next].status = -1;
+                next++;
+                done++;
+                continue;
+            }
+            else if (pid == 0) {
+                int fd;
+
+                fd = open(b->output[next],O_WRONLY|O_CREAT|O_TRUNC,0644);
+                if (fd < 0) {
+                    fprintf(stderr,"Unable to create %s, %s\n",b->output[next],strerror(errno));
+                    _exit(127);
+                }
+
+                dup2(fd,1);
+                if (b->errsuffix == NULL) dup2(fd,2);
+                close(fd);
+
+                if (b->errsuffix != NULL) {
+                    snprintf(name,sizeof(name),"%s%s",b->output[next],b->errsuffix);
+                    fd = open(name,O_WRONLY|O_CREAT|O_TRUNC,0644);
+                    if (fd < 0) _exit(127);
+                    dup2(fd,2);
+                    close(fd);
+                }
+
+                b->current = b->files[next];
+                free(slot);
+                return 1;
+            }
+
+            slot[i].pid = pid;
+            slot[i].index = next++;
+            running++;
+        }
+
+        pid = waitpid(-1,&status,0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr,"waitpid failed, %s\n",strerror(errno));
+            break;
+        }
+
+        for (i=0;i < b->jobs && slot[i].pid != pid;i++);
+        if (i == b->jobs) continue; /* not ours */
+
+        {
+            struct exe_batch_result *r = &b->result[slot[i].index];
+
+            clock_gettime(CLOCK_MONOTONIC,&now);
+            r->status = status;
+            r->seconds = exe_batch_elapsed(&slot[i].start,&now);
+
+            if (stat(b->output[slot[i].index],&st) == 0) r->out_size = (unsigned long)st.st_size;
+
+            printf("[%u/%u] %s: %s, %.3f sec\n",done + 1,b->count,b->files[slot[i].index],
+                (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "ok" : "FAILED",r->seconds);
+        }
+
+        slot[i].pid = 0;
+        running--;
+        done++;
+    }
+
+    free(slot);
+
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    if (exe_batch_write_index(b,exe_batch_elapsed(&t0,&now)) < 0)
+        return -1;
+
+    return 0;
+}
+
@@ -0,0 +1,35 @@
+
+/* Batch mode for the EXE dump tools and disassemblers (Linux host only).
+ *
+ * The tools keep everything about the file they're working on in globals, so instead of
+ * threads each input file gets its own process, forked from the tool after it has loaded
+ * whatever is shared between files (symbol files, label files). Up to "jobs" of them run
+ * at once. Each one writes to its own file in the output directory, and when they are all
+ * done the parent writes an index listing how each file went and how long it took.
+ * Tools whose output is binary set errsuffix so their messages (and the index) go to a text
+ * file of their own. */
+
+struct exe_batch_result {
+    int                                             status;         /* from waitpid() */
+    double                                          seconds;
+    unsigned long                                   out_size;
+};
+
+struct exe_batch {
+    char**                                          files;
+    char**                                          output;         /* [count] output file of each */
+    struct exe_batch_result*                        result;         /* [count] */
+    unsigned int                                    count;
+    unsigned int                                    alloc;
+    unsigned int                                    jobs;
+    const char*                                     outdir;
+    const char*                                     suffix;         /* appended to the output file names */
+    const char*                                     errsuffix;      /* if set, stderr goes to the output name plus this instead */
+    const char*                                     current;        /* in the child, the file to process */
+};
+
+void exe_batch_init(struct exe_batch * const b);
+void exe_batch_free(struct exe_batch * const b);
+int exe_batch_load_list(struct exe_batch * const b,const char * const list);
+int exe_batch_run(struct exe_batch * const b);
+
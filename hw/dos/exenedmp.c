@@ -13,23 +13,42 @@
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
 
+#if defined(LINUX)
+#include <hw/dos/exebatch.h>
+#endif
+
 #ifndef O_BINARY
 #define O_BINARY (0)
 #endif
 
 static unsigned char            opt_sort_ordinal = 0;
 static unsigned char            opt_sort_names = 0;
+static uint16_t                 opt_res_type = 0;       /* -rt, dump only this type of resource */
 
 static char*                    src_file = NULL;
 static int                      src_fd = -1;
 
+#if defined(LINUX)
+static char*                    batch_list = NULL;      /* -batch, file with a list of files to dump */
+static struct exe_batch         batch;
+#endif
+
 static struct exe_dos_header    exehdr;
 static struct exe_dos_layout    exelayout;
 
+static struct exe_ne_header_resource_index ne_resindex;
+
 static void help(void) {
     fprintf(stderr,"EXENEDMP -i <exe file>\n");
     fprintf(stderr," -sn        Sort names\n");
     fprintf(stderr," -so        Sort by ordinal\n");
+    fprintf(stderr," -rt <type> Read and dump the contents of only this type of resource\n");
+    fprintf(stderr,"            (ICON, GROUP_ICON, VERSION, ... or a number)\n");
+#if defined(LINUX)
+    fprintf(stderr," -batch <list> Dump each file named in the list (- for stdin), one output file each\n");
+    fprintf(stderr," -o <dir>   Where -batch writes output and index (default .)\n");
+    fprintf(stderr," -j <n>     Dump this many files at once in -batch mode\n");
+#endif
 }
 
 void print_imported_name_table(const struct exe_ne_header_imported_name_table * const t) {
@@ -499,6 +518,17 @@ void dump_ne_res_RT_ICON(const unsigned char *data,const size_t len) {
     assert(data <= fence);
 }
 
+/* where the RT_ICON or RT_CURSOR listed in a group is */
+void dump_ne_res_group_member(const uint16_t type,const uint16_t nID) {
+    const struct exe_ne_header_resource_index_entry *e =
+        exe_ne_header_resource_index_find(&ne_resindex,type,0x8000U | nID);
+
+    if (e != NULL)
+        printf("                        -> %lu bytes at %lu\n",(unsigned long)e->length,(unsigned long)e->offset);
+    else
+        printf("                        ! No %s with this ID\n",exe_ne_header_resource_table_typeinfo_TYPEID_INTEGER_name_str(type));
+}
+
 void dump_ne_res_RT_GROUP_ICON(const unsigned char *data,const size_t len) {
     const struct exe_ne_header_resource_GRICONDIRENTRY *grent;
     const struct exe_ne_header_resource_ICONDIR *hdr;
@@ -529,6 +559,7 @@ void dump_ne_res_RT_GROUP_ICON(const unsigned char *data,const size_t len) {
         printf("                        wBitCount:      %u\n",grent->wBitCount);
         printf("                        dwBytesInRes:   %lu\n",(unsigned long)grent->dwBytesInRes);
         printf("                        nID:            %u\n",grent->nID);
+        dump_ne_res_group_member(exe_ne_header_RT_ICON,grent->nID);
 
         /* NTS: The Windows 3.1 docs I have mis-document it as "resource table index of RT_ICON resource", which is wrong.
          *      Even more devious, is that this mis-documentation would happen to work regardless because RT_ICON resources
@@ -628,6 +659,7 @@ void dump_ne_res_RT_GROUP_CURSOR(const unsigned char *data,const size_t len) {
         printf("                        wBitCount:      %u\n",grent->wBitCount);
         printf("                        lBytesInRes:    %lu\n",(unsigned long)grent->lBytesInRes);
         printf("                        nID:            %u\n",grent->nID);
+        dump_ne_res_group_member(exe_ne_header_RT_CURSOR,grent->nID);
 
         /* NTS: The Windows 3.1 docs I have mis-document it as "resource table index of RT_CURSOR resource", which is wrong.
          *      Even more devious, is that this mis-documentation would happen to work regardless because RT_CURSOR resources
@@ -1606,6 +1638,7 @@ int main(int argc,char **argv) {
     struct exe_ne_header_name_entry_table ne_nonresname;
     struct exe_ne_header_resource_table_t ne_resources;
     struct exe_ne_header_name_entry_table ne_resname;
+    struct exe_ne_header_resource_cache ne_rescache;
     struct exe_ne_header_segment_table ne_segments;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
@@ -1617,10 +1650,15 @@ int main(int argc,char **argv) {
     memset(&exehdr,0,sizeof(exehdr));
     exe_ne_header_segment_table_init(&ne_segments);
     exe_ne_header_resource_table_init(&ne_resources);
+    exe_ne_header_resource_index_init(&ne_resindex);
     exe_ne_header_name_entry_table_init(&ne_resname);
     exe_ne_header_name_entry_table_init(&ne_nonresname);
     exe_ne_header_entry_table_table_init(&ne_entry_table);
     exe_ne_header_imported_name_table_init(&ne_imported_name_table);
+#if defined(LINUX)
+    exe_batch_init(&batch);
+    batch.suffix = ".exenedmp.txt";
+#endif
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -1638,10 +1676,29 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"so")) {
                 opt_sort_ordinal = 1;
             }
+            else if (!strcmp(a,"rt")) {
+                if ((a=argv[i++]) == NULL) return 1;
+                if ((opt_res_type=exe_ne_header_resource_type_from_string(a)) == 0) {
+                    fprintf(stderr,"Unknown resource type %s\n",a);
+                    return 1;
+                }
+            }
             else if (!strcmp(a,"i")) {
                 src_file = argv[i++];
                 if (src_file == NULL) return 1;
             }
+#if defined(LINUX)
+            else if (!strcmp(a,"batch")) {
+                if ((batch_list=argv[i++]) == NULL) return 1;
+            }
+            else if (!strcmp(a,"o")) {
+                if ((batch.outdir=argv[i++]) == NULL) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                if ((a=argv[i++]) == NULL) return 1;
+                batch.jobs = (unsigned int)strtoul(a,NULL,0);
+            }
+#endif
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -1655,6 +1712,21 @@ int main(int argc,char **argv) {
 
     assert(sizeof(exehdr) == 0x1C);
 
+#if defined(LINUX)
+    if (batch_list != NULL) {
+        if (exe_batch_load_list(&batch,batch_list) < 0)
+            return 1;
+
+        /* the parent comes back when all are done, each child comes back with its file */
+        if ((i=exe_batch_run(&batch)) <= 0) {
+            exe_batch_free(&batch);
+            return (i < 0) ? 1 : 0;
+        }
+
+        src_file = (char*)batch.current;
+    }
+#endif
+
     if (src_file == NULL) {
         fprintf(stderr,"No source file specified\n");
         return 1;
@@ -2122,8 +2194,20 @@ int main(int argc,char **argv) {
         }
 
         exe_ne_header_resource_table_parse(&ne_resources);
+        if (exe_ne_header_resource_index_build(&ne_resindex,&ne_resources) < 0)
+            fprintf(stderr,"Cannot index resources\n");
     }
 
+    /* resource data is read only for the resources dumped, and freed once dumped.
+     * impose limits on resource data reading. for most formats we only care about the header anyway. */
+#if TARGET_MSDOS == 16
+    // refuse to handle more than 16KB if 16-bit DOS
+    exe_ne_header_resource_cache_init(&ne_rescache,src_fd,0x4000UL);
+#else
+    // refuse to handle more than 4MB for anything else. nobody's resources are that large anyway.
+    exe_ne_header_resource_cache_init(&ne_rescache,src_fd,0x400000UL);
+#endif
+
     /* imported name table */
     printf("    Imported name table, %u entries:\n",
         (unsigned int)ne_imported_name_table.length);
@@ -2293,54 +2377,51 @@ int main(int argc,char **argv) {
                     printf("                rnUsage:            0x%04x\n",
                         ninfo->rnUsage);
 
-                if (ninfo->rnLength != 0) {
-                    unsigned long res_ofs = (unsigned long)ninfo->rnOffset << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
-                    unsigned long res_len = (unsigned long)ninfo->rnLength << (unsigned long)exe_ne_header_resource_table_get_shift(&ne_resources);
-                    unsigned char *res_raw = NULL;
+                if (ninfo->rnLength != 0 && (opt_res_type == 0 || opt_res_type == tinfo->rtTypeID)) {
+                    struct exe_ne_header_resource_index_entry ent;
+                    const unsigned char *res_raw;
+                    uint32_t res_len;
 
-                    // impose limits on resource data reading.
-                    // for most formats we only care about the header anyway.
-#if TARGET_MSDOS == 16
-                    // refuse to handle more than 16KB if 16-bit DOS
-                    if (res_len > 0x4000UL) res_len = 0x4000UL;
-#else
-                    // refuse to handle more than 4MB for anything else. nobody's resources are that large anyway.
-                    if (res_len > 0x400000UL) res_len = 0x400000UL;
-#endif
+                    ent.type = tinfo->rtTypeID;
+                    ent.id = ninfo->rnID;
+                    ent.flags = ninfo->rnFlags;
+                    ent.offset = (uint32_t)ninfo->rnOffset << (uint32_t)exe_ne_header_resource_table_get_shift(&ne_resources);
+                    ent.length = (uint32_t)ninfo->rnLength << (uint32_t)exe_ne_header_resource_table_get_shift(&ne_resources);
 
-                    res_raw = malloc(res_len);
+                    res_raw = exe_ne_header_resource_cache_get(&ne_rescache,&ent,&res_len);
                     if (res_raw != NULL) {
-                        if ((unsigned long)lseek(src_fd,res_ofs,SEEK_SET) == res_ofs &&
-                            (unsigned long)read(src_fd,res_raw,res_len) == res_len) {
-
-                            /* FIXME: Running this code against Windows 2.x executables, it seems
-                             *        that the ICON, CURSOR, and BITMAP resources used an entirely
-                             *        different format inside the NE resource. */
-                            if (tinfo->rtTypeID == exe_ne_header_RT_ICON)
-                                dump_ne_res_RT_ICON(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON)
-                                dump_ne_res_RT_GROUP_ICON(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR)
-                                dump_ne_res_RT_CURSOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR)
-                                dump_ne_res_RT_GROUP_CURSOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_STRING)
-                                dump_ne_res_RT_STRING(res_raw,(size_t)res_len,ninfo->rnID);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_NAME_TABLE)
-                                dump_ne_res_RT_NAME_TABLE(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_ACCELERATOR)
-                                dump_ne_res_RT_ACCELERATOR(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP)
-                                dump_ne_res_RT_BITMAP(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_MENU)
-                                dump_ne_res_RT_MENU(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_DIALOG)
-                                dump_ne_res_RT_DIALOG(res_raw,(size_t)res_len);
-                            else if (tinfo->rtTypeID == exe_ne_header_RT_VERSION)
-                                dump_ne_res_RT_VERSION(res_raw,(size_t)res_len);
-                        }
-
-                        free(res_raw);
+                        /* FIXME: Running this code against Windows 2.x executables, it seems
+                         *        that the ICON, CURSOR, and BITMAP resources used an entirely
+                         *        different format inside the NE resource. */
+                        if (tinfo->rtTypeID == exe_ne_header_RT_ICON)
+                            dump_ne_res_RT_ICON(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_ICON)
+                            dump_ne_res_RT_GROUP_ICON(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_CURSOR)
+                            dump_ne_res_RT_CURSOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_GROUP_CURSOR)
+                            dump_ne_res_RT_GROUP_CURSOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_STRING)
+                            dump_ne_res_RT_STRING(res_raw,(size_t)res_len,ninfo->rnID);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_NAME_TABLE)
+                            dump_ne_res_RT_NAME_TABLE(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_ACCELERATOR)
+                            dump_ne_res_RT_ACCELERATOR(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_BITMAP)
+                            dump_ne_res_RT_BITMAP(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_MENU)
+                            dump_ne_res_RT_MENU(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_DIALOG)
+                            dump_ne_res_RT_DIALOG(res_raw,(size_t)res_len);
+                        else if (tinfo->rtTypeID == exe_ne_header_RT_VERSION)
+                            dump_ne_res_RT_VERSION(res_raw,(size_t)res_len);
+
+                        /* each resource is dumped once, holding on to it gains nothing */
+                        exe_ne_header_resource_cache_free(&ne_rescache);
+                    }
+                    else {
+                        printf("! Cannot read resource data (%lu bytes at 0x%lx)\n",
+                            (unsigned long)ent.length,(unsigned long)ent.offset);
                     }
                 }
             }
@@ -2359,6 +2440,8 @@ int main(int argc,char **argv) {
     exe_ne_header_entry_table_table_free(&ne_entry_table);
     exe_ne_header_name_entry_table_free(&ne_nonresname);
     exe_ne_header_name_entry_table_free(&ne_resname);
+    exe_ne_header_resource_cache_free(&ne_rescache);
+    exe_ne_header_resource_index_free(&ne_resindex);
     exe_ne_header_resource_table_free(&ne_resources);
     exe_ne_header_segment_table_free(&ne_segments);
     close(src_fd);
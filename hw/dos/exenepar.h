@@ -11,6 +11,43 @@ struct exe_ne_header_resource_table_t {
     uint16_t                                        resnames_length;
 };
 
+/* one resource, see exe_ne_header_resource_index_build() */
+struct exe_ne_header_resource_index_entry {
+    uint16_t                                        type;           /* rtTypeID */
+    uint16_t                                        id;             /* rnID */
+    uint16_t                                        flags;          /* rnFlags */
+    uint32_t                                        offset;         /* in the file, bytes */
+    uint32_t                                        length;         /* bytes */
+};
+
+/* sorted by type, then id */
+struct exe_ne_header_resource_index {
+    struct exe_ne_header_resource_index_entry*      table;
+    unsigned int                                    length;
+};
+
+/* 16-bit small model builds keep to one, the near heap has no room for more */
+#if TARGET_MSDOS == 16
+#define EXE_NE_HEADER_RESOURCE_CACHE_SLOTS          1
+#else
+#define EXE_NE_HEADER_RESOURCE_CACHE_SLOTS          4
+#endif
+
+struct exe_ne_header_resource_cache_slot {
+    unsigned char*                                  data;
+    uint32_t                                        length;
+    uint32_t                                        offset;         /* which resource */
+    unsigned long                                   last_used;
+};
+
+struct exe_ne_header_resource_cache {
+    struct exe_ne_header_resource_cache_slot        slot[EXE_NE_HEADER_RESOURCE_CACHE_SLOTS];
+    int                                             fd;
+    uint32_t                                        max_length;     /* longer resources are cut short */
+    unsigned long                                   clock;
+    unsigned long                                   hits,misses;
+};
+
 struct exe_ne_header_imported_name_table {
     uint16_t*                                       table;
     unsigned int                                    length;
@@ -117,6 +154,17 @@ uint16_t exe_ne_header_resource_table_get_resname(const struct exe_ne_header_res
 void exe_ne_header_resource_table_parse(struct exe_ne_header_resource_table_t * const t);
 unsigned char *exe_ne_header_resource_table_alloc_raw(struct exe_ne_header_resource_table_t * const t,const size_t length);
 
+void exe_ne_header_resource_index_init(struct exe_ne_header_resource_index * const x);
+void exe_ne_header_resource_index_free(struct exe_ne_header_resource_index * const x);
+int exe_ne_header_resource_index_build(struct exe_ne_header_resource_index * const x,const struct exe_ne_header_resource_table_t * const t);
+const struct exe_ne_header_resource_index_entry *exe_ne_header_resource_index_find_type(const struct exe_ne_header_resource_index * const x,const uint16_t type,unsigned int * const count);
+const struct exe_ne_header_resource_index_entry *exe_ne_header_resource_index_find(const struct exe_ne_header_resource_index * const x,const uint16_t type,const uint16_t id);
+uint16_t exe_ne_header_resource_type_from_string(const char *s);
+
+void exe_ne_header_resource_cache_init(struct exe_ne_header_resource_cache * const c,const int fd,const uint32_t max_length);
+void exe_ne_header_resource_cache_free(struct exe_ne_header_resource_cache * const c);
+const unsigned char *exe_ne_header_resource_cache_get(struct exe_ne_header_resource_cache * const c,const struct exe_ne_header_resource_index_entry * const e,uint32_t * const length);
+
 void ne_imported_name_table_entry_get_name(char *dst,size_t dstmax,const struct exe_ne_header_imported_name_table * const t,const uint16_t offset);
 void ne_imported_name_table_entry_get_module_ref_name(char *dst,size_t dstmax,const struct exe_ne_header_imported_name_table * const t,const uint16_t index);
 void exe_ne_header_imported_name_table_init(struct exe_ne_header_imported_name_table * const t);
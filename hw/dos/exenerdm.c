@@ -20,6 +20,9 @@ static char*                    src_file = NULL;
 static int                      src_fd = -1;
 
 static unsigned char            opt_pric = 0;
+static unsigned char            opt_gico = 0;
+static uint16_t                 opt_res_type = 0;       /* -rt */
+static uint16_t                 opt_res_id = 0;         /* -rn */
 
 static struct exe_dos_header    exehdr;
 static struct exe_dos_layout    exelayout;
@@ -28,10 +31,129 @@ static void help(void) {
     fprintf(stderr,"EXENERDM -i <exe file>\n");
     fprintf(stderr,"  -pric      Pre-pend a directory structure to ICON and CURSOR resources.\n");
     fprintf(stderr,"             .ico and .cur files are expected to contain this directory.\n");
+    fprintf(stderr,"  -rt <type> Write only this type of resource (ICON, GROUP_ICON, VERSION, ... or a number)\n");
+    fprintf(stderr,"  -rn <id>   Write only the resource(s) with this integer ID\n");
+    fprintf(stderr,"  -gico      Write each GROUP_ICON as a complete .ico file with the icons it lists\n");
+}
+
+/* RT_GROUP_ICON -> .ico: the group's directory, with file offsets instead of RT_ICON IDs,
+ * followed by the icons. An icon shared by several groups is read once, if it is still in
+ * the cache. Only Windows 3.x format icons (BITMAPINFOHEADER) can be written this way. */
+static int write_group_icon(const struct exe_ne_header_resource_index * const x,struct exe_ne_header_resource_cache * const cache,const struct exe_ne_header_resource_index_entry * const grp) {
+    const struct exe_ne_header_resource_GRICONDIRENTRY *grent;
+    struct exe_ne_header_resource_ICONDIRENTRY dent;
+    struct exe_ne_header_resource_ICONDIR hdr;
+    const struct exe_ne_header_resource_index_entry *ie;
+    const unsigned char *data;
+    unsigned char *dir = NULL;
+    uint32_t len,ofs,icolen;
+    unsigned int i,count;
+    char name[32];
+    int fd = -1;
+
+    data = exe_ne_header_resource_cache_get(cache,grp,&len);
+    if (data == NULL || len < sizeof(hdr)) {
+        printf("! Cannot read GROUP_ICON %04X\n",(unsigned int)grp->id);
+        return 0;
+    }
+    memcpy(&hdr,data,sizeof(hdr));
+    if (len < (sizeof(hdr) + ((uint32_t)hdr.idCount * sizeof(*grent)))) {
+        printf("! GROUP_ICON %04X is too short\n",(unsigned int)grp->id);
+        return 0;
+    }
+
+    /* loading the icons may push the group out of the cache */
+    if ((dir=malloc(hdr.idCount * sizeof(*grent))) == NULL)
+        return 0;
+    memcpy(dir,data + sizeof(hdr),hdr.idCount * sizeof(*grent));
+
+    sprintf(name,"%04X%04X.ico",(unsigned int)grp->type,(unsigned int)grp->id);
+    printf("GROUP_ICON %04X, %u icons, writing to: %s\n",(unsigned int)grp->id,hdr.idCount,name);
+
+    fd = open(name,O_CREAT|O_TRUNC|O_WRONLY|O_BINARY,0644);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to write %s, %s\n",name,strerror(errno));
+        free(dir);
+        return -1;
+    }
+
+    /* icons the group lists that aren't there are left out */
+    count = 0;
+    for (i=0;i < hdr.idCount;i++) {
+        grent = (const struct exe_ne_header_resource_GRICONDIRENTRY*)(dir + (i * sizeof(*grent)));
+        if (exe_ne_header_resource_index_find(x,exe_ne_header_RT_ICON,0x8000U | grent->nID) != NULL)
+            count++;
+        else
+            printf("! No ICON %u\n",grent->nID);
+    }
+
+    hdr.idReserved = 0;
+    hdr.idType = 1;
+    i = hdr.idCount;
+    hdr.idCount = count;
+    write(fd,&hdr,sizeof(hdr));
+    hdr.idCount = i;
+
+    /* directory, from the index alone */
+    ofs = sizeof(hdr) + ((uint32_t)count * sizeof(dent));
+    for (i=0;i < hdr.idCount;i++) {
+        grent = (const struct exe_ne_header_resource_GRICONDIRENTRY*)(dir + (i * sizeof(*grent)));
+        if ((ie=exe_ne_header_resource_index_find(x,exe_ne_header_RT_ICON,0x8000U | grent->nID)) == NULL)
+            continue;
+
+        icolen = grent->dwBytesInRes;
+        if (icolen > ie->length)
+            icolen = ie->length;
+
+        dent.bWidth = grent->bWidth;
+        dent.bHeight = grent->bHeight;
+        dent.bColorCount = grent->bColorCount;
+        dent.bReserved = 0;
+        dent.wPlanes = grent->wPlanes;
+        dent.wBitCount = grent->wBitCount;
+        dent.dwBytesInRes = icolen;
+        dent.dwImageOffset = ofs;
+        write(fd,&dent,sizeof(dent));
+        ofs += icolen;
+    }
+
+    /* then the icons */
+    for (i=0;i < hdr.idCount;i++) {
+        grent = (const struct exe_ne_header_resource_GRICONDIRENTRY*)(dir + (i * sizeof(*grent)));
+        if ((ie=exe_ne_header_resource_index_find(x,exe_ne_header_RT_ICON,0x8000U | grent->nID)) == NULL)
+            continue;
+
+        icolen = grent->dwBytesInRes;
+        if (icolen > ie->length)
+            icolen = ie->length;
+
+        data = exe_ne_header_resource_cache_get(cache,ie,&len);
+        if (data != NULL && len >= 4 && exe_ne_header_is_WINOLDICON(data,len))
+            printf("! ICON %u is in the Windows 1.x/2.x format, .ico will not be valid\n",grent->nID);
+
+        if (data == NULL) {
+            printf("! Cannot read ICON %u\n",grent->nID);
+            len = 0;
+        }
+        if (len > icolen)
+            len = icolen;
+        if (len != 0)
+            write(fd,data,len);
+
+        /* keep the offsets in the directory right */
+        for (;len < icolen;len++)
+            write(fd,"",1);
+    }
+
+    close(fd);
+    free(dir);
+    return 0;
 }
 
 int main(int argc,char **argv) {
     struct exe_ne_header_resource_table_t ne_resources;
+    struct exe_ne_header_resource_cache ne_rescache;
+    struct exe_ne_header_resource_index ne_resindex;
     struct exe_ne_header ne_header;
     uint32_t ne_header_offset;
     uint32_t file_size;
@@ -41,6 +163,7 @@ int main(int argc,char **argv) {
     assert(sizeof(ne_header) == 0x40);
     memset(&exehdr,0,sizeof(exehdr));
     exe_ne_header_resource_table_init(&ne_resources);
+    exe_ne_header_resource_index_init(&ne_resindex);
 
     for (i=1;i < argc;) {
         a = argv[i++];
@@ -59,6 +182,20 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"pric")) {
                 opt_pric = 1;
             }
+            else if (!strcmp(a,"gico")) {
+                opt_gico = 1;
+            }
+            else if (!strcmp(a,"rt")) {
+                if ((a=argv[i++]) == NULL) return 1;
+                if ((opt_res_type=exe_ne_header_resource_type_from_string(a)) == 0) {
+                    fprintf(stderr,"Unknown resource type %s\n",a);
+                    return 1;
+                }
+            }
+            else if (!strcmp(a,"rn")) {
+                if ((a=argv[i++]) == NULL) return 1;
+                opt_res_id = (uint16_t)(0x8000U | (strtoul(a,NULL,0) & 0x7FFFUL));
+            }
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -437,6 +574,8 @@ int main(int argc,char **argv) {
         }
 
         exe_ne_header_resource_table_parse(&ne_resources);
+        if (exe_ne_header_resource_index_build(&ne_resindex,&ne_resources) < 0)
+            fprintf(stderr,"Cannot index resources\n");
     }
 
     printf("    Resource table, 1 << %u = %lu byte alignment:\n",
@@ -557,6 +696,9 @@ int main(int argc,char **argv) {
                         ninfo->rnID,tmp);
                 }
 
+                if ((opt_res_type != 0 && opt_res_type != tinfo->rtTypeID) || (opt_res_id != 0 && opt_res_id != ninfo->rnID))
+                    continue;
+
                 /* then choose file to write */
                 sprintf(tmp,"%04X%04X%s",
                     (unsigned int)tinfo->rtTypeID,
@@ -1005,6 +1147,25 @@ int main(int argc,char **argv) {
         }
     }
 
+    if (opt_gico) {
+        const struct exe_ne_header_resource_index_entry *grp;
+        unsigned int count,gi;
+
+        exe_ne_header_resource_cache_init(&ne_rescache,src_fd,0xFFF0UL);
+
+        grp = exe_ne_header_resource_index_find_type(&ne_resindex,exe_ne_header_RT_GROUP_ICON,&count);
+        for (gi=0;gi < count;gi++) {
+            if (opt_res_id != 0 && opt_res_id != grp[gi].id)
+                continue;
+            if (write_group_icon(&ne_resindex,&ne_rescache,&grp[gi]) < 0)
+                return 1;
+        }
+
+        printf("Resource cache: %lu reads, %lu hits\n",ne_rescache.misses,ne_rescache.hits);
+        exe_ne_header_resource_cache_free(&ne_rescache);
+    }
+
+    exe_ne_header_resource_index_free(&ne_resindex);
     exe_ne_header_resource_table_free(&ne_resources);
     close(src_fd);
     return 0;
@@ -0,0 +1,209 @@
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+
+#include <hw/dos/exehdr.h>
+#include <hw/dos/exenehdr.h>
+#include <hw/dos/exenepar.h>
+
+/* (type,id) -> (offset,length) index of the resources, made from the resource table alone,
+ * so that a resource can be found without walking the table and loaded only when wanted. */
+
+void exe_ne_header_resource_index_init(struct exe_ne_header_resource_index * const x) {
+    memset(x,0,sizeof(*x));
+}
+
+void exe_ne_header_resource_index_free(struct exe_ne_header_resource_index * const x) {
+    if (x->table) free(x->table);
+    x->table = NULL;
+    x->length = 0;
+}
+
+static int exe_ne_header_resource_index_entry_cmp(const void *a,const void *b) {
+    const struct exe_ne_header_resource_index_entry *ea = (const struct exe_ne_header_resource_index_entry*)a;
+    const struct exe_ne_header_resource_index_entry *eb = (const struct exe_ne_header_resource_index_entry*)b;
+
+    if (ea->type != eb->type)
+        return (ea->type < eb->type) ? -1 : 1;
+    if (ea->id != eb->id)
+        return (ea->id < eb->id) ? -1 : 1;
+
+    return 0;
+}
+
+/* the table must already be parsed (exe_ne_header_resource_table_parse) */
+int exe_ne_header_resource_index_build(struct exe_ne_header_resource_index * const x,const struct exe_ne_header_resource_table_t * const t) {
+    const struct exe_ne_header_resource_table_nameinfo *ninfo;
+    const struct exe_ne_header_resource_table_typeinfo *tinfo;
+    const unsigned char *fence;
+    unsigned int ti,ni,count;
+    uint16_t shift;
+
+    exe_ne_header_resource_index_free(x);
+    if (t->raw == NULL || t->typeinfo == NULL) return 0;
+
+    fence = t->raw + t->raw_length;
+    shift = exe_ne_header_resource_table_get_shift(t);
+    if (shift > 16U) return -1;
+
+    count = 0;
+    for (ti=0;ti < t->typeinfo_length;ti++) {
+        if ((tinfo=exe_ne_header_resource_table_get_typeinfo_entry(t,ti)) == NULL) continue;
+        count += tinfo->rtResourceCount;
+    }
+
+    if (count == 0) return 0;
+    x->table = (struct exe_ne_header_resource_index_entry*)malloc(count * sizeof(struct exe_ne_header_resource_index_entry));
+    if (x->table == NULL) return -1;
+
+    for (ti=0;ti < t->typeinfo_length;ti++) {
+        if ((tinfo=exe_ne_header_resource_table_get_typeinfo_entry(t,ti)) == NULL) continue;
+
+        for (ni=0;ni < tinfo->rtResourceCount && x->length < count;ni++) {
+            struct exe_ne_header_resource_index_entry *e;
+
+            ninfo = exe_ne_header_resource_table_get_typeinfo_nameinfo_entry(tinfo,ni);
+            if (ninfo == NULL || (const unsigned char*)(ninfo+1) > fence) break; /* table cut short */
+
+            e = &x->table[x->length++];
+            e->type = tinfo->rtTypeID;
+            e->id = ninfo->rnID;
+            e->flags = ninfo->rnFlags;
+            e->offset = (uint32_t)ninfo->rnOffset << (uint32_t)shift;
+            e->length = (uint32_t)ninfo->rnLength << (uint32_t)shift;
+        }
+    }
+
+    qsort(x->table,x->length,sizeof(struct exe_ne_header_resource_index_entry),exe_ne_header_resource_index_entry_cmp);
+    return 0;
+}
+
+/* first entry of the given type, and how many there are. returns NULL if none */
+const struct exe_ne_header_resource_index_entry *exe_ne_header_resource_index_find_type(const struct exe_ne_header_resource_index * const x,const uint16_t type,unsigned int * const count) {
+    unsigned int lo = 0,hi = x->length,mid,end;
+
+    *count = 0;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1U);
+        if (x->table[mid].type < type)
+            lo = mid + 1U;
+        else
+            hi = mid;
+    }
+
+    for (end=lo;end < x->length && x->table[end].type == type;end++);
+    if (end == lo) return NULL;
+
+    *count = end - lo;
+    return &x->table[lo];
+}
+
+/* type and id as they appear in the resource table: 0x8000 | integer, or the offset of the name */
+const struct exe_ne_header_resource_index_entry *exe_ne_header_resource_index_find(const struct exe_ne_header_resource_index * const x,const uint16_t type,const uint16_t id) {
+    struct exe_ne_header_resource_index_entry key;
+
+    if (x->table == NULL) return NULL;
+
+    key.type = type;
+    key.id = id;
+    return (const struct exe_ne_header_resource_index_entry*)
+        bsearch(&key,x->table,x->length,sizeof(struct exe_ne_header_resource_index_entry),exe_ne_header_resource_index_entry_cmp);
+}
+
+/* "ICON", "RT_ICON", or a number. returns 0 if not recognized */
+uint16_t exe_ne_header_resource_type_from_string(const char *s) {
+    const char *name;
+    unsigned int i;
+    uint16_t t;
+
+    if (isdigit((unsigned char)(*s))) {
+        unsigned long v = strtoul(s,NULL,0);
+        if (v == 0UL || v > 0x7FFFUL) return 0;
+        return (uint16_t)(0x8000U | (uint16_t)v);
+    }
+
+    for (t=exe_ne_header_RT_CURSOR;t <= exe_ne_header_RT_VERSION;t++) {
+        if ((name=exe_ne_header_resource_table_typeinfo_TYPEID_INTEGER_name_str(t)) == NULL) continue;
+        if (toupper((unsigned char)s[0]) != 'R' || toupper((unsigned char)s[1]) != 'T' || s[2] != '_') name += 3; /* allow without RT_ */
+
+        for (i=0;name[i] != 0 && toupper((unsigned char)s[i]) == name[i];i++);
+        if (name[i] == 0 && s[i] == 0) return t;
+    }
+
+    return 0;
+}
+
+/* Resource bodies, read from the file when asked for and kept in a few slots, least
+ * recently used out first. A pointer from _get() stays good until the cache has loaded
+ * as many other resources as it has slots. */
+
+void exe_ne_header_resource_cache_init(struct exe_ne_header_resource_cache * const c,const int fd,const uint32_t max_length) {
+    memset(c,0,sizeof(*c));
+    c->fd = fd;
+    c->max_length = max_length;
+}
+
+void exe_ne_header_resource_cache_free(struct exe_ne_header_resource_cache * const c) {
+    unsigned int i;
+
+    for (i=0;i < EXE_NE_HEADER_RESOURCE_CACHE_SLOTS;i++) {
+        if (c->slot[i].data) free(c->slot[i].data);
+        c->slot[i].data = NULL;
+        c->slot[i].length = 0;
+    }
+}
+
+/* returns the body (cut to max_length) and its length, or NULL if it can't be read */
+const unsigned char *exe_ne_header_resource_cache_get(struct exe_ne_header_resource_cache * const c,const struct exe_ne_header_resource_index_entry * const e,uint32_t * const length) {
+    struct exe_ne_header_resource_cache_slot *s,*victim;
+    uint32_t len;
+    unsigned int i;
+
+    *length = 0;
+    if (e->length == 0) return NULL;
+
+    victim = &c->slot[0];
+    for (i=0;i < EXE_NE_HEADER_RESOURCE_CACHE_SLOTS;i++) {
+        s = &c->slot[i];
+        if (s->data != NULL && s->offset == e->offset) {
+            s->last_used = ++c->clock;
+            c->hits++;
+            *length = s->length;
+            return s->data;
+        }
+
+        if (victim->data != NULL && (s->data == NULL || s->last_used < victim->last_used))
+            victim = s;
+    }
+
+    c->misses++;
+
+    len = e->length;
+    if (len > c->max_length) len = c->max_length;
+
+    if (victim->data) free(victim->data);
+    victim->length = 0;
+    victim->data = (unsigned char*)malloc(len);
+    if (victim->data == NULL) return NULL;
+
+    if ((unsigned long)lseek(c->fd,e->offset,SEEK_SET) != (unsigned long)e->offset ||
+        (unsigned long)read(c->fd,victim->data,len) != (unsigned long)len) {
+        free(victim->data);
+        victim->data = NULL;
+        return NULL;
+    }
+
+    victim->offset = e->offset;
+    victim->length = len;
+    victim->last_used = ++c->clock;
+    *length = len;
+    return victim->data;
+}
+
@@ -0,0 +1,260 @@
+
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#if !defined(LINUX)
+#include <malloc.h>
+#include <dos.h>
+
+#include <hw/cpu/cpu.h>
+#endif
+
+#include <hw/ultrasnd/modeng.h>
+
+#if defined(LINUX)
+# define FAR
+#endif
+
+unsigned int mod_samples = 0;
+unsigned int mod_patterns = 0;
+unsigned int mod_song_length = 0;
+unsigned int mod_song_loops = 0;
+unsigned int mod_speed = 6;
+
+unsigned char mod_pattern[128];
+
+struct mod_sample mod_sample[MOD_MAX_SAMPLES+1];
+
+unsigned int chpan[MOD_MAX_CHANNELS];
+
+unsigned short pattern_channels = 0;
+unsigned short pattern_block_size = 0;
+unsigned short pattern_block_ofs = 0;
+unsigned short song_pos = 0;
+#if TARGET_MSDOS == 32 || defined(LINUX)
+unsigned char *pattern_data = NULL;
+unsigned char *pattern_data_read = NULL;
+#else
+unsigned char far *pattern_data = NULL;
+unsigned char far *pattern_data_read = NULL;
+#endif
+
+void (*mod_trigger)(unsigned int channel,unsigned int sample,unsigned short period,unsigned short effect) = NULL;
+
+void begin_pattern() {
+    unsigned char c = mod_pattern[song_pos];
+    pattern_block_ofs = 0;
+
+    if (c >= mod_patterns) c = 0;
+
+#if TARGET_MSDOS == 32 || defined(LINUX)
+    pattern_data_read = pattern_data + (c * pattern_block_size);
+#else
+    {
+        unsigned long ofs = ((unsigned long)c * (unsigned long)pattern_block_size);
+        pattern_data_read = MK_FP(FP_SEG(pattern_data) + (unsigned)(ofs >> 4UL),(unsigned)(ofs & 0xFUL));
+    };
+#endif
+}
+
+void next_step() {
+    if (pattern_block_ofs < pattern_block_size) {
+        unsigned int channel;
+        for (channel = 0;channel < pattern_channels;channel++) {
+            unsigned char FAR *pat = pattern_data_read + pattern_block_ofs;
+            unsigned short note_period;
+            unsigned short effect;
+            unsigned char sample;
+
+            sample  = (pat[0] & 0xF0u);
+            sample += (pat[2] >> 4u);
+
+            note_period = (pat[0] & 0x0Fu) << 8u;
+            note_period += pat[1];
+
+            effect  = (pat[2] & 0x0Fu) << 8;
+            effect +=  pat[3];
+
+            if (sample != 0 && sample <= mod_samples && mod_trigger != NULL)
+                mod_trigger(channel,sample-1u,note_period,effect);
+
+            pattern_block_ofs += 4;
+        }
+    }
+    if (pattern_block_ofs >= pattern_block_size) {
+        song_pos++;
+        if (song_pos >= mod_song_length) {
+            song_pos = 0;
+            mod_song_loops++;
+        }
+        begin_pattern();
+    }
+}
+
+void play_mod() {
+    song_pos = 0;
+    mod_song_loops = 0;
+    begin_pattern();
+}
+
+/* channel count from the signature at offset 1080, 0 if it isn't one (15-sample MOD) */
+static unsigned int mod_signature_channels(const unsigned char *sig) {
+    if (!memcmp(sig,"M.K.",4) ||
+        !memcmp(sig,"M!K!",4) ||
+        !memcmp(sig,"FLT4",4) ||
+        !memcmp(sig,"FLT8",4) ||
+        !memcmp(sig,"4CHN",4))
+        return 4;
+
+    /* "6CHN", "8CHN" (FastTracker) */
+    if (sig[0] >= '2' && sig[0] <= '9' && !memcmp(sig+1,"CHN",3))
+        return (unsigned int)(sig[0] - '0');
+
+    /* "10CH" ... "32CH" */
+    if (isdigit(sig[0]) && isdigit(sig[1]) && sig[2] == 'C' && sig[3] == 'H') {
+        unsigned int c = ((unsigned int)(sig[0] - '0') * 10u) + (unsigned int)(sig[1] - '0');
+        if (c >= 10u && c <= MOD_MAX_CHANNELS) return c;
+    }
+
+    return 0;
+}
+
+int mod_load(int fd) {
+    unsigned char temp[2+128];
+    unsigned long sof;
+    unsigned long tof;
+    unsigned int i;
+
+    /* first 20 bytes: Song name */
+    /* 20 + (30 * sample): Sample info */
+    /* offset 1080: 'M.K.', or 'M!K!' or sometimes other IDs as well */
+    if (lseek(fd,1080,SEEK_SET) != 1080 || read(fd,temp,4) != 4) return 0;
+
+    pattern_channels = mod_signature_channels(temp);
+    if (pattern_channels != 0) {
+        mod_samples = 31;
+    }
+    else {
+        mod_samples = 15;
+        pattern_channels = 4;
+    }
+    pattern_block_size = 256u * pattern_channels; /* 64 rows */
+
+    // default Amiga panning, left right right left
+    for (i=0;i < MOD_MAX_CHANNELS;i++)
+        chpan[i] = ((i & 3u) == 1u || (i & 3u) == 2u) ? 15 : 0;
+
+    tof = 20ul + (30ul * (unsigned long)mod_samples);
+    if ((unsigned long)lseek(fd,tof,SEEK_SET) != tof || read(fd,temp,2+128) != (2+128)) return 0;
+    mod_song_length = temp[0];
+    memcpy(mod_pattern,temp+2,128);
+
+    if (mod_song_length == 0 || mod_song_length > 128) {
+        printf("Invalid song length %u\n",mod_song_length);
+        return 0;
+    }
+
+    mod_patterns = 0;
+    for (i=0;i < 128;i++) {
+        unsigned int pn = (unsigned int)mod_pattern[i] + 1u;
+        if (mod_patterns < pn) mod_patterns = pn;
+    }
+
+    printf("MOD: samples=%u patterns=%u song_length=%u channels=%u\n",
+        mod_samples,mod_patterns,mod_song_length,pattern_channels);
+
+    tof = 20ul + (30ul * (unsigned long)mod_samples) + 2u + 128u;
+    if (mod_samples != 15) tof += 4u;
+    printf("     pattern_ofs=%lu\n",(unsigned long)tof);
+    if ((unsigned long)lseek(fd,tof,SEEK_SET) != tof) return 0;
+
+    {
+        unsigned long sz = (unsigned long)mod_patterns * (unsigned long)pattern_block_size;
+
+#if TARGET_MSDOS == 32 || defined(LINUX)
+        pattern_data = malloc(sz);
+        if (pattern_data == NULL) {
+            printf("Allocation failure (pattern data)\n");
+            return 0;
+        }
+        printf("     Pattern data: %p\n",pattern_data);
+        if ((unsigned long)read(fd,pattern_data,sz) != sz) {
+            printf("Read failure (pattern data)\n");
+            return 0;
+        }
+#else
+        {
+            unsigned sg = 0;
+            if (_dos_allocmem((unsigned)(sz >> 4UL),&sg) != 0) {
+                printf("Allocation failure (pattern data)\n");
+                return 0;
+            }
+            pattern_data = MK_FP(sg,0);
+        }
+        printf("     Pattern data: %Fp\n",pattern_data);
+        {
+            unsigned sg = FP_SEG(pattern_data);
+            for (i=0;i < mod_patterns;i++) {
+                unsigned long o = pattern_block_size * (unsigned long)i;
+                unsigned char far *p = MK_FP(sg + (unsigned)(o >> 4ul),(unsigned)(o & 0xful));
+                unsigned rd = 0;
+
+                if (_dos_read(fd,p,(unsigned)pattern_block_size,&rd) != 0 || rd != (unsigned)pattern_block_size) {
+                    printf("Read failure (pattern data)\n");
+                    return 0;
+                }
+            }
+        }
+#endif
+    }
+
+    sof = 20ul + (30ul * (unsigned long)mod_samples) + 2u + 128u + ((unsigned long)mod_patterns * (unsigned long)pattern_block_size);
+    if (mod_samples != 15) sof += 4ul;
+    printf("     samples_ofs=%lu\n",(unsigned long)sof);
+    for (i=0;i < mod_samples;i++) {
+        struct mod_sample *s = &mod_sample[i];
+
+        memset(s,0,sizeof(*s));
+
+        tof = 20ul + (30ul * (unsigned long)i);
+        if ((unsigned long)lseek(fd,tof,SEEK_SET) != tof || read(fd,temp,30) != 30) return 0;
+
+        /* +0-21 Sample name
+         * +22 WORD, sample length in words
+         * +24 finetune (low 4 bits)
+         * +25 volume for sample (0x00-0x40)
+         * +26 repeat point, words
+         * +28 repeat length, words
+         * =30 */
+        s->file_offset = sof;
+        s->size = ((unsigned long)(((unsigned)temp[22] << 8u) + ((unsigned)temp[23]))) * 2ul;
+        s->finetune = (signed char)(temp[24] & 0xF);
+        if (s->finetune >= 8) s->finetune -= 0x10;
+        s->volume = temp[25];
+        s->repeat_point = ((unsigned long)(((unsigned)temp[26] << 8u) + ((unsigned)temp[27]))) * 2ul;
+        s->repeat_length = ((unsigned long)(((unsigned)temp[28] << 8u) + ((unsigned)temp[29]))) * 2ul;
+        s->ram_offset = ~0ul;
+
+        sof += s->size;
+    }
+
+    pattern_block_ofs = 0u;
+    song_pos = (unsigned short)(~0u);
+    return 1;
+}
+
+void mod_free() {
+    if (pattern_data != NULL) {
+#if TARGET_MSDOS == 32 || defined(LINUX)
+        free(pattern_data);
+#else
+        _dos_freemem(FP_SEG(pattern_data));
+#endif
+        pattern_data = NULL;
+    }
+    pattern_data_read = NULL;
+}
+
@@ -0,0 +1,50 @@
+
+/* MOD file loader and pattern engine, shared by the GUS player (modplay.c) and the
+ * software renderer (modrend.c, Linux host).
+ *
+ * mod_load() reads the header, order list, patterns and sample table. It leaves the
+ * sample data in the file at mod_sample[].file_offset, for the backend to load where
+ * it wants it (GUS DRAM, or memory for the mixer). Every mod_speed ticks the backend
+ * calls next_step(), which decodes one row and calls mod_trigger for each channel that
+ * starts a sample. */
+
+#define MOD_MAX_CHANNELS            32
+#define MOD_MAX_SAMPLES             31
+
+struct mod_sample {
+    unsigned long   file_offset;
+    unsigned long   ram_offset;     /* GUS DRAM, ~0ul if not loaded */
+    unsigned long   size;
+
+    signed char     finetune;
+    unsigned char   volume;
+    unsigned long   repeat_point;
+    unsigned long   repeat_length;
+};
+
+extern unsigned int                 mod_samples;
+extern unsigned int                 mod_patterns;
+extern unsigned int                 mod_song_length;
+extern unsigned int                 mod_song_loops;     /* times the song wrapped back to the start */
+extern unsigned int                 mod_speed;          /* ticks per row */
+
+extern unsigned char                mod_pattern[128];
+extern struct mod_sample            mod_sample[MOD_MAX_SAMPLES+1];
+
+extern unsigned int                 chpan[MOD_MAX_CHANNELS];
+
+extern unsigned short               pattern_channels;
+extern unsigned short               pattern_block_size;
+extern unsigned short               pattern_block_ofs;
+extern unsigned short               song_pos;
+
+/* channel starts sample (0-based index into mod_sample[]) at the Amiga period given.
+ * A period of 0 means the row names a sample but no note. */
+extern void                         (*mod_trigger)(unsigned int channel,unsigned int sample,unsigned short period,unsigned short effect);
+
+int mod_load(int fd);
+void mod_free();
+void begin_pattern();
+void next_step();
+void play_mod();
+
@@ -0,0 +1,207 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <hw/ultrasnd/modeng.h>
+#include <hw/ultrasnd/modmix.h>
+
+/* Paula clock x 2, the same rate the GUS player computes from the period */
+#define MOD_MIX_AMIGA_CLOCK         7159090ul
+
+int mod_mix_init(struct mod_mix * const m,const unsigned long rate) {
+    unsigned int half;
+
+    memset(m,0,sizeof(*m));
+    if (rate == 0) return -1;
+    m->rate = rate;
+
+    /* full scale at two full volume voices hard panned to the same side, or at half the
+     * channels if there are more than four */
+    half = pattern_channels / 2u;
+    if (half < 2u) half = 2u;
+    m->master = (int32_t)((32767.0 * 16777216.0) / (32768.0 * 64.0 * 15.0 * (double)half));
+
+    return 0;
+}
+
+void mod_mix_free(struct mod_mix * const m) {
+    unsigned int i;
+
+    for (i=0;i < MOD_MAX_SAMPLES;i++) {
+        if (m->sample_data[i]) free(m->sample_data[i]);
+        m->sample_data[i] = NULL;
+    }
+    if (m->accum) free(m->accum);
+    m->accum = NULL;
+    m->accum_frames = 0;
+}
+
+/* read each sample's data from the MOD file (mod_load() must have been called) */
+int mod_mix_load_samples(struct mod_mix * const m,const int fd) {
+    unsigned int i;
+
+    for (i=0;i < mod_samples && i < MOD_MAX_SAMPLES;i++) {
+        const struct mod_sample *s = &mod_sample[i];
+        uint32_t end = (uint32_t)s->size;
+        uint32_t loop_start = 0;
+        unsigned char loop = 0;
+        int8_t *d;
+        long rd;
+
+        if (s->size == 0) continue;
+
+        /* a loop of one word or less means no loop. the sample never plays past the
+         * end of the loop, so that is where it ends */
+        if (s->repeat_length > 2ul && s->repeat_point < s->size) {
+            loop_start = (uint32_t)s->repeat_point;
+            if (s->repeat_point + s->repeat_length < s->size)
+                end = (uint32_t)(s->repeat_point + s->repeat_length);
+            loop = 1;
+        }
+
+        if ((d=(int8_t*)malloc((size_t)end + 1)) == NULL) {
+            fprintf(stderr,"Out of memory, sample %u\n",i);
+            return -1;
+        }
+
+        if ((unsigned long)lseek(fd,(off_t)s->file_offset,SEEK_SET) != s->file_offset) {
+            fprintf(stderr,"Seek error, sample %u\n",i);
+            free(d);
+            return -1;
+        }
+
+        /* the last sample is often cut short in the file, the rest is silence */
+        rd = (long)read(fd,d,(size_t)end);
+        if (rd < 0) rd = 0;
+        if ((uint32_t)rd < end) memset(d+rd,0,(size_t)(end - (uint32_t)rd));
+
+        d[end] = loop ? d[loop_start] : 0;
+
+        m->sample_data[i] = d;
+        m->sample_end[i] = end;
+    }
+
+    return 0;
+}
+
+/* mod_trigger: start the sample from the beginning at the given period. With no period
+ * (a sample number alone) the voice keeps playing what it has, at the sample's volume */
+void mod_mix_trigger(struct mod_mix * const m,const unsigned int channel,const unsigned int sample,const unsigned short period) {
+    const struct mod_sample *s;
+    struct mod_mix_voice *v;
+    unsigned int vol,pan;
+
+    if (channel >= MOD_MAX_CHANNELS || sample >= MOD_MAX_SAMPLES) return;
+    v = &m->voice[channel];
+    s = &mod_sample[sample];
+
+    vol = s->volume;
+    if (vol > 64u) vol = 64u;
+    pan = chpan[channel];
+    if (pan > 15u) pan = 15u;
+
+    if (period != 0) {
+        if (m->sample_data[sample] == NULL) {
+            v->data = NULL;
+            return;
+        }
+
+        v->data = m->sample_data[sample];
+        v->end = m->sample_end[sample];
+        v->loop = (s->repeat_length > 2ul && s->repeat_point < s->size);
+        v->loop_start = v->loop ? (uint32_t)s->repeat_point : 0;
+        v->pos = 0;
+        v->step = ((uint64_t)MOD_MIX_AMIGA_CLOCK << 32ull) / ((uint64_t)period * 2ull * (uint64_t)m->rate);
+    }
+
+    v->gain_l = (int32_t)(vol * (15u - pan));
+    v->gain_r = (int32_t)(vol * pan);
+}
+
+/* add n frames of one voice, which will not reach v->end in that time */
+static void mod_mix_voice_run(struct mod_mix_voice * const v,int32_t *acc,unsigned int n) {
+    const int8_t *d = v->data;
+    const int32_t gl = v->gain_l,gr = v->gain_r;
+    const uint64_t step = v->step;
+    uint64_t pos = v->pos;
+    int32_t s0,s1,smp;
+    uint32_t idx,frac;
+
+    while (n-- != 0) {
+        idx = (uint32_t)(pos >> 32ull);
+        frac = (uint32_t)(pos >> 16ull) & 0xFFFFu;
+        s0 = d[idx];
+        s1 = d[idx+1]; /* guard sample at the end */
+        smp = (s0 << 8) + (((s1 - s0) * (int32_t)frac) >> 8);
+        acc[0] += smp * gl;
+        acc[1] += smp * gr;
+        acc += 2;
+        pos += step;
+    }
+
+    v->pos = pos;
+}
+
+void mod_mix_render(struct mod_mix * const m,int16_t *out,const unsigned int frames) {
+    unsigned int ch,done,n,i;
+    struct mod_mix_voice *v;
+    uint64_t end;
+    int32_t x;
+
+    if (m->accum_frames < frames) {
+        int32_t *na = (int32_t*)realloc(m->accum,(size_t)frames * 2u * sizeof(int32_t));
+
+        if (na == NULL) {
+            memset(out,0,(size_t)frames * 2u * sizeof(int16_t));
+            return;
+        }
+        m->accum = na;
+        m->accum_frames = frames;
+    }
+
+    memset(m->accum,0,(size_t)frames * 2u * sizeof(int32_t));
+
+    /* one voice at a time over the whole block */
+    for (ch=0;ch < pattern_channels && ch < MOD_MAX_CHANNELS;ch++) {
+        v = &m->voice[ch];
+        done = 0;
+
+        while (done < frames && v->data != NULL) {
+            end = (uint64_t)v->end << 32ull;
+            if (v->pos >= end) {
+                if (v->loop && v->end > v->loop_start) {
+                    v->pos -= (uint64_t)(v->end - v->loop_start) << 32ull;
+                    continue;
+                }
+
+                v->data = NULL;
+                break;
+            }
+
+            /* frames until the position reaches the end */
+            n = (unsigned int)(((end - v->pos) + v->step - 1ull) / v->step);
+            if (n > (frames - done)) n = frames - done;
+
+            mod_mix_voice_run(v,m->accum + (done * 2u),n);
+            done += n;
+        }
+    }
+
+    for (i=0;i < (frames * 2u);i++) {
+        x = (int32_t)(((int64_t)m->accum[i] * (int64_t)m->master) >> 24ll);
+        if (x > 32767) {
+            x = 32767;
+            m->clipped++;
+        }
+        else if (x < -32768) {
+            x = -32768;
+            m->clipped++;
+        }
+        out[i] = (int16_t)x;
+    }
+}
+
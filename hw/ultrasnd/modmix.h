@@ -0,0 +1,35 @@
+
+/* Software mixer backend for the MOD engine (modeng.h), in place of the GUS.
+ *
+ * Samples are 8-bit signed, each copied once into memory with one guard sample past the
+ * end (the loop start, or silence) so the interpolation never has to check for the end.
+ * Voices step through them in 32.32 fixed point with linear interpolation and are summed
+ * into a 32-bit stereo accumulator, then scaled and clipped to 16-bit stereo. */
+
+struct mod_mix_voice {
+    const int8_t*           data;           /* NULL if the voice is silent */
+    uint32_t                end;            /* play up to here... */
+    uint32_t                loop_start;     /* ...then go back here, if looping */
+    unsigned char           loop;
+    uint64_t                pos;            /* 32.32 */
+    uint64_t                step;           /* 32.32, source samples per output sample */
+    int32_t                 gain_l,gain_r;  /* volume (0-64) x pan (0-15) */
+};
+
+struct mod_mix {
+    int8_t*                 sample_data[MOD_MAX_SAMPLES];
+    uint32_t                sample_end[MOD_MAX_SAMPLES];
+    struct mod_mix_voice    voice[MOD_MAX_CHANNELS];
+    int32_t*                accum;          /* stereo, accum_frames long */
+    unsigned int            accum_frames;
+    unsigned long           rate;
+    int32_t                 master;         /* 8.24 scale from the accumulator to 16-bit */
+    unsigned long           clipped;        /* output samples that had to be clipped */
+};
+
+int mod_mix_init(struct mod_mix * const m,const unsigned long rate);
+void mod_mix_free(struct mod_mix * const m);
+int mod_mix_load_samples(struct mod_mix * const m,const int fd);
+void mod_mix_trigger(struct mod_mix * const m,const unsigned int channel,const unsigned int sample,const unsigned short period);
+void mod_mix_render(struct mod_mix * const m,int16_t *out,const unsigned int frames);
+
@@ -19,6 +19,7 @@
 #include <hw/8254/8254.h>		/* 8254 timer */
 #include <hw/8259/8259.h>		/* 8259 PIC interrupts */
 #include <hw/ultrasnd/ultrasnd.h>
+#include <hw/ultrasnd/modeng.h>
 #include <hw/dos/tgusmega.h>
 #include <hw/dos/tgussbos.h>
 #include <hw/dos/doswin.h>
@@ -126,142 +127,57 @@ static void help() {
 }
 
 char *mod_file = NULL;
-unsigned int mod_samples = 0;
-unsigned int mod_patterns = 0;
-unsigned int mod_song_length = 0;
-
-unsigned char mod_pattern[128];
-
-unsigned char temp[4096];
-
-struct mod_sample {
-    unsigned long   file_offset;
-    unsigned long   ram_offset;
-    unsigned long   size;
-
-    signed char     finetune;
-    unsigned char   volume;
-    unsigned long   repeat_point;
-    unsigned long   repeat_length;
-};
-
-struct mod_sample mod_sample[32];
-
-unsigned int chpan[16];
-
-unsigned short pattern_channels = 0;
-unsigned short pattern_block_size = 0;
-unsigned short pattern_block_ofs = 0;
-unsigned short song_pos = 0;
-#if TARGET_MSDOS == 32
-unsigned char *pattern_data = NULL;
-unsigned char *pattern_data_read = NULL;
-#else
-unsigned char far *pattern_data = NULL;
-unsigned char far *pattern_data_read = NULL;
-#endif
 
-void begin_pattern() {
-    unsigned char c = mod_pattern[song_pos];
-    pattern_block_ofs = 0;
+/* mod_trigger: start the sample on the GUS voice of the same number */
+static void gus_trigger(unsigned int channel,unsigned int sample,unsigned short note_period,unsigned short effect) {
+    struct mod_sample *s = &mod_sample[sample];
+    unsigned char voice_mode;
 
-    if (c >= mod_patterns) c = 0;
+    (void)effect;
 
-#if TARGET_MSDOS == 32
-    pattern_data_read = pattern_data + (c * pattern_block_size);
-#else
-    {
-        unsigned long ofs = ((unsigned long)c * (unsigned long)pattern_block_size);
-        pattern_data_read = MK_FP(FP_SEG(pattern_data) + (unsigned)(ofs >> 4UL),(unsigned)(ofs & 0xFUL));
-    };
-#endif
-}
+    /* the GUS has fewer voices than a 32 channel MOD can have */
+    if (channel >= gus->active_voices) return;
 
-void next_step() {
-    if (pattern_block_ofs < pattern_block_size) {
-        unsigned int channel;
-        for (channel = 0;channel < pattern_channels;channel++) {
-            unsigned char FAR *pat = pattern_data_read + pattern_block_ofs;
-            unsigned short note_period;
-            unsigned char voice_mode;
-            unsigned short effect;
-            unsigned char sample;
-
-            sample  = (pat[0] & 0xF0u);
-            sample += (pat[2] >> 4u);
-
-            note_period = (pat[0] & 0x0Fu) << 8u;
-            note_period += pat[1];
-            if (note_period < 1ul) note_period = 1ul;
-
-            effect  = (pat[2] & 0x0Fu) << 8;
-            effect +=  pat[3];
-
-            if (sample != 0 && sample <= mod_samples) {
-                struct mod_sample *s = &mod_sample[sample-1];
-
-//                printf("spos=%u sample=%u period=%u effect=%u\n",song_pos,sample,note_period,effect);
-
-                if (s->size != 0 && s->ram_offset != (~0ul)) {
-                    ultrasnd_stop_voice(gus,channel);
-
-                    voice_mode = ULTRASND_VOICE_MODE_STOP | ULTRASND_VOICE_MODE_IS_STOPPED;
-                    ultrasnd_set_voice_mode(gus,channel,voice_mode);
-
-                    ultrasnd_set_voice_ramp_rate(gus,channel,0,0);
-                    ultrasnd_set_voice_ramp_start(gus,channel,0xF0); /* NTS: You have to set the ramp start/end because it will override your current volume */
-                    ultrasnd_set_voice_ramp_end(gus,channel,0xF0);
-                    ultrasnd_set_voice_volume(gus,channel,0xFFF0); /* full vol */
-                    ultrasnd_set_voice_pan(gus,channel,chpan[channel]);
-                    ultrasnd_set_voice_ramp_control(gus,channel,0);
-
-                    {
-                        unsigned long amiga_rate = 7159090ul / ((unsigned long)note_period * 2ul);
-                        unsigned long freq = (amiga_rate << 10ul) / (unsigned long)gus->output_rate;
-
-                        ultrasnd_select_voice(gus,channel);
-                        ultrasnd_select_write16(gus,0x01,(unsigned short)freq);
-                        ultrasnd_set_voice_current(gus,channel,s->ram_offset);
-                        ultrasnd_set_voice_start(gus,channel,s->ram_offset);
-                        ultrasnd_set_voice_end(gus,channel,s->ram_offset + s->size - 1ul);
-                    }
+    /* no note: restart the sample at the lowest pitch, as this player always has */
+    if (note_period < 1u) note_period = 1u;
 
-                    voice_mode = ultrasnd_read_voice_mode(gus,channel);
-                    ultrasnd_start_voice(gus,channel);
-                }
-            }
+//    printf("spos=%u sample=%u period=%u effect=%u\n",song_pos,sample,note_period,effect);
+
+    if (s->size != 0 && s->ram_offset != (~0ul)) {
+        ultrasnd_stop_voice(gus,channel);
+
+        voice_mode = ULTRASND_VOICE_MODE_STOP | ULTRASND_VOICE_MODE_IS_STOPPED;
+        ultrasnd_set_voice_mode(gus,channel,voice_mode);
 
-            pattern_block_ofs += 4;
+        ultrasnd_set_voice_ramp_rate(gus,channel,0,0);
+        ultrasnd_set_voice_ramp_start(gus,channel,0xF0); /* NTS: You have to set the ramp start/end because it will override your current volume */
+        ultrasnd_set_voice_ramp_end(gus,channel,0xF0);
+        ultrasnd_set_voice_volume(gus,channel,0xFFF0); /* full vol */
+        ultrasnd_set_voice_pan(gus,channel,chpan[channel]);
+        ultrasnd_set_voice_ramp_control(gus,channel,0);
+
+        {
+            unsigned long amiga_rate = 7159090ul / ((unsigned long)note_period * 2ul);
+            unsigned long freq = (amiga_rate << 10ul) / (unsigned long)gus->output_rate;
+
+            ultrasnd_select_voice(gus,channel);
+            ultrasnd_select_write16(gus,0x01,(unsigned short)freq);
+            ultrasnd_set_voice_current(gus,channel,s->ram_offset);
+            ultrasnd_set_voice_start(gus,channel,s->ram_offset);
+            ultrasnd_set_voice_end(gus,channel,s->ram_offset + s->size - 1ul);
         }
-    }
-    if (pattern_block_ofs >= pattern_block_size) {
-        song_pos++;
-        if (song_pos >= mod_song_length) song_pos = 0;
-        begin_pattern();
-    }
-}
 
-void play_mod() {
-    song_pos = 0;
-    begin_pattern();
+        voice_mode = ultrasnd_read_voice_mode(gus,channel);
+        ultrasnd_start_voice(gus,channel);
+    }
 }
 
 int load_mod() {
     unsigned long rammax;
     unsigned long ramofs[4];
-    unsigned long sof;
-    unsigned long tof;
     unsigned int i,ri;
     int fd;
 
-    // default Amiga panning
-    for (i=0;i < 16;i++) {
-        chpan[0] = 0;//left
-        chpan[1] = 15;//right
-        chpan[2] = 15;//right
-        chpan[3] = 0;//left
-    }
-
     rammax = 256ul << 10ul;
 
     ramofs[0] = 0;
@@ -272,116 +188,11 @@ int load_mod() {
     fd = open(mod_file,O_RDONLY | O_BINARY);
     if (fd < 0) return 0;
 
-    /* first 20 bytes: Song name */
-    /* 20 + (30 * sample): Sample info */
-    /* offset 1080: 'M.K.', or 'M!K!' or sometimes other IDs as well */
-    if (lseek(fd,1080,SEEK_SET) != 1080 || read(fd,temp,4) != 4) goto fail;
-
-    pattern_block_size = 256u * 4u;
-    pattern_channels = 4;
-
-    mod_samples = 15;
-    if (!memcmp(temp,"M.K.",4) ||
-        !memcmp(temp,"M!K!",4) ||
-        !memcmp(temp,"FLT4",4) ||
-        !memcmp(temp,"FLT8",4) ||
-        !memcmp(temp,"10CH",4))
-        mod_samples = 31;
-
-    if (!memcmp(temp,"10CH",4)) {
-        pattern_block_size = 256u * 10u;
-        pattern_channels = 10;
-    }
-
-    tof = 20ul + (30ul * (unsigned long)mod_samples);
-    if (lseek(fd,tof,SEEK_SET) != tof || read(fd,temp,2+128) != (2+128)) goto fail;
-    mod_song_length = temp[0];
-    memcpy(mod_pattern,temp+2,128);
-
-    mod_patterns = 0;
-    for (i=0;i < 128;i++) {
-        unsigned int pn = (unsigned int)mod_pattern[i] + 1u;
-        if (mod_patterns < pn) mod_patterns = pn;
-    }
-
-    printf("MOD: samples=%u patterns=%u song_length=%u\n",
-        mod_samples,mod_patterns,mod_song_length);
-
-    tof = 20ul + (30ul * (unsigned long)mod_samples) + 2u + 128u;
-    if (mod_samples != 15) tof += 4u;
-    printf("     pattern_ofs=%lu\n",(unsigned long)tof);
-    if (lseek(fd,tof,SEEK_SET) != tof) goto fail;
+    if (!mod_load(fd)) goto fail;
 
-    {
-        unsigned long sz = (unsigned long)mod_patterns * (unsigned long)pattern_block_size;
-
-#if TARGET_MSDOS == 32
-        pattern_data = malloc(sz);
-        if (pattern_data == NULL) {
-            printf("Allocation failure (pattern data)\n");
-            goto fail;
-        }
-        printf("     Pattern data: %p\n",pattern_data);
-        if (read(fd,pattern_data,sz) != sz) {
-            printf("Read failure (pattern data)\n");
-            goto fail;
-        }
-#else
-        {
-            unsigned sg = 0;
-            if (_dos_allocmem((unsigned)(sz >> 4UL),&sg) != 0) {
-                printf("Allocation failure (pattern data)\n");
-                goto fail;
-            }
-            pattern_data = MK_FP(sg,0);
-        }
-        printf("     Pattern data: %Fp\n",pattern_data);
-        {
-            unsigned sg = FP_SEG(pattern_data);
-            for (i=0;i < mod_patterns;i++) {
-                unsigned long o = pattern_block_size * (unsigned long)i;
-                unsigned char far *p = MK_FP(sg + (unsigned)(o >> 4ul),(unsigned)(o & 0xful));
-                unsigned rd = 0;
-
-                if (_dos_read(fd,p,(unsigned)pattern_block_size,&rd) != 0 || rd != (unsigned)pattern_block_size) {
-                    printf("Read failure (pattern data)\n");
-                    goto fail;
-                }
-            }
-        }
-#endif
-    }
-
-    sof = 20ul + (30ul * (unsigned long)mod_samples) + 2u + 128u + ((unsigned long)mod_patterns * (unsigned long)pattern_block_size);
-    if (mod_samples != 15) sof += 4ul;
-    printf("     samples_ofs=%lu\n",(unsigned long)sof);
     for (i=0;i < mod_samples;i++) {
         struct mod_sample *s = &mod_sample[i];
 
-        memset(s,0,sizeof(*s));
-
-        tof = 20ul + (30ul * (unsigned long)i);
-        if (lseek(fd,tof,SEEK_SET) != tof || read(fd,temp,30) != 30) goto fail;
-
-        /* +0-21 Sample name
-         * +22 WORD, sample length in words
-         * +24 finetune (low 4 bits)
-         * +25 volume for sample (0x00-0x40)
-         * +26 repeat point, words
-         * +28 repeat length, words
-         * =30 */
-        s->file_offset = sof;
-        s->size = ((unsigned long)(((unsigned)temp[22] << 8u) + ((unsigned)temp[23]))) * 2ul;
-        s->finetune = (signed char)(temp[24] & 0xF);
-        if (s->finetune >= 8) s->finetune -= 0x10;
-        s->volume = temp[25];
-        s->repeat_point = ((unsigned long)(((unsigned)temp[26] << 8u) + ((unsigned)temp[27]))) * 2ul;
-        s->repeat_length = ((unsigned long)(((unsigned)temp[28] << 8u) + ((unsigned)temp[29]))) * 2ul;
-
-        sof += s->size;
-
-        s->ram_offset = ~0ul;
-
         if (s->size != 0ul) {
             // make room in GUS RAM for the sample,
             // taking into consideration that you shouldn't cross 256KB boundaries.
@@ -467,9 +278,6 @@ int load_mod() {
         ultrasnd_dram_buffer_free(gus);
     }
 
-    pattern_block_ofs = 0u;
-    song_pos = ~0u;
-
     close(fd);
     return 1;
 fail:
@@ -596,6 +404,7 @@ int main(int argc,char **argv) {
 
         printf("MOD loaded\n");
 
+        mod_trigger = gus_trigger;
         play_mod();
 
 		gus_timer_ctl = 0x04;
@@ -622,7 +431,7 @@ int main(int argc,char **argv) {
 
                 while (tick_time < t) {
                     next_step();
-                    tick_time += 6;
+                    tick_time += mod_speed;
                 }
             }
         } while (1);
@@ -640,6 +449,7 @@ int main(int argc,char **argv) {
 	ultrasnd_stop_timers(gus);
 	ultrasnd_drain_irq_events(gus);
 	printf("Freeing buffer...\n");
+	mod_free();
 	return 0;
 }
 
@@ -0,0 +1,241 @@
+
+/* Render a MOD file to a WAV file on the host, through the same pattern engine as the
+ * GUS player (modeng.c) and a software mixer (modmix.c) in place of the GUS. With -bench
+ * nothing is written and the render speed is reported against real time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <hw/ultrasnd/modeng.h>
+#include <hw/ultrasnd/modmix.h>
+
+#ifndef O_BINARY
+#define O_BINARY (0)
+#endif
+
+/* ticks per second at the default tempo (125 BPM) */
+#define MODREND_TICK_RATE           50u
+
+static struct mod_mix               mixer;
+
+static void mix_trigger(unsigned int channel,unsigned int sample,unsigned short note_period,unsigned short effect) {
+    (void)effect;
+    mod_mix_trigger(&mixer,channel,sample,note_period);
+}
+
+static unsigned long modrend_time_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ((unsigned long)ts.tv_sec * 1000000ul) + ((unsigned long)ts.tv_nsec / 1000ul);
+}
+
+static void wav_le16(unsigned char *d,const unsigned int v) {
+    d[0] = (unsigned char)v;
+    d[1] = (unsigned char)(v >> 8u);
+}
+
+static void wav_le32(unsigned char *d,const unsigned long v) {
+    d[0] = (unsigned char)v;
+    d[1] = (unsigned char)(v >> 8ul);
+    d[2] = (unsigned char)(v >> 16ul);
+    d[3] = (unsigned char)(v >> 24ul);
+}
+
+/* 16-bit stereo PCM, data_bytes is filled in once the length is known */
+static int wav_write_header(const int fd,const unsigned long rate,const unsigned long data_bytes) {
+    unsigned char h[44];
+
+    memcpy(h+0,"RIFF",4);
+    wav_le32(h+4,36ul + data_bytes);
+    memcpy(h+8,"WAVE",4);
+    memcpy(h+12,"fmt ",4);
+    wav_le32(h+16,16);
+    wav_le16(h+20,1);                   /* PCM */
+    wav_le16(h+22,2);                   /* channels */
+    wav_le32(h+24,rate);
+    wav_le32(h+28,rate * 4ul);          /* bytes per second */
+    wav_le16(h+32,4);                   /* block align */
+    wav_le16(h+34,16);                  /* bits per sample */
+    memcpy(h+36,"data",4);
+    wav_le32(h+40,data_bytes);
+
+    if (lseek(fd,0,SEEK_SET) != 0 || write(fd,h,44) != 44) return -1;
+    return 0;
+}
+
+static void help(void) {
+    fprintf(stderr,"MODREND [options] <mod file> [output .wav file]\n");
+    fprintf(stderr,"  -r <rate>    Sample rate (default 44100)\n");
+    fprintf(stderr,"  -t <sec>     Stop after this many seconds (default: when the song loops)\n");
+    fprintf(stderr,"  -bench       Render without writing anything, report the speed\n");
+}
+
+int main(int argc,char **argv) {
+    unsigned long rate = 44100,max_sec = 0,frames = 0,max_frames,t0,t1,frac = 0;
+    const char *src_file = NULL,*dst_file = NULL;
+    unsigned int tick = 0,n,buf_frames;
+    int16_t *buf = NULL;
+    int fd,ofd = -1;
+    int bench = 0;
+    double sec,rt;
+    char *a;
+    int i;
+
+    for (i=1;i < argc;) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"r")) {
+                if (i >= argc) return 1;
+                rate = strtoul(argv[i++],NULL,0);
+                if (rate < 4000ul || rate > 192000ul) {
+                    fprintf(stderr,"Sample rate out of range\n");
+                    return 1;
+                }
+            }
+            else if (!strcmp(a,"t")) {
+                if (i >= argc) return 1;
+                max_sec = strtoul(argv[i++],NULL,0);
+            }
+            else if (!strcmp(a,"bench")) {
+                bench = 1;
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else if (src_file == NULL) {
+            src_file = a;
+        }
+        else if (dst_file == NULL) {
+            dst_file = a;
+        }
+        else {
+            fprintf(stderr,"Unknown arg %s\n",a);
+            return 1;
+        }
+    }
+
+    if (src_file == NULL || (dst_file == NULL && !bench)) {
+        help();
+        return 1;
+    }
+
+    fd = open(src_file,O_RDONLY|O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr,"Unable to open %s, %s\n",src_file,strerror(errno));
+        return 1;
+    }
+
+    if (!mod_load(fd)) {
+        fprintf(stderr,"Unable to load %s\n",src_file);
+        close(fd);
+        mod_free();
+        return 1;
+    }
+
+    if (mod_mix_init(&mixer,rate) < 0 || mod_mix_load_samples(&mixer,fd) < 0) {
+        close(fd);
+        mod_mix_free(&mixer);
+        mod_free();
+        return 1;
+    }
+    close(fd);
+
+    if (!bench) {
+        ofd = open(dst_file,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,0644);
+        if (ofd < 0) {
+            fprintf(stderr,"Unable to create %s, %s\n",dst_file,strerror(errno));
+            mod_mix_free(&mixer);
+            mod_free();
+            return 1;
+        }
+        if (wav_write_header(ofd,rate,0) < 0) {
+            fprintf(stderr,"Write error\n");
+            close(ofd);
+            mod_mix_free(&mixer);
+            mod_free();
+            return 1;
+        }
+    }
+
+    buf_frames = (unsigned int)(rate / MODREND_TICK_RATE) + 1u;
+    if ((buf=(int16_t*)malloc((size_t)buf_frames * 2u * sizeof(int16_t))) == NULL) {
+        fprintf(stderr,"Out of memory\n");
+        if (ofd >= 0) close(ofd);
+        mod_mix_free(&mixer);
+        mod_free();
+        return 1;
+    }
+
+    /* a song with a jump back into itself never loops, so stop it somewhere */
+    max_frames = ((max_sec != 0ul) ? max_sec : 30ul * 60ul) * rate;
+
+    mod_trigger = mix_trigger;
+    play_mod();
+
+    t0 = modrend_time_us();
+
+    while (frames < max_frames) {
+        if (tick == 0) {
+            /* the last row has played out once the song is back at the start */
+            if (mod_song_loops != 0 && max_sec == 0ul) break;
+            next_step();
+            tick = mod_speed;
+        }
+        tick--;
+
+        /* rate / 50 is not always whole, carry the remainder */
+        n = (unsigned int)(rate / MODREND_TICK_RATE);
+        frac += rate % MODREND_TICK_RATE;
+        if (frac >= MODREND_TICK_RATE) {
+            frac -= MODREND_TICK_RATE;
+            n++;
+        }
+        if (n > (max_frames - frames)) n = (unsigned int)(max_frames - frames);
+
+        mod_mix_render(&mixer,buf,n);
+        frames += n;
+
+        if (ofd >= 0 && write(ofd,buf,(size_t)n * 4u) != (int)(n * 4u)) {
+            fprintf(stderr,"Write error\n");
+            break;
+        }
+    }
+
+    t1 = modrend_time_us();
+
+    if (ofd >= 0) {
+        if (wav_write_header(ofd,rate,frames * 4ul) < 0)
+            fprintf(stderr,"Write error\n");
+        close(ofd);
+    }
+
+    sec = (double)frames / rate;
+    rt = (double)(t1 - t0) / 1000000.0;
+    printf("%.3f seconds of audio at %luHz, %u channels, rendered in %.3f seconds",sec,rate,pattern_channels,rt);
+    if (rt > 0) printf(" (%.1fx realtime)",sec / rt);
+    printf("\n");
+    if (mixer.clipped != 0ul)
+        printf("%lu samples clipped\n",mixer.clipped);
+
+    free(buf);
+    mod_mix_free(&mixer);
+    mod_free();
+    return 0;
+}
+
@@ -10,3 +10,20 @@ uint32_t convert_ip_mono2stereo(uint32_t samples,void dosamp_FAR * const proc_bu
 uint32_t convert_ip_mono2stereo_u8(uint32_t samples,void dosamp_FAR * const proc_buf,const uint32_t buf_max);
 uint32_t convert_ip_mono2stereo_s16(uint32_t samples,void dosamp_FAR * const proc_buf,const uint32_t buf_max);
 
+/* N to M channel conversion (5.1 to stereo, etc.) through a mixing matrix, with bit conversion in the same pass */
+#define convert_ip_matrix_max_channels  (8)
+#define convert_ip_matrix_shift         (14) /* coefficients are Q14 */
+
+struct convert_ip_matrix_t {
+    int16_t                             m[convert_ip_matrix_max_channels][convert_ip_matrix_max_channels]; /* [out][in] */
+    uint8_t                             in_channels;
+    uint8_t                             out_channels;
+    uint8_t                             in_bits;
+    uint8_t                             out_bits;
+};
+
+extern struct convert_ip_matrix_t       convert_ip_matrix_state;
+
+uint32_t convert_ip_default_channel_mask(const uint8_t channels);
+int convert_ip_matrix_init(struct convert_ip_matrix_t * const mx,const uint8_t out_channels,uint32_t out_mask,const uint8_t out_bits,const uint8_t in_channels,uint32_t in_mask,const uint8_t in_bits);
+uint32_t convert_ip_matrix(const struct convert_ip_matrix_t * const mx,uint32_t samples,void dosamp_FAR * const proc_buf,const uint32_t buf_max);
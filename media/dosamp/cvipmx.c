@@ -0,0 +1,290 @@
+
+#if defined(TARGET_WINDOWS)
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dosamp.h"
+#include "wavefmt.h"
+#include "cvip.h"
+
+#define convert_ip_matrix_gain_1        (1L << convert_ip_matrix_shift)         /* 1.0 */
+#define convert_ip_matrix_gain_half     (1L << (convert_ip_matrix_shift - 1))   /* 0.5 */
+#define convert_ip_matrix_gain_m3db     (11585L)                                /* 0.7071 (-3dB) */
+
+/* speaker bit numbers, see windows_SPEAKER_* */
+enum {
+    convert_ip_spk_FL=0,
+    convert_ip_spk_FR,
+    convert_ip_spk_FC,
+    convert_ip_spk_LFE,
+    convert_ip_spk_BL,
+    convert_ip_spk_BR,
+    convert_ip_spk_FLC,
+    convert_ip_spk_FRC,
+    convert_ip_spk_BC,
+    convert_ip_spk_SL,
+    convert_ip_spk_SR
+};
+
+/* matrix being built */
+struct convert_ip_matrix_build_t {
+    int32_t                             g[convert_ip_matrix_max_channels][convert_ip_matrix_max_channels]; /* [out][in] */
+    int8_t                              out_of_spk[32];     /* speaker bit -> output channel, or -1 */
+    uint32_t                            out_mask;
+    unsigned char                       mono_in;
+};
+
+struct convert_ip_matrix_t              convert_ip_matrix_state;
+
+/* what WAV files without WAVE_FORMAT_EXTENSIBLE are assumed to contain */
+static const uint32_t convert_ip_default_masks[convert_ip_matrix_max_channels+1] = {
+    0,
+    windows_SPEAKER_FRONT_CENTER,                                                                   /* mono */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT,                                       /* stereo */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT | windows_SPEAKER_FRONT_CENTER,        /* 3.0 */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT |
+        windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT,                                     /* quad */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT | windows_SPEAKER_FRONT_CENTER |
+        windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT,                                     /* 5.0 */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT | windows_SPEAKER_FRONT_CENTER |
+        windows_SPEAKER_LOW_FREQUENCY | windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT,     /* 5.1 */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT | windows_SPEAKER_FRONT_CENTER |
+        windows_SPEAKER_LOW_FREQUENCY | windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT |
+        windows_SPEAKER_BACK_CENTER,                                                                /* 6.1 */
+    windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT | windows_SPEAKER_FRONT_CENTER |
+        windows_SPEAKER_LOW_FREQUENCY | windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT |
+        windows_SPEAKER_SIDE_LEFT | windows_SPEAKER_SIDE_RIGHT                                      /* 7.1 */
+};
+
+uint32_t convert_ip_default_channel_mask(const uint8_t channels) {
+    if (channels > convert_ip_matrix_max_channels)
+        return 0;
+
+    return convert_ip_default_masks[channels];
+}
+
+static unsigned int convert_ip_mask_count(uint32_t mask) {
+    unsigned int c = 0;
+
+    while (mask != 0UL) {
+        c += (unsigned int)(mask & 1UL);
+        mask >>= 1UL;
+    }
+
+    return c;
+}
+
+static int convert_ip_matrix_has(const struct convert_ip_matrix_build_t * const b,const uint32_t bits) {
+    return (b->out_mask & bits) == bits;
+}
+
+/* route input channel "in", playing through speaker "spk", to the output channels.
+ * speakers the output doesn't have fold into their nearest neighbor at -3dB, ending at
+ * the front pair (or front center, for mono output). LFE is dropped when the output has
+ * no LFE channel, as the ITU downmix does. */
+static void convert_ip_matrix_route(struct convert_ip_matrix_build_t * const b,const unsigned int in,const unsigned int spk,const int32_t gain) {
+    const int32_t g3 = (gain * convert_ip_matrix_gain_m3db) >> (int32_t)convert_ip_matrix_shift;
+
+    if (b->out_mask & (1UL << (unsigned long)spk)) {
+        b->g[b->out_of_spk[spk]][in] += gain;
+        return;
+    }
+
+    switch (spk) {
+        case convert_ip_spk_FC:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_FRONT_LEFT | windows_SPEAKER_FRONT_RIGHT)) {
+                /* mono to stereo has always been a straight copy to both channels */
+                convert_ip_matrix_route(b,in,convert_ip_spk_FL,b->mono_in ? gain : g3);
+                convert_ip_matrix_route(b,in,convert_ip_spk_FR,b->mono_in ? gain : g3);
+            }
+            break;
+        case convert_ip_spk_FL:
+        case convert_ip_spk_FR:
+            /* mono output, stereo to mono has always been an average */
+            if (convert_ip_matrix_has(b,windows_SPEAKER_FRONT_CENTER))
+                convert_ip_matrix_route(b,in,convert_ip_spk_FC,(gain * convert_ip_matrix_gain_half) >> (int32_t)convert_ip_matrix_shift);
+            break;
+        case convert_ip_spk_FLC:
+            convert_ip_matrix_route(b,in,convert_ip_spk_FL,gain);
+            break;
+        case convert_ip_spk_FRC:
+            convert_ip_matrix_route(b,in,convert_ip_spk_FR,gain);
+            break;
+        case convert_ip_spk_BL:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_SIDE_LEFT))
+                convert_ip_matrix_route(b,in,convert_ip_spk_SL,g3);
+            else
+                convert_ip_matrix_route(b,in,convert_ip_spk_FL,g3);
+            break;
+        case convert_ip_spk_BR:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_SIDE_RIGHT))
+                convert_ip_matrix_route(b,in,convert_ip_spk_SR,g3);
+            else
+                convert_ip_matrix_route(b,in,convert_ip_spk_FR,g3);
+            break;
+        case convert_ip_spk_SL:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_BACK_LEFT))
+                convert_ip_matrix_route(b,in,convert_ip_spk_BL,g3);
+            else
+                convert_ip_matrix_route(b,in,convert_ip_spk_FL,g3);
+            break;
+        case convert_ip_spk_SR:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_BACK_RIGHT))
+                convert_ip_matrix_route(b,in,convert_ip_spk_BR,g3);
+            else
+                convert_ip_matrix_route(b,in,convert_ip_spk_FR,g3);
+            break;
+        case convert_ip_spk_BC:
+            if (convert_ip_matrix_has(b,windows_SPEAKER_BACK_LEFT | windows_SPEAKER_BACK_RIGHT)) {
+                convert_ip_matrix_route(b,in,convert_ip_spk_BL,g3);
+                convert_ip_matrix_route(b,in,convert_ip_spk_BR,g3);
+            }
+            else if (convert_ip_matrix_has(b,windows_SPEAKER_SIDE_LEFT | windows_SPEAKER_SIDE_RIGHT)) {
+                convert_ip_matrix_route(b,in,convert_ip_spk_SL,g3);
+                convert_ip_matrix_route(b,in,convert_ip_spk_SR,g3);
+            }
+            else {
+                convert_ip_matrix_route(b,in,convert_ip_spk_FL,(gain * convert_ip_matrix_gain_half) >> (int32_t)convert_ip_matrix_shift);
+                convert_ip_matrix_route(b,in,convert_ip_spk_FR,(gain * convert_ip_matrix_gain_half) >> (int32_t)convert_ip_matrix_shift);
+            }
+            break;
+        default: /* LFE, or a speaker we have no rule for */
+            break;
+    }
+}
+
+/* a channel mask of zero, or one that doesn't match the channel count, means the default layout */
+int convert_ip_matrix_init(struct convert_ip_matrix_t * const mx,const uint8_t out_channels,uint32_t out_mask,const uint8_t out_bits,const uint8_t in_channels,uint32_t in_mask,const uint8_t in_bits) {
+    struct convert_ip_matrix_build_t b;
+    unsigned int i,o,spk;
+    int32_t sum,max = 0;
+
+    if (in_channels == 0 || in_channels > convert_ip_matrix_max_channels)
+        return -1;
+    if (out_channels == 0 || out_channels > convert_ip_matrix_max_channels)
+        return -1;
+
+    if (convert_ip_mask_count(in_mask) != in_channels)
+        in_mask = convert_ip_default_masks[in_channels];
+    if (convert_ip_mask_count(out_mask) != out_channels)
+        out_mask = convert_ip_default_masks[out_channels];
+
+    memset(&b,0,sizeof(b));
+    memset(b.out_of_spk,-1,sizeof(b.out_of_spk));
+    b.out_mask = out_mask;
+    b.mono_in = (in_channels == 1);
+
+    for (spk=0,o=0;spk < 32;spk++) {
+        if (out_mask & (1UL << (unsigned long)spk))
+            b.out_of_spk[spk] = (int8_t)(o++);
+    }
+
+    for (spk=0,i=0;spk < 32;spk++) {
+        if (in_mask & (1UL << (unsigned long)spk))
+            convert_ip_matrix_route(&b,i++,spk,convert_ip_matrix_gain_1);
+    }
+
+    /* scale down so that no output channel can clip, keeping the balance between them */
+    for (o=0;o < out_channels;o++) {
+        for (i=0,sum=0;i < in_channels;i++)
+            sum += (b.g[o][i] < 0L) ? -b.g[o][i] : b.g[o][i];
+
+        if (max < sum)
+            max = sum;
+    }
+
+    mx->in_channels = in_channels;
+    mx->out_channels = out_channels;
+    mx->in_bits = in_bits;
+    mx->out_bits = out_bits;
+
+    for (o=0;o < convert_ip_matrix_max_channels;o++) {
+        for (i=0;i < convert_ip_matrix_max_channels;i++) {
+            if (o < out_channels && i < in_channels && max > convert_ip_matrix_gain_1)
+                mx->m[o][i] = (int16_t)((b.g[o][i] * convert_ip_matrix_gain_1) / max);
+            else if (o < out_channels && i < in_channels)
+                mx->m[o][i] = (int16_t)b.g[o][i];
+            else
+                mx->m[o][i] = 0;
+        }
+    }
+
+    return 0;
+}
+
+/* one sample frame. all input channels are read before any output is written, so the
+ * output may overlap the input */
+static inline void convert_ip_matrix_frame(const struct convert_ip_matrix_t * const mx,const unsigned char dosamp_FAR *s,unsigned char dosamp_FAR *d) {
+    int32_t x[convert_ip_matrix_max_channels];
+    register unsigned int i,o;
+    int32_t acc;
+
+    if (mx->in_bits > 8) {
+        for (i=0;i < mx->in_channels;i++)
+            x[i] = ((const int16_t dosamp_FAR*)s)[i];
+    }
+    else {
+        for (i=0;i < mx->in_channels;i++)
+            x[i] = ((int32_t)s[i] - 0x80L) << 8L;
+    }
+
+    for (o=0;o < mx->out_channels;o++) {
+        acc = 0;
+        for (i=0;i < mx->in_channels;i++)
+            acc += (int32_t)mx->m[o][i] * x[i];
+
+        acc = (acc + (1L << (convert_ip_matrix_shift - 1))) >> (int32_t)convert_ip_matrix_shift;
+        if (acc > 32767L) acc = 32767L;
+        else if (acc < -32768L) acc = -32768L;
+
+        if (mx->out_bits > 8)
+            ((int16_t dosamp_FAR*)d)[o] = (int16_t)acc;
+        else
+            d[o] = (unsigned char)((acc >> 8L) + 0x80L);
+    }
+}
+
+uint32_t convert_ip_matrix(const struct convert_ip_matrix_t * const mx,uint32_t samples,void dosamp_FAR * const proc_buf,const uint32_t buf_max) {
+    /* in-place channel and bit conversion (up to proc_buf_len)
+     * from file_codec channels/bits to play_codec channels/bits, in one pass */
+    const unsigned int in_bpf = (mx->in_bits > 8 ? 2U : 1U) * mx->in_channels;
+    const unsigned int out_bpf = (mx->out_bits > 8 ? 2U : 1U) * mx->out_channels;
+    unsigned char dosamp_FAR *s = (unsigned char dosamp_FAR*)proc_buf;
+    unsigned char dosamp_FAR *d = (unsigned char dosamp_FAR*)proc_buf;
+    uint32_t i = samples;
+
+    /* buffer range check */
+    assert((samples * (uint32_t)in_bpf) <= buf_max);
+    assert((samples * (uint32_t)out_bpf) <= buf_max);
+
+    if (samples == 0UL)
+        return 0;
+
+    if (out_bpf <= in_bpf) {
+        /* shrinking: front to back */
+        while (i-- != 0UL) {
+            convert_ip_matrix_frame(mx,s,d);
+            s += in_bpf;
+            d += out_bpf;
+        }
+    }
+    else {
+        /* growing: back to front */
+        s += (samples - 1UL) * (uint32_t)in_bpf;
+        d += (samples - 1UL) * (uint32_t)out_bpf;
+        while (1) {
+            convert_ip_matrix_frame(mx,s,d);
+            if ((--i) == 0UL) break;
+            s -= in_bpf;
+            d -= out_bpf;
+        }
+    }
+
+    return samples * (uint32_t)out_bpf;
+}
+
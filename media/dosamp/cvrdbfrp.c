@@ -0,0 +1,101 @@
+
+#if defined(TARGET_WINDOWS)
+# include <windows.h>
+#endif
+
+#if TARGET_MSDOS == 16
+# include <dos.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "dosamp.h"
+#include "cvrdbuf.h"
+#include "dosptrnm.h"
+#include "resample.h"
+
+#if defined(RESAMPLE_SINC)
+
+/* the window is always signed 16-bit, whatever the play format */
+static inline int16_t resample_sinc_in8(const uint8_t s) {
+    return (int16_t)(((int)s - 0x80) << 8);
+}
+
+static inline int16_t resample_sinc_in16(const int16_t s) {
+    return s;
+}
+
+static inline int32_t resample_sinc_round(const int32_t acc) {
+    int32_t v = (acc + (1L << (resample_sinc_coeff_shift - 1))) >> resample_sinc_coeff_shift;
+
+    /* sinc ringing can overshoot full scale */
+    if (v > 32767L) v = 32767L;
+    else if (v < -32768L) v = -32768L;
+
+    return v;
+}
+
+static inline uint8_t resample_sinc_out8(const int32_t acc) {
+    return (uint8_t)((resample_sinc_round(acc) >> 8L) + 0x80);
+}
+
+static inline int16_t resample_sinc_out16(const int32_t acc) {
+    return (int16_t)resample_sinc_round(acc);
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_8_mono(uint8_t dosamp_FAR *dst,uint32_t samples) {
+#define resample_sinc_in_func resample_sinc_in8
+#define resample_sinc_out_func resample_sinc_out8
+#define sample_type_t uint8_t
+#define sample_channels 1
+#include "rsrdbtmp.h"
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_8_stereo(uint8_t dosamp_FAR *dst,uint32_t samples) {
+#define resample_sinc_in_func resample_sinc_in8
+#define resample_sinc_out_func resample_sinc_out8
+#define sample_type_t uint8_t
+#define sample_channels 2
+#include "rsrdbtmp.h"
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_16_mono(int16_t dosamp_FAR *dst,uint32_t samples) {
+#define resample_sinc_in_func resample_sinc_in16
+#define resample_sinc_out_func resample_sinc_out16
+#define sample_type_t int16_t
+#define sample_channels 1
+#include "rsrdbtmp.h"
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t samples) {
+#define resample_sinc_in_func resample_sinc_in16
+#define resample_sinc_out_func resample_sinc_out16
+#define sample_type_t int16_t
+#define sample_channels 2
+#include "rsrdbtmp.h"
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples) {
+    const unsigned int channels = resample_state.channels;
+#define resample_sinc_in_func resample_sinc_in8
+#define resample_sinc_out_func resample_sinc_out8
+#define sample_type_t uint8_t
+#define sample_channels channels
+#include "rsrdbtmp.h"
+}
+
+uint32_t convert_rdbuf_resample_sinc_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples) {
+    const unsigned int channels = resample_state.channels;
+#define resample_sinc_in_func resample_sinc_in16
+#define resample_sinc_out_func resample_sinc_out16
+#define sample_type_t int16_t
+#define sample_channels channels
+#include "rsrdbtmp.h"
+}
+
+#endif /* RESAMPLE_SINC */
+
@@ -54,3 +54,19 @@ uint32_t convert_rdbuf_resample_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t sa
 #include "rsrdbtm.h"
 }
 
+uint32_t convert_rdbuf_resample_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples) {
+    const unsigned int channels = resample_state.channels;
+#define resample_interpolate_func resample_interpolate8
+#define sample_type_t uint8_t
+#define sample_channels channels
+#include "rsrdbtm.h"
+}
+
+uint32_t convert_rdbuf_resample_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples) {
+    const unsigned int channels = resample_state.channels;
+#define resample_interpolate_func resample_interpolate16
+#define sample_type_t int16_t
+#define sample_channels channels
+#include "rsrdbtm.h"
+}
+
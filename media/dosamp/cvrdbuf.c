@@ -35,6 +35,7 @@ void convert_rdbuf_free(void) {
         _ffree(convert_rdbuf.buffer - BOUNDS_ADJUST);
 #endif
         convert_rdbuf.buffer = NULL;
+        convert_rdbuf.data = NULL;
         convert_rdbuf.len = 0;
         convert_rdbuf.pos = 0;
     }
@@ -72,6 +73,8 @@ unsigned char dosamp_FAR * convert_rdbuf_get(uint32_t *sz) {
             }
         }
 #endif
+
+        convert_rdbuf.data = convert_rdbuf.buffer;
     }
 
     if (sz != NULL) *sz = convert_rdbuf.size;
@@ -1,6 +1,7 @@
 
 struct convert_rdbuf_t {
     unsigned char dosamp_FAR *          buffer; // pointer to base
+    const unsigned char dosamp_FAR *    data;   // what the resamplers read from: buffer, or the file source's mapping (zero-copy)
     unsigned int                        size;   // size in bytes (16-bit builds will not exceed 64KN)
     unsigned int                        len;    // length of actual data
     unsigned int                        pos;    // read position of data
@@ -17,14 +18,28 @@ uint32_t convert_rdbuf_resample_to_8_mono(uint8_t dosamp_FAR *dst,uint32_t sampl
 uint32_t convert_rdbuf_resample_to_8_stereo(uint8_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_to_16_mono(int16_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples);
 
 uint32_t convert_rdbuf_resample_fast_to_8_mono(uint8_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_fast_to_8_stereo(uint8_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_fast_to_16_mono(int16_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_fast_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_fast_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_fast_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples);
 
 uint32_t convert_rdbuf_resample_best_to_8_mono(uint8_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_best_to_8_stereo(uint8_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_best_to_16_mono(int16_t dosamp_FAR *dst,uint32_t samples);
 uint32_t convert_rdbuf_resample_best_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_best_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_best_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples);
+
+/* RESAMPLE_SINC builds only */
+uint32_t convert_rdbuf_resample_sinc_to_8_mono(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_sinc_to_8_stereo(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_sinc_to_16_mono(int16_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_sinc_to_16_stereo(int16_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_sinc_to_8_multi(uint8_t dosamp_FAR *dst,uint32_t samples);
+uint32_t convert_rdbuf_resample_sinc_to_16_multi(int16_t dosamp_FAR *dst,uint32_t samples);
 
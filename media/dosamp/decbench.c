@@ -0,0 +1,150 @@
+/* dosamp decoder benchmark (Linux host).
+ *
+ * Opens each file given on the command line through the same decoder sources
+ * DOSAMP plays from, decodes all of it, and reports how much CPU time one second
+ * of audio costs. Then seeks to a few places and checks the PCM read there
+ * matches what the straight decode produced at the same offset. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "decsrc.h"
+
+#define BENCH_READ                      (16384U) /* bytes per read(), about what convert_rdbuf_fill() asks for */
+#define BENCH_SEEKS                     (8U)
+
+dosamp_file_source_t dosamp_file_source_file_fd_open(const char * const path);
+
+static double cpu_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static int bench_file(const char * const path) {
+    const struct dosamp_decoder_codec *codec = NULL;
+    dosamp_file_source_t file,pcm;
+    const struct dosamp_decoder *d;
+    unsigned char hdr[16];
+    unsigned char *all = NULL,*chk = NULL;
+    uint64_t len = 0,alloc = 0;
+    unsigned int rd,i,bad = 0;
+    double t_open,t_dec,audio;
+    int ret = 1;
+
+    file = dosamp_file_source_file_fd_open(path);
+    if (file == NULL) {
+        fprintf(stderr,"%s: cannot open\n",path);
+        return 1;
+    }
+    dosamp_file_source_addref(file);
+
+    memset(hdr,0,sizeof(hdr));
+    file->read(file,hdr,sizeof(hdr));
+
+    t_open = cpu_sec();
+    pcm = dosamp_decoder_source_open(file,hdr,sizeof(hdr),&codec);
+    t_open = cpu_sec() - t_open;
+
+    /* the decoder source holds its own reference now */
+    dosamp_file_source_release(file);
+    dosamp_file_source_autofree(&file);
+
+    if (pcm == NULL) {
+        fprintf(stderr,"%s: not a format any decoder accepts\n",path);
+        goto done;
+    }
+    dosamp_file_source_addref(pcm);
+    d = pcm->p.decoder.dec;
+
+    t_dec = cpu_sec();
+    for (;;) {
+        if ((len + BENCH_READ) > alloc) {
+            unsigned char *np;
+
+            alloc += 16UL << 20UL;
+            np = realloc(all,(size_t)alloc);
+            if (np == NULL) {
+                fprintf(stderr,"out of memory\n");
+                goto done;
+            }
+            all = np;
+        }
+
+        rd = pcm->read(pcm,all + len,BENCH_READ);
+        if (rd == dosamp_file_io_err) {
+            fprintf(stderr,"%s: read error\n",path);
+            goto done;
+        }
+        if (rd == 0) break;
+        len += rd;
+    }
+    t_dec = cpu_sec() - t_dec;
+
+    audio = (double)(len / d->fmt.bytes_per_block) / (double)d->fmt.sample_rate;
+    if (audio <= 0) {
+        fprintf(stderr,"%s: no audio\n",path);
+        goto done;
+    }
+
+    if (pcm->file_size >= 0LL && (uint64_t)pcm->file_size != len)
+        printf("%s: WARNING: decoded %llu bytes, length said %llu\n",path,(unsigned long long)len,(unsigned long long)pcm->file_size);
+
+    /* seek to a few places and compare with the straight decode */
+    chk = malloc(BENCH_READ);
+    if (chk == NULL) {
+        fprintf(stderr,"out of memory\n");
+        goto done;
+    }
+
+    srand(1);
+    for (i=0;i < BENCH_SEEKS;i++) {
+        uint64_t at = ((uint64_t)rand() * (uint64_t)rand()) % len;
+        unsigned int n = BENCH_READ;
+
+        at -= at % d->fmt.bytes_per_block;
+        if ((uint64_t)n > (len - at)) n = (unsigned int)(len - at);
+
+        if (pcm->seek(pcm,(dosamp_file_off_t)at) != (dosamp_file_off_t)at || pcm->read(pcm,chk,n) != n || memcmp(chk,all + at,n) != 0)
+            bad++;
+    }
+
+    printf("%-10s %s\n",codec->name,path);
+    printf("  %luHz %u-channel, %.2f sec of audio\n",(unsigned long)d->fmt.sample_rate,(unsigned int)d->fmt.number_of_channels,audio);
+    printf("  open %.2f ms, decode %.2f ms: %.3f ms CPU per second of audio, %.1fx realtime\n",
+        t_open * 1000.0,t_dec * 1000.0,(t_dec * 1000.0) / audio,audio / t_dec);
+    printf("  seek: %u of %u sample exact\n",BENCH_SEEKS - bad,BENCH_SEEKS);
+    ret = 0;
+done:
+    if (pcm != NULL) {
+        dosamp_file_source_release(pcm);
+        dosamp_file_source_autofree(&pcm);
+    }
+    if (all != NULL) free(all);
+    if (chk != NULL) free(chk);
+    return ret;
+}
+
+int main(int argc,char **argv) {
+    int i,ret = 0;
+
+    if (argc < 2) {
+        fprintf(stderr,"decbench <file.mp3|file.flac|file.ogg> [...]\n");
+        return 1;
+    }
+
+    for (i=1;i < argc;i++) {
+        if (bench_file(argv[i]))
+            ret = 1;
+    }
+
+    return ret;
+}
+
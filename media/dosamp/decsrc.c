@@ -0,0 +1,248 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
+#include <errno.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "decsrc.h"
+
+#if defined(HAS_DECODERS)
+
+const struct dosamp_decoder_codec * const dosamp_decoder_codecs[] = {
+    &dosamp_decoder_codec_flac,
+    &dosamp_decoder_codec_ogg,
+    &dosamp_decoder_codec_mp3,     /* last, frame sync is the weakest signature */
+    NULL
+};
+
+int16_t *dosamp_decoder_pcm_reserve(struct dosamp_decoder * const d,const unsigned int frames) {
+    const unsigned int need = d->pcm_len + (frames * d->fmt.bytes_per_block);
+
+    /* slide out what read() already took */
+    if (d->pcm_pos != 0) {
+        if (d->pcm_len > d->pcm_pos)
+            memmove(d->pcm,d->pcm + d->pcm_pos,d->pcm_len - d->pcm_pos);
+
+        d->pcm_len -= d->pcm_pos;
+        d->pcm_pos = 0;
+        return dosamp_decoder_pcm_reserve(d,frames);
+    }
+
+    if (need > d->pcm_alloc) {
+        unsigned char *np;
+        unsigned int na;
+
+        na = (need + 4095U) & (~4095U);
+        np = realloc(d->pcm,na);
+        if (np == NULL) return NULL;
+
+        d->pcm = np;
+        d->pcm_alloc = na;
+    }
+
+    return (int16_t*)(d->pcm + d->pcm_len);
+}
+
+static int dosamp_FAR dosamp_decoder_source_close(dosamp_file_source_t const inst) {
+    struct dosamp_decoder *d = inst->p.decoder.dec;
+
+    if (d != NULL) {
+        if (d->priv != NULL)
+            d->codec->close(d);
+
+        if (d->src != NULL) {
+            dosamp_file_source_release(d->src);
+            dosamp_file_source_autofree(&d->src);
+            d->src = NULL;
+        }
+
+        if (d->pcm != NULL) {
+            free(d->pcm);
+            d->pcm = NULL;
+        }
+
+        free(d);
+        inst->p.decoder.dec = NULL;
+    }
+
+    return 0;/*success*/
+}
+
+static void dosamp_FAR dosamp_decoder_source_free(dosamp_file_source_t const inst) {
+    dosamp_decoder_source_close(inst);
+    dosamp_file_source_free(inst);
+}
+
+static unsigned int dosamp_FAR dosamp_decoder_source_read(dosamp_file_source_t const inst,void dosamp_FAR * buf,unsigned int count) {
+    struct dosamp_decoder *d = inst->p.decoder.dec;
+    unsigned char *dst = (unsigned char*)buf;
+    unsigned int rd = 0,n;
+
+    if (d == NULL || count > dosamp_file_io_maxb)
+        return dosamp_file_io_err;
+
+    /* never run past the length we promised */
+    if (inst->file_size >= 0LL) {
+        if (inst->file_pos >= inst->file_size)
+            return 0;
+        if ((uint64_t)count > (uint64_t)(inst->file_size - inst->file_pos))
+            count = (unsigned int)(inst->file_size - inst->file_pos);
+    }
+
+    while (rd < count) {
+        if (d->pcm_pos >= d->pcm_len) {
+            d->pcm_pos = d->pcm_len = 0;
+
+            if (d->eof || d->codec->decode(d) < 0) {
+                d->eof = 1;
+
+                /* the stream ended early (damaged file). keep the promise with silence
+                 * so the playback code's idea of the file pointer stays valid. */
+                if (inst->file_size < 0LL)
+                    break;
+
+                memset(dst+rd,0,count-rd);
+                rd = count;
+                break;
+            }
+
+            continue;
+        }
+
+        n = d->pcm_len - d->pcm_pos;
+
+        /* finish a seek to the exact sample frame */
+        if (d->skip != 0UL) {
+            if ((uint32_t)n > d->skip) n = (unsigned int)d->skip;
+            d->pcm_pos += n;
+            d->skip -= n;
+            continue;
+        }
+
+        if (n > (count - rd)) n = count - rd;
+        memcpy(dst+rd,d->pcm + d->pcm_pos,n);
+        d->pcm_pos += n;
+        rd += n;
+    }
+
+    inst->file_pos += rd;
+    return rd;
+}
+
+static unsigned int dosamp_FAR dosamp_decoder_source_write(dosamp_file_source_t const inst,const void dosamp_FAR * buf,unsigned int count) {
+    (void)inst;
+    (void)buf;
+    (void)count;
+
+    errno = EIO; /* not implemented */
+    return dosamp_file_io_err;
+}
+
+static dosamp_file_off_t dosamp_FAR dosamp_decoder_source_seek(dosamp_file_source_t const inst,dosamp_file_off_t pos) {
+    struct dosamp_decoder *d = inst->p.decoder.dec;
+    uint64_t frame;
+    int64_t at;
+
+    if (d == NULL || pos == dosamp_file_off_err)
+        return dosamp_file_off_err;
+
+    if (inst->file_size >= 0LL && (uint64_t)pos > (uint64_t)inst->file_size)
+        pos = (dosamp_file_off_t)inst->file_size;
+
+    /* no-op seeks are common (the playback code re-asserts the file pointer after short reads) */
+    if ((int64_t)pos == inst->file_pos)
+        return pos;
+
+    frame = (uint64_t)pos / (uint64_t)d->fmt.bytes_per_block;
+
+    d->pcm_pos = d->pcm_len = 0;
+    d->skip = 0;
+    d->eof = 0;
+
+    at = d->codec->seek(d,frame);
+    if (at < 0LL || (uint64_t)at > frame) {
+        inst->file_pos = -1LL;
+        return dosamp_file_off_err;
+    }
+
+    /* the codec may land early (MP3 needs a few frames of preroll), read() discards the difference */
+    d->skip = (uint32_t)(((frame - (uint64_t)at) * (uint64_t)d->fmt.bytes_per_block) + ((uint64_t)pos % (uint64_t)d->fmt.bytes_per_block));
+    inst->file_pos = (int64_t)pos;
+    return pos;
+}
+
+static const struct dosamp_file_source dosamp_decoder_source_init = {
+    .obj_id =                           dosamp_file_source_id_decoder,
+    .file_size =                        -1LL,
+    .file_pos =                         0,
+    .free =                             dosamp_decoder_source_free,
+    .close =                            dosamp_decoder_source_close,
+    .read =                             dosamp_decoder_source_read,
+    .write =                            dosamp_decoder_source_write,
+    .seek =                             dosamp_decoder_source_seek,
+    .p.decoder.dec =                    NULL
+};
+
+dosamp_file_source_t dosamp_decoder_source_open(dosamp_file_source_t const src,const unsigned char * const hdr,const unsigned int len,const struct dosamp_decoder_codec ** const codec) {
+    const struct dosamp_decoder_codec * const *c;
+    struct dosamp_decoder *d;
+    dosamp_file_source_t inst;
+
+    if (src == NULL || hdr == NULL) return NULL;
+
+    for (c=dosamp_decoder_codecs;*c != NULL;c++) {
+        if (!(*c)->probe(hdr,len))
+            continue;
+        if (src->seek(src,0) != 0)
+            return NULL;
+
+        d = calloc(1,sizeof(*d));
+        if (d == NULL) return NULL;
+        d->codec = *c;
+        d->src = src;
+
+        if ((*c)->open(d) < 0 || d->fmt.sample_rate == 0UL || d->fmt.number_of_channels == 0U) {
+            if (d->priv != NULL) (*c)->close(d);
+            if (d->pcm != NULL) free(d->pcm);
+            free(d);
+            continue;
+        }
+
+        /* every codec hands out 16-bit PCM */
+        d->fmt.bits_per_sample = 16;
+        d->fmt.samples_per_block = 1;
+        d->fmt.bytes_per_block = 2U * d->fmt.number_of_channels;
+
+        inst = dosamp_file_source_alloc(&dosamp_decoder_source_init);
+        if (inst == NULL) {
+            (*c)->close(d);
+            if (d->pcm != NULL) free(d->pcm);
+            free(d);
+            return NULL;
+        }
+
+        dosamp_file_source_addref(src);
+        inst->p.decoder.dec = d;
+        inst->open_flags = src->open_flags;
+        if (d->frames != 0ULL)
+            inst->file_size = (int64_t)(d->frames * (uint64_t)d->fmt.bytes_per_block);
+
+        if (codec != NULL) *codec = *c;
+        return inst;
+    }
+
+    return NULL;
+}
+
+#endif /* HAS_DECODERS */
+
@@ -0,0 +1,69 @@
+
+/* decoder sources.
+ *
+ * A decoder source is a dosamp_file_source whose byte stream is the decoded PCM of a
+ * compressed file (MP3, FLAC, Ogg Vorbis). read() returns 16-bit PCM in the format
+ * reported when opened, seek() takes a byte offset into that PCM, and file_size is the
+ * length of the decoded audio in bytes. To the rest of DOSAMP it looks exactly like
+ * the data chunk of a WAV file starting at offset zero, so decoded audio goes straight
+ * from the codec into convert_rdbuf without any intermediate file.
+ *
+ * WAV files do not go through here, open_wav() reads their data chunk in place. */
+
+/* the codecs need a flat 32-bit address space */
+#if TARGET_MSDOS == 32 || defined(LINUX)
+# define HAS_DECODERS
+#endif
+
+#if defined(HAS_DECODERS)
+
+struct dosamp_decoder;
+
+/* one per codec */
+struct dosamp_decoder_codec {
+    const char*                         name;
+    /* return 1 if the first bytes of the file look like ours */
+    int                                 (*probe)(const unsigned char * const hdr,const unsigned int len);
+    /* d->src is positioned at 0. fill in d->fmt, d->frames and d->priv. 0 = success, -1 = not ours / failure */
+    int                                 (*open)(struct dosamp_decoder * const d);
+    /* append at least one sample frame to d->pcm. 0 = success, -1 = end of stream or error */
+    int                                 (*decode)(struct dosamp_decoder * const d);
+    /* reposition so that decode() resumes at or before sample frame 'frame'.
+     * returns the frame decode() will resume at, or -1LL on failure */
+    int64_t                             (*seek)(struct dosamp_decoder * const d,const uint64_t frame);
+    /* free d->priv */
+    void                                (*close)(struct dosamp_decoder * const d);
+};
+
+struct dosamp_decoder {
+    const struct dosamp_decoder_codec*  codec;
+    dosamp_file_source_t                src;        /* compressed file, we hold a reference */
+    struct wav_cbr_t                    fmt;        /* decoded format, always 16-bit */
+    uint64_t                            frames;     /* total length in sample frames, 0 if unknown */
+    unsigned char*                      pcm;        /* decoded audio not yet returned by read() */
+    unsigned int                        pcm_alloc;  /* in bytes */
+    unsigned int                        pcm_len;    /* in bytes */
+    unsigned int                        pcm_pos;    /* in bytes */
+    uint32_t                            skip;       /* bytes to discard after a seek, to reach the exact frame asked for */
+    unsigned char                       eof;        /* decode() has nothing more to give */
+    void*                               priv;       /* codec state */
+};
+
+extern const struct dosamp_decoder_codec dosamp_decoder_codec_mp3;
+extern const struct dosamp_decoder_codec dosamp_decoder_codec_flac;
+extern const struct dosamp_decoder_codec dosamp_decoder_codec_ogg;
+
+/* NULL terminated, in probe order */
+extern const struct dosamp_decoder_codec * const dosamp_decoder_codecs[];
+
+/* for use by codecs: room for 'frames' more sample frames at the end of d->pcm, NULL if out of memory.
+ * the caller adds what it actually wrote to d->pcm_len */
+int16_t *dosamp_decoder_pcm_reserve(struct dosamp_decoder * const d,const unsigned int frames);
+
+/* probe hdr[] (the first bytes of src) against each codec and open the first one that accepts the file.
+ * returns a new file source (refcount 0) that holds its own reference to src, or NULL.
+ * if codec != NULL, the codec that opened the file is returned there. */
+dosamp_file_source_t dosamp_decoder_source_open(dosamp_file_source_t const src,const unsigned char * const hdr,const unsigned int len,const struct dosamp_decoder_codec ** const codec);
+
+#endif /* HAS_DECODERS */
+
@@ -58,11 +58,14 @@
 #include "timesrc.h"
 #include "dosptrnm.h"
 #include "filesrc.h"
+#include "decsrc.h"
 #include "resample.h"
 #include "cvrdbuf.h"
 #include "cvip.h"
 #include "trkrbase.h"
 #include "tmpbuf.h"
+#include "pcmring.h"
+#include "thrd.h"
 #include "snirq.h"
 #include "sndcard.h"
 #include "termios.h"
@@ -98,6 +101,12 @@
 
 /* file source */
 dosamp_file_source_t dosamp_file_source_file_fd_open(const char * const path);
+#if defined(HAS_FILE_MMAP)
+dosamp_file_source_t dosamp_file_source_file_mmap_open(const char * const path);
+#endif
+#if defined(HAS_FILE_READAHEAD)
+dosamp_file_source_t dosamp_file_source_file_readahead_open(const char * const path);
+#endif
 
 /* tool */
 char                                            str_tmp[256];
@@ -111,6 +120,7 @@ static unsigned char                            prefer_channels = 0;
 static unsigned char                            prefer_bits = 0;
 static unsigned char                            prefer_no_clamp = 0;
 static signed char                              opt_round = -1;
+static unsigned int                             opt_file_source = dosamp_file_source_id_file_fd;
 
 /* DOSAMP debug state */
 static char                                     stuck_test = 0;
@@ -133,7 +143,7 @@ dosamp_file_source_t                            wav_source = NULL;
 char*                                           wav_file = NULL;
 
 /* convert/read buffer */
-struct convert_rdbuf_t                          convert_rdbuf = {NULL,0,0,0};
+struct convert_rdbuf_t                          convert_rdbuf = {NULL,NULL,0,0,0};
 
 struct wav_cbr_t                                file_codec;
 struct wav_cbr_t                                play_codec;
@@ -142,6 +152,7 @@ struct wav_cbr_t                                play_codec;
 static unsigned long                            wav_data_offset = 44;
 static unsigned long                            wav_data_length_bytes = 0;
 static unsigned long                            wav_data_length = 0;/* in samples */
+static uint32_t                                 wav_channel_mask = 0;/* WAVE_FORMAT_EXTENSIBLE speaker mask, 0 if default layout */
 
 /* WAV playback state */
 static unsigned long                            wav_position = 0;/* in samples. read pointer. after reading, points to next sample to read. */
@@ -151,6 +162,32 @@ static unsigned long                            wav_play_position = 0L;
 static unsigned long                            wav_play_load_block_size = 0;/*max load per call*/
 static unsigned long                            wav_play_min_load_size = 0;/*minimum "can write" threshhold to load more*/
 
+#if defined(HAS_THREADS)
+/* producer thread. reads, converts and resamples into producer_ring while the main loop
+ * feeds the sound card from it, so a slow disk or decoder doesn't starve the card. */
+#define PRODUCER_REBASE_MAX                     64
+
+static unsigned char                            use_producer = 1;
+static unsigned char                            producer_running = 0;
+static volatile unsigned char                   producer_stop = 0;
+static dosamp_thread_t                          producer_thread;
+static struct pcm_ring                          producer_ring = {NULL,0,0,0,0};
+static uint32_t                                 producer_chunk_size = 0;/* most to produce per pass */
+static uint32_t                                 producer_min_free = 0;/* don't bother producing until this much is free */
+static uint64_t                                 producer_write_counter = 0;/* bytes the producer has put into the ring */
+static uint64_t                                 producer_read_counter = 0;/* bytes the main loop has taken out of the ring */
+
+/* rebase events from the producer, relative to producer_write_counter.
+ * the main loop turns them into real rebase events (rebase_add() is not thread safe)
+ * when it has written up to that point to the sound card. */
+static struct audio_playback_rebase_t           producer_rebase[PRODUCER_REBASE_MAX];
+static volatile unsigned char                   producer_rebase_read = 0,producer_rebase_write = 0;
+
+/* statistics for display_idle_buffer() */
+static unsigned long                            producer_underruns = 0;
+static unsigned char                            producer_in_underrun = 0;
+#endif
+
 #if defined(HAS_IRQ)
 
 /* WARNING!!! This interrupt handler calls subroutines. To avoid system
@@ -219,9 +256,26 @@ int wav_position_to_file_pointer(void) {
 }
 
 void wav_rebase_position_event(void) {
-    /* make a rebase event */
-    struct audio_playback_rebase_t *r = rebase_add();
+    struct audio_playback_rebase_t *r;
+
+#if defined(HAS_THREADS)
+    if (producer_running) {
+        /* producer thread: queue it for the main loop */
+        const unsigned char w = producer_rebase_write;
+        unsigned char n = w + 1;
 
+        if (n >= PRODUCER_REBASE_MAX) n = 0;
+        if (n == pcm_ring_load_acquire(producer_rebase_read)) return; /* full */
+
+        producer_rebase[w].event_at = producer_write_counter;
+        producer_rebase[w].wav_position = wav_position;
+        pcm_ring_store_release(producer_rebase_write,n);
+        return;
+    }
+#endif
+
+    /* make a rebase event */
+    r = rebase_add();
     if (r != NULL) {
         r->event_at = soundcard->wav_state.write_counter;
         r->wav_position = wav_position;
@@ -244,6 +298,45 @@ int convert_rdbuf_fill(void) {
         if (buf == NULL) return -1;
         of = bufsz;
 
+        /* zero-copy: if there is nothing to convert in place, resample straight out of the file source's mapping */
+        if (wav_source->map != NULL &&
+            file_codec.number_of_channels == play_codec.number_of_channels &&
+            file_codec.bits_per_sample == play_codec.bits_per_sample) {
+            const unsigned char dosamp_FAR *m;
+            unsigned int mlen;
+
+            do {
+                rem = wav_data_length_bytes + wav_data_offset;
+                if ((uint64_t)wav_source->file_pos <= (uint64_t)rem)
+                    rem -= wav_source->file_pos;
+                else
+                    rem = 0;
+
+                /* if we're at the end, seek back around and start again */
+                if (rem < file_codec.bytes_per_block) {
+                    if (wav_rewind() < 0) return -1;
+                    wav_rebase_position_event();
+                }
+            } while (rem < file_codec.bytes_per_block);
+
+            mlen = (rem > bufsz) ? bufsz : (unsigned int)rem;
+            m = wav_source->map(wav_source,&mlen);
+            mlen -= mlen % file_codec.bytes_per_block;
+
+            if (m != NULL && mlen != 0) {
+                rem = wav_source->file_pos + mlen;
+                if (wav_source->seek(wav_source,rem) != rem)
+                    return -1;
+
+                convert_rdbuf.data = m;
+                convert_rdbuf.len = mlen;
+                wav_file_pointer_to_position();
+                return 0;
+            }
+        }
+
+        convert_rdbuf.data = convert_rdbuf.buffer;
+
         /* factor buffer size into upconversion: mono to stereo */
         if (play_codec.number_of_channels > file_codec.number_of_channels) {
             bufsz *= file_codec.number_of_channels;
@@ -302,17 +395,24 @@ int convert_rdbuf_fill(void) {
 
         samples = (uint32_t)convert_rdbuf.len / (uint32_t)file_codec.bytes_per_block;
 
-        /* channel conversion */
-        if (file_codec.number_of_channels == 2 && play_codec.number_of_channels == 1)
-            convert_rdbuf.len = convert_ip_stereo2mono(samples,convert_rdbuf.buffer,of,file_codec.bits_per_sample);
-        else if (file_codec.number_of_channels == 1 && play_codec.number_of_channels == 2)
-            convert_rdbuf.len = convert_ip_mono2stereo(samples,convert_rdbuf.buffer,of,file_codec.bits_per_sample);
-
-        /* bit conversion */
-        if (file_codec.bits_per_sample == 16 && play_codec.bits_per_sample == 8)
-            convert_rdbuf.len = convert_ip_16_to_8(samples * play_codec.number_of_channels,convert_rdbuf.buffer,of);
-        else if (file_codec.bits_per_sample == 8 && play_codec.bits_per_sample == 16)
-            convert_rdbuf.len = convert_ip_8_to_16(samples * play_codec.number_of_channels,convert_rdbuf.buffer,of);
+        if (file_codec.number_of_channels != play_codec.number_of_channels &&
+            (file_codec.number_of_channels > 2 || play_codec.number_of_channels > 2)) {
+            /* multichannel: downmix/upmix matrix and bit conversion, one pass */
+            convert_rdbuf.len = convert_ip_matrix(&convert_ip_matrix_state,samples,convert_rdbuf.buffer,of);
+        }
+        else {
+            /* channel conversion */
+            if (file_codec.number_of_channels == 2 && play_codec.number_of_channels == 1)
+                convert_rdbuf.len = convert_ip_stereo2mono(samples,convert_rdbuf.buffer,of,file_codec.bits_per_sample);
+            else if (file_codec.number_of_channels == 1 && play_codec.number_of_channels == 2)
+                convert_rdbuf.len = convert_ip_mono2stereo(samples,convert_rdbuf.buffer,of,file_codec.bits_per_sample);
+
+            /* bit conversion */
+            if (file_codec.bits_per_sample == 16 && play_codec.bits_per_sample == 8)
+                convert_rdbuf.len = convert_ip_16_to_8(samples * play_codec.number_of_channels,convert_rdbuf.buffer,of);
+            else if (file_codec.bits_per_sample == 8 && play_codec.bits_per_sample == 16)
+                convert_rdbuf.len = convert_ip_8_to_16(samples * play_codec.number_of_channels,convert_rdbuf.buffer,of);
+        }
 
         assert(convert_rdbuf.len <= of);
     }
@@ -320,6 +420,88 @@ int convert_rdbuf_fill(void) {
     return 0;
 }
 
+/* resample from convert_rdbuf into ptr, up to bsz bytes. returns sample blocks written. */
+static uint32_t resample_audio(unsigned char dosamp_FAR * const ptr,const uint32_t bsz) {
+    uint32_t dop = 0;
+
+    if (resample_state.resample_mode == resample_fast) {
+        if (play_codec.bits_per_sample > 8) {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_fast_to_16_multi((int16_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_fast_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
+            else
+                dop = convert_rdbuf_resample_fast_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
+        }
+        else {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_fast_to_8_multi((uint8_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_fast_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
+            else
+                dop = convert_rdbuf_resample_fast_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
+        }
+    }
+    else if (resample_state.resample_mode == resample_good) {
+        if (play_codec.bits_per_sample > 8) {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_to_16_multi((int16_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
+            else
+                dop = convert_rdbuf_resample_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
+        }
+        else {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_to_8_multi((uint8_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
+            else
+                dop = convert_rdbuf_resample_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
+        }
+    }
+    else if (resample_state.resample_mode == resample_best) {
+        if (play_codec.bits_per_sample > 8) {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_best_to_16_multi((int16_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_best_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
+            else
+                dop = convert_rdbuf_resample_best_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
+        }
+        else {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_best_to_8_multi((uint8_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_best_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
+            else
+                dop = convert_rdbuf_resample_best_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
+        }
+    }
+#if defined(RESAMPLE_SINC)
+    else if (resample_state.resample_mode == resample_sinc) {
+        if (play_codec.bits_per_sample > 8) {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_sinc_to_16_multi((int16_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_sinc_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
+            else
+                dop = convert_rdbuf_resample_sinc_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
+        }
+        else {
+            if (play_codec.number_of_channels > 2)
+                dop = convert_rdbuf_resample_sinc_to_8_multi((uint8_t dosamp_FAR*)ptr,bsz / (uint32_t)play_codec.bytes_per_block);
+            else if (play_codec.number_of_channels == 2)
+                dop = convert_rdbuf_resample_sinc_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
+            else
+                dop = convert_rdbuf_resample_sinc_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
+        }
+    }
+#endif
+
+    return dop;
+}
+
 static void load_audio_convert(uint32_t howmuch/*in bytes*/) {
     unsigned char dosamp_FAR * ptr;
     uint32_t dop,bsz;
@@ -351,7 +533,7 @@ static void load_audio_convert(uint32_t howmuch/*in bytes*/) {
             if (dop == 0)
                 break;
 
-            if (soundcard->write(soundcard,dosamp_ptr_add_normalize(convert_rdbuf.buffer,convert_rdbuf.pos),dop) != dop)
+            if (soundcard->write(soundcard,dosamp_cptr_add_normalize(convert_rdbuf.data,convert_rdbuf.pos),dop) != dop)
                 break;
 
             convert_rdbuf.pos += dop;
@@ -360,51 +542,7 @@ static void load_audio_convert(uint32_t howmuch/*in bytes*/) {
             avail -= dop;
         }
         else {
-            if (resample_state.resample_mode == resample_fast) {
-                if (play_codec.bits_per_sample > 8) {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_fast_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
-                    else
-                        dop = convert_rdbuf_resample_fast_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
-                }
-                else {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_fast_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
-                    else
-                        dop = convert_rdbuf_resample_fast_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
-                }
-            }
-            else if (resample_state.resample_mode == resample_good) {
-                if (play_codec.bits_per_sample > 8) {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
-                    else
-                        dop = convert_rdbuf_resample_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
-                }
-                else {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
-                    else
-                        dop = convert_rdbuf_resample_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
-                }
-            }
-            else if (resample_state.resample_mode == resample_best) {
-                if (play_codec.bits_per_sample > 8) {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_best_to_16_stereo((int16_t dosamp_FAR*)ptr,bsz / 4UL);
-                    else
-                        dop = convert_rdbuf_resample_best_to_16_mono((int16_t dosamp_FAR*)ptr,bsz / 2UL);
-                }
-                else {
-                    if (play_codec.number_of_channels == 2)
-                        dop = convert_rdbuf_resample_best_to_8_stereo((uint8_t dosamp_FAR*)ptr,bsz / 2UL);
-                    else
-                        dop = convert_rdbuf_resample_best_to_8_mono((uint8_t dosamp_FAR*)ptr,bsz);
-                }
-            }
-            else {
-                dop = 0;
-            }
+            dop = resample_audio(ptr,bsz);
 
             assert(convert_rdbuf.pos <= convert_rdbuf.len);
 
@@ -460,6 +598,29 @@ static void load_audio_copy(uint32_t howmuch/*in bytes*/) { /* load audio up to
             if (ptr == NULL || towrite == 0) break;
         }
         else {
+            /* zero-copy: straight from the file source's mapping to the sound card */
+            if (wav_source->map != NULL) {
+                const unsigned char dosamp_FAR *m;
+                unsigned int mlen = (unsigned int)rem;
+
+                m = wav_source->map(wav_source,&mlen);
+                mlen -= mlen % play_codec.bytes_per_block;
+
+                if (m != NULL && mlen != 0) {
+                    towrite = soundcard->write(soundcard,m,mlen);
+                    if (towrite == 0) break;
+
+                    rem = wav_source->file_pos + towrite;
+                    if (wav_source->seek(wav_source,rem) != rem)
+                        break;
+
+                    wav_file_pointer_to_position();
+                    howmuch -= towrite;
+                    if (towrite != mlen) break;
+                    continue;
+                }
+            }
+
             /* prepare the temp buffer, limit ourself to it */
             ptr = tmpbuffer_get(&towrite);
             if (ptr == NULL) break;
@@ -497,7 +658,242 @@ static void load_audio_copy(uint32_t howmuch/*in bytes*/) { /* load audio up to
         soundcard->clamp_if_behind(soundcard,wav_play_min_load_size);
 }
 
+#if defined(HAS_THREADS)
+/* producer thread: convert into the ring. returns bytes written to ptr. */
+static uint32_t producer_convert(unsigned char * const ptr,const uint32_t len) {
+    uint32_t dop;
+
+    if (convert_rdbuf_fill() < 0) return 0;
+
+    if (resample_state.step == resample_100) {
+        /* don't do full resampling if no resampling needed */
+        if (convert_rdbuf.pos < convert_rdbuf.len)
+            dop = convert_rdbuf.len - convert_rdbuf.pos;
+        else
+            dop = 0;
+
+        if (dop > len) dop = len;
+        dop -= dop % play_codec.bytes_per_block;
+
+        if (dop != 0) {
+            memcpy(ptr,convert_rdbuf.data + convert_rdbuf.pos,dop);
+            convert_rdbuf.pos += dop;
+        }
+    }
+    else {
+        dop = resample_audio(ptr,len) * play_codec.bytes_per_block;
+    }
+
+    assert(convert_rdbuf.pos <= convert_rdbuf.len);
+    return dop;
+}
+
+/* producer thread: copy from the file into the ring. returns bytes written to ptr. */
+static uint32_t producer_copy(unsigned char * const ptr,const uint32_t len) {
+    dosamp_file_off_t rem;
+    uint32_t towrite;
+
+    do {
+        rem = wav_data_length_bytes + wav_data_offset;
+        if ((uint64_t)wav_source->file_pos <= (uint64_t)rem)
+            rem -= wav_source->file_pos;
+        else
+            rem = 0;
+
+        /* if we're at the end, seek back around and start again */
+        if (rem < play_codec.bytes_per_block) {
+            if (wav_rewind() < 0) return 0;
+            wav_rebase_position_event();
+        }
+    } while (rem < play_codec.bytes_per_block);
+
+    if (rem > len) rem = len;
+    rem -= rem % play_codec.bytes_per_block;
+    if (rem == 0) return 0;
+    towrite = (uint32_t)rem;
+
+    /* read */
+    rem = wav_source->file_pos + towrite; /* expected result pos */
+    if (wav_source->read(wav_source,ptr,towrite) != towrite) {
+        if (wav_source->seek(wav_source,rem) != rem)
+            return 0;
+        if (wav_file_pointer_to_position() < 0)
+            return 0;
+        wav_rebase_position_event();
+        if (wav_position_to_file_pointer() < 0)
+            return 0;
+    }
+
+    /* adjust */
+    wav_file_pointer_to_position();
+    return towrite;
+}
+
+static void producer_main(void *arg) {
+    unsigned char *ptr;
+    uint32_t len,done;
+    int pending;
+
+    (void)arg;
+
+    while (!producer_stop) {
+        /* wait for room in the ring, and for the main loop to take the rebase events */
+        pending = (int)producer_rebase_write - (int)pcm_ring_load_acquire(producer_rebase_read);
+        if (pending < 0) pending += PRODUCER_REBASE_MAX;
+        if (pending >= (PRODUCER_REBASE_MAX / 2) ||
+            (producer_ring.size - producer_ring.block - pcm_ring_used(&producer_ring)) < producer_min_free) {
+            dosamp_thread_sleep(5);
+            continue;
+        }
+
+        /* the span may stop short at the end of the buffer. fill it anyway, the next one starts at the beginning */
+        ptr = pcm_ring_write_ptr(&producer_ring,&len);
+        if (len > producer_chunk_size) len = producer_chunk_size;
+
+        if (resample_on)
+            done = producer_convert(ptr,len);
+        else
+            done = producer_copy(ptr,len);
+
+        if (done == 0) {
+            /* read error. try again later, the main loop will count the underrun if it comes to that */
+            dosamp_thread_sleep(10);
+            continue;
+        }
+
+        /* count before publishing, so rebase events made during the next pass are at the right place */
+        producer_write_counter += done;
+        pcm_ring_commit(&producer_ring,done);
+    }
+}
+
+/* main loop: pass rebase events the sound card has caught up to on to the real rebase list */
+static void producer_drain_rebase(void) {
+    struct audio_playback_rebase_t *r;
+    unsigned char i = producer_rebase_read;
+
+    while (i != pcm_ring_load_acquire(producer_rebase_write) && producer_rebase[i].event_at <= producer_read_counter) {
+        r = rebase_add();
+        if (r != NULL) {
+            r->event_at = soundcard->wav_state.write_counter;
+            r->wav_position = producer_rebase[i].wav_position;
+        }
+
+        if (++i >= PRODUCER_REBASE_MAX) i = 0;
+        pcm_ring_store_release(producer_rebase_read,i);
+    }
+}
+
+/* main loop: bytes until the next pending rebase event, or ~0 if none */
+static uint32_t producer_next_rebase(void) {
+    const unsigned char i = producer_rebase_read;
+
+    if (i == pcm_ring_load_acquire(producer_rebase_write))
+        return ~((uint32_t)0);
+
+    return (uint32_t)(producer_rebase[i].event_at - producer_read_counter);
+}
+
+static int producer_start(void) {
+    uint32_t sz;
+
+    if (producer_running) return 0;
+
+    /* ~500ms of audio in the ring, produced ~50ms at a time once at least ~25ms is free */
+    sz = (play_codec.sample_rate / 2UL / play_codec.samples_per_block) * play_codec.bytes_per_block;
+    if (pcm_ring_alloc(&producer_ring,sz,play_codec.bytes_per_block) < 0)
+        return -1;
+
+    producer_chunk_size = (play_codec.sample_rate / 20UL / play_codec.samples_per_block) * play_codec.bytes_per_block;
+    if (producer_chunk_size < play_codec.bytes_per_block) producer_chunk_size = play_codec.bytes_per_block;
+    producer_min_free = producer_chunk_size / 2UL;
+    producer_min_free -= producer_min_free % play_codec.bytes_per_block;
+    if (producer_min_free < play_codec.bytes_per_block) producer_min_free = play_codec.bytes_per_block;
+
+    producer_write_counter = 0;
+    producer_read_counter = 0;
+    producer_rebase_read = producer_rebase_write = 0;
+    producer_in_underrun = 0;
+    producer_stop = 0;
+
+    /* must be set before the thread runs, wav_rebase_position_event() checks it */
+    producer_running = 1;
+    if (dosamp_thread_create(&producer_thread,producer_main,NULL) < 0) {
+        producer_running = 0;
+        pcm_ring_free(&producer_ring);
+        return -1;
+    }
+
+    /* wait (not forever) for enough to preroll */
+    for (sz=0;sz < 100U && pcm_ring_used(&producer_ring) < wav_play_load_block_size &&
+        pcm_ring_used(&producer_ring) < (producer_ring.size - producer_ring.block - producer_min_free);sz++)
+        dosamp_thread_sleep(2);
+
+    return 0;
+}
+
+static void producer_end(void) {
+    if (!producer_running) return;
+
+    producer_stop = 1;
+    dosamp_thread_join(&producer_thread);
+    producer_running = 0;
+
+    /* anything still in the ring is thrown away, stop_play() works from what was played */
+    producer_drain_rebase();
+    pcm_ring_free(&producer_ring);
+}
+
+static void load_audio_ring(uint32_t howmuch/*in bytes*/) { /* load audio from the producer up to point or max */
+    const unsigned char *ptr;
+    uint32_t avail,len,wr;
+
+    avail = soundcard->can_write(soundcard);
+
+    if (howmuch > avail) howmuch = avail;
+    if (howmuch < wav_play_min_load_size) return;
+
+    while (howmuch > 0) {
+        producer_drain_rebase();
+
+        ptr = pcm_ring_read_ptr(&producer_ring,&len);
+        if (len == 0) break;
+
+        /* stop at the next rebase event so it is placed exactly */
+        wr = producer_next_rebase();
+        if (len > wr) len = wr;
+        if (len > howmuch) len = howmuch;
+        if (len == 0) break;
+
+        wr = soundcard->write(soundcard,ptr,len);
+        pcm_ring_consume(&producer_ring,wr);
+        producer_read_counter += wr;
+        howmuch -= wr;
+        if (wr != len) break;
+    }
+
+    /* ran out of ring while the card is nearly out too: that's an underrun, count once per episode */
+    if (howmuch > 0 && soundcard->wav_state.play_delay_bytes < wav_play_min_load_size) {
+        if (!producer_in_underrun) {
+            producer_in_underrun = 1;
+            producer_underruns++;
+        }
+    }
+    else {
+        producer_in_underrun = 0;
+    }
+
+    if (!prefer_no_clamp)
+        soundcard->clamp_if_behind(soundcard,wav_play_min_load_size);
+}
+#endif
+
 static void load_audio(uint32_t howmuch/*in bytes*/) { /* load audio up to point or max */
+#if defined(HAS_THREADS)
+    if (producer_running)
+        load_audio_ring(howmuch);
+    else
+#endif
     if (resample_on)
         load_audio_convert(howmuch);
     else
@@ -549,7 +945,10 @@ static void wav_idle() {
     if (!soundcard->wav_state.playing || wav_source == NULL)
         return;
 
-    /* debug */
+    /* debug (the producer thread owns convert_rdbuf while it runs) */
+#if defined(HAS_THREADS)
+    if (!producer_running)
+#endif
     convert_rdbuf_check();
 
     /* update card state */
@@ -571,6 +970,50 @@ static void close_wav() {
     }
 }
 
+#if defined(HAS_DECODERS)
+/* replace wav_source with a decoder source reading from it, and take the format from the decoder */
+static int open_wav_decoder(const unsigned char * const hdr,const unsigned int len) {
+    const struct dosamp_decoder_codec *codec = NULL;
+    dosamp_file_source_t pcm;
+
+    pcm = dosamp_decoder_source_open(wav_source,hdr,len,&codec);
+    if (pcm == NULL) return -1;
+
+    /* the decoder holds its own reference to the file */
+    dosamp_file_source_release(wav_source);
+    wav_source = pcm;
+    dosamp_file_source_addref(wav_source);
+
+    /* decoded audio can't be played until we know how long it is */
+    if (wav_source->file_size <= 0LL || (uint64_t)wav_source->file_size > (uint64_t)ULONG_MAX)
+        return -1;
+
+    file_codec = pcm->p.decoder.dec->fmt;
+    wav_data_offset = 0;
+    wav_data_length_bytes = (unsigned long)wav_source->file_size;
+    wav_data_length = wav_data_length_bytes;
+
+    printf("%s decoder\n",codec->name);
+    return 0;
+}
+#endif
+
+/* the file source chosen by the user, or plain file I/O if that one can't open it */
+static dosamp_file_source_t open_wav_file_source(const char * const path) {
+    dosamp_file_source_t r = NULL;
+
+#if defined(HAS_FILE_MMAP)
+    if (opt_file_source == dosamp_file_source_id_file_mmap && (r=dosamp_file_source_file_mmap_open(path)) != NULL)
+        return r;
+#endif
+#if defined(HAS_FILE_READAHEAD)
+    if (opt_file_source == dosamp_file_source_id_file_readahead && (r=dosamp_file_source_file_readahead_open(path)) != NULL)
+        return r;
+#endif
+
+    return dosamp_file_source_file_fd_open(path);
+}
+
 static int open_wav() {
     char tmp[64];
 
@@ -580,17 +1023,26 @@ static int open_wav() {
         wav_position = 0;
         wav_data_offset = 0;
         wav_data_length = 0;
+        wav_channel_mask = 0;
         if (wav_file == NULL) return -1;
         if (strlen(wav_file) < 1) return -1;
 
-        wav_source = dosamp_file_source_file_fd_open(wav_file);
+        wav_source = open_wav_file_source(wav_file);
         if (wav_source == NULL) return -1;
         dosamp_file_source_addref(wav_source);
 
         /* first, the RIFF:WAVE chunk */
         /* 3 DWORDS: 'RIFF' <length> 'WAVE' */
         if (wav_source->read(wav_source,tmp,12) != 12) goto fail;
-        if (memcmp(tmp+0,"RIFF",4) || memcmp(tmp+8,"WAVE",4)) goto fail;
+        if (memcmp(tmp+0,"RIFF",4) || memcmp(tmp+8,"WAVE",4)) {
+#if defined(HAS_DECODERS)
+            /* not WAV, maybe something we can decode */
+            if (open_wav_decoder((const unsigned char*)tmp,12) < 0) goto fail;
+            goto opened;
+#else
+            goto fail;
+#endif
+        }
 
         scan = 12;
         riff_length = *((uint32_t*)(tmp+4));
@@ -618,9 +1070,19 @@ static int open_wav() {
                             file_codec.samples_per_block = 1;
 
                             if (file_codec.sample_rate >= 1000UL && file_codec.sample_rate <= 96000UL) {
-                                if (le16toh(wfx->wFormatTag) == windows_WAVE_FORMAT_PCM) {
+                                uint16_t tag = le16toh(wfx->wFormatTag);
+
+                                /* WAVE_FORMAT_EXTENSIBLE: the real format tag is in the SubFormat GUID, plus a speaker mask */
+                                if (tag == windows_WAVE_FORMAT_EXTENSIBLE && len >= sizeof(windows_WAVEFORMATEXTENSIBLE)) {
+                                    windows_WAVEFORMATEXTENSIBLE *wfe = (windows_WAVEFORMATEXTENSIBLE*)tmp;
+
+                                    tag = le16toh(*((uint16_t*)(wfe->SubFormat)));
+                                    wav_channel_mask = le32toh(wfe->dwChannelMask);
+                                }
+
+                                if (tag == windows_WAVE_FORMAT_PCM) {
                                     if ((file_codec.bits_per_sample >= 8U && file_codec.bits_per_sample <= 16U) &&
-                                        (file_codec.number_of_channels >= 1U && file_codec.number_of_channels <= 2U)) {
+                                        (file_codec.number_of_channels >= 1U && file_codec.number_of_channels <= convert_ip_matrix_max_channels)) {
                                         file_codec.bytes_per_block =
                                             ((file_codec.bits_per_sample + 7U) >> 3U) *
                                             file_codec.number_of_channels;
@@ -644,6 +1106,9 @@ static int open_wav() {
         if (file_codec.sample_rate == 0UL || wav_data_length == 0UL || wav_data_length_bytes == 0UL) goto fail;
     }
 
+#if defined(HAS_DECODERS)
+opened:
+#endif
     /* convert length to samples */
     wav_data_length /= file_codec.bytes_per_block;
     wav_data_length *= file_codec.samples_per_block;
@@ -714,6 +1179,12 @@ static int begin_play() {
     if (resampler_init(&resample_state,&play_codec,&file_codec) < 0)
         goto error_out;
 
+    /* and the channel matrix, if either side is multichannel */
+    if (convert_ip_matrix_init(&convert_ip_matrix_state,
+        play_codec.number_of_channels,0,play_codec.bits_per_sample,
+        file_codec.number_of_channels,wav_channel_mask,file_codec.bits_per_sample) < 0)
+        goto error_out;
+
     /* prepare buffer */
     if (prepare_buffer() < 0)
         goto error_out;
@@ -771,6 +1242,11 @@ static int begin_play() {
     /* preroll */
     wav_position_to_file_pointer();
     wav_rebase_position_event();
+#if defined(HAS_THREADS)
+    /* if the thread can't start, load from the idle loop like the other targets */
+    if (use_producer && producer_start() < 0)
+        printf("Unable to start producer thread\n");
+#endif
     load_audio(wav_play_load_block_size);
     update_play_position();
 
@@ -780,6 +1256,9 @@ static int begin_play() {
 
     return 0;
 error_out:
+#if defined(HAS_THREADS)
+    producer_end();
+#endif
     soundcard->ioctl(soundcard,soundcard_ioctl_stop_play,NULL,NULL,0);
     soundcard->ioctl(soundcard,soundcard_ioctl_unprepare_play,NULL,NULL,0);
 #if defined(HAS_IRQ)
@@ -792,6 +1271,9 @@ static void stop_play() {
     if (!soundcard->wav_state.playing) return;
 
     /* stop */
+#if defined(HAS_THREADS)
+    producer_end();
+#endif
     soundcard->ioctl(soundcard,soundcard_ioctl_stop_play,NULL,NULL,0);
     soundcard->ioctl(soundcard,soundcard_ioctl_unprepare_play,NULL,NULL,0);
 #if defined(HAS_IRQ)
@@ -805,6 +1287,12 @@ static void stop_play() {
 static void help() {
     printf("dosamp [options] <file>\n");
     printf(" /h /help             This help\n");
+#if defined(HAS_THREADS)
+    printf(" /nothread            Convert in the main loop, no producer thread\n");
+#endif
+#if defined(HAS_FILE_MMAP) || defined(HAS_FILE_READAHEAD)
+    printf(" /fs <fd|mmap|ra>     File source: plain reads, memory mapped, read-ahead thread\n");
+#endif
 }
 
 char *prompt_open_file(void) {
@@ -870,6 +1358,27 @@ static int parse_argv(int argc,char **argv) {
             else if (!strcmp(a,"nc")) {
                 prefer_no_clamp = 1;
             }
+#if defined(HAS_THREADS)
+            else if (!strcmp(a,"nothread")) {
+                use_producer = 0;
+            }
+#endif
+            else if (!strcmp(a,"fs")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                if (!strcmp(a,"fd"))
+                    opt_file_source = dosamp_file_source_id_file_fd;
+#if defined(HAS_FILE_MMAP)
+                else if (!strcmp(a,"mmap"))
+                    opt_file_source = dosamp_file_source_id_file_mmap;
+#endif
+#if defined(HAS_FILE_READAHEAD)
+                else if (!strcmp(a,"ra"))
+                    opt_file_source = dosamp_file_source_id_file_readahead;
+#endif
+                else
+                    return 0;
+            }
             else {
                 return 0;
             }
@@ -1022,6 +1531,19 @@ void display_idle_buffer(void) {
             (unsigned long)soundcard->wav_state.play_counter,
             (unsigned long)irq_counter);
 
+#if defined(HAS_THREADS)
+    /* ring fill and total latency (ring + card) in ms, and how many times the card ran dry waiting on the producer */
+    if (producer_running) {
+        const unsigned long bps = (unsigned long)play_codec.sample_rate * (unsigned long)play_codec.bytes_per_block;
+        const unsigned long rb = (unsigned long)pcm_ring_used(&producer_ring);
+
+        printf("/ur=%lu/rb=%4lums/lat=%4lums",
+            producer_underruns,
+            (unsigned long)(((unsigned long long)rb * 1000ULL) / bps),
+            (unsigned long)(((unsigned long long)(rb + soundcard->wav_state.play_delay_bytes) * 1000ULL) / bps));
+    }
+#endif
+
     fflush(stdout);
 }
 
@@ -1586,6 +2108,9 @@ int main(int argc,char **argv,char **envp) {
     free_dma_buffer();
 #endif
     convert_rdbuf_free();
+#if defined(RESAMPLE_SINC)
+    resample_sinc_free();
+#endif
     close_soundcard();
 
 #if defined(HAS_SNDSB)
@@ -118,6 +118,24 @@
 /* no */
 #endif
 
+/* platform has threads (for the producer thread).
+ * Win32s and Win386 do not, and neither does MS-DOS */
+#if defined(LINUX)
+# define HAS_THREADS
+#elif defined(TARGET_WINDOWS) && TARGET_MSDOS == 32 && TARGET_WINDOWS >= 40 && !defined(WIN386)
+# define HAS_THREADS
+#else
+/* no */
+#endif
+
+/* platform can memory map files, and read ahead of playback on another thread, for the file sources */
+#if defined(LINUX)
+# define HAS_FILE_MMAP
+# define HAS_FILE_READAHEAD
+#else
+/* no */
+#endif
+
 #ifdef USE_WINFCON
 # include <hw/dos/winfcon.h>
 #endif
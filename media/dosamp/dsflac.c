@@ -0,0 +1,246 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "decsrc.h"
+
+#if defined(HAS_DECODERS)
+
+#include <ext/flac/stream_decoder.h>
+
+/* FLAC through libFLAC's stream decoder, reading through our file source.
+ * The length comes from STREAMINFO, seeking is libFLAC's own (which uses the
+ * SEEKTABLE if there is one, and lands on the exact sample either way). */
+
+struct dsflac_state {
+    FLAC__StreamDecoder*                dec;
+    unsigned int                        bits;       /* bits per sample in the file */
+    unsigned char                       error;
+};
+
+static int dsflac_probe(const unsigned char * const hdr,const unsigned int len) {
+    return (len >= 4 && !memcmp(hdr,"fLaC",4)) ? 1 : 0;
+}
+
+static FLAC__StreamDecoderReadStatus dsflac_read_cb(const FLAC__StreamDecoder *dec,FLAC__byte buffer[],size_t *bytes,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+    unsigned int rd;
+
+    (void)dec;
+
+    if (*bytes == 0)
+        return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+
+    rd = d->src->read(d->src,buffer,*bytes > 65536U ? 65536U : (unsigned int)(*bytes));
+    if (rd == dosamp_file_io_err)
+        return FLAC__STREAM_DECODER_READ_STATUS_ABORT;
+
+    *bytes = rd;
+    return rd == 0 ? FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM : FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+static FLAC__StreamDecoderSeekStatus dsflac_seek_cb(const FLAC__StreamDecoder *dec,FLAC__uint64 absolute_byte_offset,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+
+    (void)dec;
+
+    if (d->src->seek(d->src,(dosamp_file_off_t)absolute_byte_offset) != (dosamp_file_off_t)absolute_byte_offset)
+        return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+
+    return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamDecoderTellStatus dsflac_tell_cb(const FLAC__StreamDecoder *dec,FLAC__uint64 *absolute_byte_offset,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+
+    (void)dec;
+
+    if (d->src->file_pos < 0LL)
+        return FLAC__STREAM_DECODER_TELL_STATUS_ERROR;
+
+    *absolute_byte_offset = (FLAC__uint64)d->src->file_pos;
+    return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamDecoderLengthStatus dsflac_length_cb(const FLAC__StreamDecoder *dec,FLAC__uint64 *stream_length,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+
+    (void)dec;
+
+    if (d->src->file_size < 0LL)
+        return FLAC__STREAM_DECODER_LENGTH_STATUS_UNSUPPORTED;
+
+    *stream_length = (FLAC__uint64)d->src->file_size;
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+static FLAC__bool dsflac_eof_cb(const FLAC__StreamDecoder *dec,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+
+    (void)dec;
+
+    if (d->src->file_size < 0LL || d->src->file_pos < 0LL)
+        return false;
+
+    return d->src->file_pos >= d->src->file_size ? true : false;
+}
+
+static FLAC__StreamDecoderWriteStatus dsflac_write_cb(const FLAC__StreamDecoder *dec,const FLAC__Frame *frame,const FLAC__int32 * const buffer[],void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+    const unsigned int n = frame->header.blocksize;
+    const unsigned int ch = d->fmt.number_of_channels;
+    unsigned int i,c;
+    int16_t *o;
+
+    (void)dec;
+
+    /* the format can't change under the playback code */
+    if (frame->header.channels != ch || frame->header.bits_per_sample != s->bits)
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    if ((o=dosamp_decoder_pcm_reserve(d,n)) == NULL)
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    /* FLAC channel order for 3-8 channels is the same as WAVE_FORMAT_EXTENSIBLE's default order */
+    if (s->bits > 16U) {
+        const unsigned int shf = s->bits - 16U;
+
+        for (i=0;i < n;i++) {
+            for (c=0;c < ch;c++) *o++ = (int16_t)(buffer[c][i] >> shf);
+        }
+    }
+    else {
+        const unsigned int shf = 16U - s->bits;
+
+        for (i=0;i < n;i++) {
+            for (c=0;c < ch;c++) *o++ = (int16_t)(buffer[c][i] << shf);
+        }
+    }
+
+    d->pcm_len += n * d->fmt.bytes_per_block;
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+static void dsflac_metadata_cb(const FLAC__StreamDecoder *dec,const FLAC__StreamMetadata *metadata,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+
+    (void)dec;
+
+    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
+        d->fmt.sample_rate = metadata->data.stream_info.sample_rate;
+        d->fmt.number_of_channels = (uint8_t)metadata->data.stream_info.channels;
+        d->frames = metadata->data.stream_info.total_samples;
+        s->bits = metadata->data.stream_info.bits_per_sample;
+    }
+}
+
+static void dsflac_error_cb(const FLAC__StreamDecoder *dec,FLAC__StreamDecoderErrorStatus status,void *client_data) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)client_data;
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+
+    (void)dec;
+    (void)status;
+
+    /* libFLAC resyncs on its own, note it and carry on */
+    s->error = 1;
+}
+
+static void dsflac_close(struct dosamp_decoder * const d) {
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+
+    if (s != NULL) {
+        if (s->dec != NULL) {
+            FLAC__stream_decoder_finish(s->dec);
+            FLAC__stream_decoder_delete(s->dec);
+        }
+        free(s);
+        d->priv = NULL;
+    }
+}
+
+static int dsflac_open(struct dosamp_decoder * const d) {
+    struct dsflac_state *s;
+
+    s = calloc(1,sizeof(*s));
+    if (s == NULL) return -1;
+    d->priv = s;
+
+    s->dec = FLAC__stream_decoder_new();
+    if (s->dec == NULL) return -1;
+
+    /* MD5 checking needs the whole stream decoded in order, which seeking breaks anyway */
+    FLAC__stream_decoder_set_md5_checking(s->dec,false);
+
+    if (FLAC__stream_decoder_init_stream(s->dec,
+        dsflac_read_cb,dsflac_seek_cb,dsflac_tell_cb,dsflac_length_cb,dsflac_eof_cb,
+        dsflac_write_cb,dsflac_metadata_cb,dsflac_error_cb,d) != FLAC__STREAM_DECODER_INIT_STATUS_OK)
+        return -1;
+
+    if (!FLAC__stream_decoder_process_until_end_of_metadata(s->dec))
+        return -1;
+
+    if (s->bits < 4U || s->bits > 32U || d->fmt.number_of_channels > 8U)
+        return -1;
+
+    return 0;
+}
+
+static int dsflac_decode(struct dosamp_decoder * const d) {
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+    const unsigned int before = d->pcm_len;
+
+    /* one call decodes one frame, or one metadata block, or nothing at the end */
+    do {
+        if (FLAC__stream_decoder_get_state(s->dec) == FLAC__STREAM_DECODER_END_OF_STREAM)
+            return -1;
+        if (!FLAC__stream_decoder_process_single(s->dec))
+            return -1;
+    } while (d->pcm_len == before);
+
+    return 0;
+}
+
+static int64_t dsflac_seek(struct dosamp_decoder * const d,const uint64_t frame) {
+    struct dsflac_state *s = (struct dsflac_state*)d->priv;
+
+    /* a failed seek leaves the decoder in SEEK_ERROR, which only a flush clears */
+    if (FLAC__stream_decoder_get_state(s->dec) == FLAC__STREAM_DECODER_SEEK_ERROR)
+        FLAC__stream_decoder_flush(s->dec);
+
+    /* libFLAC decodes the target frame during the seek and hands it to dsflac_write_cb() starting at exactly 'frame' */
+    if (d->frames != 0ULL && frame >= d->frames) {
+        /* seeking to the very end is not allowed, but there's nothing to decode there anyway */
+        d->eof = 1;
+        return (int64_t)frame;
+    }
+
+    if (!FLAC__stream_decoder_seek_absolute(s->dec,frame))
+        return -1LL;
+
+    return (int64_t)frame;
+}
+
+const struct dosamp_decoder_codec dosamp_decoder_codec_flac = {
+    .name =                             "FLAC",
+    .probe =                            dsflac_probe,
+    .open =                             dsflac_open,
+    .decode =                           dsflac_decode,
+    .seek =                             dsflac_seek,
+    .close =                            dsflac_close
+};
+
+#endif /* HAS_DECODERS */
+
@@ -0,0 +1,316 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "decsrc.h"
+
+#if defined(HAS_DECODERS)
+
+#include <ext/libmad/mad.h>
+
+/* MPEG audio through libmad.
+ *
+ * At open the whole file is scanned once, headers only, to index where every frame
+ * starts. That gives us the exact length (MP3 has none in its headers, unless you trust
+ * a Xing tag) and lets seek() go straight to a frame instead of decoding from the start. */
+
+#define dsmp3_inbuf_size                (16384U)
+
+/* Layer III frames can take main data from up to 511 bytes back (the bit reservoir),
+ * and the IMDCT overlaps each frame with the one before it. Back up at least this many
+ * bytes and two frames when seeking so the frame asked for decodes exactly. */
+#define dsmp3_preroll_bytes             (1024UL)
+#define dsmp3_preroll_frames            (2U)
+
+struct dsmp3_state {
+    struct mad_stream                   stream;
+    struct mad_frame                    frame;
+    struct mad_synth                    synth;
+    uint32_t*                           index;      /* file offset of each frame */
+    unsigned long                       index_len;
+    unsigned long                       index_alloc;
+    unsigned int                        frame_samples;
+    uint32_t                            data_offset; /* past the ID3v2 tag, if any */
+    unsigned char*                      inbuf;      /* + MAD_BUFFER_GUARD */
+    unsigned int                        inbuf_len;
+    uint32_t                            inbuf_base; /* file offset of inbuf[0] */
+    unsigned char                       in_eof;
+};
+
+/* ID3v2 tag length, including header (and footer) */
+static uint32_t dsmp3_id3v2_length(const unsigned char * const hdr) {
+    uint32_t len;
+
+    if (memcmp(hdr,"ID3",3) != 0)
+        return 0;
+    if ((hdr[6] | hdr[7] | hdr[8] | hdr[9]) & 0x80)
+        return 0;
+
+    len  = ((uint32_t)hdr[6] << 21UL) | ((uint32_t)hdr[7] << 14UL) | ((uint32_t)hdr[8] << 7UL) | (uint32_t)hdr[9];
+    len += 10UL;
+    if (hdr[5] & 0x10) len += 10UL; /* footer present */
+    return len;
+}
+
+static int dsmp3_probe(const unsigned char * const hdr,const unsigned int len) {
+    if (len >= 10 && dsmp3_id3v2_length(hdr) != 0)
+        return 1;
+
+    /* frame sync, not layer "reserved", not bitrate "bad" */
+    if (len >= 4 && hdr[0] == 0xFF && (hdr[1] & 0xE0) == 0xE0 && (hdr[1] & 0x06) != 0x00 && (hdr[2] & 0xF0) != 0xF0)
+        return 1;
+
+    return 0;
+}
+
+/* refill the input buffer, keeping whatever libmad has not consumed yet. -1 if nothing more to read */
+static int dsmp3_fill(struct dosamp_decoder * const d,struct dsmp3_state * const s) {
+    unsigned int keep = 0,rd;
+
+    if (s->in_eof)
+        return -1;
+
+    if (s->stream.next_frame != NULL) {
+        keep = (unsigned int)(s->stream.bufend - s->stream.next_frame);
+        if (keep != 0) memmove(s->inbuf,s->stream.next_frame,keep);
+    }
+
+    s->inbuf_base = (uint32_t)d->src->file_pos - (uint32_t)keep;
+    rd = d->src->read(d->src,s->inbuf + keep,dsmp3_inbuf_size - keep);
+    if (rd == dosamp_file_io_err) rd = 0;
+
+    s->inbuf_len = keep + rd;
+    if (rd == 0) {
+        /* libmad needs MAD_BUFFER_GUARD zero bytes after the last frame to decode it */
+        memset(s->inbuf + s->inbuf_len,0,MAD_BUFFER_GUARD);
+        s->inbuf_len += MAD_BUFFER_GUARD;
+        s->in_eof = 1;
+    }
+
+    mad_stream_buffer(&s->stream,s->inbuf,s->inbuf_len);
+    return 0;
+}
+
+/* file offset of what the stream is looking at now */
+static uint32_t dsmp3_stream_offset(struct dsmp3_state * const s) {
+    return s->inbuf_base + (uint32_t)(s->stream.this_frame - s->inbuf);
+}
+
+static void dsmp3_restart(struct dsmp3_state * const s) {
+    mad_synth_finish(&s->synth);
+    mad_frame_finish(&s->frame);
+    mad_stream_finish(&s->stream);
+    mad_stream_init(&s->stream);
+    mad_frame_init(&s->frame);
+    mad_synth_init(&s->synth);
+    s->inbuf_len = 0;
+    s->in_eof = 0;
+}
+
+static int dsmp3_scan(struct dosamp_decoder * const d,struct dsmp3_state * const s) {
+    struct mad_header h;
+
+    mad_header_init(&h);
+
+    for (;;) {
+        if (mad_header_decode(&h,&s->stream) != 0) {
+            if (s->stream.error == MAD_ERROR_BUFLEN || s->stream.error == MAD_ERROR_BUFPTR) { /* BUFPTR: no buffer yet */
+                if (dsmp3_fill(d,s) < 0) break;
+                continue;
+            }
+            if (MAD_RECOVERABLE(s->stream.error))
+                continue;
+
+            break;
+        }
+
+        /* the first good header decides the format, anything that disagrees is junk that happened to sync */
+        if (s->index_len == 0) {
+            d->fmt.sample_rate = h.samplerate;
+            d->fmt.number_of_channels = MAD_NCHANNELS(&h);
+            s->frame_samples = 32U * MAD_NSBSAMPLES(&h);
+        }
+        else if (h.samplerate != d->fmt.sample_rate || (32U * MAD_NSBSAMPLES(&h)) != s->frame_samples) {
+            continue;
+        }
+
+        if (s->index_len >= s->index_alloc) {
+            unsigned long na = s->index_alloc + 4096UL;
+            uint32_t *ni = realloc(s->index,na * sizeof(uint32_t));
+
+            if (ni == NULL) return -1;
+            s->index = ni;
+            s->index_alloc = na;
+        }
+
+        s->index[s->index_len++] = dsmp3_stream_offset(s);
+    }
+
+    mad_header_finish(&h);
+
+    if (s->index_len == 0)
+        return -1;
+
+    d->frames = (uint64_t)s->index_len * (uint64_t)s->frame_samples;
+    return 0;
+}
+
+static void dsmp3_close(struct dosamp_decoder * const d) {
+    struct dsmp3_state *s = (struct dsmp3_state*)d->priv;
+
+    if (s != NULL) {
+        mad_synth_finish(&s->synth);
+        mad_frame_finish(&s->frame);
+        mad_stream_finish(&s->stream);
+        if (s->index != NULL) free(s->index);
+        if (s->inbuf != NULL) free(s->inbuf);
+        free(s);
+        d->priv = NULL;
+    }
+}
+
+static int dsmp3_open(struct dosamp_decoder * const d) {
+    unsigned char hdr[10];
+    struct dsmp3_state *s;
+
+    s = calloc(1,sizeof(*s));
+    if (s == NULL) return -1;
+    d->priv = s;
+
+    mad_stream_init(&s->stream);
+    mad_frame_init(&s->frame);
+    mad_synth_init(&s->synth);
+
+    s->inbuf = malloc(dsmp3_inbuf_size + MAD_BUFFER_GUARD);
+    if (s->inbuf == NULL) return -1;
+
+    if (d->src->read(d->src,hdr,10) == 10)
+        s->data_offset = dsmp3_id3v2_length(hdr);
+    if (d->src->seek(d->src,s->data_offset) != s->data_offset)
+        return -1;
+
+    if (dsmp3_scan(d,s) < 0)
+        return -1;
+
+    /* ready to decode from the top */
+    dsmp3_restart(s);
+    if (d->src->seek(d->src,s->index[0]) != s->index[0])
+        return -1;
+
+    return 0;
+}
+
+static inline int16_t dsmp3_sample(mad_fixed_t v) {
+    /* round, clip, and keep the top 16 bits */
+    v += (1L << (MAD_F_FRACBITS - 16));
+    if (v >= MAD_F_ONE)
+        v = MAD_F_ONE - 1;
+    else if (v < -MAD_F_ONE)
+        v = -MAD_F_ONE;
+
+    return (int16_t)(v >> (MAD_F_FRACBITS + 1 - 16));
+}
+
+static int dsmp3_decode(struct dosamp_decoder * const d) {
+    struct dsmp3_state *s = (struct dsmp3_state*)d->priv;
+    const unsigned int och = d->fmt.number_of_channels;
+    unsigned int i,n,ich;
+    int16_t *o;
+
+    for (;;) {
+        if (mad_frame_decode(&s->frame,&s->stream) != 0) {
+            if (s->stream.error == MAD_ERROR_BUFLEN || s->stream.error == MAD_ERROR_BUFPTR) { /* BUFPTR: no buffer yet */
+                if (dsmp3_fill(d,s) < 0) return -1;
+                continue;
+            }
+
+            /* a frame whose bit reservoir we do not have (first frame after a seek, or a damaged file).
+             * play it as silence so sample positions still line up with the index */
+            if (s->stream.error == MAD_ERROR_BADDATAPTR) {
+                n = 32U * MAD_NSBSAMPLES(&s->frame.header);
+                if ((o=dosamp_decoder_pcm_reserve(d,n)) == NULL) return -1;
+                memset(o,0,n * d->fmt.bytes_per_block);
+                d->pcm_len += n * d->fmt.bytes_per_block;
+                mad_frame_mute(&s->frame);
+                return 0;
+            }
+
+            if (MAD_RECOVERABLE(s->stream.error))
+                continue;
+
+            return -1;
+        }
+
+        /* same rule as the scan, skip junk that decodes to another format */
+        if (s->frame.header.samplerate != d->fmt.sample_rate)
+            continue;
+
+        break;
+    }
+
+    mad_synth_frame(&s->synth,&s->frame);
+
+    n = s->synth.pcm.length;
+    ich = s->synth.pcm.channels;
+    if ((o=dosamp_decoder_pcm_reserve(d,n)) == NULL) return -1;
+
+    if (och == 1) {
+        const mad_fixed_t *l = s->synth.pcm.samples[0];
+
+        for (i=0;i < n;i++) *o++ = dsmp3_sample(l[i]);
+    }
+    else {
+        /* mono frames in a stereo stream are rare but legal */
+        const mad_fixed_t *l = s->synth.pcm.samples[0];
+        const mad_fixed_t *r = s->synth.pcm.samples[ich > 1 ? 1 : 0];
+
+        for (i=0;i < n;i++) {
+            *o++ = dsmp3_sample(l[i]);
+            *o++ = dsmp3_sample(r[i]);
+        }
+    }
+
+    d->pcm_len += n * d->fmt.bytes_per_block;
+    return 0;
+}
+
+static int64_t dsmp3_seek(struct dosamp_decoder * const d,const uint64_t frame) {
+    struct dsmp3_state *s = (struct dsmp3_state*)d->priv;
+    unsigned long k,j;
+
+    k = (unsigned long)(frame / (uint64_t)s->frame_samples);
+    if (k >= s->index_len) k = s->index_len - 1UL;
+
+    j = k;
+    while (j > 0UL && ((k - j) < dsmp3_preroll_frames || (s->index[k] - s->index[j]) < dsmp3_preroll_bytes))
+        j--;
+
+    dsmp3_restart(s);
+    if (d->src->seek(d->src,s->index[j]) != s->index[j])
+        return -1LL;
+
+    return (int64_t)j * (int64_t)s->frame_samples;
+}
+
+const struct dosamp_decoder_codec dosamp_decoder_codec_mp3 = {
+    .name =                             "MP3",
+    .probe =                            dsmp3_probe,
+    .open =                             dsmp3_open,
+    .decode =                           dsmp3_decode,
+    .seek =                             dsmp3_seek,
+    .close =                            dsmp3_close
+};
+
+#endif /* HAS_DECODERS */
+
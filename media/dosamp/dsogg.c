@@ -0,0 +1,211 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "decsrc.h"
+
+#if defined(HAS_DECODERS)
+
+#define OV_EXCLUDE_STATIC_CALLBACKS
+#include <ext/vorbis/vorbisfile.h>
+
+/* Ogg Vorbis through vorbisfile, reading through our file source. */
+
+/* decode this much per call, in bytes */
+#define dsogg_chunk                     (8192U)
+
+struct dsogg_state {
+    OggVorbis_File                      vf;
+    unsigned char                       vf_open;
+    int                                 link;
+};
+
+/* Vorbis orders 3-8 channels differently from WAVE_FORMAT_EXTENSIBLE, which is what
+ * the rest of DOSAMP expects. dsogg_order[ch][i] is the Vorbis channel that goes in
+ * WAV position i. 6.1 side channels are taken as the back pair. */
+static const unsigned char dsogg_order[9][8] = {
+    { 0 },
+    { 0 },
+    { 0, 1 },
+    { 0, 2, 1 },                        /* L C R -> L R C */
+    { 0, 1, 2, 3 },
+    { 0, 2, 1, 3, 4 },                  /* L C R BL BR -> L R C BL BR */
+    { 0, 2, 1, 5, 3, 4 },               /* L C R BL BR LFE -> L R C LFE BL BR */
+    { 0, 2, 1, 6, 3, 4, 5 },            /* L C R SL SR BC LFE -> L R C LFE SL SR BC */
+    { 0, 2, 1, 7, 5, 6, 3, 4 }          /* L C R SL SR BL BR LFE -> L R C LFE BL BR SL SR */
+};
+
+static int dsogg_probe(const unsigned char * const hdr,const unsigned int len) {
+    return (len >= 4 && !memcmp(hdr,"OggS",4)) ? 1 : 0;
+}
+
+static size_t dsogg_read_cb(void *ptr,size_t size,size_t nmemb,void *datasource) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)datasource;
+    size_t want = size * nmemb;
+    unsigned int rd;
+
+    if (size == 0 || want == 0)
+        return 0;
+    if (want > 65536U)
+        want = 65536U;
+
+    rd = d->src->read(d->src,ptr,(unsigned int)want);
+    if (rd == dosamp_file_io_err)
+        return 0;
+
+    return (size_t)rd / size;
+}
+
+static int dsogg_seek_cb(void *datasource,ogg_int64_t offset,int whence) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)datasource;
+
+    switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            if (d->src->file_pos < 0LL) return -1;
+            offset += d->src->file_pos;
+            break;
+        case SEEK_END:
+            if (d->src->file_size < 0LL) return -1;
+            offset += d->src->file_size;
+            break;
+        default:
+            return -1;
+    }
+
+    if (offset < 0)
+        return -1;
+    if (d->src->seek(d->src,(dosamp_file_off_t)offset) != (dosamp_file_off_t)offset)
+        return -1;
+
+    return 0;
+}
+
+static long dsogg_tell_cb(void *datasource) {
+    struct dosamp_decoder *d = (struct dosamp_decoder*)datasource;
+
+    return (long)d->src->file_pos;
+}
+
+static const ov_callbacks dsogg_callbacks = {
+    dsogg_read_cb,
+    dsogg_seek_cb,
+    NULL,                               /* the file source is closed by whoever owns it */
+    dsogg_tell_cb
+};
+
+static void dsogg_close(struct dosamp_decoder * const d) {
+    struct dsogg_state *s = (struct dsogg_state*)d->priv;
+
+    if (s != NULL) {
+        if (s->vf_open) ov_clear(&s->vf);
+        free(s);
+        d->priv = NULL;
+    }
+}
+
+static int dsogg_open(struct dosamp_decoder * const d) {
+    struct dsogg_state *s;
+    vorbis_info *vi;
+    ogg_int64_t total;
+
+    s = calloc(1,sizeof(*s));
+    if (s == NULL) return -1;
+    d->priv = s;
+
+    if (ov_open_callbacks(d,&s->vf,NULL,0,dsogg_callbacks) != 0)
+        return -1;
+    s->vf_open = 1;
+
+    vi = ov_info(&s->vf,-1);
+    if (vi == NULL || vi->channels < 1 || vi->channels > 8)
+        return -1;
+
+    d->fmt.sample_rate = (uint32_t)vi->rate;
+    d->fmt.number_of_channels = (uint8_t)vi->channels;
+
+    total = ov_pcm_total(&s->vf,-1);
+    if (total > 0)
+        d->frames = (uint64_t)total;
+
+    return 0;
+}
+
+static int dsogg_decode(struct dosamp_decoder * const d) {
+    struct dsogg_state *s = (struct dsogg_state*)d->priv;
+    const unsigned int ch = d->fmt.number_of_channels;
+    const unsigned int bpb = d->fmt.bytes_per_block;
+    unsigned int frames = dsogg_chunk / bpb;
+    int16_t *o;
+    long rd;
+
+    if ((o=dosamp_decoder_pcm_reserve(d,frames)) == NULL) return -1;
+
+    do {
+        rd = ov_read(&s->vf,(char*)o,(int)(frames * bpb),
+#if defined(__BIG_ENDIAN__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+            1,
+#else
+            0,
+#endif
+            2,1,&s->link);
+    } while (rd == OV_HOLE); /* gap in the data, vorbisfile already resynced */
+
+    if (rd <= 0)
+        return -1;
+
+    frames = (unsigned int)rd / bpb;
+
+    if (ch > 2U && dsogg_order[ch][1] != 1) {
+        const unsigned char *ord = dsogg_order[ch];
+        int16_t tmp[8];
+        unsigned int i,c;
+
+        for (i=0;i < frames;i++,o += ch) {
+            for (c=0;c < ch;c++) tmp[c] = o[ord[c]];
+            for (c=0;c < ch;c++) o[c] = tmp[c];
+        }
+    }
+
+    d->pcm_len += frames * bpb;
+    return 0;
+}
+
+static int64_t dsogg_seek(struct dosamp_decoder * const d,const uint64_t frame) {
+    struct dsogg_state *s = (struct dsogg_state*)d->priv;
+
+    if (d->frames != 0ULL && frame >= d->frames) {
+        d->eof = 1;
+        return (int64_t)frame;
+    }
+
+    /* sample accurate */
+    if (ov_pcm_seek(&s->vf,(ogg_int64_t)frame) != 0)
+        return -1LL;
+
+    return (int64_t)frame;
+}
+
+const struct dosamp_decoder_codec dosamp_decoder_codec_ogg = {
+    .name =                             "Ogg Vorbis",
+    .probe =                            dsogg_probe,
+    .open =                             dsogg_open,
+    .decode =                           dsogg_decode,
+    .seek =                             dsogg_seek,
+    .close =                            dsogg_close
+};
+
+#endif /* HAS_DECODERS */
+
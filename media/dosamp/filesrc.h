@@ -1,7 +1,10 @@
 
 enum {
     dosamp_file_source_id_null = 0,
-    dosamp_file_source_id_file_fd = 1
+    dosamp_file_source_id_file_fd = 1,
+    dosamp_file_source_id_decoder = 2,
+    dosamp_file_source_id_file_mmap = 3,
+    dosamp_file_source_id_file_readahead = 4
 };
 
 #if TARGET_MSDOS == 32 || defined(LINUX)
@@ -37,6 +40,30 @@ struct dosamp_file_source_priv_file_fd {
     int                                 fd;
 };
 
+/* obj_id == dosamp_file_source_id_file_mmap (HAS_FILE_MMAP builds).
+ * must be sizeof() <= sizeof(private) */
+struct dosamp_file_source_priv_file_mmap {
+    int                                 fd;
+    const unsigned char*                base;       /* the whole file, mapped read only */
+    uint64_t                            advised;    /* file offset up to which we told the kernel we'll need pages */
+};
+
+/* obj_id == dosamp_file_source_id_file_readahead (HAS_FILE_READAHEAD builds).
+ * must be sizeof() <= sizeof(private) */
+struct dosamp_file_readahead;
+
+struct dosamp_file_source_priv_file_readahead {
+    struct dosamp_file_readahead*       ra;
+};
+
+/* obj_id == dosamp_file_source_id_decoder (see decsrc.h).
+ * must be sizeof() <= sizeof(private) */
+struct dosamp_decoder;
+
+struct dosamp_file_source_priv_decoder {
+    struct dosamp_decoder dosamp_FAR*   dec;
+};
+
 struct dosamp_file_source;
 typedef struct dosamp_file_source dosamp_FAR * dosamp_file_source_t;
 typedef struct dosamp_file_source dosamp_FAR * dosamp_FAR * dosamp_file_source_ptr_t;
@@ -53,8 +80,14 @@ struct dosamp_file_source {
     unsigned int                        (dosamp_FAR * read)(dosamp_file_source_t const inst,void dosamp_FAR *buf,unsigned int count); /* read function */
     unsigned int                        (dosamp_FAR * write)(dosamp_file_source_t const inst,const void dosamp_FAR *buf,unsigned int count); /* write function */
     dosamp_file_off_t                   (dosamp_FAR * seek)(dosamp_file_source_t const inst,dosamp_file_off_t pos); /* seek function */
+    /* zero-copy read, NULL if the source can't: returns a pointer to *count (or fewer, *count is updated) bytes at file_pos,
+     * valid until the source is closed. does not move file_pos, seek past what you used. */
+    const unsigned char dosamp_FAR *    (dosamp_FAR * map)(dosamp_file_source_t const inst,unsigned int dosamp_FAR * const count);
     union {
         struct dosamp_file_source_priv_file_fd      file_fd;
+        struct dosamp_file_source_priv_file_mmap    file_mmap;
+        struct dosamp_file_source_priv_file_readahead file_readahead;
+        struct dosamp_file_source_priv_decoder      decoder;
     } p;
 };
 
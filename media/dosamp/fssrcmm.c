@@ -0,0 +1,177 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef LINUX
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+
+#if defined(HAS_FILE_MMAP)
+
+/* memory mapped file source. read() is a memcpy() out of the mapping and map() hands
+ * out the mapping itself, so the convert path can work straight out of the page cache.
+ * To keep page faults (disk I/O) out of the audio path, we ask the kernel to bring in
+ * pages well ahead of the file pointer as it moves. */
+
+/* how far ahead of the file pointer to ask for pages, and how often */
+#define dosamp_file_mmap_advise_ahead   (4UL << 20UL)
+#define dosamp_file_mmap_advise_step    (1UL << 20UL)
+
+static void dosamp_file_source_file_mmap_advise(dosamp_file_source_t const inst) {
+    uint64_t from,to;
+
+    if ((uint64_t)inst->file_pos + dosamp_file_mmap_advise_step <= inst->p.file_mmap.advised)
+        return;
+
+    /* page aligned, and not past the end */
+    from = (uint64_t)inst->file_pos & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1ULL);
+    to = (uint64_t)inst->file_pos + dosamp_file_mmap_advise_ahead;
+    if (to > (uint64_t)inst->file_size) to = (uint64_t)inst->file_size;
+    if (to <= from) return;
+
+    madvise((void*)(inst->p.file_mmap.base + from),(size_t)(to - from),MADV_WILLNEED);
+    inst->p.file_mmap.advised = to;
+}
+
+static int dosamp_FAR dosamp_file_source_file_mmap_close(dosamp_file_source_t const inst) {
+    /* ASSUME: inst != NULL */
+    if (inst->p.file_mmap.base != NULL) {
+        munmap((void*)inst->p.file_mmap.base,(size_t)inst->file_size);
+        inst->p.file_mmap.base = NULL;
+    }
+    if (inst->p.file_mmap.fd >= 0) {
+        close(inst->p.file_mmap.fd);
+        inst->p.file_mmap.fd = -1;
+    }
+
+    return 0;/*success*/
+}
+
+static void dosamp_FAR dosamp_file_source_file_mmap_free(dosamp_file_source_t const inst) {
+    dosamp_file_source_file_mmap_close(inst);
+    dosamp_file_source_free(inst);
+}
+
+static const unsigned char dosamp_FAR * dosamp_FAR dosamp_file_source_file_mmap_map(dosamp_file_source_t const inst,unsigned int dosamp_FAR * const count) {
+    uint64_t rem;
+
+    if (inst->p.file_mmap.base == NULL)
+        return NULL;
+
+    if ((uint64_t)inst->file_pos < (uint64_t)inst->file_size)
+        rem = (uint64_t)inst->file_size - (uint64_t)inst->file_pos;
+    else
+        rem = 0;
+
+    if ((uint64_t)(*count) > rem) *count = (unsigned int)rem;
+    if (*count == 0) return inst->p.file_mmap.base;
+
+    dosamp_file_source_file_mmap_advise(inst);
+    return inst->p.file_mmap.base + inst->file_pos;
+}
+
+static unsigned int dosamp_FAR dosamp_file_source_file_mmap_read(dosamp_file_source_t const inst,void dosamp_FAR * buf,unsigned int count) {
+    const unsigned char *src;
+
+    if (inst->p.file_mmap.base == NULL || count > dosamp_file_io_maxb)
+        return dosamp_file_io_err;
+
+    if (count > 0) {
+        src = dosamp_file_source_file_mmap_map(inst,&count);
+        memcpy(buf,src,count);
+        inst->file_pos += count;
+    }
+
+    return count;
+}
+
+static unsigned int dosamp_FAR dosamp_file_source_file_mmap_write(dosamp_file_source_t const inst,const void dosamp_FAR * buf,unsigned int count) {
+    (void)inst;
+    (void)buf;
+    (void)count;
+
+    errno = EIO; /* not implemented */
+    return dosamp_file_io_err;
+}
+
+static dosamp_file_off_t dosamp_FAR dosamp_file_source_file_mmap_seek(dosamp_file_source_t const inst,dosamp_file_off_t pos) {
+    if (inst->p.file_mmap.base == NULL || pos == dosamp_file_io_err)
+        return dosamp_file_off_err;
+
+    /* like lseek() we can go past the end, reads there return nothing */
+    if (pos > dosamp_file_off_max)
+        pos = dosamp_file_off_max;
+
+    /* a seek backwards (loop, rewind) needs pages we may have let go, ask again */
+    if ((uint64_t)pos < (uint64_t)inst->file_pos)
+        inst->p.file_mmap.advised = 0;
+
+    return (inst->file_pos = (dosamp_file_off_t)pos);
+}
+
+static const struct dosamp_file_source dosamp_file_source_priv_file_mmap_init = {
+    .obj_id =                           dosamp_file_source_id_file_mmap,
+    .file_size =                        -1LL,
+    .file_pos =                         0,
+    .free =                             dosamp_file_source_file_mmap_free,
+    .close =                            dosamp_file_source_file_mmap_close,
+    .read =                             dosamp_file_source_file_mmap_read,
+    .write =                            dosamp_file_source_file_mmap_write,
+    .seek =                             dosamp_file_source_file_mmap_seek,
+    .map =                              dosamp_file_source_file_mmap_map,
+    .p.file_mmap.fd =                   -1,
+    .p.file_mmap.base =                 NULL,
+    .p.file_mmap.advised =              0
+};
+
+/* fails if the file is empty or too large to map (32-bit builds), caller can fall back to the file_fd source */
+dosamp_file_source_t dosamp_file_source_file_mmap_open(const char * const path) {
+    dosamp_file_source_t inst;
+    struct stat st;
+    void *p;
+
+    if (path == NULL) return NULL;
+    if (*path == 0) return NULL;
+
+    inst = dosamp_file_source_alloc(&dosamp_file_source_priv_file_mmap_init);
+    if (inst == NULL) return NULL;
+
+    inst->p.file_mmap.fd = open(path,O_RDONLY);
+    if (inst->p.file_mmap.fd < 0) goto fail;
+
+    if (fstat(inst->p.file_mmap.fd,&st)) goto fail; /* cannot stat: fail */
+    if (!S_ISREG(st.st_mode)) goto fail; /* not a file: fail */
+    if (st.st_size <= 0) goto fail; /* can't map nothing */
+    if ((uint64_t)st.st_size > (uint64_t)SIZE_MAX) goto fail; /* too big for the address space */
+    inst->file_size = (dosamp_file_off_t)st.st_size;
+
+    p = mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,inst->p.file_mmap.fd,0);
+    if (p == MAP_FAILED) goto fail;
+    inst->p.file_mmap.base = (const unsigned char*)p;
+
+    /* playback reads front to back. let the kernel read ahead harder and drop pages behind us */
+    madvise(p,(size_t)st.st_size,MADV_SEQUENTIAL);
+    dosamp_file_source_file_mmap_advise(inst);
+
+    return inst;
+fail:
+    inst->close(inst);
+    inst->free(inst);
+    return NULL;
+}
+
+#endif /* HAS_FILE_MMAP */
+
@@ -0,0 +1,271 @@
+
+#include <stdio.h>
+#include <stdint.h>
+#ifdef LINUX
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "dosamp.h"
+#include "filesrc.h"
+#include "thrd.h"
+
+#if defined(HAS_FILE_READAHEAD)
+
+/* read-ahead file source. A thread keeps a few MB of the file buffered ahead of the
+ * file pointer with pread(), so read() is normally just a memcpy() and the disk is
+ * never touched from the audio path. A seek within the buffered data just skips
+ * forward, any other seek throws the buffer away and restarts the thread there. */
+
+#define dosamp_file_readahead_size      (4UL << 20UL)   /* buffered ahead */
+#define dosamp_file_readahead_chunk     (256UL << 10UL) /* per pread() */
+
+struct dosamp_file_readahead {
+    int                                 fd;
+    dosamp_thread_t                     thread;
+    unsigned char                       thread_running;
+    pthread_mutex_t                     lock;
+    pthread_cond_t                      cond;       /* broadcast when data arrives, space frees up, or the file pointer moves */
+    unsigned char*                      buffer;
+    uint32_t                            size;
+    uint32_t                            head;       /* the thread fills here */
+    uint32_t                            used;       /* bytes buffered, the file pointer is at (head - used) */
+    uint64_t                            fill_pos;   /* file offset of the byte at head */
+    unsigned int                        generation; /* bumped when the buffer is thrown away, so a read in progress is too */
+    unsigned char                       eof;
+    unsigned char                       error;
+    unsigned char                       stop;
+};
+
+static void dosamp_file_readahead_thread(void *arg) {
+    struct dosamp_file_readahead *ra = (struct dosamp_file_readahead*)arg;
+    unsigned int generation;
+    unsigned char *dst;
+    uint64_t at;
+    uint32_t n;
+    ssize_t rd;
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->stop) {
+        if (ra->used >= ra->size || ra->eof || ra->error) {
+            pthread_cond_wait(&ra->cond,&ra->lock);
+            continue;
+        }
+
+        /* contiguous free space at head */
+        n = ra->size - ra->used;
+        if (n > (ra->size - ra->head)) n = ra->size - ra->head;
+        if (n > dosamp_file_readahead_chunk) n = dosamp_file_readahead_chunk;
+
+        dst = ra->buffer + ra->head;
+        at = ra->fill_pos;
+        generation = ra->generation;
+
+        /* nobody else touches the free space, so read into it without the lock */
+        pthread_mutex_unlock(&ra->lock);
+        rd = pread(ra->fd,dst,n,(off_t)at);
+        pthread_mutex_lock(&ra->lock);
+
+        if (generation != ra->generation)
+            continue; /* the reader seeked elsewhere while we were reading */
+
+        if (rd < 0) {
+            if (errno == EINTR) continue;
+            ra->error = 1;
+        }
+        else if (rd == 0) {
+            ra->eof = 1;
+        }
+        else {
+            ra->head += (uint32_t)rd;
+            if (ra->head >= ra->size) ra->head -= ra->size;
+            ra->used += (uint32_t)rd;
+            ra->fill_pos += (uint64_t)rd;
+        }
+
+        pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->lock);
+}
+
+static int dosamp_FAR dosamp_file_source_file_readahead_close(dosamp_file_source_t const inst) {
+    struct dosamp_file_readahead *ra = inst->p.file_readahead.ra;
+
+    /* ASSUME: inst != NULL */
+    if (ra != NULL) {
+        if (ra->thread_running) {
+            pthread_mutex_lock(&ra->lock);
+            ra->stop = 1;
+            pthread_cond_broadcast(&ra->cond);
+            pthread_mutex_unlock(&ra->lock);
+
+            dosamp_thread_join(&ra->thread);
+            ra->thread_running = 0;
+        }
+
+        pthread_cond_destroy(&ra->cond);
+        pthread_mutex_destroy(&ra->lock);
+
+        if (ra->fd >= 0) close(ra->fd);
+        if (ra->buffer != NULL) free(ra->buffer);
+        free(ra);
+
+        inst->p.file_readahead.ra = NULL;
+    }
+
+    return 0;/*success*/
+}
+
+static void dosamp_FAR dosamp_file_source_file_readahead_free(dosamp_file_source_t const inst) {
+    dosamp_file_source_file_readahead_close(inst);
+    dosamp_file_source_free(inst);
+}
+
+static unsigned int dosamp_FAR dosamp_file_source_file_readahead_read(dosamp_file_source_t const inst,void dosamp_FAR * buf,unsigned int count) {
+    struct dosamp_file_readahead *ra = inst->p.file_readahead.ra;
+    unsigned int done = 0;
+    uint32_t tail,n;
+
+    if (ra == NULL || count > dosamp_file_io_maxb)
+        return dosamp_file_io_err;
+
+    pthread_mutex_lock(&ra->lock);
+    while (done < count) {
+        if (ra->used == 0) {
+            if (ra->eof || ra->error) break;
+
+            /* the thread fell behind. this is the disk access we're trying to keep out of the audio path */
+            pthread_cond_wait(&ra->cond,&ra->lock);
+            continue;
+        }
+
+        tail = (ra->head >= ra->used) ? (ra->head - ra->used) : (ra->size + ra->head - ra->used);
+
+        n = ra->used;
+        if (n > (ra->size - tail)) n = ra->size - tail;
+        if (n > (count - done)) n = count - done;
+
+        memcpy((unsigned char*)buf + done,ra->buffer + tail,n);
+        ra->used -= n;
+        done += n;
+
+        pthread_cond_broadcast(&ra->cond);
+    }
+
+    if (done == 0 && ra->error) {
+        pthread_mutex_unlock(&ra->lock);
+        errno = EIO;
+        return dosamp_file_io_err;
+    }
+
+    inst->file_pos += done;
+    pthread_mutex_unlock(&ra->lock);
+    return done;
+}
+
+static unsigned int dosamp_FAR dosamp_file_source_file_readahead_write(dosamp_file_source_t const inst,const void dosamp_FAR * buf,unsigned int count) {
+    (void)inst;
+    (void)buf;
+    (void)count;
+
+    errno = EIO; /* not implemented */
+    return dosamp_file_io_err;
+}
+
+static dosamp_file_off_t dosamp_FAR dosamp_file_source_file_readahead_seek(dosamp_file_source_t const inst,dosamp_file_off_t pos) {
+    struct dosamp_file_readahead *ra = inst->p.file_readahead.ra;
+
+    if (ra == NULL || pos == dosamp_file_io_err)
+        return dosamp_file_off_err;
+
+    if (pos > dosamp_file_off_max)
+        pos = dosamp_file_off_max;
+
+    pthread_mutex_lock(&ra->lock);
+    if ((uint64_t)pos >= (uint64_t)inst->file_pos && (uint64_t)pos <= ra->fill_pos) {
+        /* forward within what's buffered */
+        ra->used -= (uint32_t)((uint64_t)pos - (uint64_t)inst->file_pos);
+    }
+    else {
+        /* anywhere else, start over from there */
+        ra->head = 0;
+        ra->used = 0;
+        ra->fill_pos = (uint64_t)pos;
+        ra->eof = 0;
+        ra->error = 0;
+        ra->generation++;
+    }
+
+    inst->file_pos = (int64_t)pos;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    return pos;
+}
+
+static const struct dosamp_file_source dosamp_file_source_priv_file_readahead_init = {
+    .obj_id =                           dosamp_file_source_id_file_readahead,
+    .file_size =                        -1LL,
+    .file_pos =                         0,
+    .free =                             dosamp_file_source_file_readahead_free,
+    .close =                            dosamp_file_source_file_readahead_close,
+    .read =                             dosamp_file_source_file_readahead_read,
+    .write =                            dosamp_file_source_file_readahead_write,
+    .seek =                             dosamp_file_source_file_readahead_seek,
+    .p.file_readahead.ra =              NULL
+};
+
+dosamp_file_source_t dosamp_file_source_file_readahead_open(const char * const path) {
+    struct dosamp_file_readahead *ra;
+    dosamp_file_source_t inst;
+    struct stat st;
+
+    if (path == NULL) return NULL;
+    if (*path == 0) return NULL;
+
+    inst = dosamp_file_source_alloc(&dosamp_file_source_priv_file_readahead_init);
+    if (inst == NULL) return NULL;
+
+    ra = calloc(1,sizeof(*ra));
+    if (ra == NULL) goto fail;
+    ra->fd = -1;
+    pthread_mutex_init(&ra->lock,NULL);
+    pthread_cond_init(&ra->cond,NULL);
+    inst->p.file_readahead.ra = ra;
+
+    ra->fd = open(path,O_RDONLY);
+    if (ra->fd < 0) goto fail;
+
+    if (fstat(ra->fd,&st)) goto fail; /* cannot stat: fail */
+    if (!S_ISREG(st.st_mode)) goto fail; /* not a file: fail */
+    inst->file_size = (dosamp_file_off_t)st.st_size;
+
+    /* we do our own read-ahead, but the kernel's helps too */
+    posix_fadvise(ra->fd,0,0,POSIX_FADV_SEQUENTIAL);
+
+    ra->size = dosamp_file_readahead_size;
+    ra->buffer = malloc(ra->size);
+    if (ra->buffer == NULL) goto fail;
+
+    if (dosamp_thread_create(&ra->thread,dosamp_file_readahead_thread,ra) < 0) goto fail;
+    ra->thread_running = 1;
+
+    return inst;
+fail:
+    inst->close(inst);
+    inst->free(inst);
+    return NULL;
+}
+
+#endif /* HAS_FILE_READAHEAD */
+
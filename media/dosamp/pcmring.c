@@ -0,0 +1,102 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "dosamp.h"
+#include "pcmring.h"
+
+#if defined(HAS_THREADS)
+
+int pcm_ring_alloc(struct pcm_ring * const r,const uint32_t size,const uint32_t block) {
+    pcm_ring_free(r);
+
+    if (block == 0U) return -1;
+
+    /* at least two blocks, one is always kept empty */
+    r->block = block;
+    r->size = size - (size % block);
+    if (r->size < (block * 2UL)) r->size = block * 2UL;
+
+    r->buffer = malloc(r->size);
+    if (r->buffer == NULL) {
+        r->size = 0;
+        return -1;
+    }
+
+    pcm_ring_reset(r);
+    return 0;
+}
+
+void pcm_ring_free(struct pcm_ring * const r) {
+    if (r->buffer != NULL) {
+        free(r->buffer);
+        r->buffer = NULL;
+    }
+
+    r->size = 0;
+    r->head = 0;
+    r->tail = 0;
+}
+
+/* only while neither side is running */
+void pcm_ring_reset(struct pcm_ring * const r) {
+    r->head = 0;
+    r->tail = 0;
+}
+
+uint32_t pcm_ring_used(const struct pcm_ring * const r) {
+    const uint32_t h = pcm_ring_load_acquire(r->head);
+    const uint32_t t = pcm_ring_load_acquire(r->tail);
+
+    return (h >= t) ? (h - t) : (r->size - t + h);
+}
+
+unsigned char *pcm_ring_write_ptr(struct pcm_ring * const r,uint32_t * const len) {
+    const uint32_t h = r->head; /* ours */
+    const uint32_t t = pcm_ring_load_acquire(r->tail);
+    uint32_t n;
+
+    if (h >= t) {
+        n = r->size - h;            /* up to the end of the buffer */
+        if (t == 0U) n -= r->block; /* can't let head wrap onto tail */
+    }
+    else {
+        n = t - h - r->block;
+    }
+
+    *len = n;
+    return r->buffer + h;
+}
+
+void pcm_ring_commit(struct pcm_ring * const r,const uint32_t len) {
+    uint32_t h = r->head + len;
+
+    if (h >= r->size) h -= r->size;
+    pcm_ring_store_release(r->head,h);
+}
+
+const unsigned char *pcm_ring_read_ptr(struct pcm_ring * const r,uint32_t * const len) {
+    const uint32_t h = pcm_ring_load_acquire(r->head);
+    const uint32_t t = r->tail; /* ours */
+
+    *len = (h >= t) ? (h - t) : (r->size - t);
+    return r->buffer + t;
+}
+
+void pcm_ring_consume(struct pcm_ring * const r,const uint32_t len) {
+    uint32_t t = r->tail + len;
+
+    if (t >= r->size) t -= r->size;
+    pcm_ring_store_release(r->tail,t);
+}
+
+#endif /* HAS_THREADS */
+
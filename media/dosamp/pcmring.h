@@ -0,0 +1,45 @@
+
+/* single producer, single consumer PCM ring.
+ *
+ * The producer thread writes converted audio in, the main loop takes it out and hands
+ * it to the sound card. No locks: head is only written by the producer, tail only by
+ * the consumer, and each side publishes its index only after it is done with the data.
+ * Sizes and positions are always whole sample blocks, so a contiguous span never splits
+ * a block at the wrap point. One block is always left empty to tell full from empty. */
+
+#if defined(HAS_THREADS)
+
+#if defined(__GNUC__)
+# define pcm_ring_load_acquire(x)       __atomic_load_n(&(x),__ATOMIC_ACQUIRE)
+# define pcm_ring_store_release(x,v)    __atomic_store_n(&(x),(v),__ATOMIC_RELEASE)
+#else
+/* x86 does not reorder loads with loads or stores with stores, volatile keeps the compiler from doing so */
+# define pcm_ring_load_acquire(x)       (x)
+# define pcm_ring_store_release(x,v)    ((x) = (v))
+#endif
+
+struct pcm_ring {
+    unsigned char*                      buffer;
+    uint32_t                            size;       /* multiple of block */
+    uint32_t                            block;      /* bytes per sample block */
+    volatile uint32_t                   head;       /* producer writes here */
+    volatile uint32_t                   tail;       /* consumer reads here */
+};
+
+int pcm_ring_alloc(struct pcm_ring * const r,const uint32_t size,const uint32_t block);
+void pcm_ring_free(struct pcm_ring * const r);
+void pcm_ring_reset(struct pcm_ring * const r);
+
+/* bytes ready to read (either side may call this) */
+uint32_t pcm_ring_used(const struct pcm_ring * const r);
+
+/* producer: contiguous free span at head, then commit what was written into it */
+unsigned char *pcm_ring_write_ptr(struct pcm_ring * const r,uint32_t * const len);
+void pcm_ring_commit(struct pcm_ring * const r,const uint32_t len);
+
+/* consumer: contiguous readable span at tail, then release what was taken from it */
+const unsigned char *pcm_ring_read_ptr(struct pcm_ring * const r,uint32_t * const len);
+void pcm_ring_consume(struct pcm_ring * const r,const uint32_t len);
+
+#endif /* HAS_THREADS */
+
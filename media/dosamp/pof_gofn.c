@@ -54,6 +54,7 @@
 #include "timesrc.h"
 #include "dosptrnm.h"
 #include "filesrc.h"
+#include "decsrc.h"
 #include "resample.h"
 #include "cvrdbuf.h"
 #include "cvip.h"
@@ -103,8 +104,16 @@ char *prompt_open_file_windows_gofn(void) {
         of.hInstance = GetModuleHandle(NULL);
 #endif
         of.lpstrFilter =
+#if defined(HAS_DECODERS)
+            "All supported files\x00*.wav;*.mp3;*.flac;*.fla;*.ogg\x00"
+            "WAV files\x00*.wav\x00"
+            "MP3 files\x00*.mp3\x00"
+            "FLAC files\x00*.flac;*.fla\x00"
+            "Ogg Vorbis files\x00*.ogg\x00"
+#else
             "All supported files\x00*.wav\x00"
             "WAV files\x00*.wav\x00"
+#endif
             "All files\x00*.*\x00";
         of.nFilterIndex = 1;
         if (wav_file != NULL) strncpy(tmp,wav_file,sizeof(tmp)-1);
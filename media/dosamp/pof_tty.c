@@ -54,6 +54,7 @@
 #include "timesrc.h"
 #include "dosptrnm.h"
 #include "filesrc.h"
+#include "decsrc.h"
 #include "resample.h"
 #include "cvrdbuf.h"
 #include "cvip.h"
@@ -86,6 +87,10 @@ int tty_tab_complete_filter(char *fname) {
 
     if (!strcasecmp(ext,"wav"))
         return 1;
+#if defined(HAS_DECODERS)
+    if (!strcasecmp(ext,"mp3") || !strcasecmp(ext,"flac") || !strcasecmp(ext,"fla") || !strcasecmp(ext,"ogg"))
+        return 1;
+#endif
 
     return 0;
 }
@@ -84,11 +84,21 @@ int resampler_init(struct resampler_state_t *r,struct wav_cbr_t * const d,const
         r->frac = 0;
     }
 
+    r->channels = d->number_of_channels;
+
     if (r->step == resample_100 && d->number_of_channels == s->number_of_channels && d->bits_per_sample == s->bits_per_sample)
         resample_on = 0;
     else {
         resample_on = 1;
 
+#if defined(RESAMPLE_SINC)
+        if (r->resample_mode == resample_sinc) {
+            /* if the coefficient tables can't be allocated, fall back to linear + lowpass */
+            if (resample_sinc_init(s->sample_rate,d->sample_rate) < 0)
+                r->resample_mode = resample_best;
+        }
+#endif
+
         if (r->resample_mode == resample_best) {
             unsigned long m;
 
@@ -19,13 +19,27 @@ typedef unsigned int                    resample_counting_element_t; /* one half
 typedef unsigned long                   resample_whole_count_element_t; /* whole + fraction, fixed pt */
 #endif
 
-#define resample_max_channels           (2)
+#define resample_max_channels           (8) /* up to 7.1 */
+
+/* windowed-sinc polyphase resampler. 32-bit and Linux builds only, the coefficient
+ * tables and per-sample multiply-accumulate are far too much for 16-bit real mode. */
+#if TARGET_MSDOS == 32 || defined(LINUX)
+# define RESAMPLE_SINC
+#endif
+
+/* SSE2/AVX2 inner loops, chosen at runtime */
+#if defined(RESAMPLE_SINC) && defined(LINUX) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define RESAMPLE_SINC_X86
+#endif
 
 /* resampler mode */
 enum {
     resample_fast=0,                    /* fast (nearest neighbor) */
     resample_good,                      /* good (linear interpolate) */
     resample_best,                      /* best (linear + lowpass) */
+#if defined(RESAMPLE_SINC)
+    resample_sinc,                      /* windowed sinc, polyphase */
+#endif
 
     resample_MAX
 };
@@ -38,6 +52,7 @@ struct resampler_state_t {
     int16_t                             c[resample_max_channels];
     int32_t                             f[resample_max_channels];
     uint8_t                             resample_mode;
+    uint8_t                             channels; /* for the _multi resamplers, output channel count */
     uint8_t                             f_best; /* best filter, averaging */
     unsigned int                        init:1;
 };
@@ -57,6 +72,42 @@ static inline int resample_interpolate_generic(const unsigned int channel) {
     return (int)tmp;
 }
 
+#if defined(RESAMPLE_SINC)
+# define resample_sinc_phase_bits       (8)
+# define resample_sinc_phases           (1U << resample_sinc_phase_bits)
+# define resample_sinc_tap_align        (16) /* taps are always a multiple of this (one AVX2 register of int16_t) */
+# define resample_sinc_max_taps         (128)
+# define resample_sinc_coeff_shift      (14) /* coefficients are Q14, leaves headroom in _mm_madd_epi16 pairs */
+
+typedef int32_t (*resample_sinc_dot_t)(const int16_t *h,const int16_t *c,const unsigned int taps);
+
+/* windowed sinc state */
+struct resample_sinc_state_t {
+    int16_t*                            coeff;      /* [phases][taps], 32-byte aligned */
+    int16_t*                            hist;       /* [resample_max_channels][taps*2], every sample stored twice so the window is contiguous */
+    void*                               coeff_alloc;
+    unsigned int                        taps;
+    unsigned int                        hist_pos;   /* oldest sample in the window */
+    unsigned long                       src_rate;   /* rates the coefficient table was computed for */
+    unsigned long                       dst_rate;
+    resample_sinc_dot_t                 dot;
+};
+
+extern struct resample_sinc_state_t     resample_sinc_state;
+
+int32_t resample_sinc_dot_c(const int16_t *h,const int16_t *c,const unsigned int taps);
+# if defined(RESAMPLE_SINC_X86)
+int32_t resample_sinc_dot_sse2(const int16_t *h,const int16_t *c,const unsigned int taps);
+int32_t resample_sinc_dot_avx2(const int16_t *h,const int16_t *c,const unsigned int taps);
+int resample_sinc_have_sse2(void);
+int resample_sinc_have_avx2(void);
+# endif
+
+int resample_sinc_init(const unsigned long src_rate,const unsigned long dst_rate);
+void resample_sinc_clear(void);
+void resample_sinc_free(void);
+#endif
+
 void resampler_state_reset(struct resampler_state_t *r);
 int resampler_init(struct resampler_state_t *r,struct wav_cbr_t * const d,const struct wav_cbr_t * const s);
 
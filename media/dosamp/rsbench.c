@@ -0,0 +1,201 @@
+/* dosamp resampler benchmark (Linux host).
+ *
+ * Runs the convert_rdbuf_resample_* paths over a synthetic 16-bit stereo signal
+ * for a few common rate conversions and reports throughput of each. For the
+ * windowed sinc resampler every inner loop available on this CPU is timed, and
+ * checked to produce the same output as the plain C loop. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "dosamp.h"
+#include "cvrdbuf.h"
+#include "resample.h"
+
+struct convert_rdbuf_t                          convert_rdbuf = {NULL,NULL,0,0,0};
+
+#define BENCH_CHUNK                             (4096) /* output samples per call, like load_audio_convert() */
+
+static const struct {
+    unsigned long       src,dst;
+} bench_rates[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 22050, 44100 },
+    { 48000, 22050 },
+    { 44100,  8000 }
+};
+
+#define BENCH_RATES (sizeof(bench_rates) / sizeof(bench_rates[0]))
+
+static const struct {
+    const char*         name;
+    uint8_t             mode;
+    resample_sinc_dot_t dot;
+} bench_modes[] = {
+    { "fast",           resample_fast,  NULL },
+    { "good",           resample_good,  NULL },
+    { "best",           resample_best,  NULL },
+    { "sinc C",         resample_sinc,  resample_sinc_dot_c },
+#if defined(RESAMPLE_SINC_X86)
+    { "sinc SSE2",      resample_sinc,  resample_sinc_dot_sse2 },
+    { "sinc AVX2",      resample_sinc,  resample_sinc_dot_avx2 },
+#endif
+};
+
+#define BENCH_MODES (sizeof(bench_modes) / sizeof(bench_modes[0]))
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static int dot_available(const resample_sinc_dot_t dot) {
+#if defined(RESAMPLE_SINC_X86)
+    if (dot == resample_sinc_dot_sse2) return resample_sinc_have_sse2();
+    if (dot == resample_sinc_dot_avx2) return resample_sinc_have_avx2();
+#endif
+    (void)dot;
+    return 1;
+}
+
+/* run one mode over the whole input. returns number of output samples (per channel) */
+static unsigned long bench_run(const unsigned int m,struct wav_cbr_t *d,const struct wav_cbr_t *s,int16_t *out,const unsigned long out_max) {
+    unsigned long total = 0;
+    uint32_t dop;
+
+    resample_state.resample_mode = bench_modes[m].mode;
+    if (resampler_init(&resample_state,d,s) < 0)
+        return 0;
+    if (resample_state.resample_mode != bench_modes[m].mode)
+        return 0;
+    if (bench_modes[m].dot != NULL)
+        resample_sinc_state.dot = bench_modes[m].dot;
+
+    resampler_state_reset(&resample_state);
+    convert_rdbuf.pos = 0;
+
+    do {
+        uint32_t n = BENCH_CHUNK;
+
+        if (n > (out_max - total)) n = (uint32_t)(out_max - total);
+        if (n == 0) break;
+
+        if (bench_modes[m].mode == resample_fast)
+            dop = convert_rdbuf_resample_fast_to_16_stereo(out + (total * 2UL),n);
+        else if (bench_modes[m].mode == resample_good)
+            dop = convert_rdbuf_resample_to_16_stereo(out + (total * 2UL),n);
+        else if (bench_modes[m].mode == resample_best)
+            dop = convert_rdbuf_resample_best_to_16_stereo(out + (total * 2UL),n);
+        else
+            dop = convert_rdbuf_resample_sinc_to_16_stereo(out + (total * 2UL),n);
+
+        total += dop;
+    } while (dop != 0);
+
+    return total;
+}
+
+int main(int argc,char **argv) {
+    unsigned int seconds = 10,rate,m,rep,reps = 3;
+    unsigned long in_samples,out_max,out_len,ref_len = 0,i;
+    struct wav_cbr_t s,d;
+    int16_t *out,*ref;
+    double t;
+
+    if (argc > 1)
+        seconds = (unsigned int)strtoul(argv[1],NULL,0);
+    if (seconds == 0)
+        seconds = 1;
+
+#if defined(RESAMPLE_SINC_X86)
+    printf("SSE2: %s  AVX2: %s\n",resample_sinc_have_sse2() ? "yes" : "no",resample_sinc_have_avx2() ? "yes" : "no");
+#endif
+
+    for (rate=0;rate < BENCH_RATES;rate++) {
+        memset(&s,0,sizeof(s));
+        s.sample_rate = bench_rates[rate].src;
+        s.number_of_channels = 2;
+        s.bits_per_sample = 16;
+        s.samples_per_block = 1;
+        s.bytes_per_block = 4;
+
+        d = s;
+        d.sample_rate = bench_rates[rate].dst;
+
+        /* 440Hz + 5kHz tones and a little noise */
+        in_samples = (unsigned long)seconds * s.sample_rate;
+        convert_rdbuf_free();
+        convert_rdbuf.size = (unsigned int)(in_samples * 4UL);
+        if (convert_rdbuf_get(NULL) == NULL) {
+            fprintf(stderr,"out of memory\n");
+            return 1;
+        }
+
+        srand(1);
+        for (i=0;i < in_samples;i++) {
+            const double tm = (double)i / (double)s.sample_rate;
+            const double v = (sin(tm * 2.0 * 3.14159265358979 * 440.0) * 12000.0) + (sin(tm * 2.0 * 3.14159265358979 * 5000.0) * 6000.0);
+            int16_t *p = (int16_t*)convert_rdbuf.buffer + (i * 2UL);
+
+            p[0] = (int16_t)(v + (double)((rand() & 511) - 256));
+            p[1] = (int16_t)(-v);
+        }
+        convert_rdbuf.len = convert_rdbuf.size;
+
+        out_max = ((in_samples * d.sample_rate) / s.sample_rate) + 1024UL;
+        out = malloc(out_max * 4UL);
+        ref = malloc(out_max * 4UL);
+        if (out == NULL || ref == NULL) {
+            fprintf(stderr,"out of memory\n");
+            return 1;
+        }
+
+        for (m=0;m < BENCH_MODES;m++) {
+            if (!dot_available(bench_modes[m].dot))
+                continue;
+
+            out_len = 0;
+            t = now_sec();
+            for (rep=0;rep < reps;rep++)
+                out_len = bench_run(m,&d,&s,out,out_max);
+            t = now_sec() - t;
+
+            if (out_len == 0) {
+                fprintf(stderr,"%s: resampler init failed\n",bench_modes[m].name);
+                return 1;
+            }
+
+            if (bench_modes[m].dot == resample_sinc_dot_c) {
+                memcpy(ref,out,out_len * 4UL);
+                ref_len = out_len;
+            }
+            else if (bench_modes[m].dot != NULL) {
+                if (out_len != ref_len || memcmp(ref,out,out_len * 4UL) != 0) {
+                    fprintf(stderr,"%s: output differs from C loop\n",bench_modes[m].name);
+                    return 1;
+                }
+            }
+
+            printf("%5lu -> %5lu  %-10s taps=%-3u %8.2f Msamples/s  %7.1fx realtime\n",
+                bench_rates[rate].src,bench_rates[rate].dst,bench_modes[m].name,
+                bench_modes[m].dot != NULL ? resample_sinc_state.taps : 0,
+                ((double)out_len * reps) / (t * 1000000.0),
+                ((double)out_len * reps) / (t * (double)d.sample_rate));
+        }
+
+        free(out);
+        free(ref);
+    }
+
+    convert_rdbuf_free();
+    resample_sinc_free();
+    return 0;
+}
+
@@ -8,7 +8,7 @@
 
     /* NTS: Open Watcom is smart enough to turn for (i=0;i < constant;i++) into unrolled loop for small values of constant. Good! This code relies on it! */
 
-    sample_type_t dosamp_FAR *src = (sample_type_t dosamp_FAR*)dosamp_ptr_add_normalize(convert_rdbuf.buffer,convert_rdbuf.pos);
+    const sample_type_t dosamp_FAR *src = (const sample_type_t dosamp_FAR*)dosamp_cptr_add_normalize(convert_rdbuf.data,convert_rdbuf.pos);
     uint32_t r = 0;
 
     if (resample_state.init == 0) {
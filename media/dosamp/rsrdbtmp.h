@@ -0,0 +1,48 @@
+#define bytes_per_sample (sizeof(sample_type_t) * sample_channels)
+
+#define LOAD() { { register unsigned int i; for (i=0;i < sample_channels;i++) { int16_t *h = resample_sinc_state.hist + (i * taps * 2U) + pos; h[0] = h[taps] = resample_sinc_in_func(src[i]); }; }; if ((++pos) == taps) pos = 0; convert_rdbuf.pos += bytes_per_sample; src += sample_channels; }
+
+#define FILTER() { { const int16_t *c = resample_sinc_state.coeff + ((unsigned int)(resample_state.frac >> (resample_100_shift - resample_sinc_phase_bits)) * taps); register unsigned int i; for (i=0;i < sample_channels;i++) dst[i] = resample_sinc_out_func(dot(resample_sinc_state.hist + (i * taps * 2U) + pos,c,taps)); }; dst += sample_channels; samples--; r++; }
+
+    /* NTS: Open Watcom is smart enough to turn for (i=0;i < constant;i++) into unrolled loop for small values of constant. Good! This code relies on it! */
+
+    const sample_type_t dosamp_FAR *src = (const sample_type_t dosamp_FAR*)dosamp_cptr_add_normalize(convert_rdbuf.data,convert_rdbuf.pos);
+    const resample_sinc_dot_t dot = resample_sinc_state.dot;
+    const unsigned int taps = resample_sinc_state.taps;
+    unsigned int pos;
+    uint32_t r = 0;
+
+    if (resample_sinc_state.coeff == NULL) return r;
+
+    /* the window starts out as silence, the output is delayed by taps/2 samples */
+    if (resample_state.init == 0) {
+        resample_sinc_clear();
+        resample_state.init = 1;
+    }
+
+    pos = resample_sinc_state.hist_pos;
+
+    while (samples > 0) {
+        if (resample_state.frac >= resample_100) {
+            if ((convert_rdbuf.pos+bytes_per_sample) > convert_rdbuf.len) break;
+            resample_state.frac -= resample_100;
+
+            LOAD();
+        }
+        else {
+            FILTER();
+
+            resample_state.frac += resample_state.step;
+        }
+    }
+
+    resample_sinc_state.hist_pos = pos;
+    return r;
+
+#undef LOAD
+#undef FILTER
+#undef sample_type_t
+#undef sample_channels
+#undef bytes_per_sample
+#undef resample_sinc_in_func
+#undef resample_sinc_out_func
@@ -0,0 +1,205 @@
+
+#if defined(TARGET_WINDOWS)
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "dosamp.h"
+#include "resample.h"
+
+#if defined(RESAMPLE_SINC)
+
+#if defined(RESAMPLE_SINC_X86)
+# include <immintrin.h>
+#endif
+
+#define resample_sinc_pi                (3.14159265358979323846)
+
+struct resample_sinc_state_t            resample_sinc_state = {NULL,NULL,NULL,0,0,0,0,resample_sinc_dot_c};
+
+int32_t resample_sinc_dot_c(const int16_t *h,const int16_t *c,const unsigned int taps) {
+    register unsigned int i;
+    int32_t a = 0,b = 0;
+
+    /* taps is always a multiple of resample_sinc_tap_align, two accumulators lets the CPU overlap the multiplies */
+    for (i=0;i < taps;i += 2) {
+        a += (int32_t)h[i  ] * (int32_t)c[i  ];
+        b += (int32_t)h[i+1] * (int32_t)c[i+1];
+    }
+
+    return a + b;
+}
+
+#if defined(RESAMPLE_SINC_X86)
+/* NTS: h[] is wherever the history window happens to start, c[] is 32-byte aligned */
+__attribute__((target("sse2"))) int32_t resample_sinc_dot_sse2(const int16_t *h,const int16_t *c,const unsigned int taps) {
+    __m128i a = _mm_setzero_si128(),b = _mm_setzero_si128();
+    register unsigned int i;
+
+    for (i=0;i < taps;i += 16) {
+        a = _mm_add_epi32(a,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(h+i  )),_mm_load_si128((const __m128i*)(c+i  ))));
+        b = _mm_add_epi32(b,_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(h+i+8)),_mm_load_si128((const __m128i*)(c+i+8))));
+    }
+
+    a = _mm_add_epi32(a,b);
+    a = _mm_add_epi32(a,_mm_shuffle_epi32(a,0x4E));
+    a = _mm_add_epi32(a,_mm_shuffle_epi32(a,0xB1));
+    return _mm_cvtsi128_si32(a);
+}
+
+__attribute__((target("avx2"))) int32_t resample_sinc_dot_avx2(const int16_t *h,const int16_t *c,const unsigned int taps) {
+    __m256i a = _mm256_setzero_si256();
+    register unsigned int i;
+    __m128i s;
+
+    for (i=0;i < taps;i += 16)
+        a = _mm256_add_epi32(a,_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(h+i)),_mm256_load_si256((const __m256i*)(c+i))));
+
+    s = _mm_add_epi32(_mm256_castsi256_si128(a),_mm256_extracti128_si256(a,1));
+    s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0x4E));
+    s = _mm_add_epi32(s,_mm_shuffle_epi32(s,0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+int resample_sinc_have_sse2(void) {
+    return __builtin_cpu_supports("sse2") ? 1 : 0;
+}
+
+int resample_sinc_have_avx2(void) {
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+}
+#endif
+
+void resample_sinc_free(void) {
+    if (resample_sinc_state.coeff_alloc != NULL) {
+        free(resample_sinc_state.coeff_alloc);
+        resample_sinc_state.coeff_alloc = NULL;
+    }
+    if (resample_sinc_state.hist != NULL) {
+        free(resample_sinc_state.hist);
+        resample_sinc_state.hist = NULL;
+    }
+
+    resample_sinc_state.coeff = NULL;
+    resample_sinc_state.taps = 0;
+    resample_sinc_state.src_rate = 0;
+    resample_sinc_state.dst_rate = 0;
+}
+
+/* zero history (silence), called by the resampler when resample_state.init == 0 */
+void resample_sinc_clear(void) {
+    if (resample_sinc_state.hist != NULL)
+        memset(resample_sinc_state.hist,0,sizeof(int16_t) * resample_sinc_state.taps * 2U * resample_max_channels);
+
+    resample_sinc_state.hist_pos = 0;
+}
+
+/* Build the polyphase table. Phase p interpolates the point p/phases of the way between
+ * window taps (taps/2)-1 and taps/2. The cutoff follows the lower of the two rates, and
+ * when downsampling the filter is made proportionally longer so the transition band keeps
+ * the same width relative to the output rate. */
+int resample_sinc_init(const unsigned long src_rate,const unsigned long dst_rate) {
+    double tmp[resample_sinc_max_taps];
+    unsigned int taps,half,p,k;
+    unsigned char *a;
+    double fc;
+
+    if (src_rate == 0 || dst_rate == 0)
+        return -1;
+
+#if defined(RESAMPLE_SINC_X86)
+    if (resample_sinc_have_avx2())
+        resample_sinc_state.dot = resample_sinc_dot_avx2;
+    else if (resample_sinc_have_sse2())
+        resample_sinc_state.dot = resample_sinc_dot_sse2;
+    else
+#endif
+        resample_sinc_state.dot = resample_sinc_dot_c;
+
+    /* same rates, same table */
+    if (resample_sinc_state.coeff != NULL && resample_sinc_state.src_rate == src_rate && resample_sinc_state.dst_rate == dst_rate)
+        return 0;
+
+    resample_sinc_free();
+
+    if (dst_rate < src_rate) {
+        taps = resample_sinc_tap_align * (unsigned int)((src_rate + dst_rate - 1UL) / dst_rate);
+        fc = (double)dst_rate / (double)src_rate;
+    }
+    else {
+        taps = resample_sinc_tap_align;
+        fc = 1.0;
+    }
+
+    if (taps > resample_sinc_max_taps)
+        taps = resample_sinc_max_taps;
+
+    /* leave a little room below Nyquist for the transition band */
+    fc *= 0.92;
+    half = taps / 2U;
+
+    /* +32 to align the table for the SIMD loads */
+    resample_sinc_state.coeff_alloc = malloc((sizeof(int16_t) * taps * resample_sinc_phases) + 32U);
+    if (resample_sinc_state.coeff_alloc == NULL)
+        return -1;
+
+    resample_sinc_state.hist = malloc(sizeof(int16_t) * taps * 2U * resample_max_channels);
+    if (resample_sinc_state.hist == NULL) {
+        resample_sinc_free();
+        return -1;
+    }
+
+    a = (unsigned char*)resample_sinc_state.coeff_alloc;
+    a += (32U - ((unsigned int)((size_t)a) & 31U)) & 31U;
+    resample_sinc_state.coeff = (int16_t*)a;
+    resample_sinc_state.taps = taps;
+    resample_sinc_state.src_rate = src_rate;
+    resample_sinc_state.dst_rate = dst_rate;
+
+    for (p=0;p < resample_sinc_phases;p++) {
+        int16_t *row = resample_sinc_state.coeff + (p * taps);
+        const double mu = (double)p / (double)resample_sinc_phases;
+        double sum = 0;
+        long total = 0;
+
+        for (k=0;k < taps;k++) {
+            const double t = (double)k - (double)(half - 1U) - mu; /* distance from output point, in source samples */
+            const double x = t / (double)half;                     /* -1.0 ... +1.0 across the window */
+            double v;
+
+            if (t == 0)
+                v = fc;
+            else
+                v = sin(resample_sinc_pi * fc * t) / (resample_sinc_pi * t);
+
+            /* Blackman window */
+            v *= 0.42 + (0.5 * cos(resample_sinc_pi * x)) + (0.08 * cos(2.0 * resample_sinc_pi * x));
+
+            tmp[k] = v;
+            sum += v;
+        }
+
+        /* normalize each phase to unity gain, then put the rounding error on the
+         * tap nearest the output point so DC passes through exactly */
+        for (k=0;k < taps;k++) {
+            const long q = (long)floor(((tmp[k] * (double)(1L << resample_sinc_coeff_shift)) / sum) + 0.5);
+
+            row[k] = (int16_t)q;
+            total += q;
+        }
+
+        row[half - 1U + (p >= (resample_sinc_phases / 2U) ? 1U : 0U)] += (int16_t)((1L << resample_sinc_coeff_shift) - total);
+    }
+
+    resample_sinc_clear();
+    return 0;
+}
+
+#endif /* RESAMPLE_SINC */
+
@@ -0,0 +1,92 @@
+
+#if defined(TARGET_WINDOWS)
+# define HW_DOS_DONT_DEFINE_MMSYSTEM
+# include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+#if defined(LINUX)
+# include <time.h>
+#endif
+
+#include "dosamp.h"
+#include "thrd.h"
+
+#if defined(HAS_THREADS)
+
+struct dosamp_thread_start {
+    dosamp_thread_func_t                func;
+    void*                               arg;
+};
+
+#if defined(LINUX)
+static void *dosamp_thread_entry(void *p) {
+#else
+static DWORD WINAPI dosamp_thread_entry(LPVOID p) {
+#endif
+    struct dosamp_thread_start s = *((struct dosamp_thread_start*)p);
+
+    free(p);
+    s.func(s.arg);
+    return 0;
+}
+
+int dosamp_thread_create(dosamp_thread_t * const t,dosamp_thread_func_t func,void * const arg) {
+    struct dosamp_thread_start *s;
+
+    s = malloc(sizeof(*s));
+    if (s == NULL) return -1;
+    s->func = func;
+    s->arg = arg;
+
+#if defined(LINUX)
+    if (pthread_create(t,NULL,dosamp_thread_entry,s) != 0) {
+        free(s);
+        return -1;
+    }
+#else
+    {
+        DWORD id;
+
+        /* NTS: Windows 95 requires the thread ID pointer to be non-NULL */
+        *t = CreateThread(NULL,0,dosamp_thread_entry,s,0,&id);
+        if (*t == NULL) {
+            free(s);
+            return -1;
+        }
+
+        /* don't let other programs starve the producer, the ring would run dry */
+        SetThreadPriority(*t,THREAD_PRIORITY_ABOVE_NORMAL);
+    }
+#endif
+
+    return 0;
+}
+
+void dosamp_thread_join(dosamp_thread_t * const t) {
+#if defined(LINUX)
+    pthread_join(*t,NULL);
+#else
+    WaitForSingleObject(*t,INFINITE);
+    CloseHandle(*t);
+    *t = NULL;
+#endif
+}
+
+void dosamp_thread_sleep(const unsigned int ms) {
+#if defined(LINUX)
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000U;
+    ts.tv_nsec = (long)(ms % 1000U) * 1000000L;
+    nanosleep(&ts,NULL);
+#else
+    Sleep(ms);
+#endif
+}
+
+#endif /* HAS_THREADS */
+
@@ -0,0 +1,20 @@
+
+/* minimal threads, just enough for the producer thread */
+
+#if defined(HAS_THREADS)
+
+#if defined(LINUX)
+# include <pthread.h>
+typedef pthread_t                       dosamp_thread_t;
+#else
+typedef HANDLE                          dosamp_thread_t;
+#endif
+
+typedef void                            (*dosamp_thread_func_t)(void *arg);
+
+int dosamp_thread_create(dosamp_thread_t * const t,dosamp_thread_func_t func,void * const arg);
+void dosamp_thread_join(dosamp_thread_t * const t);
+void dosamp_thread_sleep(const unsigned int ms);
+
+#endif /* HAS_THREADS */
+
@@ -8,7 +8,29 @@ typedef struct windows_WAVEFORMATPCM {
     uint16_t    nBlockAlign;            /* +12 */
     uint16_t    wBitsPerSample;         /* +14 */
 } windows_WAVEFORMATPCM;                /* =16 */
+
+typedef struct windows_WAVEFORMATEXTENSIBLE {
+    windows_WAVEFORMATPCM   fmt;        /* +0 */
+    uint16_t    cbSize;                 /* +16 */
+    uint16_t    wValidBitsPerSample;    /* +18 */
+    uint32_t    dwChannelMask;          /* +20 */
+    uint8_t     SubFormat[16];          /* +24 GUID, first WORD is the WAVE_FORMAT_* tag */
+} windows_WAVEFORMATEXTENSIBLE;         /* =40 */
 #pragma pack(pop)
 
 #define windows_WAVE_FORMAT_PCM         0x0001
+#define windows_WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+/* dwChannelMask, in the order the channels appear in each sample frame */
+#define windows_SPEAKER_FRONT_LEFT              0x00000001UL
+#define windows_SPEAKER_FRONT_RIGHT             0x00000002UL
+#define windows_SPEAKER_FRONT_CENTER            0x00000004UL
+#define windows_SPEAKER_LOW_FREQUENCY           0x00000008UL
+#define windows_SPEAKER_BACK_LEFT               0x00000010UL
+#define windows_SPEAKER_BACK_RIGHT              0x00000020UL
+#define windows_SPEAKER_FRONT_LEFT_OF_CENTER    0x00000040UL
+#define windows_SPEAKER_FRONT_RIGHT_OF_CENTER   0x00000080UL
+#define windows_SPEAKER_BACK_CENTER             0x00000100UL
+#define windows_SPEAKER_SIDE_LEFT               0x00000200UL
+#define windows_SPEAKER_SIDE_RIGHT              0x00000400UL
 
@@ -14,6 +14,8 @@
 
 #include <hw/dos/exehdr.h>
 
+#include "labelidx.h"
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -49,6 +51,8 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
+struct dec_code_map             dec_code;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -193,34 +197,63 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_index_free(&dec_label_idx);
 }
 
 struct dec_label *dec_find_label(const uint32_t ofs) {
-    unsigned int i=0;
+    struct dec_label *l;
+    size_t i;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    /* labels made since the last lookup have their offset filled in by now */
+    while (dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,0,l->offset,dec_label_idx.indexed) < 0)
+            break;
+
+        dec_label_idx.indexed++;
+    }
 
+    i = dec_label_index_find(&dec_label_idx,0,ofs);
+    if (i != (size_t)DEC_LABEL_INDEX_NONE && i < dec_label_count) {
+        l = dec_label + i;
         if (l->offset == ofs)
             return l;
+    }
 
-        i++;
+    /* anything the index couldn't take */
+    for (i=dec_label_idx.indexed;i < dec_label_count;i++) {
+        l = dec_label + i;
+        if (l->offset == ofs)
+            return l;
     }
 
     return NULL;
 }
 
+/* NTS: can move the array, don't hold on to label pointers across this call */
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        l = (struct dec_label*)realloc(dec_label,sizeof(*dec_label) * dec_label_alloc * 2);
+        if (l == NULL) {
+            fprintf(stderr,"Out of memory for labels (%u)\n",(unsigned int)dec_label_count);
+            return NULL;
+        }
+
+        dec_label = l;
+        dec_label_alloc *= 2;
+    }
 
-    return dec_label + (dec_label_count++);
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int exe_relocation_qsort_cb(const void *a,const void *b) {
@@ -235,6 +268,14 @@ int exe_relocation_qsort_cb(const void *a,const void *b) {
     return 0;
 }
 
+/* relocation table is sorted. returns nonzero if a relocation is applied at ofs */
+int exe_relocation_at(const uint32_t ofs) {
+    if (exe_relocation == NULL || exe_relocation_count == 0)
+        return 0;
+
+    return bsearch(&ofs,exe_relocation,exe_relocation_count,sizeof(uint32_t),exe_relocation_qsort_cb) != NULL;
+}
+
 int dec_label_qsortcb(const void *a,const void *b) {
     const struct dec_label *as = (const struct dec_label*)a;
     const struct dec_label *bs = (const struct dec_label*)b;
@@ -252,6 +293,7 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dec_label_index_clear(&dec_label_idx);
 }
 
 int main(int argc,char **argv) {
@@ -263,6 +305,9 @@ int main(int argc,char **argv) {
     if (parse_argv(argc,argv))
         return 1;
 
+    dec_label_index_init(&dec_label_idx);
+    dec_code_map_init(&dec_code);
+
     dec_label_alloc = 4096;
     dec_label_count = 0;
     dec_label = malloc(sizeof(*dec_label) * dec_label_alloc);
@@ -456,11 +501,15 @@ int main(int argc,char **argv) {
     }
 
     /* first pass: CALL + JMP + Jcc ident and label building from it.
-     * for each label, decode until 1024 instructions or a JMP, RET */
+     * labels not yet walked are the worklist, targets found along the way are added to the end.
+     * for each label, decode until 1024 instructions, a JMP, RET, or code already walked from another label */
     {
         unsigned int los = 0;
         unsigned int inscount;
 
+        if (end_decom > start_decom)
+            dec_code_map_add(&dec_code,0,0,end_decom - start_decom);
+
         while (los < dec_label_count) {
             label = dec_label + los;
             entry_ip = label->ofs_v;
@@ -480,10 +529,12 @@ int main(int argc,char **argv) {
                 los,(unsigned int)dec_label_count,
                 (unsigned int)dec_cs,(unsigned int)entry_ip,(unsigned long)dec_ofs);
 
+            dec_code_map_walk_begin(&dec_code);
             do {
                 uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - start_decom;
                 uint32_t ip = ofs + entry_ip - dec_ofs;
 
+                if (dec_code_map_visit(&dec_code,0,ofs)) break;
                 if (!refill()) break;
 
                 minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
@@ -545,7 +596,7 @@ int main(int argc,char **argv) {
                 else if (dec_i.opcode == MXOP_RET || dec_i.opcode == MXOP_RETF)
                     break;
                 else if (dec_i.opcode == MXOP_CALL_FAR || dec_i.opcode == MXOP_JMP_FAR) {
-                    size_t i,inslen;
+                    size_t inslen;
 
                     /* if it's affected by an EXE relocation entry (touches the segment part), then we *can* trace it. */
                     if (exe_relocation) {
@@ -553,34 +604,30 @@ int main(int argc,char **argv) {
                         if ((*dec_i.start == 0x9AU || *dec_i.start == 0xEAU) && dec_i.argc == 1 &&
                             dec_i.argv[0].segment == MX86_SEG_IMM &&
                             dec_i.argv[0].regtype == MX86_RT_IMM) {
-                            for (i=0;i < exe_relocation_count;i++) {
-                                /* must affect the segment portion */
-                                if ((exe_relocation[i] == (ofs + 1 + 2) && inslen == 5) ||
-                                    (exe_relocation[i] == (ofs + 1 + 4) && inslen == 7)) {
-                                    unsigned long noffset =
-                                        ((unsigned long)dec_i.argv[0].segval << 4UL) + dec_i.argv[0].value;
-                                    printf("Far jmp/call, adjusted by relocation, detected, to %04lx+reloc:%04lx\n",
-                                        (unsigned long)dec_i.argv[0].segval,
-                                        (unsigned long)dec_i.argv[0].value);
-
-                                    label = dec_find_label(noffset);
-                                    if (label == NULL) {
-                                        if ((label=dec_label_malloc()) != NULL) {
-                                            if (dec_i.opcode == MXOP_JMP_FAR)
-                                                dec_label_set_name(label,"JMP FAR target");
-                                            else if (dec_i.opcode == MXOP_CALL_FAR)
-                                                dec_label_set_name(label,"CALL FAR target");
-
-                                            label->offset =
-                                                noffset;
-                                            label->seg_v =
-                                                dec_i.argv[0].segval;
-                                            label->ofs_v =
-                                                dec_i.argv[0].value;
-                                        }
+                            /* must affect the segment portion */
+                            if ((inslen == 5 && exe_relocation_at(ofs + 1 + 2)) ||
+                                (inslen == 7 && exe_relocation_at(ofs + 1 + 4))) {
+                                unsigned long noffset =
+                                    ((unsigned long)dec_i.argv[0].segval << 4UL) + dec_i.argv[0].value;
+                                printf("Far jmp/call, adjusted by relocation, detected, to %04lx+reloc:%04lx\n",
+                                    (unsigned long)dec_i.argv[0].segval,
+                                    (unsigned long)dec_i.argv[0].value);
+
+                                label = dec_find_label(noffset);
+                                if (label == NULL) {
+                                    if ((label=dec_label_malloc()) != NULL) {
+                                        if (dec_i.opcode == MXOP_JMP_FAR)
+                                            dec_label_set_name(label,"JMP FAR target");
+                                        else if (dec_i.opcode == MXOP_CALL_FAR)
+                                            dec_label_set_name(label,"CALL FAR target");
+
+                                        label->offset =
+                                            noffset;
+                                        label->seg_v =
+                                            dec_i.argv[0].segval;
+                                        label->ofs_v =
+                                            dec_i.argv[0].value;
                                     }
-
-                                    break;
                                 }
                             }
                         }
@@ -590,12 +637,18 @@ int main(int argc,char **argv) {
                         break;
                 }
 
-                if (++inscount >= 1024)
+                if (++inscount >= 1024) {
+                    dec_code_map_walk_undo(&dec_code);
                     break;
+                }
             } while(1);
 
             los++;
         }
+
+        printf("* 1st pass done, %u labels, %lu instructions walked\n",
+            (unsigned int)dec_label_count,dec_code.visited);
+        dec_code_map_free(&dec_code);
     }
 
     /* sort labels */
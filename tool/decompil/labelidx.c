@@ -0,0 +1,222 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "labelidx.h"
+
+static size_t dec_label_index_hash(const uint16_t seg,const uint32_t ofs) {
+    uint32_t h = (uint32_t)((((uint32_t)seg << 16UL) ^ ofs) * 0x9E3779B1UL);
+
+    /* the table is indexed by the low bits, fold the better mixed high bits down */
+    return (size_t)(h ^ (h >> 15UL));
+}
+
+void dec_label_index_init(struct dec_label_index * const x) {
+    memset(x,0,sizeof(*x));
+}
+
+void dec_label_index_free(struct dec_label_index * const x) {
+    if (x->table) free(x->table);
+    x->table = NULL;
+    x->alloc = 0;
+    x->length = 0;
+    x->indexed = 0;
+}
+
+/* forget everything, for when the caller reorders dec_label[] */
+void dec_label_index_clear(struct dec_label_index * const x) {
+    size_t i;
+
+    for (i=0;i < x->alloc;i++)
+        x->table[i].label = DEC_LABEL_INDEX_NONE;
+
+    x->length = 0;
+    x->indexed = 0;
+}
+
+static void dec_label_index_put(struct dec_label_index * const x,const struct dec_label_index_ent * const e) {
+    size_t i = dec_label_index_hash(e->seg,e->ofs) & (x->alloc - 1);
+
+    while (x->table[i].label != DEC_LABEL_INDEX_NONE)
+        i = (i + 1) & (x->alloc - 1);
+
+    x->table[i] = *e;
+    x->length++;
+}
+
+/* kept at most half full, so that probes stay short */
+static int dec_label_index_grow(struct dec_label_index * const x) {
+    struct dec_label_index_ent *old = x->table;
+    size_t oldalloc = x->alloc,i;
+    size_t nalloc = (oldalloc != 0) ? (oldalloc * 2) : 1024;
+
+    x->table = (struct dec_label_index_ent*)malloc(nalloc * sizeof(struct dec_label_index_ent));
+    if (x->table == NULL) {
+        x->table = old;
+        return -1;
+    }
+
+    x->alloc = nalloc;
+    x->length = 0;
+    for (i=0;i < nalloc;i++)
+        x->table[i].label = DEC_LABEL_INDEX_NONE;
+
+    if (old != NULL) {
+        for (i=0;i < oldalloc;i++) {
+            if (old[i].label != DEC_LABEL_INDEX_NONE)
+                dec_label_index_put(x,&old[i]);
+        }
+
+        free(old);
+    }
+
+    return 0;
+}
+
+int dec_label_index_add(struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs,const size_t label) {
+    struct dec_label_index_ent e;
+
+    if ((x->length + 1) * 2 > x->alloc) {
+        if (dec_label_index_grow(x) < 0)
+            return -1;
+    }
+
+    e.seg = seg;
+    e.ofs = ofs;
+    e.label = (uint32_t)label;
+    dec_label_index_put(x,&e);
+    return 0;
+}
+
+/* returns the position in dec_label[], or DEC_LABEL_INDEX_NONE */
+size_t dec_label_index_find(const struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs) {
+    size_t i;
+
+    if (x->table == NULL)
+        return (size_t)DEC_LABEL_INDEX_NONE;
+
+    i = dec_label_index_hash(seg,ofs) & (x->alloc - 1);
+    while (x->table[i].label != DEC_LABEL_INDEX_NONE) {
+        if (x->table[i].seg == seg && x->table[i].ofs == ofs)
+            return (size_t)x->table[i].label;
+
+        i = (i + 1) & (x->alloc - 1);
+    }
+
+    return (size_t)DEC_LABEL_INDEX_NONE;
+}
+
+void dec_code_map_init(struct dec_code_map * const m) {
+    memset(m,0,sizeof(*m));
+}
+
+void dec_code_map_free(struct dec_code_map * const m) {
+    unsigned int i;
+
+    if (m->seg) {
+        for (i=0;i < m->count;i++) {
+            if (m->seg[i].bits) free(m->seg[i].bits);
+        }
+
+        free(m->seg);
+    }
+
+    if (m->walk) free(m->walk);
+
+    m->seg = NULL;
+    m->count = 0;
+    m->visited = 0;
+    m->walk = NULL;
+    m->walk_length = 0;
+    m->walk_alloc = 0;
+}
+
+/* track ofs base...base+length-1 of the segment */
+int dec_code_map_add(struct dec_code_map * const m,const unsigned int seg,const uint32_t base,const uint32_t length) {
+    struct dec_code_map_seg *s;
+
+    if (seg >= m->count) {
+        s = (struct dec_code_map_seg*)realloc(m->seg,(seg + 1) * sizeof(struct dec_code_map_seg));
+        if (s == NULL) return -1;
+
+        memset(s + m->count,0,(seg + 1 - m->count) * sizeof(struct dec_code_map_seg));
+        m->seg = s;
+        m->count = seg + 1;
+    }
+
+    s = &m->seg[seg];
+    if (s->bits) free(s->bits);
+    s->base = base;
+    s->length = 0;
+    s->bits = (unsigned char*)calloc(((size_t)length + 7) / 8,1);
+    if (s->bits == NULL) return -1;
+    s->length = length;
+
+    return 0;
+}
+
+/* marks an instruction start. returns 1 if it was already marked, 0 if not (or if it's
+ * outside anything tracked, in which case the caller has to rely on its own limits) */
+int dec_code_map_visit(struct dec_code_map * const m,const unsigned int seg,const uint32_t ofs) {
+    struct dec_code_map_seg *s;
+    unsigned char b;
+    uint32_t o;
+
+    if (seg >= m->count)
+        return 0;
+
+    s = &m->seg[seg];
+    if (s->bits == NULL || ofs < s->base)
+        return 0;
+
+    o = ofs - s->base;
+    if (o >= s->length)
+        return 0;
+
+    b = (unsigned char)(1U << (o & 7U));
+    if (s->bits[o >> 3U] & b)
+        return 1;
+
+    /* a mark that could not be taken back later is not made at all */
+    if (m->walk_length >= m->walk_alloc) {
+        size_t nalloc = (m->walk_alloc != 0) ? (m->walk_alloc * 2) : 1024;
+        struct dec_code_map_mark *n;
+
+        n = (struct dec_code_map_mark*)realloc(m->walk,nalloc * sizeof(struct dec_code_map_mark));
+        if (n == NULL) return 0;
+        m->walk = n;
+        m->walk_alloc = nalloc;
+    }
+
+    m->walk[m->walk_length].seg = seg;
+    m->walk[m->walk_length].ofs = ofs;
+    m->walk_length++;
+
+    s->bits[o >> 3U] |= b;
+    m->visited++;
+    return 0;
+}
+
+/* start a new walk, the marks made so far stay */
+void dec_code_map_walk_begin(struct dec_code_map * const m) {
+    m->walk_length = 0;
+}
+
+/* clear the marks made since dec_code_map_walk_begin(), for a walk that did not reach the
+ * end of its code. the visited count is left alone, it counts instructions decoded */
+void dec_code_map_walk_undo(struct dec_code_map * const m) {
+    struct dec_code_map_seg *s;
+    uint32_t o;
+    size_t i;
+
+    for (i=0;i < m->walk_length;i++) {
+        s = &m->seg[m->walk[i].seg];
+        o = m->walk[i].ofs - s->base;
+        s->bits[o >> 3U] &= (unsigned char)~(1U << (o & 7U));
+    }
+
+    m->walk_length = 0;
+}
+
@@ -0,0 +1,66 @@
+
+/* Label lookup and code coverage shared by the disassemblers.
+ *
+ * dec_label_index maps seg:ofs to a position in the caller's dec_label[] array through
+ * an open addressed hash table that doubles as it fills, so finding a label is the same
+ * cost no matter how many there are. Entries hold the key they were added with, the
+ * caller still compares against the label itself in case it was renamed or moved since.
+ *
+ * dec_code_map keeps one bit per byte of each segment, set at every instruction start the
+ * first pass has already decoded. A walk from a new label stops where it runs into code
+ * that was already walked, so every byte is decoded at most once in the first pass. The
+ * marks of a walk that gets cut short by the caller's instruction limit are taken back
+ * (dec_code_map_walk_undo), so that later walks follow the code past the point where it
+ * stopped, and only ever stop on code that was walked to its end. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC_LABEL_INDEX_NONE            0xFFFFFFFFUL
+
+struct dec_label_index_ent {
+    uint32_t                    ofs;
+    uint32_t                    label;      /* position in dec_label[], or DEC_LABEL_INDEX_NONE if unused */
+    uint16_t                    seg;
+};
+
+struct dec_label_index {
+    struct dec_label_index_ent* table;
+    size_t                      alloc;      /* power of 2 */
+    size_t                      length;
+    size_t                      indexed;    /* dec_label[0...indexed-1] have been added */
+};
+
+void dec_label_index_init(struct dec_label_index * const x);
+void dec_label_index_free(struct dec_label_index * const x);
+void dec_label_index_clear(struct dec_label_index * const x);
+int dec_label_index_add(struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs,const size_t label);
+size_t dec_label_index_find(const struct dec_label_index * const x,const uint16_t seg,const uint32_t ofs);
+
+struct dec_code_map_seg {
+    unsigned char*              bits;
+    uint32_t                    base;
+    uint32_t                    length;
+};
+
+struct dec_code_map_mark {
+    uint32_t                    ofs;
+    unsigned int                seg;
+};
+
+struct dec_code_map {
+    struct dec_code_map_seg*    seg;
+    unsigned int                count;      /* segments 0...count-1 */
+    unsigned long               visited;
+    struct dec_code_map_mark*   walk;       /* marks made since dec_code_map_walk_begin() */
+    size_t                      walk_length;
+    size_t                      walk_alloc;
+};
+
+void dec_code_map_init(struct dec_code_map * const m);
+void dec_code_map_free(struct dec_code_map * const m);
+int dec_code_map_add(struct dec_code_map * const m,const unsigned int seg,const uint32_t base,const uint32_t length);
+int dec_code_map_visit(struct dec_code_map * const m,const unsigned int seg,const uint32_t ofs);
+void dec_code_map_walk_begin(struct dec_code_map * const m);
+void dec_code_map_walk_undo(struct dec_code_map * const m);
+
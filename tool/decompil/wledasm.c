@@ -882,6 +882,11 @@ const char *vxd_service_to_name(const uint16_t vid,const uint16_t sid) {
 #include <hw/dos/exenepar.h>
 #include <hw/dos/exelehdr.h>
 #include <hw/dos/exelepar.h>
+#if defined(LINUX)
+#include <hw/dos/exebatch.h>
+#endif
+
+#include "labelidx.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -954,6 +959,8 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
+struct dec_code_map             dec_code;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -982,6 +989,11 @@ char*                           label_file = NULL;
 char*                           src_file = NULL;
 int                             src_fd = -1;
 
+#if defined(LINUX)
+char*                           batch_list = NULL;
+struct exe_batch                batch;
+#endif
+
 void dec_free_labels() {
     unsigned int i=0;
 
@@ -996,6 +1008,7 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_index_free(&dec_label_idx);
 }
 
 uint32_t current_offset_minus_buffer() {
@@ -1019,6 +1032,11 @@ void help() {
     fprintf(stderr,"    -lf <file>       Text file to define labels\n");
     fprintf(stderr,"    -sym <file>      Module symbols file\n");
     fprintf(stderr,"    -b <a>           Load base\n");
+#if defined(LINUX)
+    fprintf(stderr,"    -batch <list>    Decompile each file named in the list (- for stdin)\n");
+    fprintf(stderr,"    -o <dir>         Where -batch writes output and index (default .)\n");
+    fprintf(stderr,"    -j <n>           Decompile this many files at once in -batch mode\n");
+#endif
 }
 
 void print_entry_table_locate_name_by_ordinal(const struct exe_ne_header_name_entry_table * const nonresnames,const struct exe_ne_header_name_entry_table *resnames,const unsigned int ordinal) {
@@ -1081,6 +1099,21 @@ int parse_argv(int argc,char **argv) {
                 if (a == NULL) return 1;
                 load_base = (uint32_t)strtoul(a,NULL,0);
             }
+#if defined(LINUX)
+            else if (!strcmp(a,"batch")) {
+                batch_list = argv[i++];
+                if (batch_list == NULL) return 1;
+            }
+            else if (!strcmp(a,"o")) {
+                batch.outdir = argv[i++];
+                if (batch.outdir == NULL) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                batch.jobs = (unsigned int)strtoul(a,NULL,0);
+            }
+#endif
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -1092,6 +1125,11 @@ int parse_argv(int argc,char **argv) {
         }
     }
 
+#if defined(LINUX)
+    if (batch_list != NULL)
+        return 0;
+#endif
+
     if (src_file == NULL) {
         fprintf(stderr,"Must specify -i source file\n");
         return 1;
@@ -1181,31 +1219,59 @@ void dec_label_xlate_32flat_always(struct dec_label *l,struct le_header_parseinf
 }
 
 struct dec_label *dec_find_label(const uint16_t so,const uint32_t oo) {
-    unsigned int i=0;
+    struct dec_label *l;
+    size_t i;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    /* labels made since the last lookup have their seg:off filled in (and translated) by now */
+    while (dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,l->seg_v,l->ofs_v,dec_label_idx.indexed) < 0)
+            break;
 
+        dec_label_idx.indexed++;
+    }
+
+    i = dec_label_index_find(&dec_label_idx,so,oo);
+    if (i != (size_t)DEC_LABEL_INDEX_NONE && i < dec_label_count) {
+        l = dec_label + i;
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
+    }
 
-        i++;
+    /* anything the index couldn't take */
+    for (i=dec_label_idx.indexed;i < dec_label_count;i++) {
+        l = dec_label + i;
+        if (l->seg_v == so && l->ofs_v == oo)
+            return l;
     }
 
     return NULL;
 }
 
+/* NTS: can move the array, don't hold on to label pointers across this call */
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        l = (struct dec_label*)realloc(dec_label,sizeof(*dec_label) * dec_label_alloc * 2);
+        if (l == NULL) {
+            fprintf(stderr,"Out of memory for labels (%u)\n",(unsigned int)dec_label_count);
+            return NULL;
+        }
+
+        dec_label = l;
+        dec_label_alloc *= 2;
+    }
 
-    return dec_label + (dec_label_count++);
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int dec_label_qsortcb(const void *a,const void *b) {
@@ -1244,6 +1310,7 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dec_label_index_clear(&dec_label_idx);
 }
 
 struct fixup_tracking_window_ent {
@@ -1349,12 +1416,36 @@ int main(int argc,char **argv) {
     assert(sizeof(le_parser.le_header) == EXE_HEADER_LE_HEADER_SIZE);
     le_header_parseinfo_init(&le_parser);
     memset(&exehdr,0,sizeof(exehdr));
+#if defined(LINUX)
+    exe_batch_init(&batch);
+    batch.suffix = ".wledasm.txt";
+#endif
 
     if (parse_argv(argc,argv))
         return 1;
 
+#if defined(LINUX)
+    if (batch_list != NULL) {
+        int r;
+
+        if (exe_batch_load_list(&batch,batch_list) < 0)
+            return 1;
+
+        /* the parent comes back when all are done, each child comes back with its file */
+        if ((r=exe_batch_run(&batch)) <= 0) {
+            exe_batch_free(&batch);
+            return (r < 0) ? 1 : 0;
+        }
+
+        src_file = (char*)batch.current;
+    }
+#endif
+
     assert(sizeof(exehdr) == 0x1C);
 
+    dec_label_index_init(&dec_label_idx);
+    dec_code_map_init(&dec_code);
+
 #if defined(TARGET_MSDOS) && TARGET_MSDOS == 16
     dec_label_alloc = 4096;
 #else
@@ -1760,12 +1851,26 @@ int main(int argc,char **argv) {
         }
     }
  
-    /* first pass: decompilation */
+    /* first pass: decompilation.
+     * labels not yet walked are the worklist, targets found along the way are added to the end.
+     * each walk stops at 1024 instructions, a JMP, RET, or code already walked from another label. */
     {
         struct exe_le_header_object_table_entry *ent;
         unsigned int inscount;
         unsigned int los = 0;
 
+        /* offsets in 32-bit objects are linear, see dec_label_xlate_32flat() */
+        for (los=0;los < le_parser.le_header.object_table_entries;los++) {
+            ent = le_parser.le_object_table + los;
+            if (!(ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_EXECUTABLE))
+                continue;
+
+            dec_code_map_add(&dec_code,los + 1,
+                (ent->object_flags & LE_HEADER_OBJECT_TABLE_ENTRY_FLAGS_386_BIG_DEFAULT) ? le_parser.le_object_table_loaded_linear[los] : 0,
+                ent->virtual_segment_size);
+        }
+
+        los = 0;
         while (los < dec_label_count) {
             label = dec_label + los;
             if (label->seg_v == 0 || label->seg_v > le_parser.le_header.object_table_entries) {
@@ -1812,11 +1917,13 @@ int main(int argc,char **argv) {
             printf("* NE segment #%d : 0x%04lx 1st pass from '%s'\n",
                 (unsigned int)dec_cs,(unsigned long)label->ofs_v,label->name);
 
+            dec_code_map_walk_begin(&dec_code);
             do {
                 uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer();
                 uint32_t ip = ofs + entry_ip - dec_ofs;
                 unsigned int c;
 
+                if (dec_code_map_visit(&dec_code,dec_cs,ip)) break;
                 if (!refill(&io,&le_parser)) break;
 
                 minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
@@ -1943,12 +2050,18 @@ int main(int argc,char **argv) {
                         break;
                 }
 
-                if (++inscount >= 1024)
+                if (++inscount >= 1024) {
+                    dec_code_map_walk_undo(&dec_code);
                     break;
+                }
             } while(1);
 
             los++;
         }
+
+        printf("* 1st pass done, %u labels, %lu instructions walked\n",
+            (unsigned int)dec_label_count,dec_code.visited);
+        dec_code_map_free(&dec_code);
     }
 
     /* sort labels */
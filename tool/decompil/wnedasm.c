@@ -40,6 +40,11 @@
 #include <hw/dos/exehdr.h>
 #include <hw/dos/exenehdr.h>
 #include <hw/dos/exenepar.h>
+#if defined(LINUX)
+#include <hw/dos/exebatch.h>
+#endif
+
+#include "labelidx.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -56,6 +61,15 @@ struct mod_symbols_list {
     size_t                      length;
 };
 
+/* the -sym file, loaded once: ordinal names by module name. mod_symbols_list is then
+ * made for each file by matching its module reference table against this */
+struct mod_symbols_db {
+    char**                      name;
+    struct mod_symbol_table*    table;
+    size_t                      length;
+    size_t                      alloc;
+};
+
 struct dec_label {
     uint16_t                    seg_v,ofs_v;
     char*                       name;
@@ -92,16 +106,30 @@ void mod_symbol_table_free(struct mod_symbol_table *t) {
     t->alloc = 0;
 }
 
+/* the tables themselves belong to the mod_symbols_db */
 void mod_symbols_list_free(struct mod_symbols_list *t) {
+    if (t->table) free(t->table);
+    t->table = NULL;
+    t->length = 0;
+}
+
+void mod_symbols_db_free(struct mod_symbols_db *db) {
     unsigned int i;
 
-    if (t->table) {
-        for (i=0;i < t->length;i++) mod_symbol_table_free(&(t->table[i]));
-        free(t->table);
+    if (db->table) {
+        for (i=0;i < db->length;i++) {
+            mod_symbol_table_free(&(db->table[i]));
+            cstr_free(&(db->name[i]));
+        }
+
+        free(db->table);
+        free(db->name);
     }
 
-    t->table = NULL;
-    t->length = 0;
+    db->table = NULL;
+    db->name = NULL;
+    db->length = 0;
+    db->alloc = 0;
 }
 
 void dec_label_set_name(struct dec_label *l,const char *s) {
@@ -111,6 +139,8 @@ void dec_label_set_name(struct dec_label *l,const char *s) {
 struct dec_label*               dec_label = NULL;
 size_t                          dec_label_count = 0;
 size_t                          dec_label_alloc = 0;
+struct dec_label_index          dec_label_idx;
+struct dec_code_map             dec_code;
 unsigned long                   dec_ofs;
 uint16_t                        dec_cs;
 
@@ -133,6 +163,15 @@ struct exe_dos_header           exehdr;
 char*                           sym_file = NULL;
 char*                           label_file = NULL;
 
+struct mod_symbols_db           sym_db;
+struct dec_label*               label_defs = NULL;      /* from the -lf file, loaded once */
+size_t                          label_defs_count = 0;
+
+#if defined(LINUX)
+char*                           batch_list = NULL;
+struct exe_batch                batch;
+#endif
+
 char*                           src_file = NULL;
 int                             src_fd = -1;
 
@@ -150,6 +189,7 @@ void dec_free_labels() {
 
     free(dec_label);
     dec_label = NULL;
+    dec_label_index_free(&dec_label_idx);
 }
 
 uint32_t current_offset_minus_buffer() {
@@ -172,6 +212,11 @@ void help() {
     fprintf(stderr,"    -i <file>        File to decompile\n");
     fprintf(stderr,"    -lf <file>       Text file to define labels\n");
     fprintf(stderr,"    -sym <file>      Module symbols file\n");
+#if defined(LINUX)
+    fprintf(stderr,"    -batch <list>    Decompile each file named in the list (- for stdin)\n");
+    fprintf(stderr,"    -o <dir>         Where -batch writes output and index (default .)\n");
+    fprintf(stderr,"    -j <n>           Decompile this many files at once in -batch mode\n");
+#endif
 }
 
 int parse_argv(int argc,char **argv) {
@@ -200,6 +245,21 @@ int parse_argv(int argc,char **argv) {
                 help();
                 return 1;
             }
+#if defined(LINUX)
+            else if (!strcmp(a,"batch")) {
+                batch_list = argv[i++];
+                if (batch_list == NULL) return 1;
+            }
+            else if (!strcmp(a,"o")) {
+                batch.outdir = argv[i++];
+                if (batch.outdir == NULL) return 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                batch.jobs = (unsigned int)strtoul(a,NULL,0);
+            }
+#endif
             else {
                 fprintf(stderr,"Unknown switch %s\n",a);
                 return 1;
@@ -211,6 +271,11 @@ int parse_argv(int argc,char **argv) {
         }
     }
 
+#if defined(LINUX)
+    if (batch_list != NULL)
+        return 0;
+#endif
+
     if (src_file == NULL) {
         fprintf(stderr,"Must specify -i source file\n");
         return 1;
@@ -263,31 +328,59 @@ int refill() {
 }
 
 struct dec_label *dec_find_label(const uint16_t so,const uint16_t oo) {
-    unsigned int i=0;
+    struct dec_label *l;
+    size_t i;
 
     if (dec_label == NULL)
         return NULL;
 
-    while (i < dec_label_count) {
-        struct dec_label *l = dec_label + i;
+    /* labels made since the last lookup have their seg:off filled in by now */
+    while (dec_label_idx.indexed < dec_label_count) {
+        l = dec_label + dec_label_idx.indexed;
+        if (dec_label_index_add(&dec_label_idx,l->seg_v,l->ofs_v,dec_label_idx.indexed) < 0)
+            break;
 
+        dec_label_idx.indexed++;
+    }
+
+    i = dec_label_index_find(&dec_label_idx,so,oo);
+    if (i != (size_t)DEC_LABEL_INDEX_NONE && i < dec_label_count) {
+        l = dec_label + i;
         if (l->seg_v == so && l->ofs_v == oo)
             return l;
+    }
 
-        i++;
+    /* anything the index couldn't take */
+    for (i=dec_label_idx.indexed;i < dec_label_count;i++) {
+        l = dec_label + i;
+        if (l->seg_v == so && l->ofs_v == oo)
+            return l;
     }
 
     return NULL;
 }
 
+/* NTS: can move the array, don't hold on to label pointers across this call */
 struct dec_label *dec_label_malloc() {
+    struct dec_label *l;
+
     if (dec_label == NULL)
         return NULL;
 
-    if (dec_label_count >= dec_label_alloc)
-        return NULL;
+    if (dec_label_count >= dec_label_alloc) {
+        l = (struct dec_label*)realloc(dec_label,sizeof(*dec_label) * dec_label_alloc * 2);
+        if (l == NULL) {
+            fprintf(stderr,"Out of memory for labels (%u)\n",(unsigned int)dec_label_count);
+            return NULL;
+        }
+
+        dec_label = l;
+        dec_label_alloc *= 2;
+    }
 
-    return dec_label + (dec_label_count++);
+    l = dec_label + (dec_label_count++);
+    memset(l,0,sizeof(*l));
+    return l;
 }
 
 int dec_label_qsortcb(const void *a,const void *b) {
@@ -326,6 +419,7 @@ void dec_label_sort() {
         return;
 
     qsort(dec_label,dec_label_count,sizeof(*dec_label),dec_label_qsortcb);
+    dec_label_index_clear(&dec_label_idx);
 }
 
 const char *mod_symbols_list_lookup(
@@ -709,6 +803,169 @@ void print_relocation_offset(
     }
 }
 
+static void line_trim_end(char *s) {
+    char *e = s + strlen(s) - 1;
+    while (e > s && (*e == '\r' || *e == '\n')) *e-- = 0;
+}
+
+int mod_symbols_db_load(struct mod_symbols_db *db,const char *path) {
+    struct mod_symbol_table *tbl = NULL;
+    char *current_module = NULL;
+    char line[512];
+    unsigned int i;
+    FILE *fp;
+
+    fp = fopen(path,"r");
+    if (fp == NULL) {
+        fprintf(stderr,"Failed to open sym file, %s\n",path);
+        return -1;
+    }
+
+    while (!feof(fp) && !ferror(fp)) {
+        char *s;
+
+        memset(line,0,sizeof(line));
+        if (fgets(line,sizeof(line)-1,fp) == NULL)
+            break;
+
+        s = line;
+        line_trim_end(s);
+        while (*s == ' ' || *s == '\t') s++;
+
+        if (!strncasecmp(s,"module ",7)) {
+            s += 7;
+            while (*s == ' ' || *s == '\t') s++;
+
+            /* a module listed twice adds to what is already there */
+            for (i=0;i < db->length && strcasecmp(db->name[i],s) != 0;i++);
+            if (i == db->length) {
+                if (db->length >= db->alloc) {
+                    size_t na = (db->alloc != 0) ? (db->alloc * 2) : 16;
+                    void *np;
+
+                    if ((np=realloc(db->name,sizeof(*db->name) * na)) == NULL) break;
+                    db->name = np;
+                    if ((np=realloc(db->table,sizeof(*db->table) * na)) == NULL) break;
+                    db->table = np;
+                    db->alloc = na;
+                }
+
+                db->name[i] = NULL;
+                cstr_copy(&(db->name[i]),s);
+                memset(&(db->table[i]),0,sizeof(db->table[i]));
+                db->length++;
+            }
+
+            tbl = db->table + i;
+            current_module = db->name[i];
+        }
+        else if (tbl == NULL) {
+        }
+        else if (!strncasecmp(s,"ordinal.",8)) {
+            unsigned int ordinal;
+
+            s += 8;
+            ordinal = (unsigned int)strtoul(s,&s,10);
+
+            if (tbl->table == NULL) {
+                tbl->alloc = 256;
+                tbl->length = 0;
+                tbl->table = malloc(sizeof(*tbl->table) * tbl->alloc);
+                if (tbl->table == NULL) tbl->alloc = tbl->length = 0;
+            }
+            if (tbl->table != NULL) {
+                if (ordinal != 0 && ordinal <= 8192) {
+                    size_t nl = (ordinal + 255 + 1) & (~255);
+                    if (nl < tbl->alloc) nl = tbl->alloc;
+
+                    if (tbl->alloc < nl) {
+                        void *np = realloc((void*)tbl->table,sizeof(*tbl->table) * nl);
+                        if (np == NULL) break;
+                        tbl->table = np;
+                        tbl->alloc = nl;
+                    }
+
+                    while (tbl->length <= (ordinal - 1))
+                        tbl->table[tbl->length++] = NULL;
+
+                    assert(tbl->length < tbl->alloc);
+                    assert((ordinal - 1) < tbl->alloc);
+                    assert((ordinal - 1) <= tbl->length);
+
+                    if (!strncasecmp(s,".name=",6)) {
+                        s += 6;
+
+                        if (tbl->table[ordinal - 1] != NULL)
+                            printf("* WARNING: symfile redefines ordinal %u in module %s. '%s' to '%s'\n",
+                                ordinal,current_module,
+                                tbl->table[ordinal - 1],
+                                s);
+
+                        cstr_copy(&(tbl->table[ordinal - 1]),s);
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/* seg:off label, one per line */
+int label_defs_load(const char *path) {
+    char line[512];
+    FILE *fp;
+
+    fp = fopen(path,"r");
+    if (fp == NULL) {
+        fprintf(stderr,"Failed to open label file, %s\n",path);
+        return -1;
+    }
+
+    while (!feof(fp) && !ferror(fp)) {
+        char *s;
+
+        memset(line,0,sizeof(line));
+        if (fgets(line,sizeof(line)-1,fp) == NULL)
+            break;
+
+        s = line;
+        line_trim_end(s);
+
+        while (*s == ' ') s++;
+        if (*s == ';' || *s == '#') continue;
+
+        // seg:off label
+        if (isxdigit(*s)) {
+            struct dec_label *l;
+            uint16_t so,oo;
+
+            so = (uint16_t)strtoul(s,&s,16);
+            if (*s == ':') {
+                s++;
+                oo = (uint16_t)strtoul(s,&s,16);
+                while (*s == '\t' || *s == ' ') s++;
+
+                if ((label_defs_count & 255) == 0) {
+                    l = realloc(label_defs,sizeof(*label_defs) * (label_defs_count + 256));
+                    if (l == NULL) break;
+                    label_defs = l;
+                }
+
+                l = label_defs + (label_defs_count++);
+                memset(l,0,sizeof(*l));
+                dec_label_set_name(l,s);
+                l->seg_v = so;
+                l->ofs_v = oo;
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
 int main(int argc,char **argv) {
     struct exe_ne_header_segment_reloc_table *ne_segment_relocs = NULL;
     struct exe_ne_header_imported_name_table ne_imported_name_table;
@@ -737,9 +994,41 @@ int main(int argc,char **argv) {
     exe_ne_header_entry_table_table_init(&ne_entry_table);
     exe_ne_header_imported_name_table_init(&ne_imported_name_table);
 
+    memset(&sym_db,0,sizeof(sym_db));
+#if defined(LINUX)
+    exe_batch_init(&batch);
+    batch.suffix = ".wnedasm.txt";
+#endif
+
     if (parse_argv(argc,argv))
         return 1;
 
+    /* shared by every file in -batch mode, so load them first */
+    if (sym_file != NULL && mod_symbols_db_load(&sym_db,sym_file) < 0)
+        return 1;
+    if (label_file != NULL && label_defs_load(label_file) < 0)
+        return 1;
+
+#if defined(LINUX)
+    if (batch_list != NULL) {
+        int r;
+
+        if (exe_batch_load_list(&batch,batch_list) < 0)
+            return 1;
+
+        /* the parent comes back when all are done, each child comes back with its file */
+        if ((r=exe_batch_run(&batch)) <= 0) {
+            exe_batch_free(&batch);
+            return (r < 0) ? 1 : 0;
+        }
+
+        src_file = (char*)batch.current;
+    }
+#endif
+
+    dec_label_index_init(&dec_label_idx);
+    dec_code_map_init(&dec_code);
+
     dec_label_alloc = 4096;
     dec_label_count = 0;
     dec_label = malloc(sizeof(*dec_label) * dec_label_alloc);
@@ -929,10 +1218,8 @@ int main(int argc,char **argv) {
         exe_ne_header_entry_table_table_parse_raw(&ne_entry_table);
     }
 
-    if (sym_file != NULL && ne_imported_name_table.length != 0 && ne_imported_name_table.module_ref_table_length != 0) {
-        int current_module_index = -1;
-        char *current_module = NULL;
-        unsigned int i;
+    if (sym_db.length != 0 && ne_imported_name_table.length != 0 && ne_imported_name_table.module_ref_table_length != 0) {
+        unsigned int i,j;
 
         assert(mod_syms.table == NULL && mod_syms.length == 0);
         mod_syms.length = ne_imported_name_table.module_ref_table_length;
@@ -940,148 +1227,33 @@ int main(int argc,char **argv) {
         if (mod_syms.table == NULL) return 1;
         memset(mod_syms.table,0,sizeof(*mod_syms.table) * mod_syms.length);
 
-        FILE *fp = fopen(sym_file,"r");
-        if (fp == NULL) {
-            fprintf(stderr,"Failed to open sym file, %s\n",sym_file);
-            return 1;
-        }
-
-        while (!feof(fp) && !ferror(fp)) {
-            char *s;
-
-            memset(dec_buffer,0,sizeof(dec_buffer));
-            if (fgets((char*)dec_buffer,sizeof(dec_buffer)-1,fp) == NULL)
-                break;
-
-            s = (char*)dec_buffer;
-            {
-                char *e = s + strlen(s) - 1;
-                while (e > (char*)dec_buffer && (*e == '\r' || *e == '\n')) *e-- = 0;
-            }
-
-            while (*s == ' ' || *s == '\t') s++;
-
-            if (!strncasecmp(s,"module ",7)) {
-                s += 7;
-                while (*s == ' ' || *s == '\t') s++;
-
-                i = 0;
-                current_module_index = -1;
-                cstr_copy(&current_module,s);
-                while (i < ne_imported_name_table.module_ref_table_length) {
-                    ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),
-                        &ne_imported_name_table,i + 1);
-
-                    if (name_tmp[0] != 0 && strcasecmp(name_tmp,current_module) == 0) {
-                        current_module_index = i;
-                        break;
-                    }
+        for (i=0;i < mod_syms.length;i++) {
+            ne_imported_name_table_entry_get_module_ref_name(name_tmp,sizeof(name_tmp),
+                &ne_imported_name_table,i + 1);
+            if (name_tmp[0] == 0) continue;
 
-                    i++;
-                }
-
-                if (current_module_index >= 0)
-                    printf("Sym file parsing module index %u for '%s'\n",current_module_index + 1,current_module);
-            }
-            else if (current_module_index < 0) {
-            }
-            else if (!strncasecmp(s,"ordinal.",8)) {
-                struct mod_symbol_table *tbl = mod_syms.table + current_module_index;
-                unsigned int ordinal;
-
-                s += 8;
-                ordinal = (unsigned int)strtoul(s,&s,10);
-
-                if (tbl->table == NULL) {
-                    tbl->alloc = 256;
-                    tbl->length = 0;
-                    tbl->table = malloc(sizeof(*tbl->table) * tbl->alloc);
-                    if (tbl->table == NULL) tbl->alloc = tbl->length = 0;
-                }
-                if (tbl->table != NULL) {
-                    if (ordinal != 0 && ordinal <= 8192) {
-                        size_t nl = (ordinal + 255 + 1) & (~255);
-                        if (nl < tbl->alloc) nl = tbl->alloc;
-
-                        if (tbl->alloc < nl) {
-                            void *np = realloc((void*)tbl->table,sizeof(*tbl->table) * nl);
-                            if (np == NULL) break;
-                            tbl->table = np;
-                            tbl->alloc = nl;
-                        }
-
-                        while (tbl->length <= (ordinal - 1))
-                            tbl->table[tbl->length++] = NULL;
-
-                        assert(tbl->length < tbl->alloc);
-                        assert((ordinal - 1) < tbl->alloc);
-                        assert((ordinal - 1) <= tbl->length);
-
-                        if (!strncasecmp(s,".name=",6)) {
-                            s += 6;
-
-                            if (tbl->table[ordinal - 1] != NULL)
-                                printf("* WARNING: symfile redefines ordinal %u in module %s. '%s' to '%s'\n",
-                                    ordinal,current_module,
-                                    tbl->table[ordinal - 1],
-                                    s);
-
-                            cstr_copy(&(tbl->table[ordinal - 1]),s);
-                        }
-                    }
+            for (j=0;j < sym_db.length;j++) {
+                if (strcasecmp(name_tmp,sym_db.name[j]) == 0) {
+                    printf("Sym file parsing module index %u for '%s'\n",i + 1,sym_db.name[j]);
+                    mod_syms.table[i] = sym_db.table[j];
+                    break;
                 }
             }
         }
-
-        cstr_free(&current_module);
-        fclose(fp);
     }
 
-    if (label_file != NULL) {
-        FILE *fp = fopen(label_file,"r");
-        if (fp == NULL) {
-            fprintf(stderr,"Failed to open label file, %s\n",label_file);
-            return 1;
-        }
-
-        while (!feof(fp) && !ferror(fp)) {
-            char *s;
-
-            memset(dec_buffer,0,sizeof(dec_buffer));
-            if (fgets((char*)dec_buffer,sizeof(dec_buffer)-1,fp) == NULL)
-                break;
-
-            s = (char*)dec_buffer;
-            {
-                char *e = s + strlen(s) - 1;
-                while (e > (char*)dec_buffer && (*e == '\r' || *e == '\n')) *e-- = 0;
-            }
-
-            while (*s == ' ') s++;
-            if (*s == ';' || *s == '#') continue;
-
-            // seg:off label
-            if (isxdigit(*s)) {
-                uint16_t so,oo;
-
-                so = (uint16_t)strtoul(s,&s,16);
-                if (*s == ':') {
-                    s++;
-                    oo = (uint16_t)strtoul(s,&s,16);
-                    while (*s == '\t' || *s == ' ') s++;
-
-                    if ((label=dec_label_malloc()) != NULL) {
-                        dec_label_set_name(label,s);
-                        label->seg_v =
-                            so;
-                        label->ofs_v =
-                            oo;
-                    }
-                }
+    {
+        size_t i;
+
+        for (i=0;i < label_defs_count;i++) {
+            if ((label=dec_label_malloc()) != NULL) {
+                dec_label_set_name(label,label_defs[i].name);
+                label->seg_v =
+                    label_defs[i].seg_v;
+                label->ofs_v =
+                    label_defs[i].ofs_v;
             }
         }
-
-        fclose(fp);
     }
 
     printf("* Entry point %04X:%04X\n",
@@ -1317,11 +1489,21 @@ int main(int argc,char **argv) {
         }
     }
 
-    /* first pass: decompilation */
+    /* first pass: decompilation.
+     * labels not yet walked are the worklist, targets found along the way (including internal
+     * references through relocations) are added to the end. each walk stops at 1024 instructions,
+     * a JMP, RET, or code already walked from another label. */
     {
         unsigned int los = 0;
         unsigned int inscount;
 
+        for (segmenti=0;segmenti < ne_segments.length;segmenti++) {
+            const struct exe_ne_header_segment_entry *segent = ne_segments.table + segmenti;
+
+            if (segent->offset_in_segments != 0 && !(segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA))
+                dec_code_map_add(&dec_code,segmenti + 1,0,segent->length == 0 ? 0x10000UL : segent->length);
+        }
+
         while (los < dec_label_count) {
             label = dec_label + los;
             if (label->seg_v == 0) {
@@ -1371,11 +1553,13 @@ int main(int argc,char **argv) {
                 if (segent->flags & EXE_NE_HEADER_SEGMENT_ENTRY_FLAGS_DATA) {
                 }
                 else {
+                    dec_code_map_walk_begin(&dec_code);
                     do {
                         uint32_t ofs = (uint32_t)(dec_read - dec_buffer) + current_offset_minus_buffer() - segment_ofs;
                         uint32_t ip = ofs + entry_ip - dec_ofs;
                         size_t inslen;
 
+                        if (dec_code_map_visit(&dec_code,dec_cs,ip)) break;
                         if (!refill()) break;
 
                         minx86dec_set_buffer(&dec_st,dec_read,(int)(dec_end - dec_read));
@@ -1506,14 +1690,20 @@ int main(int argc,char **argv) {
                                 break;
                         }
 
-                        if (++inscount >= 1024)
+                        if (++inscount >= 1024) {
+                            dec_code_map_walk_undo(&dec_code);
                             break;
+                        }
                     } while(1);
                 }
             }
 
             los++;
         }
+
+        printf("* 1st pass done, %u labels, %lu instructions walked\n",
+            (unsigned int)dec_label_count,dec_code.visited);
+        dec_code_map_free(&dec_code);
     }
 
     /* sort labels */
@@ -2066,6 +2256,14 @@ int main(int argc,char **argv) {
     }
 
     mod_symbols_list_free(&mod_syms);
+    mod_symbols_db_free(&sym_db);
+    if (label_defs != NULL) {
+        size_t i;
+
+        for (i=0;i < label_defs_count;i++) cstr_free(&(label_defs[i].name));
+        free(label_defs);
+        label_defs = NULL;
+    }
     exe_ne_header_imported_name_table_free(&ne_imported_name_table);
     exe_ne_header_entry_table_table_free(&ne_entry_table);
     exe_ne_header_name_entry_table_free(&ne_nonresname);
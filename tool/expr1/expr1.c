@@ -1,9 +1,11 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <time.h>
 
 /* lowest to highest precedence */
 enum {
@@ -20,6 +22,7 @@ enum {
     PFWHAT_NEG,                 /* 10  -(value)  */
     PFWHAT_LPARENS,             /*     (         */
     PFWHAT_RPARENS,             /*     )         */
+    PFWHAT_VAR,                 /*     variable, value is the slot */
 
     PFWHAT_MAX
 };
@@ -38,7 +41,8 @@ static const unsigned char what_prec[PFWHAT_MAX] = {
     6,                          /*    MOD */
     7,                          /* 10 NEG */
     255,                        /*    LPAREMS */
-    255                         /*    RPARENS */
+    255,                        /*    RPARENS */
+    0                           /*    VAR */
 };
 
 static const char *what_str[PFWHAT_MAX] = {
@@ -54,7 +58,8 @@ static const char *what_str[PFWHAT_MAX] = {
     "%",
     "NEG",                      /* 10 */
     "(",
-    ")"
+    ")",
+    ""
 };
 
 struct postfix_t {
@@ -62,18 +67,81 @@ struct postfix_t {
     signed long         value;
 };
 
+/* grows as needed */
 struct postfix_expr_t {
-    struct postfix_t    pf[64];
+    struct postfix_t*   pf;
     unsigned int        count;
+    unsigned int        alloc;
 };
 
-int parse_expr_token(struct postfix_t * const tok,const char **ps,const unsigned char last_what) {
+/* variables, numbered in the order they first appear in the expression */
+#define EXPR_VARS_MAX           32
+#define EXPR_VAR_NAME_MAX       16
+
+struct expr_vars_t {
+    char                name[EXPR_VARS_MAX][EXPR_VAR_NAME_MAX];
+    unsigned int        count;
+};
+
+int expr_var_find(const struct expr_vars_t * const vars,const char * const name) {
+    unsigned int i;
+
+    for (i=0;i < vars->count;i++) {
+        if (!strcmp(vars->name[i],name))
+            return (int)i;
+    }
+
+    return -1;
+}
+
+int expr_var_slot(struct expr_vars_t * const vars,const char * const name) {
+    int i = expr_var_find(vars,name);
+
+    if (i >= 0)
+        return i;
+
+    if (vars->count >= EXPR_VARS_MAX) {
+        fprintf(stderr,"Too many variables\n");
+        return -1;
+    }
+
+    strcpy(vars->name[vars->count],name);
+    return (int)(vars->count++);
+}
+
+int parse_expr_token(struct postfix_t * const tok,struct expr_vars_t * const vars,const char **ps,const unsigned char last_what) {
     const char *s = *ps;
 
     while (isspace(*s)) s++;
 
+    if (isalpha(*s) || *s == '_') {
+        char name[EXPR_VAR_NAME_MAX];
+        unsigned int len = 0;
+        int slot;
+
+        if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
+            return -1;
+
+        while (isalnum(*s) || *s == '_') {
+            if (len >= (EXPR_VAR_NAME_MAX - 1)) {
+                fprintf(stderr,"Variable name too long\n");
+                return -1;
+            }
+            name[len++] = *s++;
+        }
+        name[len] = 0;
+
+        if ((slot=expr_var_slot(vars,name)) < 0)
+            return -1;
+
+        tok->what = PFWHAT_VAR;
+        tok->value = slot;
+        *ps = s;
+        return 0;
+    }
+
     if (isdigit(*s)) {
-        if (last_what == PFWHAT_VALUE)
+        if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR)
             return -1;
 
         tok->what = PFWHAT_VALUE;
@@ -86,7 +154,7 @@ int parse_expr_token(struct postfix_t * const tok,const char **ps,const unsigned
         case '-':
             /* if the previous token was a value, this is subtract.
              * else, it's negate */
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_SUB;
             else if (last_what == PFWHAT_NEG)
                 return -1; /* we don't want no double negatives */
@@ -95,54 +163,56 @@ int parse_expr_token(struct postfix_t * const tok,const char **ps,const unsigned
             s++;
             break;
         case '+':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_ADD;
             else
                 return -1;
             s++;
             break;
         case '*':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_MUL;
             else
                 return -1;
             s++;
             break;
         case '/':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_DIV;
             else
                 return -1;
             s++;
             break;
         case '%':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_MOD;
             else
                 return -1;
             s++;
             break;
         case '|':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_OR;
             else
                 return -1;
             s++;
             break;
         case '&':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_AND;
             else
                 return -1;
+            s++;
             break;
         case '^':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS)
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS)
                 tok->what = PFWHAT_XOR;
             else
                 return -1;
+            s++;
             break;
         case '=':
-            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_RPARENS) {
+            if (last_what == PFWHAT_VALUE || last_what == PFWHAT_VAR || last_what == PFWHAT_RPARENS) {
                 s++;
                 if (*s == '=') {
                     tok->what = PFWHAT_EQUCMP;
@@ -173,33 +243,58 @@ int parse_expr_token(struct postfix_t * const tok,const char **ps,const unsigned
     return 0;
 }
 
+void postfix_expr_free(struct postfix_expr_t * const expr) {
+    if (expr->pf != NULL) {
+        free(expr->pf);
+        expr->pf = NULL;
+    }
+
+    expr->count = expr->alloc = 0;
+}
+
 int postfix_expr_add(struct postfix_expr_t * const expr,const struct postfix_t * const tok) {
-    if (expr->count >= 64)
-        return -1;
+    if (expr->count >= expr->alloc) {
+        unsigned int n = (expr->alloc != 0) ? (expr->alloc * 2u) : 64u;
+        struct postfix_t *np;
+
+        if (n <= expr->alloc)
+            return -1;
+        if ((np=(struct postfix_t*)realloc(expr->pf,n * sizeof(struct postfix_t))) == NULL)
+            return -1;
+
+        expr->pf = np;
+        expr->alloc = n;
+    }
 
     expr->pf[expr->count++] = *tok;
     return 0;
 }
 
-int parse_expr(struct postfix_expr_t * const expr,const char *s) {
+int parse_expr(struct postfix_expr_t * const expr,struct expr_vars_t * const vars,const char *s) {
     unsigned char last_what = PFWHAT_MAX;
-    struct postfix_t op[64];
-    unsigned int opstk = 0;
+    unsigned int opstk = 0,opmax;
     struct postfix_t tok;
+    struct postfix_t *op;
+    int ret = -1;
 
     expr->count = 0;
 
+    /* every operator is at least one char of the string */
+    opmax = (unsigned int)strlen(s) + 1u;
+    if ((op=(struct postfix_t*)malloc(opmax * sizeof(struct postfix_t))) == NULL)
+        return -1;
+
     while (*s != 0) {
-        if (parse_expr_token(&tok,&s,last_what) < 0)
-            return -1;
+        if (parse_expr_token(&tok,vars,&s,last_what) < 0)
+            goto done;
 
-        if (tok.what == PFWHAT_VALUE) {
+        if (tok.what == PFWHAT_VALUE || tok.what == PFWHAT_VAR) {
             if (postfix_expr_add(expr,&tok) < 0)
-                return -1;
+                goto done;
         }
         else if (tok.what == PFWHAT_LPARENS) {
-            if (opstk >= 64)
-                return -1;
+            if (opstk >= opmax)
+                goto done;
 
             op[opstk++] = tok;
         }
@@ -212,7 +307,7 @@ int parse_expr(struct postfix_expr_t * const expr,const char *s) {
                     break;
                 }
                 else if (postfix_expr_add(expr,top) < 0)
-                    return -1;
+                    goto done;
 
                 opstk--;
             }
@@ -225,7 +320,7 @@ int parse_expr(struct postfix_expr_t * const expr,const char *s) {
                     break;
                 else if (what_prec[tok.what] <= what_prec[top->what]) {
                     if (postfix_expr_add(expr,top) < 0)
-                        return -1;
+                        goto done;
 
                     opstk--;
                 }
@@ -234,8 +329,8 @@ int parse_expr(struct postfix_expr_t * const expr,const char *s) {
                 }
             }
 
-            if (opstk >= 64)
-                return -1;
+            if (opstk >= opmax)
+                goto done;
 
             op[opstk++] = tok;
         }
@@ -254,18 +349,21 @@ int parse_expr(struct postfix_expr_t * const expr,const char *s) {
 
         if (top->what == PFWHAT_LPARENS || top->what == PFWHAT_RPARENS) {
             fprintf(stderr,"parse error: unbalanced parenthesis\n");
-            return -1;
+            goto done;
         }
         if (postfix_expr_add(expr,top) < 0)
-            return -1;
+            goto done;
 
         opstk--;
     }
 
-    return 0;
+    ret = 0;
+done:
+    free(op);
+    return ret;
 }
 
-void print_expr(const struct postfix_expr_t * const expr) {
+void print_expr(const struct postfix_expr_t * const expr,const struct expr_vars_t * const vars) {
     unsigned int i;
 
     for (i=0;i < expr->count;i++) {
@@ -273,25 +371,45 @@ void print_expr(const struct postfix_expr_t * const expr) {
 
         if (p->what == PFWHAT_VALUE)
             printf("%lu ",p->value);
+        else if (p->what == PFWHAT_VAR)
+            printf("%s ",vars->name[p->value]);
         else
             printf("%s ",what_str[p->what]);
     }
 }
 
-unsigned long eval_expr(const struct postfix_expr_t * const expr) {
-    signed long stk[64],A,B;
+/* vars[] holds a value for each variable slot */
+unsigned long eval_expr(const struct postfix_expr_t * const expr,const signed long * const vars) {
+    /* the stack can't get deeper than the expression is long. the usual case fits in
+     * stk_fixed, deeper nesting gets a stack of its own, as bytecode does */
+    signed long stk_fixed[64],*stk = stk_fixed,A,B;
+    unsigned int stk_max = 64;
+    unsigned long ret = LONG_MAX;
     unsigned int stp = 0;
     unsigned int i;
 
+    if (expr->count > stk_max) {
+        stk_max = expr->count;
+        if ((stk=(signed long*)malloc(stk_max * sizeof(signed long))) == NULL) {
+            fprintf(stderr,"eval out of memory\n");
+            return LONG_MAX;
+        }
+    }
+
     for (i=0;i < expr->count;i++) {
         const struct postfix_t *p = &expr->pf[i];
 
         switch (p->what) {
             case PFWHAT_VALUE:
-                if (stp >= 64)
+                if (stp >= stk_max)
                     goto stack_overflow;
                 stk[stp++] = p->value;
                 break;
+            case PFWHAT_VAR:
+                if (stp >= stk_max)
+                    goto stack_overflow;
+                stk[stp++] = vars[p->value];
+                break;
             case PFWHAT_ADD:
                 if (stp < 2)
                     goto stack_underflow;
@@ -318,6 +436,10 @@ unsigned long eval_expr(const struct postfix_expr_t * const expr) {
                     goto stack_underflow;
                 A = stk[--stp];
                 B = stk[--stp];
+                if (A == 0)
+                    goto divide_by_zero;
+                if (A == -1L && B == LONG_MIN)
+                    goto divide_overflow;
                 stk[stp++] = B / A;
                 break;
              case PFWHAT_MOD:
@@ -325,6 +447,10 @@ unsigned long eval_expr(const struct postfix_expr_t * const expr) {
                     goto stack_underflow;
                 A = stk[--stp];
                 B = stk[--stp];
+                if (A == 0)
+                    goto divide_by_zero;
+                if (A == -1L && B == LONG_MIN)
+                    goto divide_overflow;
                 stk[stp++] = B % A;
                 break;
               case PFWHAT_OR:
@@ -362,52 +488,678 @@ unsigned long eval_expr(const struct postfix_expr_t * const expr) {
                 break;
             default:
                 fprintf(stderr,"Unknown pf token\n");
-                return LONG_MAX;
+                goto done;
         }
     }
 
-    if (stp == 0) {
+    if (stp == 0)
         fprintf(stderr,"eval no result\n");
-        return LONG_MAX;
-    }
-    else if (stp > 1) {
+    else if (stp > 1)
         fprintf(stderr,"eval failed to clear stack\n");
-        return LONG_MAX;
-    }
+    else
+        ret = (unsigned long)stk[0];
 
-    return stk[0];
+    goto done;
 stack_overflow:
     fprintf(stderr,"eval stack overflow\n");
-    return LONG_MAX;
+    goto done;
 stack_underflow:
     fprintf(stderr,"eval stack underflow\n");
-    return LONG_MAX;
+    goto done;
+divide_by_zero:
+    fprintf(stderr,"eval divide by zero\n");
+    goto done;
+divide_overflow:
+    fprintf(stderr,"eval divide overflow\n");
+done:
+    if (stk != stk_fixed) free(stk);
+    return ret;
+}
+
+/* Bytecode: the postfix form compiled once into a byte stream for a stack machine, for
+ * evaluating the same expression over and over with different variables. Constants are
+ * folded as it compiles, small ones go inline, the rest in a pool. An operator whose right
+ * side is a constant or a variable takes it as an operand instead of from the stack (the
+ * BC_OPND_* bits), which halves the number of instructions in the usual "x * 3" case.
+ * The compiler works out how deep the stack gets, so evaluating never has to check, and
+ * there is no limit on the length of the expression other than memory. */
+enum {
+    BC_PUSH8=0,                 /* push signed byte that follows */
+    BC_PUSHK,                   /* push consts[16-bit index that follows] */
+    BC_VAR,                     /* push vars[slot byte that follows] */
+    BC_OR,
+    BC_XOR,
+    BC_AND,                     /* 5 */
+    BC_EQUCMP,
+    BC_ADD,
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,                     /* 10 */
+    BC_MOD,
+    BC_NEG,
+
+    BC_MAX
+};
+
+/* right operand of BC_OR...BC_MOD, in the upper bits of the opcode */
+#define BC_OPND_STACK           0x00
+#define BC_OPND_IMM8            0x10    /* signed byte follows */
+#define BC_OPND_CONST           0x20    /* 16-bit index into consts follows */
+#define BC_OPND_VAR             0x30    /* variable slot byte follows */
+#define BC_OPND_MASK            0x30
+
+static const char *bc_str[BC_MAX] = {
+    "push",
+    "push",
+    "var",
+    "or",
+    "xor",
+    "and",                      /* 5 */
+    "equcmp",
+    "add",
+    "sub",
+    "mul",
+    "div",                      /* 10 */
+    "mod",
+    "neg"
+};
+
+struct bc_prog_t {
+    unsigned char*      code;
+    unsigned int        len,alloc;
+    signed long*        consts;
+    unsigned int        const_count,const_alloc;
+    unsigned int        max_stack;
+    signed long*        stack;          /* max_stack entries, for bc_eval */
+};
+
+void bc_prog_free(struct bc_prog_t * const prog) {
+    if (prog->code != NULL) free(prog->code);
+    if (prog->consts != NULL) free(prog->consts);
+    if (prog->stack != NULL) free(prog->stack);
+    memset(prog,0,sizeof(*prog));
+}
+
+static int bc_emit(struct bc_prog_t * const prog,const unsigned char c) {
+    if (prog->len >= prog->alloc) {
+        unsigned int n = (prog->alloc != 0) ? (prog->alloc * 2u) : 64u;
+        unsigned char *np;
+
+        if (n <= prog->alloc)
+            return -1;
+        if ((np=(unsigned char*)realloc(prog->code,n)) == NULL)
+            return -1;
+
+        prog->code = np;
+        prog->alloc = n;
+    }
+
+    prog->code[prog->len++] = c;
+    return 0;
+}
+
+static int bc_emit_push(struct bc_prog_t * const prog,const signed long v) {
+    if (v >= -128L && v <= 127L) {
+        if (bc_emit(prog,BC_PUSH8) < 0 || bc_emit(prog,(unsigned char)((signed char)v)) < 0)
+            return -1;
+
+        return 0;
+    }
+
+    if (prog->const_count >= prog->const_alloc) {
+        unsigned int n = (prog->const_alloc != 0) ? (prog->const_alloc * 2u) : 16u;
+        signed long *np;
+
+        if (n <= prog->const_alloc || n > 0x10000UL)
+            return -1;
+        if ((np=(signed long*)realloc(prog->consts,n * sizeof(signed long))) == NULL)
+            return -1;
+
+        prog->consts = np;
+        prog->const_alloc = n;
+    }
+
+    if (bc_emit(prog,BC_PUSHK) < 0 ||
+        bc_emit(prog,(unsigned char)(prog->const_count & 0xFFu)) < 0 ||
+        bc_emit(prog,(unsigned char)(prog->const_count >> 8u)) < 0)
+        return -1;
+
+    prog->consts[prog->const_count++] = v;
+    return 0;
+}
+
+/* what the compiler knows about each entry of the stack */
+struct bc_cnode {
+    unsigned int        start;          /* where its code starts */
+    unsigned int        const_start;    /* const_count before it */
+    unsigned char       isconst;
+    unsigned char       isvar;          /* just a BC_VAR */
+    signed long         value;
+};
+
+/* apply op to B and A, the same way bc_eval does. returns -1 if it can't be folded */
+static int bc_fold(const unsigned char op,const signed long B,const signed long A,signed long * const r) {
+    switch (op) {
+        case BC_OR:     *r = B | A; break;
+        case BC_XOR:    *r = B ^ A; break;
+        case BC_AND:    *r = B & A; break;
+        case BC_EQUCMP: *r = B == A; break;
+        case BC_ADD:    *r = B + A; break;
+        case BC_SUB:    *r = B - A; break;
+        case BC_MUL:    *r = B * A; break;
+        case BC_DIV:    if (A == 0 || (A == -1L && B == LONG_MIN)) return -1; *r = B / A; break;
+        case BC_MOD:    if (A == 0 || (A == -1L && B == LONG_MIN)) return -1; *r = B % A; break;
+        default:        return -1;
+    }
+
+    return 0;
+}
+
+int bc_compile(struct bc_prog_t * const prog,const struct postfix_expr_t * const expr,const unsigned int nvars) {
+    static const unsigned char what_bc[PFWHAT_MAX] = {
+        BC_MAX,                 /* 0  VALUE */
+        BC_OR,
+        BC_XOR,
+        BC_AND,
+        BC_EQUCMP,
+        BC_ADD,                 /* 5 */
+        BC_SUB,
+        BC_MUL,
+        BC_DIV,
+        BC_MOD,
+        BC_NEG,                 /* 10 */
+        BC_MAX,
+        BC_MAX,
+        BC_MAX                  /*    VAR */
+    };
+    struct bc_cnode *stk,*A,*B;
+    unsigned int stp = 0;
+    unsigned int i;
+    signed long r;
+    int ret = -1;
+
+    memset(prog,0,sizeof(*prog));
+    if (expr->count == 0)
+        return -1;
+
+    if ((stk=(struct bc_cnode*)malloc(expr->count * sizeof(struct bc_cnode))) == NULL)
+        return -1;
+
+    for (i=0;i < expr->count;i++) {
+        const struct postfix_t *p = &expr->pf[i];
+
+        if (p->what == PFWHAT_VALUE || p->what == PFWHAT_VAR) {
+            A = &stk[stp++];
+            A->start = prog->len;
+            A->const_start = prog->const_count;
+            A->isvar = (p->what == PFWHAT_VAR) ? 1 : 0;
+
+            if (p->what == PFWHAT_VALUE) {
+                A->isconst = 1;
+                A->value = p->value;
+                if (bc_emit_push(prog,p->value) < 0)
+                    goto done;
+            }
+            else {
+                A->isconst = 0;
+                if ((unsigned long)p->value >= (unsigned long)nvars)
+                    goto done;
+                if (bc_emit(prog,BC_VAR) < 0 || bc_emit(prog,(unsigned char)p->value) < 0)
+                    goto done;
+            }
+
+            if (prog->max_stack < stp)
+                prog->max_stack = stp;
+        }
+        else if (p->what == PFWHAT_NEG) {
+            if (stp < 1)
+                goto stack_underflow;
+
+            A = &stk[stp-1];
+            if (A->isconst) {
+                prog->len = A->start;
+                prog->const_count = A->const_start;
+                A->value = -A->value;
+                if (bc_emit_push(prog,A->value) < 0)
+                    goto done;
+            }
+            else {
+                A->isvar = 0;
+                if (bc_emit(prog,BC_NEG) < 0)
+                    goto done;
+            }
+        }
+        else if (p->what < PFWHAT_MAX && what_bc[p->what] != BC_MAX) {
+            if (stp < 2)
+                goto stack_underflow;
+
+            A = &stk[--stp];
+            B = &stk[stp-1];
+            if (A->isconst && B->isconst && bc_fold(what_bc[p->what],B->value,A->value,&r) == 0) {
+                /* B's code is followed by A's, drop both */
+                prog->len = B->start;
+                prog->const_count = B->const_start;
+                B->value = r;
+                B->isvar = 0;
+                if (bc_emit_push(prog,r) < 0)
+                    goto done;
+            }
+            else {
+                unsigned char op = what_bc[p->what];
+
+                /* A's code is at the end, turn its push into the operator's operand */
+                if (A->isconst || A->isvar) {
+                    const unsigned char push = prog->code[A->start];
+
+                    prog->code[A->start] = op | (push == BC_PUSH8 ? BC_OPND_IMM8 : (push == BC_PUSHK ? BC_OPND_CONST : BC_OPND_VAR));
+                }
+                else if (bc_emit(prog,op) < 0) {
+                    goto done;
+                }
+
+                B->isconst = 0;
+                B->isvar = 0;
+            }
+        }
+        else {
+            fprintf(stderr,"Unknown pf token\n");
+            goto done;
+        }
+    }
+
+    if (stp != 1) {
+        fprintf(stderr,"compile failed to clear stack\n");
+        goto done;
+    }
+
+    if ((prog->stack=(signed long*)malloc(prog->max_stack * sizeof(signed long))) == NULL)
+        goto done;
+
+    ret = 0;
+done:
+    free(stk);
+    if (ret < 0) bc_prog_free(prog);
+    return ret;
+stack_underflow:
+    fprintf(stderr,"compile stack underflow\n");
+    goto done;
+}
+
+void bc_print(const struct bc_prog_t * const prog,const struct expr_vars_t * const vars) {
+    unsigned int ip = 0;
+    unsigned char op;
+
+    while (ip < prog->len) {
+        printf("  %04x: ",ip);
+        op = prog->code[ip++];
+        if ((op & ~BC_OPND_MASK) >= BC_MAX) {
+            printf("?\n");
+            break;
+        }
+
+        printf("%s",bc_str[op & ~BC_OPND_MASK]);
+
+        /* the operand is printed the same way as the push it replaced */
+        if ((op & BC_OPND_MASK) == BC_OPND_IMM8)
+            op = BC_PUSH8;
+        else if ((op & BC_OPND_MASK) == BC_OPND_CONST)
+            op = BC_PUSHK;
+        else if ((op & BC_OPND_MASK) == BC_OPND_VAR)
+            op = BC_VAR;
+
+        if (op == BC_PUSH8) {
+            printf(" %d",(int)((signed char)prog->code[ip]));
+            ip++;
+        }
+        else if (op == BC_PUSHK) {
+            printf(" %ld",prog->consts[prog->code[ip] + ((unsigned int)prog->code[ip+1] << 8u)]);
+            ip += 2;
+        }
+        else if (op == BC_VAR) {
+            printf(" %s",vars->name[prog->code[ip]]);
+            ip++;
+        }
+        printf("\n");
+    }
+
+    printf("  (%u bytes, %u constants, stack depth %u)\n",prog->len,prog->const_count,prog->max_stack);
+}
+
+/* each operator, with each kind of right operand */
+#define BC_CASE_BINOP(op,stmt) \
+            case op|BC_OPND_STACK: \
+                A = *--sp; stmt; break; \
+            case op|BC_OPND_IMM8: \
+                A = (signed long)((signed char)(*ip++)); stmt; break; \
+            case op|BC_OPND_CONST: \
+                A = prog->consts[ip[0] + ((unsigned int)ip[1] << 8u)]; ip += 2; stmt; break; \
+            case op|BC_OPND_VAR: \
+                A = vars[*ip++]; stmt; break;
+
+/* returns 0 and the result, or -1 on divide by zero or LONG_MIN / -1 */
+int bc_eval(const struct bc_prog_t * const prog,const signed long * const vars,signed long * const result) {
+    const unsigned char *ip = prog->code;
+    const unsigned char *fence = ip + prog->len;
+    signed long *sp = prog->stack;
+    signed long A;
+
+    while (ip < fence) {
+        switch (*ip++) {
+            case BC_PUSH8:
+                *sp++ = (signed long)((signed char)(*ip++));
+                break;
+            case BC_PUSHK:
+                *sp++ = prog->consts[ip[0] + ((unsigned int)ip[1] << 8u)];
+                ip += 2;
+                break;
+            case BC_VAR:
+                *sp++ = vars[*ip++];
+                break;
+            BC_CASE_BINOP(BC_OR,        sp[-1] |= A)
+            BC_CASE_BINOP(BC_XOR,       sp[-1] ^= A)
+            BC_CASE_BINOP(BC_AND,       sp[-1] &= A)
+            BC_CASE_BINOP(BC_EQUCMP,    sp[-1] = (sp[-1] == A))
+            BC_CASE_BINOP(BC_ADD,       sp[-1] += A)
+            BC_CASE_BINOP(BC_SUB,       sp[-1] -= A)
+            BC_CASE_BINOP(BC_MUL,       sp[-1] *= A)
+            BC_CASE_BINOP(BC_DIV,       if (A == 0 || (A == -1L && sp[-1] == LONG_MIN)) return -1; sp[-1] /= A)
+            BC_CASE_BINOP(BC_MOD,       if (A == 0 || (A == -1L && sp[-1] == LONG_MIN)) return -1; sp[-1] %= A)
+            case BC_NEG:
+                sp[-1] = -sp[-1];
+                break;
+        }
+    }
+
+    *result = sp[-1];
+    return 0;
+}
+
+#undef BC_CASE_BINOP
+
+/* evaluate rows of variables, stride longs apart. a row that fails gets LONG_MAX, the same
+ * as eval_expr. returns how many failed */
+unsigned int bc_eval_batch(const struct bc_prog_t * const prog,const signed long *vars,const unsigned int stride,const unsigned int rows,signed long *results) {
+    unsigned int r,fail = 0;
+
+    for (r=0;r < rows;r++) {
+        if (bc_eval(prog,vars,&results[r]) < 0) {
+            results[r] = LONG_MAX;
+            fail++;
+        }
+
+        vars += stride;
+    }
+
+    return fail;
+}
+
+/* timestamp in microseconds, for -bench */
+unsigned long expr_time_us(void) {
+#if defined(LINUX)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ((unsigned long)ts.tv_sec * 1000000ul) + ((unsigned long)ts.tv_nsec / 1000ul);
+#else
+    return (unsigned long)(((double)clock() * 1000000.0) / CLOCKS_PER_SEC);
+#endif
+}
+
+/* rows of variables are handled this many at a time */
+#define BATCH_ROWS              256
+
+static void help(void) {
+    fprintf(stderr,"expr1 [options] <expression> [name=value ...]\n");
+    fprintf(stderr,"  -c           Compile to bytecode, show it, and evaluate with it\n");
+    fprintf(stderr,"  -batch       Compile, then read rows of variables from stdin, one\n");
+    fprintf(stderr,"               value per variable in the order they appear, and print\n");
+    fprintf(stderr,"               one result per row\n");
+    fprintf(stderr,"  -bench <n>   Evaluate <n> rows with the interpreter and the bytecode,\n");
+    fprintf(stderr,"               each variable counting up from its name=value, compare\n");
+    fprintf(stderr,"               results and timing\n");
+}
+
+static int do_batch(const struct bc_prog_t * const prog,const unsigned int nvars) {
+    signed long *vars,*results;
+    unsigned int rows = 0,col = 0,r;
+    unsigned long row_no = 1;
+    unsigned char *bad;
+    int ret = 1;
+    char word[64];
+    int c,wl;
+
+    vars = (signed long*)malloc(BATCH_ROWS * (nvars + 1u) * sizeof(signed long));
+    results = (signed long*)malloc(BATCH_ROWS * sizeof(signed long));
+    bad = (unsigned char*)malloc(BATCH_ROWS);
+    if (vars == NULL || results == NULL || bad == NULL) {
+        fprintf(stderr,"Out of memory\n");
+        goto done;
+    }
+
+    bad[0] = 0;
+    do {
+        c = getchar();
+
+        /* one word of input, a value for the next variable */
+        wl = 0;
+        while (c != EOF && c != '\n' && !isspace(c)) {
+            if (wl < (int)(sizeof(word) - 1)) word[wl++] = (char)c;
+            c = getchar();
+        }
+        word[wl] = 0;
+
+        if (wl != 0) {
+            if (col < nvars)
+                vars[(rows * nvars) + col] = strtol(word,NULL,0);
+            else if (col == nvars)
+                bad[rows] = 1;
+            col++;
+        }
+
+        /* a malformed row prints "error" in its place, like one that fails to evaluate.
+         * with no variables, each line is a row */
+        if ((c == '\n' || c == EOF) && (col != 0 || (nvars == 0 && c == '\n'))) {
+            if (col > nvars)
+                fprintf(stderr,"Row %lu has too many values\n",row_no);
+            else if (col != nvars) {
+                fprintf(stderr,"Row %lu has %u values, need %u\n",row_no,col,nvars);
+                for (;col < nvars;col++) vars[(rows * nvars) + col] = 0;
+                bad[rows] = 1;
+            }
+            col = 0;
+            row_no++;
+            if ((++rows) < BATCH_ROWS) bad[rows] = 0;
+        }
+
+        if (rows == BATCH_ROWS || (c == EOF && rows != 0)) {
+            bc_eval_batch(prog,vars,nvars,rows,results);
+            for (r=0;r < rows;r++) {
+                if (bad[r] || results[r] == LONG_MAX)
+                    printf("error\n");
+                else
+                    printf("%ld\n",results[r]);
+            }
+            rows = 0;
+            bad[0] = 0;
+        }
+    } while (c != EOF);
+
+    ret = 0;
+done:
+    if (bad != NULL) free(bad);
+    if (results != NULL) free(results);
+    if (vars != NULL) free(vars);
+    return ret;
+}
+
+static int do_bench(const struct postfix_expr_t * const expr,const struct bc_prog_t * const prog,const signed long * const base,const unsigned int nvars,const unsigned long count) {
+    unsigned long t_interp = 0,t_bc = 0,t,done = 0,mismatch = 0;
+    signed long *vars,*results;
+    unsigned int rows,r,v;
+    signed long ival;
+
+    vars = (signed long*)malloc(BATCH_ROWS * (nvars + 1u) * sizeof(signed long));
+    results = (signed long*)malloc(BATCH_ROWS * sizeof(signed long));
+    if (vars == NULL || results == NULL) {
+        fprintf(stderr,"Out of memory\n");
+        return 1;
+    }
+
+    while (done < count) {
+        rows = ((count - done) > BATCH_ROWS) ? BATCH_ROWS : (unsigned int)(count - done);
+        for (r=0;r < rows;r++) {
+            for (v=0;v < nvars;v++)
+                vars[(r * nvars) + v] = base[v] + (signed long)(done + r);
+        }
+
+        t = expr_time_us();
+        bc_eval_batch(prog,vars,nvars,rows,results);
+        t_bc += expr_time_us() - t;
+
+        /* eval_expr returns unsigned long, the value as is */
+        t = expr_time_us();
+        for (r=0;r < rows;r++) {
+            ival = (signed long)eval_expr(expr,vars + (r * nvars));
+            if (ival != results[r]) mismatch++;
+        }
+        t_interp += expr_time_us() - t;
+
+        done += rows;
+    }
+
+    printf("%lu rows, %lu mismatches\n",done,mismatch);
+    printf("interpreter: %lu us\n",t_interp);
+    printf("bytecode:    %lu us\n",t_bc);
+    if (t_bc != 0ul)
+        printf("speedup:     %.2fx\n",(double)t_interp / (double)t_bc);
+
+    free(results);
+    free(vars);
+    return mismatch != 0ul ? 1 : 0;
 }
 
 int main(int argc,char **argv) {
-    struct postfix_expr_t expr;
+    signed long vals[EXPR_VARS_MAX];
+    unsigned char bound[EXPR_VARS_MAX];
+    struct postfix_expr_t expr = {NULL,0,0};
+    struct expr_vars_t vars;
+    struct bc_prog_t prog;
+    const char *str = NULL;
+    unsigned long bench = 0;
+    int compile = 0,batch = 0;
     signed long val;
+    char *a,*eq;
+    int i,slot;
+
+    for (i=1;i < argc;i++) {
+        a = argv[i];
+
+        if (!strcmp(a,"-c")) {
+            compile = 1;
+        }
+        else if (!strcmp(a,"-batch")) {
+            batch = 1;
+        }
+        else if (!strcmp(a,"-bench")) {
+            if (++i >= argc) {
+                help();
+                return 1;
+            }
+            bench = strtoul(argv[i],NULL,0);
+        }
+        else if (!strcmp(a,"-h") || !strcmp(a,"--help")) {
+            help();
+            return 1;
+        }
+        else {
+            break;
+        }
+    }
 
-    if (argc < 2) {
+    if (i >= argc) {
         fprintf(stderr,"Please enter an expression in argv[1]\n");
         return 1;
     }
+    str = argv[i++];
 
-    if (parse_expr(&expr,argv[1]) < 0) {
+    memset(&vars,0,sizeof(vars));
+    if (parse_expr(&expr,&vars,str) < 0) {
         fprintf(stderr,"Failure to parse\n");
         return 1;
     }
 
-    print_expr(&expr);
-    printf("\n");
+    /* name=value */
+    memset(bound,0,sizeof(bound));
+    memset(vals,0,sizeof(vals));
+    for (;i < argc;i++) {
+        a = argv[i];
+        if ((eq=strchr(a,'=')) == NULL) {
+            fprintf(stderr,"Expected name=value, got '%s'\n",a);
+            return 1;
+        }
 
-    val = eval_expr(&expr);
-    if (val == LONG_MAX) {
-        fprintf(stderr,"Failure to eval\n");
-        return 1;
+        *eq = 0;
+        if ((slot=expr_var_find(&vars,a)) < 0) {
+            fprintf(stderr,"Expression has no variable '%s'\n",a);
+            return 1;
+        }
+
+        vals[slot] = strtol(eq+1,NULL,0);
+        bound[slot] = 1;
+    }
+
+    /* -batch output is one result per row, nothing else */
+    if (!batch && bench == 0ul) {
+        print_expr(&expr,&vars);
+        printf("\n");
     }
-    printf("result = %ld\n",val);
 
+    if (compile || batch || bench != 0ul) {
+        if (bc_compile(&prog,&expr,vars.count) < 0) {
+            fprintf(stderr,"Failure to compile\n");
+            return 1;
+        }
+
+        if (compile || bench != 0ul)
+            bc_print(&prog,&vars);
+
+        if (batch) {
+            if (do_batch(&prog,vars.count))
+                return 1;
+        }
+        else if (bench != 0ul) {
+            if (do_bench(&expr,&prog,vals,vars.count,bench))
+                return 1;
+        }
+    }
+
+    if (!batch && bench == 0ul) {
+        for (slot=0;slot < (int)vars.count;slot++) {
+            if (!bound[slot]) {
+                fprintf(stderr,"No value for '%s'\n",vars.name[slot]);
+                return 1;
+            }
+        }
+
+        if (compile) {
+            if (bc_eval(&prog,vals,&val) < 0) {
+                fprintf(stderr,"Failure to eval\n");
+                return 1;
+            }
+        }
+        else {
+            val = eval_expr(&expr,vals);
+            if (val == LONG_MAX) {
+                fprintf(stderr,"Failure to eval\n");
+                return 1;
+            }
+        }
+        printf("result = %ld\n",val);
+    }
+
+    if (compile || batch || bench != 0ul)
+        bc_prog_free(&prog);
+
+    postfix_expr_free(&expr);
     return 0;
 }
-
@@ -13,6 +13,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <time.h>
+#if defined(LINUX)
+# include <pthread.h>
+#endif
 
 #include <fmt/omf/omf.h>
 #include <fmt/omf/omfcstr.h>
@@ -70,9 +74,75 @@ const char *get_in_file(unsigned int idx) {
     return "";
 }
 
+static unsigned char                    report_timing = 0;
+static unsigned long                    in_file_time_us[PASS_MAX][MAX_IN_FILES];
+
+/* timestamp in microseconds, for the -time report */
+unsigned long link_time_us(void) {
+#if defined(LINUX)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ((unsigned long)ts.tv_sec * 1000000ul) + ((unsigned long)ts.tv_nsec / 1000ul);
+#else
+    return (unsigned long)(((double)clock() * 1000000.0) / CLOCKS_PER_SEC);
+#endif
+}
+
+void dump_timing_report(void) {
+    unsigned long total[PASS_MAX] = {0};
+    unsigned int inf,pass;
+
+    fprintf(stderr,"Link timing (microseconds):\n");
+    fprintf(stderr,"  %-10s %-10s %s\n","pass 1","pass 2","file");
+    for (inf=0;inf < in_file_count;inf++) {
+        fprintf(stderr,"  %-10lu %-10lu %s\n",
+            in_file_time_us[PASS_GATHER][inf],
+            in_file_time_us[PASS_BUILD][inf],
+            get_in_file(inf));
+
+        for (pass=0;pass < PASS_MAX;pass++)
+            total[pass] += in_file_time_us[pass][inf];
+    }
+    fprintf(stderr,"  %-10lu %-10lu (total, %u files)\n",
+        total[PASS_GATHER],total[PASS_BUILD],in_file_count);
+}
+
 static unsigned char                    do_dosseg = 1;
 
-struct omf_context_t*                   omf_state = NULL;
+/* inputs are mapped/loaded once, and stay open for both passes */
+static struct omf_image_t               in_file_img[MAX_IN_FILES];
+static unsigned char                    in_file_img_open[MAX_IN_FILES];
+
+/* -l libraries: only the modules that resolve EXTDEFs are linked, found through the library dictionary */
+static unsigned char                    in_file_lib[MAX_IN_FILES];
+static struct omf_libdict_t*            in_file_libdict[MAX_IN_FILES];
+static unsigned short                   in_file_lib_modules[MAX_IN_FILES];
+static unsigned int                     in_lib_count = 0;
+
+/* one unit of input to parse */
+struct link_input {
+    unsigned short                      in_file;
+    unsigned short                      in_module;          /* module index of a single .LIB module */
+    unsigned long                       module_offset;      /* file offset of a single .LIB module */
+    unsigned char                       single_module;      /* else every module in the file */
+    unsigned char                       parsed;
+    int                                 parse_result;
+    unsigned long                       parse_time_us;
+    struct link_module*                 modules;            /* parsed modules, see link_input_parse() */
+    size_t                              modules_count;
+    size_t                              modules_alloc;
+};
+
+static struct link_input*               link_inputs = NULL;
+static size_t                           link_inputs_count = 0;
+static size_t                           link_inputs_alloc = 0;
+
+/* names of global EXTDEFs seen so far, checked against the libraries once */
+static char**                           link_extdefs = NULL;
+static size_t                           link_extdefs_count = 0;
+static size_t                           link_extdefs_alloc = 0;
+static size_t                           link_extdefs_checked = 0;
 
 static unsigned char                    verbose = 0;
 
@@ -199,12 +269,17 @@ static unsigned int                     output_format_variant = OFMTVAR_NONE;
 
 #define MAX_SEG_FRAGMENTS               1024
 
-#if TARGET_MSDOS == 32 || defined(LINUX)
+#if defined(LINUX)
+/* no fixed cap on the host build, only available memory */
+#define MAX_SYMBOLS                     (((size_t)(~((size_t)0u))) / 2u / sizeof(struct link_symbol))
+#elif TARGET_MSDOS == 32
 #define MAX_SYMBOLS                     65536
 #else
 #define MAX_SYMBOLS                     4096
 #endif
 
+#define LINK_SYMBOL_HASH_NONE           (~((size_t)0u))
+
 struct link_symbol {
     char*                               name;
     char*                               segdef;
@@ -214,6 +289,7 @@ struct link_symbol {
     unsigned short                      in_file;
     unsigned short                      in_module;
     unsigned int                        is_local:1;
+    size_t                              hash_next;          /* next symbol index in hash bucket chain */
 };
 
 static struct link_symbol*              link_symbols = NULL;
@@ -221,6 +297,59 @@ static size_t                           link_symbols_count = 0;
 static size_t                           link_symbols_alloc = 0;
 static size_t                           link_symbols_nextalloc = 0;
 
+/* symbol name index. buckets are keyed on the name only, file/module scope of local
+ * symbols is checked while walking the chain. chains hold symbol indices, not pointers,
+ * so that realloc() of link_symbols does not invalidate them. */
+static size_t*                          link_symbols_hash = NULL;
+static size_t                           link_symbols_hash_size = 0;    /* power of 2 */
+
+unsigned long link_symbol_name_hash(const char *name) {
+    unsigned long h = 2166136261ul; /* FNV-1a */
+
+    while (*name != 0) {
+        h ^= (unsigned char)(*name++);
+        h *= 16777619ul;
+    }
+
+    return h;
+}
+
+void link_symbol_hash_insert(size_t i) {
+    struct link_symbol *sym = link_symbols + i;
+    size_t b;
+
+    assert(link_symbols_hash != NULL);
+    assert(sym->name != NULL);
+
+    b = (size_t)link_symbol_name_hash(sym->name) & (link_symbols_hash_size - 1u);
+    sym->hash_next = link_symbols_hash[b];
+    link_symbols_hash[b] = i;
+}
+
+/* (re)build the name index from scratch, needed when the symbol array grows or is sorted */
+int link_symbols_rehash(void) {
+    size_t i,sz = 256;
+
+    while (sz < link_symbols_alloc) sz <<= 1u;
+
+    if (link_symbols_hash == NULL || link_symbols_hash_size != sz) {
+        size_t *n = realloc(link_symbols_hash, sz * sizeof(size_t));
+        if (n == NULL) return -1;
+        link_symbols_hash = n;
+        link_symbols_hash_size = sz;
+    }
+
+    for (i=0;i < link_symbols_hash_size;i++)
+        link_symbols_hash[i] = LINK_SYMBOL_HASH_NONE;
+
+    for (i=0;i < link_symbols_count;i++) {
+        if (link_symbols[i].name != NULL)
+            link_symbol_hash_insert(i);
+    }
+
+    return 0;
+}
+
 int link_symbols_extend(size_t sz) {
     if (sz > MAX_SYMBOLS) return -1;
     if (sz <= link_symbols_alloc) return 0;
@@ -244,7 +373,7 @@ int link_symbols_extend(size_t sz) {
     }
 
     link_symbols_alloc = sz;
-    return 0;
+    return link_symbols_rehash();
 }
 
 int link_symbols_extend_double(void) {
@@ -291,19 +420,26 @@ struct link_symbol *new_link_symbol(const char *name) {
         assert(sym->groupdef == NULL);
 
         sym->name = strdup(name);
+        if (sym->name == NULL) return NULL;
 
         sym->in_file = (unsigned short)(~0u);
+
+        link_symbol_hash_insert((size_t)(sym - link_symbols));
     }
 
     return sym;
 }
 
 struct link_symbol *find_link_symbol(const char *name,int in_file,int in_module) {
-    struct link_symbol *sym;
-    size_t i = 0;
+    struct link_symbol *sym,*found = NULL;
+    size_t i;
 
-    if (link_symbols != NULL) {
-        for (;i < link_symbols_count;i++) {
+    if (link_symbols != NULL && link_symbols_hash != NULL) {
+        i = link_symbols_hash[(size_t)link_symbol_name_hash(name) & (link_symbols_hash_size - 1u)];
+
+        /* chains are newest-first. walk the whole chain and return the lowest index match,
+         * which is the same symbol a linear scan of link_symbols[] would return */
+        for (;i != LINK_SYMBOL_HASH_NONE;i = sym->hash_next) {
             sym = link_symbols + i;
             assert(sym->name != NULL);
 
@@ -318,11 +454,11 @@ struct link_symbol *find_link_symbol(const char *name,int in_file,int in_module)
             }
 
             if (!strcmp(sym->name, name))
-                return sym;
+                found = sym;
         }
     }
 
-    return NULL;
+    return found;
 }
 
 void link_symbol_free(struct link_symbol *s) {
@@ -342,6 +478,12 @@ void link_symbols_free(void) {
         link_symbols_count = 0;
         link_symbols_nextalloc = 0;
     }
+
+    if (link_symbols_hash != NULL) {
+        free(link_symbols_hash);
+        link_symbols_hash = NULL;
+        link_symbols_hash_size = 0;
+    }
 }
 
 #define MAX_SEGMENTS                    256
@@ -848,10 +990,10 @@ void dump_hex_symbols(FILE *hfp,const char *hex_output_name) {
     }
 }
 
-void dump_link_symbols(void) {
+int dump_link_symbols(void) {
     unsigned int i,pass=0,passes=1;
 
-    if (link_symbols == NULL) return;
+    if (link_symbols == NULL) return 0;
 
     if (map_fp != NULL)
         passes = 2;
@@ -865,9 +1007,14 @@ void dump_link_symbols(void) {
             fprintf(map_fp,"---------------------------------------\n");
         }
 
-        if (verbose || map_fp != NULL)
+        if (verbose || map_fp != NULL) {
             qsort(link_symbols, link_symbols_count, sizeof(struct link_symbol),
                 pass == 0 ? link_symbol_qsort_cmp_by_name : link_symbol_qsort_cmp);
+            if (link_symbols_rehash()) {
+                fprintf(stderr,"Unable to rebuild symbol index\n");
+                return -1;
+            }
+        }
 
         while (i < link_symbols_count) {
             struct link_symbol *sym = &link_symbols[i++];
@@ -909,6 +1056,8 @@ void dump_link_symbols(void) {
         if (map_fp != NULL)
             fprintf(map_fp,"\n");
     }
+
+    return 0;
 }
 
 void dump_hex_segments(FILE *hfp,const char *hex_output_name) {
@@ -1648,8 +1797,11 @@ int apply_FIXUPP(struct omf_context_t *omf_state,unsigned int first,unsigned int
     return 0;
 }
 
-int grpdef_add(struct omf_context_t *omf_state,unsigned int first) {
-    while (first < omf_state->GRPDEFs.omf_GRPDEFS_count) {
+int grpdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int last) {
+    if (last > omf_state->GRPDEFs.omf_GRPDEFS_count)
+        last = omf_state->GRPDEFs.omf_GRPDEFS_count;
+
+    while (first < last) {
         struct omf_grpdef_t *gd = &omf_state->GRPDEFs.omf_GRPDEFS[first++];
         struct link_segdef *lsg;
         const char *grpdef_name;
@@ -1700,12 +1852,15 @@ int grpdef_add(struct omf_context_t *omf_state,unsigned int first) {
     return 0;
 }
 
-int pubdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int tag,unsigned int in_file,unsigned int in_module,unsigned int pass) {
+int pubdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int last,unsigned int tag,unsigned int in_file,unsigned int in_module,unsigned int pass) {
     const unsigned char is_local = (tag == OMF_RECTYPE_LPUBDEF) || (tag == OMF_RECTYPE_LPUBDEF32);
 
     (void)pass;
 
-    while (first < omf_state->PUBDEFs.omf_PUBDEFS_count) {
+    if (last > omf_state->PUBDEFs.omf_PUBDEFS_count)
+        last = omf_state->PUBDEFs.omf_PUBDEFS_count;
+
+    while (first < last) {
         const struct omf_pubdef_t *pubdef = &omf_state->PUBDEFs.omf_PUBDEFS[first++];
         struct link_segdef *lsg;
         struct link_symbol *sym;
@@ -1771,11 +1926,14 @@ int pubdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int t
     return 0;
 }
 
-int segdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int in_file,unsigned int in_module,unsigned int pass) {
+int segdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int last,unsigned int in_file,unsigned int in_module,unsigned int pass) {
     unsigned long alignb,malign;
     struct link_segdef *lsg;
 
-    while (first < omf_state->SEGDEFs.omf_SEGDEFS_count) {
+    if (last > omf_state->SEGDEFs.omf_SEGDEFS_count)
+        last = omf_state->SEGDEFs.omf_SEGDEFS_count;
+
+    while (first < last) {
         struct omf_segdef_t *sg = &omf_state->SEGDEFs.omf_SEGDEFS[first++];
         const char *classname = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,sg->class_name_index);
         const char *name = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,sg->segment_name_index);
@@ -1872,6 +2030,7 @@ int segdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int i
 static void help(void) {
     fprintf(stderr,"lnkdos16 [options]\n");
     fprintf(stderr,"  -i <file>    OMF file to link\n");
+    fprintf(stderr,"  -l <file>    OMF library, link only modules needed by EXTDEFs\n");
     fprintf(stderr,"  -o <file>    Output file\n");
     fprintf(stderr,"  -map <file>  Map/report file\n");
     fprintf(stderr,"  -of <fmt>    Output format (COM, EXE, COMREL)\n");
@@ -1894,6 +2053,10 @@ static void help(void) {
     fprintf(stderr,"  -hex <file>  Also emit file as C header hex dump\n");
     fprintf(stderr,"  -hexsplit    Emit to -hex as .h and .c files\n");
     fprintf(stderr,"  -hexcpp      Use CPP extension.\n");
+    fprintf(stderr,"  -time        Report pass 1/pass 2 time per input file\n");
+#if defined(LINUX)
+    fprintf(stderr,"  -j <n>       Parse input files on <n> threads\n");
+#endif
 }
 
 void my_dumpstate(const struct omf_context_t * const ctx) {
@@ -1919,22 +2082,22 @@ void my_dumpstate(const struct omf_context_t * const ctx) {
 
     if (ctx->SEGDEFs.omf_SEGDEFS != NULL) {
         for (i=1;i <= ctx->SEGDEFs.omf_SEGDEFS_count;i++)
-            dump_SEGDEF(stdout,omf_state,i);
+            dump_SEGDEF(stdout,ctx,i);
     }
 
     if (ctx->GRPDEFs.omf_GRPDEFS != NULL) {
         for (i=1;i <= ctx->GRPDEFs.omf_GRPDEFS_count;i++)
-            dump_GRPDEF(stdout,omf_state,i);
+            dump_GRPDEF(stdout,ctx,i);
     }
 
     if (ctx->EXTDEFs.omf_EXTDEFS != NULL)
-        dump_EXTDEF(stdout,omf_state,1);
+        dump_EXTDEF(stdout,ctx,1);
 
     if (ctx->PUBDEFs.omf_PUBDEFS != NULL)
-        dump_PUBDEF(stdout,omf_state,1);
+        dump_PUBDEF(stdout,ctx,1);
 
     if (ctx->FIXUPPs.omf_FIXUPPS != NULL)
-        dump_FIXUPP(stdout,omf_state,1);
+        dump_FIXUPP(stdout,ctx,1);
 
     if (verbose)
         printf("----END-----\n");
@@ -1972,12 +2135,850 @@ int segment_def_arrange(void) {
     return 0;
 }
 
-int main(int argc,char **argv) {
+struct omf_image_t *link_input_image(const unsigned int inf) {
+    if (!in_file_img_open[inf]) {
+        int fd = open(in_file[inf],O_RDONLY|O_BINARY);
+        if (fd < 0) {
+            fprintf(stderr,"Failed to open input file %s\n",strerror(errno));
+            return NULL;
+        }
+        if (omf_image_open_fd(&in_file_img[inf],fd) < 0) {
+            fprintf(stderr,"Failed to read input file %s\n",strerror(errno));
+            close(fd);
+            return NULL;
+        }
+
+        in_file_img_open[inf] = 1;
+    }
+
+    return &in_file_img[inf];
+}
+
+struct link_input *new_link_input(void) {
+    struct link_input *li;
+
+    if (link_inputs_count >= link_inputs_alloc) {
+        size_t ns = link_inputs_alloc * 2u;
+        if (ns < 64u) ns = 64u;
+
+        li = realloc(link_inputs, ns * sizeof(struct link_input));
+        if (li == NULL) return NULL;
+        link_inputs = li;
+        link_inputs_alloc = ns;
+    }
+
+    li = link_inputs + (link_inputs_count++);
+    memset(li,0,sizeof(*li));
+    return li;
+}
+
+int link_library_open(const unsigned int inf) {
+    struct omf_image_t *img;
+
+    if ((img=link_input_image(inf)) == NULL)
+        return -1;
+
+    in_file_libdict[inf] = malloc(sizeof(struct omf_libdict_t));
+    if (in_file_libdict[inf] == NULL)
+        return -1;
+
+    if (omf_libdict_open(in_file_libdict[inf],img) < 0) {
+        fprintf(stderr,"%s is not an OMF library with a dictionary\n",in_file[inf]);
+        return -1;
+    }
+
+    return 0;
+}
+
+int link_extdef_add(struct omf_context_t *omf_state,unsigned int first,unsigned int last) {
+    while (first < last) {
+        const struct omf_extdef_t *extdef = omf_extdefs_context_get_extdef(&omf_state->EXTDEFs,first++);
+
+        if (extdef == NULL || extdef->name_string == NULL) continue;
+        if (extdef->type != OMF_EXTDEF_TYPE_GLOBAL) continue;
+
+        if (link_extdefs_count >= link_extdefs_alloc) {
+            size_t ns = link_extdefs_alloc * 2u;
+            char **n;
+
+            if (ns < 256u) ns = 256u;
+            n = realloc(link_extdefs, ns * sizeof(char*));
+            if (n == NULL) return -1;
+            link_extdefs = n;
+            link_extdefs_alloc = ns;
+        }
+
+        link_extdefs[link_extdefs_count] = strdup(extdef->name_string);
+        if (link_extdefs[link_extdefs_count] == NULL) return -1;
+        link_extdefs_count++;
+    }
+
+    return 0;
+}
+
+/* add library modules that define EXTDEFs not yet resolved, in command line order of the libraries.
+ * the caller gathers the new inputs, which may add more EXTDEFs for another round. */
+int link_resolve_libraries(void) {
+    unsigned long ofs;
+    unsigned int inf;
+    size_t j;
+
+    while (link_extdefs_checked < link_extdefs_count) {
+        const char *name = link_extdefs[link_extdefs_checked++];
+
+        if (find_link_symbol(name,-1,-1) != NULL)
+            continue;
+
+        for (inf=0;inf < in_file_count;inf++) {
+            if (in_file_libdict[inf] == NULL) continue;
+
+            ofs = omf_libdict_lookup(in_file_libdict[inf],name);
+            if (ofs == 0ul) continue;
+
+            for (j=0;j < link_inputs_count;j++) {
+                if (link_inputs[j].single_module && link_inputs[j].in_file == inf && link_inputs[j].module_offset == ofs)
+                    break;
+            }
+
+            if (j == link_inputs_count) {
+                struct link_input *li = new_link_input();
+                if (li == NULL) return -1;
+
+                li->in_file = inf;
+                li->in_module = in_file_lib_modules[inf]++;
+                li->module_offset = ofs;
+                li->single_module = 1;
+
+                if (verbose)
+                    fprintf(stderr,"'%s' resolved by module at 0x%lx in %s\n",name,ofs,in_file[inf]);
+            }
+
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void free_link_inputs(void) {
+    unsigned int inf;
+    size_t i;
+
+    for (inf=0;inf < in_file_count;inf++) {
+        if (in_file_libdict[inf] != NULL) {
+            free(in_file_libdict[inf]);
+            in_file_libdict[inf] = NULL;
+        }
+        if (in_file_img_open[inf]) {
+            omf_image_close(&in_file_img[inf]);
+            close(in_file_img[inf].fd);
+            in_file_img_open[inf] = 0;
+        }
+    }
+
+    if (link_extdefs != NULL) {
+        for (i=0;i < link_extdefs_count;i++) free(link_extdefs[i]);
+        free(link_extdefs);
+        link_extdefs = NULL;
+        link_extdefs_count = 0;
+        link_extdefs_alloc = 0;
+        link_extdefs_checked = 0;
+    }
+
+    if (link_inputs != NULL) {
+        free(link_inputs);
+        link_inputs = NULL;
+        link_inputs_count = 0;
+        link_inputs_alloc = 0;
+    }
+}
+
+/* pass 1 parses each input into what the link needs of its modules (this part can run on worker threads),
+ * then gathers those in command line order. pass 2 works from the same parsed modules, the OMF is not read again. */
+enum {
+    LINK_CACHE_SEGDEF=0,
+    LINK_CACHE_GRPDEF,
+    LINK_CACHE_PUBDEF,
+    LINK_CACHE_EXTDEF,
+    LINK_CACHE_LEDATA,
+    LINK_CACHE_MODEND
+};
+
+struct link_cache_rec {
+    unsigned char                       type;               /* LINK_CACHE_* */
+    unsigned char                       rectype;            /* OMF record type */
+    unsigned char                       data_copy;          /* LEDATA payload was copied, else points into the input image */
+    unsigned int                        first,last;         /* SEGDEF/GRPDEF/PUBDEF/EXTDEF: entries [first,last) added by the record.
+                                                               MODEND: frame and target SEGDEF of the start address */
+    unsigned long                       offset;             /* MODEND: start address offset */
+    struct omf_ledata_info_t            ledata;             /* LEDATA */
+};
+
+struct link_module {
+    struct omf_context_t*               omf_state;          /* LNAMES, SEGDEFs, GRPDEFs, EXTDEFs, PUBDEFs and FIXUPPs of the module */
+    struct link_cache_rec*              recs;               /* in record order */
+    size_t                              recs_count;
+    size_t                              recs_alloc;
+    unsigned short                      in_file;
+    unsigned short                      in_module;
+};
+
+static unsigned int                     link_jobs = 1;      /* -j */
+
+struct link_module *new_link_module(struct link_input *li,const unsigned int in_module) {
+    struct link_module *m;
+
+    if (li->modules_count >= li->modules_alloc) {
+        size_t ns = li->modules_alloc * 2u;
+        if (ns < 4u) ns = 4u;
+
+        m = realloc(li->modules, ns * sizeof(struct link_module));
+        if (m == NULL) return NULL;
+        li->modules = m;
+        li->modules_alloc = ns;
+    }
+
+    m = li->modules + li->modules_count;
+    memset(m,0,sizeof(*m));
+    m->in_file = li->in_file;
+    m->in_module = in_module;
+
+    if ((m->omf_state=omf_context_create()) == NULL) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        return NULL;
+    }
+    m->omf_state->flags.verbose = (verbose > 0);
+
+    li->modules_count++;
+    return m;
+}
+
+struct link_cache_rec *link_module_add_rec(struct link_module *m,const unsigned char type,const unsigned char rectype) {
+    struct link_cache_rec *r;
+
+    if (m->recs_count >= m->recs_alloc) {
+        size_t ns = m->recs_alloc * 2u;
+        if (ns < 32u) ns = 32u;
+
+        r = realloc(m->recs, ns * sizeof(struct link_cache_rec));
+        if (r == NULL) return NULL;
+        m->recs = r;
+        m->recs_alloc = ns;
+    }
+
+    r = m->recs + (m->recs_count++);
+    memset(r,0,sizeof(*r));
+    r->type = type;
+    r->rectype = rectype;
+    return r;
+}
+
+int link_module_add_range(struct link_module *m,const unsigned char type,const unsigned char rectype,const unsigned int first,const unsigned int last) {
+    struct link_cache_rec *r = link_module_add_rec(m,type,rectype);
+    if (r == NULL) return -1;
+
+    r->first = first;
+    r->last = last;
+    return 0;
+}
+
+int link_module_add_ledata(struct link_module *m,const struct omf_ledata_info_t *info,const unsigned char rectype,const struct omf_image_t *img) {
+    struct link_cache_rec *r = link_module_add_rec(m,LINK_CACHE_LEDATA,rectype);
+    if (r == NULL) return -1;
+
+    r->ledata = *info;
+
+    /* without an in-memory image the record buffer is reused for the next record, keep a copy */
+    if (img->data == NULL && info->data_length != 0ul) {
+        r->ledata.data = malloc(info->data_length);
+        if (r->ledata.data == NULL) return -1;
+        memcpy(r->ledata.data,info->data,info->data_length);
+        r->data_copy = 1;
+    }
+
+    return 0;
+}
+
+/* move the tables the link needs out of the parsing context, before it moves on to the next module */
+void link_module_take_tables(struct link_module *m,struct omf_context_t *omf_state) {
+    struct omf_context_t *c = m->omf_state;
+
+    omf_lnames_context_free(&c->LNAMEs);
+    c->LNAMEs = omf_state->LNAMEs;
+    omf_lnames_context_init(&omf_state->LNAMEs);
+
+    omf_segdefs_context_free(&c->SEGDEFs);
+    c->SEGDEFs = omf_state->SEGDEFs;
+    omf_segdefs_context_init(&omf_state->SEGDEFs);
+
+    omf_grpdefs_context_free(&c->GRPDEFs);
+    c->GRPDEFs = omf_state->GRPDEFs;
+    omf_grpdefs_context_init(&omf_state->GRPDEFs);
+
+    omf_extdefs_context_free(&c->EXTDEFs);
+    c->EXTDEFs = omf_state->EXTDEFs;
+    omf_extdefs_context_init(&omf_state->EXTDEFs);
+
+    omf_pubdefs_context_free(&c->PUBDEFs);
+    c->PUBDEFs = omf_state->PUBDEFs;
+    omf_pubdefs_context_init(&omf_state->PUBDEFs);
+
+    omf_fixupps_context_free(&c->FIXUPPs);
+    c->FIXUPPs = omf_state->FIXUPPs;
+    omf_fixupps_context_init(&omf_state->FIXUPPs);
+}
+
+/* MODEND with a start address: remember the entry point segments */
+void link_module_gather_entry(struct link_module *m,const struct link_cache_rec *r) {
+    const struct omf_context_t *omf_state = m->omf_state;
+    const struct omf_segdef_t *frame_segdef;
+    const struct omf_segdef_t *target_segdef;
+
+    frame_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,r->first);
+    target_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,r->last);
+
+    if (frame_segdef != NULL && target_segdef != NULL) {
+        const char *framename = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index);
+        const char *targetname = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index);
+
+        if (verbose)
+            fprintf(stderr,"'%s' vs '%s'\n",framename,targetname);
+
+        if (*framename != 0 && *targetname != 0) {
+            struct link_segdef *frameseg,*targseg;
+
+            targseg = find_link_segment(targetname);
+            frameseg = find_link_segment(framename);
+            if (targseg != NULL && frameseg != NULL) {
+                entry_seg_ofs = r->offset;
+
+                assert(frameseg->fragments_count != 0);
+                entry_seg_link_frame_fragment = frameseg->fragments_count - 1u;
+
+                assert(targseg->fragments_count != 0);
+                entry_seg_link_target_fragment = targseg->fragments_count - 1u;
+
+                entry_seg_link_target_name = strdup(targetname);
+                entry_seg_link_target = targseg;
+                entry_seg_link_frame_name = strdup(framename);
+                entry_seg_link_frame = frameseg;
+            }
+            else {
+                fprintf(stderr,"Did not find segments\n");
+            }
+        }
+        else {
+            fprintf(stderr,"frame/target name not found\n");
+        }
+    }
+    else {
+        fprintf(stderr,"frame/target segdef not found\n");
+    }
+}
+
+/* pass 1 of one parsed module: replay it in record order into segments, groups and symbols */
+int link_module_gather(struct link_module *m) {
+    size_t i;
+
+    current_in_file = m->in_file;
+    current_in_mod = m->in_module;
+
+    for (i=0;i < m->recs_count;i++) {
+        const struct link_cache_rec *r = &m->recs[i];
+
+        switch (r->type) {
+            case LINK_CACHE_SEGDEF:
+                if (segdef_add(m->omf_state, r->first, r->last, m->in_file, m->in_module, PASS_GATHER))
+                    return 1;
+                break;
+            case LINK_CACHE_GRPDEF:
+                if (grpdef_add(m->omf_state, r->first, r->last))
+                    return 1;
+                break;
+            case LINK_CACHE_PUBDEF:
+                if (pubdef_add(m->omf_state, r->first, r->last, r->rectype, m->in_file, m->in_module, PASS_GATHER))
+                    return 1;
+                break;
+            case LINK_CACHE_EXTDEF:
+                if (in_lib_count != 0 && link_extdef_add(m->omf_state, r->first, r->last))
+                    return 1;
+                break;
+            case LINK_CACHE_MODEND:
+                link_module_gather_entry(m,r);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (apply_FIXUPP(m->omf_state,0,m->in_file,m->in_module,PASS_GATHER))
+        return 1;
+
+    return 0;
+}
+
+/* pass 2 of one parsed module: replay SEGDEF and LEDATA in record order, then apply FIXUPPs */
+int link_module_build(struct link_module *m) {
+    unsigned long time_start = 0;
+    size_t i;
+
+    if (report_timing)
+        time_start = link_time_us();
+
+    current_in_file = m->in_file;
+    current_in_mod = m->in_module;
+
+    for (i=0;i < m->recs_count;i++) {
+        struct link_cache_rec *r = &m->recs[i];
+
+        if (r->type == LINK_CACHE_SEGDEF) {
+            if (segdef_add(m->omf_state, r->first, r->last, m->in_file, m->in_module, PASS_BUILD))
+                return 1;
+        }
+        else if (r->type == LINK_CACHE_LEDATA) {
+            if (ledata_add(m->omf_state, &r->ledata, PASS_BUILD))
+                return 1;
+        }
+    }
+
+    if (apply_FIXUPP(m->omf_state,0,m->in_file,m->in_module,PASS_BUILD))
+        return 1;
+
+    if (report_timing)
+        in_file_time_us[PASS_BUILD][m->in_file] += link_time_us() - time_start;
+
+    return 0;
+}
+
+void free_link_modules(void) {
+    struct link_input *li;
+    size_t i,j,k;
+
+    for (k=0;k < link_inputs_count;k++) {
+        li = &link_inputs[k];
+        if (li->modules == NULL) continue;
+
+        for (i=0;i < li->modules_count;i++) {
+            struct link_module *m = &li->modules[i];
+
+            if (m->recs != NULL) {
+                for (j=0;j < m->recs_count;j++) {
+                    if (m->recs[j].data_copy && m->recs[j].ledata.data != NULL)
+                        free(m->recs[j].ledata.data);
+                }
+                free(m->recs);
+            }
+
+            m->omf_state = omf_context_destroy(m->omf_state);
+        }
+
+        free(li->modules);
+        li->modules = NULL;
+        li->modules_count = 0;
+        li->modules_alloc = 0;
+    }
+}
+
+/* the records of one input, into li->modules. the caller owns omf_state and frees it
+ * whether or not this succeeds */
+int link_input_parse_records(struct link_input *li,struct omf_context_t *omf_state,struct omf_image_t *img) {
+    const unsigned int inf = li->in_file;
+    struct link_module *cur_mod;
+    unsigned int cur_in_mod;
     unsigned char diddump = 0;
+    int ret;
+
+    cur_in_mod = li->in_module;
+    omf_context_begin_file(omf_state);
+
+    if (omf_context_seek_image(omf_state,img,li->single_module ? li->module_offset : 0ul) < 0) {
+        fprintf(stderr,"Unable to seek to start of input in %s\n",in_file[inf]);
+        return 1;
+    }
+
+    if ((cur_mod=new_link_module(li,cur_in_mod)) == NULL)
+        return 1;
+
+    do {
+        ret = omf_context_read_image(omf_state,img);
+        if (ret == 0) {
+            link_module_take_tables(cur_mod,omf_state);
+            cur_mod = NULL;
+
+            /* a module pulled in from a library through the dictionary ends at its MODEND */
+            if (omf_record_is_modend(&omf_state->record) && !li->single_module) {
+                if (!diddump && verbose) {
+                    my_dumpstate(li->modules[li->modules_count-1u].omf_state);
+                    diddump = 1;
+                }
+
+                if (verbose)
+                    printf("----- next module -----\n");
+
+                ret = omf_context_next_lib_module_image(omf_state,img);
+                if (ret < 0) {
+                    printf("Unable to advance to next .LIB module, %s\n",strerror(errno));
+                    if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
+                }
+                else if (ret > 0) {
+                    cur_in_mod++;
+                    omf_context_begin_module(omf_state);
+                    diddump = 0;
+
+                    if ((cur_mod=new_link_module(li,cur_in_mod)) == NULL)
+                        return 1;
+
+                    continue;
+                }
+            }
+
+            break;
+        }
+        else if (ret < 0) {
+            fprintf(stderr,"Error: %s\n",strerror(errno));
+            if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
+            break;
+        }
+
+        switch (omf_state->record.rectype) {
+            case OMF_RECTYPE_EXTDEF:/*0x8C*/
+            case OMF_RECTYPE_LEXTDEF:/*0xB4*/
+            case OMF_RECTYPE_LEXTDEF32:/*0xB5*/
+                {
+                    int first_new_extdef;
+
+                    if ((first_new_extdef=omf_context_parse_EXTDEF(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing EXTDEF\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_EXTDEF(stdout,omf_state,(unsigned int)first_new_extdef);
+
+                    /* EXTDEF indexes start from 1 */
+                    if (link_module_add_range(cur_mod, LINK_CACHE_EXTDEF, omf_state->record.rectype,
+                        (unsigned int)first_new_extdef, omf_state->EXTDEFs.omf_EXTDEFS_count + 1u))
+                        return 1;
+                } break;
+            case OMF_RECTYPE_PUBDEF:/*0x90*/
+            case OMF_RECTYPE_PUBDEF32:/*0x91*/
+            case OMF_RECTYPE_LPUBDEF:/*0xB6*/
+            case OMF_RECTYPE_LPUBDEF32:/*0xB7*/
+                {
+                    int p_count = omf_state->PUBDEFs.omf_PUBDEFS_count;
+                    int first_new_pubdef;
+
+                    if ((first_new_pubdef=omf_context_parse_PUBDEF(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing PUBDEF\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_PUBDEF(stdout,omf_state,(unsigned int)first_new_pubdef);
+
+                    /* TODO: LPUBDEF symbols need to "disappear" at the end of the module.
+                     *       LPUBDEF means the symbols are not visible outside the module. */
+
+                    if (link_module_add_range(cur_mod, LINK_CACHE_PUBDEF, omf_state->record.rectype,
+                        (unsigned int)p_count, omf_state->PUBDEFs.omf_PUBDEFS_count))
+                        return 1;
+                } break;
+            case OMF_RECTYPE_LNAMES:/*0x96*/
+                {
+                    int first_new_lname;
+
+                    if ((first_new_lname=omf_context_parse_LNAMES(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing LNAMES\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_LNAMES(stdout,omf_state,(unsigned int)first_new_lname);
+
+                } break;
+            case OMF_RECTYPE_SEGDEF:/*0x98*/
+            case OMF_RECTYPE_SEGDEF32:/*0x99*/
+                {
+                    int p_count = omf_state->SEGDEFs.omf_SEGDEFS_count;
+                    int first_new_segdef;
+
+                    if ((first_new_segdef=omf_context_parse_SEGDEF(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing SEGDEF\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_SEGDEF(stdout,omf_state,(unsigned int)first_new_segdef);
+
+                    if (link_module_add_range(cur_mod, LINK_CACHE_SEGDEF, omf_state->record.rectype,
+                        (unsigned int)p_count, omf_state->SEGDEFs.omf_SEGDEFS_count))
+                        return 1;
+                } break;
+            case OMF_RECTYPE_GRPDEF:/*0x9A*/
+            case OMF_RECTYPE_GRPDEF32:/*0x9B*/
+                {
+                    int p_count = omf_state->GRPDEFs.omf_GRPDEFS_count;
+                    int first_new_grpdef;
+
+                    if ((first_new_grpdef=omf_context_parse_GRPDEF(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing GRPDEF\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_GRPDEF(stdout,omf_state,(unsigned int)first_new_grpdef);
+
+                    if (link_module_add_range(cur_mod, LINK_CACHE_GRPDEF, omf_state->record.rectype,
+                        (unsigned int)p_count, omf_state->GRPDEFs.omf_GRPDEFS_count))
+                        return 1;
+                } break;
+            case OMF_RECTYPE_FIXUPP:/*0x9C*/
+            case OMF_RECTYPE_FIXUPP32:/*0x9D*/
+                {
+                    int first_new_fixupp;
+
+                    if ((first_new_fixupp=omf_context_parse_FIXUPP(omf_state,&omf_state->record)) < 0) {
+                        fprintf(stderr,"Error parsing FIXUPP\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_FIXUPP(stdout,omf_state,(unsigned int)first_new_fixupp);
+                } break;
+            case OMF_RECTYPE_LEDATA:/*0xA0*/
+            case OMF_RECTYPE_LEDATA32:/*0xA1*/
+                {
+                    struct omf_ledata_info_t info;
+
+                    if (omf_context_parse_LEDATA(omf_state,&info,&omf_state->record) < 0) {
+                        fprintf(stderr,"Error parsing LEDATA\n");
+                        return 1;
+                    }
+
+                    if (omf_state->flags.verbose)
+                        dump_LEDATA(stdout,omf_state,&info);
+
+                    if (link_module_add_ledata(cur_mod, &info, omf_state->record.rectype, img))
+                        return 1;
+                } break;
+            case OMF_RECTYPE_MODEND:/*0x8A*/
+            case OMF_RECTYPE_MODEND32:/*0x8B*/
+                {
+                    unsigned char ModuleType;
+                    unsigned char EndData;
+                    unsigned int FrameDatum;
+                    unsigned int TargetDatum;
+                    unsigned long TargetDisplacement;
+                    const struct omf_segdef_t *frame_segdef;
+                    const struct omf_segdef_t *target_segdef;
+                    struct link_cache_rec *cr;
+
+                    ModuleType = omf_record_get_byte(&omf_state->record);
+                    if (ModuleType&0x40/*START*/) {
+                        EndData = omf_record_get_byte(&omf_state->record);
+                        FrameDatum = omf_record_get_index(&omf_state->record);
+                        TargetDatum = omf_record_get_index(&omf_state->record);
+
+                        if (omf_state->record.rectype == OMF_RECTYPE_MODEND32)
+                            TargetDisplacement = omf_record_get_dword(&omf_state->record);
+                        else
+                            TargetDisplacement = omf_record_get_word(&omf_state->record);
+
+                        frame_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,FrameDatum);
+                        target_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,TargetDatum);
+
+                        if (verbose) {
+                            printf("ModuleType: 0x%02x: MainModule=%u Start=%u Segment=%u StartReloc=%u\n",
+                                    ModuleType,
+                                    ModuleType&0x80?1:0,
+                                    ModuleType&0x40?1:0,
+                                    ModuleType&0x20?1:0,
+                                    ModuleType&0x01?1:0);
+                            printf("    EndData=0x%02x FrameDatum=%u(%s) TargetDatum=%u(%s) TargetDisplacement=0x%lx\n",
+                                    EndData,
+                                    FrameDatum,
+                                    (frame_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index):"",
+                                    TargetDatum,
+                                    (target_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index):"",
+                                    TargetDisplacement);
+                        }
+
+                        if ((cr=link_module_add_rec(cur_mod,LINK_CACHE_MODEND,omf_state->record.rectype)) == NULL)
+                            return 1;
+
+                        cr->first = FrameDatum;
+                        cr->last = TargetDatum;
+                        cr->offset = TargetDisplacement;
+                    }
+                } break;
+ 
+            default:
+                break;
+        }
+    } while (1);
+
+    if (cur_mod != NULL) {
+        link_module_take_tables(cur_mod,omf_state);
+        cur_mod = NULL;
+    }
+
+    if (!diddump && verbose && li->modules_count != 0) {
+        my_dumpstate(li->modules[li->modules_count-1u].omf_state);
+        diddump = 1;
+    }
+
+    return 0;
+}
+
+/* parse one input: a whole OMF file (every module in it), or a single .LIB module found through
+ * the library dictionary. this touches nothing global but the input itself, so that it can run on
+ * a worker thread. the input image must already be open. */
+int link_input_parse(struct link_input *li) {
+    const unsigned int inf = li->in_file;
+    struct omf_context_t *omf_state;
+    unsigned long time_start = 0;
+    struct omf_image_t img;
+    int ret;
+
+    assert(in_file[inf] != NULL);
+    assert(in_file_img_open[inf]);
+
+    if (report_timing)
+        time_start = link_time_us();
+
+    /* own copy of the image read position, other inputs may be reading the same .LIB */
+    img = in_file_img[inf];
+
+    // prepare parsing
+    if ((omf_state=omf_context_create()) == NULL) {
+        fprintf(stderr,"Failed to init OMF parsing state\n");
+        return 1;
+    }
+    omf_state->flags.verbose = (verbose > 0);
+
+    ret = link_input_parse_records(li,omf_state,&img);
+
+    omf_context_clear(omf_state);
+    omf_state = omf_context_destroy(omf_state);
+    if (ret != 0)
+        return ret;
+
+    if (report_timing)
+        li->parse_time_us = link_time_us() - time_start;
+
+    return 0;
+}
+
+/* pass 1 of one input, after parsing: gather its modules */
+int link_input_gather(struct link_input *li) {
+    unsigned long time_start = 0;
+    size_t i;
+
+    if (report_timing)
+        time_start = link_time_us();
+
+    for (i=0;i < li->modules_count;i++) {
+        if (link_module_gather(&li->modules[i]))
+            return 1;
+    }
+
+    if (report_timing)
+        in_file_time_us[PASS_GATHER][li->in_file] += li->parse_time_us + (link_time_us() - time_start);
+
+    return 0;
+}
+
+#if defined(LINUX)
+struct link_parse_pool {
+    pthread_mutex_t                     lock;
+    size_t                              next,end;
+};
+
+void *link_parse_worker(void *arg) {
+    struct link_parse_pool *pool = (struct link_parse_pool*)arg;
+    struct link_input *li;
+
+    do {
+        pthread_mutex_lock(&pool->lock);
+        li = (pool->next < pool->end) ? &link_inputs[pool->next++] : NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (li != NULL && !li->parsed) {
+            li->parse_result = link_input_parse(li);
+            li->parsed = 1;
+        }
+    } while (li != NULL);
+
+    return NULL;
+}
+#endif
+
+/* parse link_inputs [first,end), on -j worker threads if asked for. the results are
+ * gathered afterwards in command line order, so the output does not depend on -j. */
+int link_inputs_parse(const size_t first,const size_t end) {
+    size_t i;
+
+    /* opening the images touches shared state, and an input that could not be loaded into
+     * memory reads through the file descriptor it shares with other modules of the same .LIB */
+    for (i=first;i < end;i++) {
+        struct omf_image_t *img;
+
+        if ((img=link_input_image(link_inputs[i].in_file)) == NULL)
+            return 1;
+
+        if (link_jobs <= 1u || img->data == NULL) {
+            link_inputs[i].parse_result = link_input_parse(&link_inputs[i]);
+            link_inputs[i].parsed = 1;
+        }
+    }
+
+#if defined(LINUX)
+    if (link_jobs > 1u && first < end) {
+        struct link_parse_pool pool;
+        pthread_t *threads;
+        unsigned int n,j;
+
+        n = link_jobs;
+        if ((size_t)n > (end - first)) n = (unsigned int)(end - first);
+
+        if ((threads=malloc(sizeof(pthread_t) * n)) == NULL)
+            return 1;
+
+        pthread_mutex_init(&pool.lock,NULL);
+        pool.next = first;
+        pool.end = end;
+
+        for (j=0;j < n;j++) {
+            if (pthread_create(&threads[j],NULL,link_parse_worker,&pool) != 0)
+                break;
+        }
+
+        /* whatever the threads that did start leave, this thread parses too */
+        link_parse_worker(&pool);
+
+        while (j > 0u)
+            pthread_join(threads[--j],NULL);
+
+        pthread_mutex_destroy(&pool.lock);
+        free(threads);
+    }
+#endif
+
+    for (i=first;i < end;i++) {
+        assert(link_inputs[i].parsed);
+        if (link_inputs[i].parse_result)
+            return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc,char **argv) {
     unsigned char pass;
     unsigned int inf;
-    int i,fd,ret;
+    size_t inp,j;
     char *a;
+    int i;
 
     hex_output_name[0] = 0;
 
@@ -1987,7 +2988,7 @@ int main(int argc,char **argv) {
         if (*a == '-') {
             do { a++; } while (*a == '-');
 
-            if (!strcmp(a,"i")) {
+            if (!strcmp(a,"i") || !strcmp(a,"l")) {
                 if (in_file_count >= MAX_IN_FILES) {
                     fprintf(stderr,"Too many input files\n");
                     return 1;
@@ -1995,6 +2996,10 @@ int main(int argc,char **argv) {
 
                 in_file[in_file_count] = argv[i++];
                 if (in_file[in_file_count] == NULL) return 1;
+                if (*a == 'l') {
+                    in_file_lib[in_file_count] = 1;
+                    in_lib_count++;
+                }
                 in_file_count++;
             }
             else if (!strcmp(a,"hsym")) {
@@ -2062,6 +3067,15 @@ int main(int argc,char **argv) {
             else if (!strcmp(a,"v")) {
                 verbose = 1;
             }
+            else if (!strcmp(a,"time")) {
+                report_timing = 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                link_jobs = (unsigned int)strtoul(a,NULL,0);
+                if (link_jobs == 0u) link_jobs = 1u;
+            }
             else if (!strcmp(a,"dosseg")) {
                 do_dosseg = 1;
             }
@@ -2079,6 +3093,10 @@ int main(int argc,char **argv) {
         }
     }
 
+    /* verbose dumps are printed while parsing, keep them in order */
+    if (verbose)
+        link_jobs = 1;
+
     if (com_segbase == (unsigned short)(~0u)) {
         if (output_format == OFMT_COM) {
             com_segbase = 0x100;
@@ -2094,7 +3112,7 @@ int main(int argc,char **argv) {
         setbuf(map_fp,NULL);
     }
 
-    if (in_file_count == 0) {
+    if (in_file_count == 0 || in_file_count == in_lib_count) {
         help();
         return 1;
     }
@@ -2118,279 +3136,45 @@ int main(int argc,char **argv) {
         sg->pinned = 1;
     }
 
-    for (pass=0;pass < PASS_MAX;pass++) {
-        for (inf=0;inf < in_file_count;inf++) {
-            assert(in_file[inf] != NULL);
-
-            fd = open(in_file[inf],O_RDONLY|O_BINARY);
-            if (fd < 0) {
-                fprintf(stderr,"Failed to open input file %s\n",strerror(errno));
+    for (inf=0;inf < in_file_count;inf++) {
+        if (in_file_lib[inf]) {
+            if (link_library_open(inf))
                 return 1;
-            }
-            current_in_file = inf;
+        }
+        else {
+            struct link_input *li = new_link_input();
+            if (li == NULL) return 1;
+            li->in_file = inf;
+        }
+    }
 
-            // prepare parsing
-            if ((omf_state=omf_context_create()) == NULL) {
-                fprintf(stderr,"Failed to init OMF parsing state\n");
-                return 1;
-            }
-            omf_state->flags.verbose = (verbose > 0);
+    for (pass=0;pass < PASS_MAX;pass++) {
+        if (pass == PASS_GATHER) {
+            for (inp=0;inp < link_inputs_count;) {
+                const size_t end = link_inputs_count;
 
-            diddump = 0;
-            current_in_mod = 0;
-            omf_context_begin_file(omf_state);
+                if (link_inputs_parse(inp,end))
+                    return 1;
 
-            do {
-                ret = omf_context_read_fd(omf_state,fd);
-                if (ret == 0) {
-                    if (apply_FIXUPP(omf_state,0,inf,current_in_mod,pass))
+                for (;inp < end;inp++) {
+                    if (link_input_gather(&link_inputs[inp]))
                         return 1;
-                    omf_fixupps_context_free_entries(&omf_state->FIXUPPs);
-
-                    if (omf_record_is_modend(&omf_state->record)) {
-                        if (!diddump && verbose) {
-                            my_dumpstate(omf_state);
-                            diddump = 1;
-                        }
-
-                        if (verbose)
-                            printf("----- next module -----\n");
-
-                        ret = omf_context_next_lib_module_fd(omf_state,fd);
-                        if (ret < 0) {
-                            printf("Unable to advance to next .LIB module, %s\n",strerror(errno));
-                            if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
-                        }
-                        else if (ret > 0) {
-                            current_in_mod++;
-                            omf_context_begin_module(omf_state);
-                            diddump = 0;
-                            continue;
-                        }
-                    }
-
-                    break;
                 }
-                else if (ret < 0) {
-                    fprintf(stderr,"Error: %s\n",strerror(errno));
-                    if (omf_state->last_error != NULL) fprintf(stderr,"Details: %s\n",omf_state->last_error);
-                    break;
-                }
-
-                switch (omf_state->record.rectype) {
-                    case OMF_RECTYPE_EXTDEF:/*0x8C*/
-                    case OMF_RECTYPE_LEXTDEF:/*0xB4*/
-                    case OMF_RECTYPE_LEXTDEF32:/*0xB5*/
-                        {
-                            int first_new_extdef;
 
-                            if ((first_new_extdef=omf_context_parse_EXTDEF(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing EXTDEF\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_EXTDEF(stdout,omf_state,(unsigned int)first_new_extdef);
-
-                            // TODO: Store as symbol, noting it is external
-                        } break;
-                    case OMF_RECTYPE_PUBDEF:/*0x90*/
-                    case OMF_RECTYPE_PUBDEF32:/*0x91*/
-                    case OMF_RECTYPE_LPUBDEF:/*0xB6*/
-                    case OMF_RECTYPE_LPUBDEF32:/*0xB7*/
-                        {
-                            int p_count = omf_state->PUBDEFs.omf_PUBDEFS_count;
-                            int first_new_pubdef;
-
-                            if ((first_new_pubdef=omf_context_parse_PUBDEF(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing PUBDEF\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_PUBDEF(stdout,omf_state,(unsigned int)first_new_pubdef);
-
-                            /* TODO: LPUBDEF symbols need to "disappear" at the end of the module.
-                             *       LPUBDEF means the symbols are not visible outside the module. */
-
-                            if (pass == PASS_GATHER && pubdef_add(omf_state, p_count, omf_state->record.rectype, inf, current_in_mod, pass))
-                                return 1;
-                        } break;
-                    case OMF_RECTYPE_LNAMES:/*0x96*/
-                        {
-                            int first_new_lname;
-
-                            if ((first_new_lname=omf_context_parse_LNAMES(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing LNAMES\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_LNAMES(stdout,omf_state,(unsigned int)first_new_lname);
-
-                        } break;
-                    case OMF_RECTYPE_SEGDEF:/*0x98*/
-                    case OMF_RECTYPE_SEGDEF32:/*0x99*/
-                        {
-                            int p_count = omf_state->SEGDEFs.omf_SEGDEFS_count;
-                            int first_new_segdef;
-
-                            if ((first_new_segdef=omf_context_parse_SEGDEF(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing SEGDEF\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_SEGDEF(stdout,omf_state,(unsigned int)first_new_segdef);
-
-                            if (segdef_add(omf_state, p_count, inf, current_in_mod, pass))
-                                return 1;
-                        } break;
-                    case OMF_RECTYPE_GRPDEF:/*0x9A*/
-                    case OMF_RECTYPE_GRPDEF32:/*0x9B*/
-                        {
-                            int p_count = omf_state->GRPDEFs.omf_GRPDEFS_count;
-                            int first_new_grpdef;
-
-                            if ((first_new_grpdef=omf_context_parse_GRPDEF(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing GRPDEF\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_GRPDEF(stdout,omf_state,(unsigned int)first_new_grpdef);
-
-                            if (pass == PASS_GATHER && grpdef_add(omf_state, p_count))
-                                return 1;
-                        } break;
-                    case OMF_RECTYPE_FIXUPP:/*0x9C*/
-                    case OMF_RECTYPE_FIXUPP32:/*0x9D*/
-                        {
-                            int first_new_fixupp;
-
-                            if ((first_new_fixupp=omf_context_parse_FIXUPP(omf_state,&omf_state->record)) < 0) {
-                                fprintf(stderr,"Error parsing FIXUPP\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose)
-                                dump_FIXUPP(stdout,omf_state,(unsigned int)first_new_fixupp);
-                        } break;
-                    case OMF_RECTYPE_LEDATA:/*0xA0*/
-                    case OMF_RECTYPE_LEDATA32:/*0xA1*/
-                        {
-                            struct omf_ledata_info_t info;
-
-                            if (omf_context_parse_LEDATA(omf_state,&info,&omf_state->record) < 0) {
-                                fprintf(stderr,"Error parsing LEDATA\n");
-                                return 1;
-                            }
-
-                            if (omf_state->flags.verbose && pass == PASS_GATHER)
-                                dump_LEDATA(stdout,omf_state,&info);
-
-                            if (pass == PASS_BUILD && ledata_add(omf_state, &info, pass))
-                                return 1;
-                        } break;
-                    case OMF_RECTYPE_MODEND:/*0x8A*/
-                    case OMF_RECTYPE_MODEND32:/*0x8B*/
-                        if (pass == PASS_GATHER) {
-                            unsigned char ModuleType;
-                            unsigned char EndData;
-                            unsigned int FrameDatum;
-                            unsigned int TargetDatum;
-                            unsigned long TargetDisplacement;
-                            const struct omf_segdef_t *frame_segdef;
-                            const struct omf_segdef_t *target_segdef;
-
-                            ModuleType = omf_record_get_byte(&omf_state->record);
-                            if (ModuleType&0x40/*START*/) {
-                                EndData = omf_record_get_byte(&omf_state->record);
-                                FrameDatum = omf_record_get_index(&omf_state->record);
-                                TargetDatum = omf_record_get_index(&omf_state->record);
-
-                                if (omf_state->record.rectype == OMF_RECTYPE_MODEND32)
-                                    TargetDisplacement = omf_record_get_dword(&omf_state->record);
-                                else
-                                    TargetDisplacement = omf_record_get_word(&omf_state->record);
-
-                                frame_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,FrameDatum);
-                                target_segdef = omf_segdefs_context_get_segdef(&omf_state->SEGDEFs,TargetDatum);
-
-                                if (verbose) {
-                                    printf("ModuleType: 0x%02x: MainModule=%u Start=%u Segment=%u StartReloc=%u\n",
-                                            ModuleType,
-                                            ModuleType&0x80?1:0,
-                                            ModuleType&0x40?1:0,
-                                            ModuleType&0x20?1:0,
-                                            ModuleType&0x01?1:0);
-                                    printf("    EndData=0x%02x FrameDatum=%u(%s) TargetDatum=%u(%s) TargetDisplacement=0x%lx\n",
-                                            EndData,
-                                            FrameDatum,
-                                            (frame_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index):"",
-                                            TargetDatum,
-                                            (target_segdef!=NULL)?omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index):"",
-                                            TargetDisplacement);
-                                }
-
-                                if (frame_segdef != NULL && target_segdef != NULL) {
-                                    const char *framename = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,frame_segdef->segment_name_index);
-                                    const char *targetname = omf_lnames_context_get_name_safe(&omf_state->LNAMEs,target_segdef->segment_name_index);
-
-                                    if (verbose)
-                                        fprintf(stderr,"'%s' vs '%s'\n",framename,targetname);
-
-                                    if (*framename != 0 && *targetname != 0) {
-                                        struct link_segdef *frameseg,*targseg;
-
-                                        targseg = find_link_segment(targetname);
-                                        frameseg = find_link_segment(framename);
-                                        if (targseg != NULL && frameseg != NULL) {
-                                            entry_seg_ofs = TargetDisplacement;
-
-                                            assert(frameseg->fragments_count != 0);
-                                            entry_seg_link_frame_fragment = frameseg->fragments_count - 1u;
-
-                                            assert(targseg->fragments_count != 0);
-                                            entry_seg_link_target_fragment = targseg->fragments_count - 1u;
-
-                                            entry_seg_link_target_name = strdup(targetname);
-                                            entry_seg_link_target = targseg;
-                                            entry_seg_link_frame_name = strdup(framename);
-                                            entry_seg_link_frame = frameseg;
-                                        }
-                                        else {
-                                            fprintf(stderr,"Did not find segments\n");
-                                        }
-                                    }
-                                    else {
-                                        fprintf(stderr,"frame/target name not found\n");
-                                    }
-                                }
-                                else {
-                                    fprintf(stderr,"frame/target segdef not found\n");
-                                }
-                            }
-                        } break;
- 
-                    default:
-                        break;
+                /* once everything so far has been gathered, pull in library modules for unresolved EXTDEFs.
+                 * those modules are appended to link_inputs and parsed and gathered by this same loop. */
+                if (link_resolve_libraries())
+                    return 1;
+            }
+        }
+        else {
+            /* pass 2 works entirely from the modules parsed in pass 1, the OMF is not read again */
+            for (inp=0;inp < link_inputs_count;inp++) {
+                for (j=0;j < link_inputs[inp].modules_count;j++) {
+                    if (link_module_build(&link_inputs[inp].modules[j]))
+                        return 1;
                 }
-            } while (1);
-
-            if (!diddump && verbose) {
-                my_dumpstate(omf_state);
-                diddump = 1;
             }
-
-            if (apply_FIXUPP(omf_state,0,inf,current_in_mod,pass))
-                return 1;
-            omf_fixupps_context_free_entries(&omf_state->FIXUPPs);
-
-            omf_context_clear(omf_state);
-            omf_state = omf_context_destroy(omf_state);
-
-            close(fd);
         }
 
         if (pass == PASS_GATHER) {
@@ -3035,10 +3819,15 @@ int main(int argc,char **argv) {
     }
 
     dump_link_relocations();
-    dump_link_symbols();
+    if (dump_link_symbols())
+        return 1;
     dump_link_segments();
 
     qsort(link_symbols, link_symbols_count, sizeof(struct link_symbol), link_symbol_qsort_cmp);
+    if (link_symbols_rehash()) {
+        fprintf(stderr,"Unable to rebuild symbol index\n");
+        return 1;
+    }
 
     /* write output */
     assert(out_file != NULL);
@@ -3595,9 +4384,14 @@ int main(int argc,char **argv) {
         map_fp = NULL;
     }
 
+    if (report_timing)
+        dump_timing_report();
+
     link_symbols_free();
     free_link_segments();
     free_exe_relocations();
+    free_link_modules();
+    free_link_inputs();
     return 0;
 }
 
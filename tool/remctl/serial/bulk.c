@@ -0,0 +1,508 @@
+
+#include <string.h>
+
+#include "proto.h"
+#include "bulk.h"
+
+/* slot states */
+enum {
+    BULK_FREE=0,
+    BULK_FILLED,                        /* send: read in, not sent yet */
+    BULK_SENT,                          /* send: sent, no word from the receiver yet */
+    BULK_RESEND,                        /* send: receiver says it never got it */
+    BULK_ACKED,                         /* send: receiver has it */
+    BULK_HAVE                           /* recv: arrived, not written yet */
+};
+
+static unsigned short crc16_table[256];
+static unsigned char crc16_table_init = 0;
+
+/* CRC-16/CCITT (polynomial 0x1021), table driven because an 8088 has to keep up with 115200 baud */
+unsigned short remctl_crc16(unsigned short crc,const unsigned char *p,unsigned int len) {
+    if (!crc16_table_init) {
+        unsigned short c;
+        unsigned int i,j;
+
+        for (i=0;i < 256;i++) {
+            c = (unsigned short)(i << 8U);
+            for (j=0;j < 8;j++)
+                c = (unsigned short)((c & 0x8000U) ? (((unsigned int)c << 1U) ^ 0x1021U) : ((unsigned int)c << 1U));
+
+            crc16_table[i] = c;
+        }
+
+        crc16_table_init = 1;
+    }
+
+    while (len-- != 0)
+        crc = (unsigned short)(crc << 8U) ^ crc16_table[((crc >> 8U) ^ (*p++)) & 0xFFU];
+
+    return crc;
+}
+
+static unsigned char bulk_slot_index(const struct remctl_bulk * const b,const unsigned char off) {
+    unsigned int i = (unsigned int)b->base_slot + off;
+
+    if (i >= b->window) i -= b->window;
+    return (unsigned char)i;
+}
+
+static unsigned char *bulk_slot(const struct remctl_bulk * const b,const unsigned char off) {
+    return b->slotmem + ((unsigned int)bulk_slot_index(b,off) * (REMCTL_SERIAL_BULK_HDR + b->payload));
+}
+
+static unsigned int bulk_frame_length(const unsigned char * const f) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)f;
+
+    return (unsigned int)h->length[0] + ((unsigned int)h->length[1] << 8U);
+}
+
+/* fill in the header of a frame whose payload is already in place */
+static void bulk_frame(unsigned char * const f,const unsigned char type,const unsigned char seq,const unsigned char flags,const unsigned int len) {
+    struct remctl_serial_bulk_header *h = (struct remctl_serial_bulk_header*)f;
+    unsigned short crc;
+
+    h->mark = REMCTL_SERIAL_BULK_MARK;
+    h->type = type;
+    h->sequence = seq;
+    h->flags = flags;
+    h->length[0] = (unsigned char)(len & 0xFFU);
+    h->length[1] = (unsigned char)(len >> 8U);
+
+    crc = remctl_crc16(0xFFFFU,&(h->type),(unsigned int)(h->crc - &(h->type)));
+    crc = remctl_crc16(crc,f + REMCTL_SERIAL_BULK_HDR,len);
+    h->crc[0] = (unsigned char)(crc & 0xFFU);
+    h->crc[1] = (unsigned char)(crc >> 8U);
+}
+
+static unsigned char bulk_ctl_rank(const unsigned char type) {
+    switch (type) {
+        case REMCTL_SERIAL_BULK_ACK:    return 1;
+        case REMCTL_SERIAL_BULK_NAK:    return 2;
+        case REMCTL_SERIAL_BULK_ABORT:  return 3;
+        case REMCTL_SERIAL_BULK_END:    return 4;
+    }
+
+    return 0;
+}
+
+/* only one control frame is pending at a time, the more important one wins.
+ * ACK/NAK contents are filled in when it goes out, so they're always current. */
+static void bulk_queue_ctl(struct remctl_bulk * const b,const unsigned char type,unsigned char limit) {
+    if (bulk_ctl_rank(b->ctl_type) > bulk_ctl_rank(type))
+        return;
+    if (type == REMCTL_SERIAL_BULK_NAK && b->ctl_type == REMCTL_SERIAL_BULK_NAK && limit < b->ctl_limit)
+        limit = b->ctl_limit;
+
+    b->ctl_type = type;
+    b->ctl_limit = limit;
+}
+
+static void bulk_build_ctl(struct remctl_bulk * const b) {
+    unsigned char *d = b->ctl + REMCTL_SERIAL_BULK_HDR;
+    unsigned int len = 0;
+
+    if (b->ctl_type == REMCTL_SERIAL_BULK_ACK || b->ctl_type == REMCTL_SERIAL_BULK_NAK) {
+        unsigned long map = 0;
+        unsigned char i;
+
+        for (i=1;i < b->window;i++) {
+            if (b->state[bulk_slot_index(b,i)] == BULK_HAVE)
+                map |= 1UL << (unsigned long)(i - 1U);
+        }
+
+        d[0] = b->base;
+        d[1] = (unsigned char)(map >> 0UL);
+        d[2] = (unsigned char)(map >> 8UL);
+        d[3] = (unsigned char)(map >> 16UL);
+        d[4] = (unsigned char)(map >> 24UL);
+        len = 5;
+
+        if (b->ctl_type == REMCTL_SERIAL_BULK_NAK)
+            d[len++] = b->ctl_limit;
+    }
+    else if (b->ctl_type == REMCTL_SERIAL_BULK_END) {
+        b->end_sent = 1;
+    }
+
+    bulk_frame(b->ctl,b->ctl_type,0,0,len);
+    b->tx_ptr = b->ctl;
+    b->tx_len = REMCTL_SERIAL_BULK_HDR + len;
+    b->tx_pos = 0;
+    b->ctl_type = 0;
+}
+
+static int bulk_next_frame(struct remctl_bulk * const b) {
+    unsigned char off,n;
+    unsigned char *st;
+
+    if (b->ctl_type != 0) {
+        bulk_build_ctl(b);
+        return 1;
+    }
+
+    if (b->role != REMCTL_BULK_SEND || b->error)
+        return 0;
+
+    /* oldest first, which puts frames the receiver asked for again ahead of new ones */
+    n = (unsigned char)(b->next - b->base);
+    for (off=0;off < n;off++) {
+        st = &(b->state[bulk_slot_index(b,off)]);
+        if (*st == BULK_FILLED || *st == BULK_RESEND) {
+            if (*st == BULK_RESEND) b->resent++;
+            *st = BULK_SENT;
+            b->stamp[bulk_slot_index(b,off)] = ++b->tx_stamp;
+
+            b->tx_ptr = bulk_slot(b,off);
+            b->tx_len = REMCTL_SERIAL_BULK_HDR + bulk_frame_length(b->tx_ptr);
+            b->tx_pos = 0;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void bulk_advance(struct remctl_bulk * const b) {
+    b->state[b->base_slot] = BULK_FREE;
+    if ((++b->base_slot) >= b->window) b->base_slot = 0;
+    b->base++;
+}
+
+static void bulk_send_ack(struct remctl_bulk * const b,const unsigned char * const d,const unsigned char nak_limit) {
+    const unsigned char inflight = (unsigned char)(b->next - b->base);
+    const unsigned char upto = (unsigned char)(d[0] - b->base);
+    const unsigned long map =
+        ((unsigned long)d[1] << 0UL) +
+        ((unsigned long)d[2] << 8UL) +
+        ((unsigned long)d[3] << 16UL) +
+        ((unsigned long)d[4] << 24UL);
+    unsigned int newest = 0,age;
+    unsigned char off,i;
+    unsigned char *st;
+
+    /* an old ACK that arrived late, or garbage */
+    if (upto > inflight)
+        return;
+
+    for (off=0;off < inflight;off++) {
+        i = bulk_slot_index(b,off);
+        st = &(b->state[i]);
+
+        if (off < upto || (off > upto && ((map >> (unsigned long)(off - upto - 1U)) & 1UL))) {
+            if (*st == BULK_SENT) {
+                age = b->tx_stamp - b->stamp[i];
+                if (newest == 0 || age < newest) newest = age + 1U;
+            }
+
+            *st = BULK_ACKED;
+        }
+        else if ((unsigned int)off < (unsigned int)upto + nak_limit && *st == BULK_SENT) {
+            *st = BULK_RESEND;
+        }
+    }
+
+    /* anything still out that was sent before the newest frame the receiver has is lost */
+    if (newest != 0) {
+        for (off=upto;off < inflight;off++) {
+            i = bulk_slot_index(b,off);
+            if (b->state[i] == BULK_SENT && (unsigned int)(b->tx_stamp - b->stamp[i]) >= newest)
+                b->state[i] = BULK_RESEND;
+        }
+    }
+
+    while (b->base != b->next && b->state[b->base_slot] == BULK_ACKED) {
+        const unsigned char *f = bulk_slot(b,0);
+
+        b->count += bulk_frame_length(f);
+        if (((const struct remctl_serial_bulk_header*)f)->flags & REMCTL_SERIAL_BULK_FLAG_LAST)
+            b->done = 1;
+
+        bulk_advance(b);
+    }
+}
+
+static void bulk_recv_data(struct remctl_bulk * const b,const unsigned int len) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)b->rx;
+    const unsigned char off = (unsigned char)(h->sequence - b->base);
+    unsigned char *st;
+
+    if (b->done) {
+        bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ACK,0);
+        return;
+    }
+
+    if (off >= b->window) {
+        /* already written, our ACK for it must have been lost */
+        if ((unsigned char)(0U - off) <= b->window)
+            bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ACK,0);
+
+        return;
+    }
+
+    st = &(b->state[bulk_slot_index(b,off)]);
+    if (*st == BULK_FREE) {
+        memcpy(bulk_slot(b,off),b->rx,REMCTL_SERIAL_BULK_HDR + len);
+        *st = BULK_HAVE;
+    }
+
+    bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ACK,0);
+}
+
+/* a DATA frame that failed CRC but whose header looks right (the header is a small part of
+ * the frame, so it usually is): ask for it again now instead of waiting for the timeout */
+static void bulk_recv_damaged(struct remctl_bulk * const b) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)b->rx;
+    const unsigned char off = (unsigned char)(h->sequence - b->base);
+
+    if (b->done || off >= b->window || b->state[bulk_slot_index(b,off)] != BULK_FREE)
+        return;
+
+    bulk_queue_ctl(b,REMCTL_SERIAL_BULK_NAK,(unsigned char)(off + 1U));
+}
+
+static void bulk_frame_in(struct remctl_bulk * const b,const unsigned int len) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)b->rx;
+    const unsigned char *d = b->rx + REMCTL_SERIAL_BULK_HDR;
+
+    switch (h->type) {
+        case REMCTL_SERIAL_BULK_DATA:
+            if (b->role == REMCTL_BULK_RECV)
+                bulk_recv_data(b,len);
+            break;
+        case REMCTL_SERIAL_BULK_ACK:
+            if (b->role == REMCTL_BULK_SEND && len >= 5)
+                bulk_send_ack(b,d,0);
+            break;
+        case REMCTL_SERIAL_BULK_NAK:
+            if (b->role == REMCTL_BULK_SEND && len >= 6)
+                bulk_send_ack(b,d,d[5]);
+            break;
+        case REMCTL_SERIAL_BULK_END:
+            b->end_seen = 1;
+            if (!b->end_sent)
+                bulk_queue_ctl(b,REMCTL_SERIAL_BULK_END,0);
+            break;
+        case REMCTL_SERIAL_BULK_ABORT:
+            b->error = 1;
+            break;
+    }
+}
+
+void remctl_bulk_negotiate(unsigned char * const window,unsigned int * const payload,const unsigned int mem) {
+    if (*payload > REMCTL_SERIAL_BULK_PAYLOAD_MAX)
+        *payload = REMCTL_SERIAL_BULK_PAYLOAD_MAX;
+    if (*payload < 16U)
+        *payload = 16U;
+    if (*payload > (mem - REMCTL_SERIAL_BULK_HDR))
+        *payload = mem - REMCTL_SERIAL_BULK_HDR;
+
+    if (*window > REMCTL_SERIAL_BULK_WINDOW_MAX)
+        *window = REMCTL_SERIAL_BULK_WINDOW_MAX;
+    if (*window > (mem / (REMCTL_SERIAL_BULK_HDR + *payload)))
+        *window = (unsigned char)(mem / (REMCTL_SERIAL_BULK_HDR + *payload));
+    if (*window < 1U)
+        *window = 1U;
+}
+
+void remctl_bulk_init(struct remctl_bulk * const b,const unsigned char role,const unsigned char window,const unsigned int payload,unsigned char *slotmem,unsigned char *rx) {
+    memset(b,0,sizeof(*b));
+    b->role = role;
+    b->window = window;
+    b->payload = payload;
+    b->slotmem = slotmem;
+    b->rx = rx;
+}
+
+/* file I/O: read ahead into free slots (send) or write out what's arrived in order (recv) */
+void remctl_bulk_pump(struct remctl_bulk * const b) {
+    if (b->error || b->end_sent)
+        return;
+
+    if (b->role == REMCTL_BULK_SEND) {
+        while (!b->last && (unsigned char)(b->next - b->base) < b->window) {
+            const unsigned char off = (unsigned char)(b->next - b->base);
+            unsigned char *f = bulk_slot(b,off);
+            unsigned char flags = 0;
+            unsigned int want;
+            int rd;
+
+            /* still going out from the last time this slot was used */
+            if (b->tx_pos < b->tx_len && b->tx_ptr == f)
+                break;
+
+            want = (b->remain < (unsigned long)b->payload) ? (unsigned int)b->remain : b->payload;
+            rd = (want != 0U) ? b->read(f + REMCTL_SERIAL_BULK_HDR,want) : 0;
+            if (rd < 0) {
+                b->error = 1;
+                bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ABORT,0);
+                return;
+            }
+
+            b->remain -= (unsigned long)rd;
+            if ((unsigned int)rd < want || b->remain == 0UL) {
+                flags |= REMCTL_SERIAL_BULK_FLAG_LAST;
+                b->last = 1;
+            }
+
+            bulk_frame(f,REMCTL_SERIAL_BULK_DATA,b->next,flags,(unsigned int)rd);
+            b->state[bulk_slot_index(b,off)] = BULK_FILLED;
+            b->next++;
+        }
+    }
+    else {
+        while (!b->done && b->state[b->base_slot] == BULK_HAVE) {
+            const unsigned char *f = bulk_slot(b,0);
+            const unsigned int len = bulk_frame_length(f);
+
+            if (len != 0U && b->write(f + REMCTL_SERIAL_BULK_HDR,len) != (int)len) {
+                b->error = 1;
+                bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ABORT,0);
+                return;
+            }
+
+            b->count += len;
+            if (((const struct remctl_serial_bulk_header*)f)->flags & REMCTL_SERIAL_BULK_FLAG_LAST)
+                b->done = 1;
+
+            bulk_advance(b);
+
+            bulk_queue_ctl(b,REMCTL_SERIAL_BULK_ACK,0);
+        }
+    }
+}
+
+/* next bytes to go out, returns how many. nothing but the END frame once it's started */
+unsigned int remctl_bulk_tx(struct remctl_bulk * const b,unsigned char *dst,unsigned int max) {
+    unsigned int n = 0,c;
+
+    while (n < max) {
+        if (b->tx_pos >= b->tx_len) {
+            if (b->end_sent || !bulk_next_frame(b))
+                break;
+        }
+
+        c = b->tx_len - b->tx_pos;
+        if (c > (max - n)) c = max - n;
+
+        memcpy(dst + n,b->tx_ptr + b->tx_pos,c);
+        b->tx_pos += c;
+        n += c;
+    }
+
+    return n;
+}
+
+/* could the header in rx be real? Only the sender gets control frames with data in them,
+ * and those are always the same size, so a damaged length there is caught right away
+ * instead of waiting for bytes that, on the quiet side of a transfer, may be slow to come */
+static int bulk_rx_header_ok(const struct remctl_bulk * const b,const unsigned int len) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)b->rx;
+
+    switch (h->type) {
+        case REMCTL_SERIAL_BULK_DATA:   return b->role == REMCTL_BULK_RECV && len <= b->payload;
+        case REMCTL_SERIAL_BULK_ACK:    return b->role == REMCTL_BULK_SEND && len == 5U;
+        case REMCTL_SERIAL_BULK_NAK:    return b->role == REMCTL_BULK_SEND && len == 6U;
+        case REMCTL_SERIAL_BULK_END:
+        case REMCTL_SERIAL_BULK_ABORT:  return len == 0U;
+    }
+
+    return 0;
+}
+
+/* drop the first n bytes held in rx, and anything after them up to the next mark */
+static void bulk_rx_skip(struct remctl_bulk * const b,unsigned int n) {
+    while (n < b->rx_pos && b->rx[n] != REMCTL_SERIAL_BULK_MARK)
+        n++;
+
+    b->rx_pos -= n;
+    if (b->rx_pos != 0U)
+        memmove(b->rx,b->rx + n,b->rx_pos);
+}
+
+/* take whole frames from the start of rx, returns how many were good. A frame that's
+ * damaged (impossible header, bad CRC) may have been a false mark, or a real one whose
+ * length got hit and ran on into the frames behind it. Either way only its mark is
+ * dropped and the bytes after it are looked at again, so those frames aren't lost. */
+static unsigned int bulk_rx_frames(struct remctl_bulk * const b) {
+    const struct remctl_serial_bulk_header *h = (const struct remctl_serial_bulk_header*)b->rx;
+    unsigned int frames = 0,flen;
+    unsigned short crc;
+
+    while (b->rx_pos >= REMCTL_SERIAL_BULK_HDR) {
+        flen = bulk_frame_length(b->rx);
+        if (!bulk_rx_header_ok(b,flen)) {
+            bulk_rx_skip(b,1);
+            continue;
+        }
+        if (b->rx_pos < (REMCTL_SERIAL_BULK_HDR + flen))
+            break;
+
+        crc = remctl_crc16(0xFFFFU,&(h->type),(unsigned int)(h->crc - &(h->type)));
+        crc = remctl_crc16(crc,b->rx + REMCTL_SERIAL_BULK_HDR,flen);
+        if (h->crc[0] != (unsigned char)(crc & 0xFFU) || h->crc[1] != (unsigned char)(crc >> 8U)) {
+            b->bad++;
+            if (b->role == REMCTL_BULK_RECV && h->type == REMCTL_SERIAL_BULK_DATA)
+                bulk_recv_damaged(b);
+
+            bulk_rx_skip(b,1); /* otherwise the sender finds out through the ACK bitmap or the timeout */
+            continue;
+        }
+
+        frames++;
+        bulk_frame_in(b,flen);
+        bulk_rx_skip(b,REMCTL_SERIAL_BULK_HDR + flen);
+    }
+
+    return frames;
+}
+
+/* bytes that came in, returns how many good frames were in them */
+unsigned int remctl_bulk_rx(struct remctl_bulk * const b,const unsigned char *src,unsigned int len) {
+    unsigned int frames = 0;
+    unsigned char c;
+
+    while (len-- != 0) {
+        c = *src++;
+
+        if (b->rx_pos == 0) {
+            if (c != REMCTL_SERIAL_BULK_MARK) {
+                if (b->junk < REMCTL_SERIAL_BULK_ESCAPE) b->junk++;
+                continue;
+            }
+
+            b->junk = 0;
+        }
+
+        /* never more than one whole frame: anything that long has been taken or skipped */
+        b->rx[b->rx_pos++] = c;
+        if (b->rx_pos >= REMCTL_SERIAL_BULK_HDR)
+            frames += bulk_rx_frames(b);
+    }
+
+    return frames;
+}
+
+/* nothing has come in for a while: resend everything outstanding (send) or ask for it (recv) */
+void remctl_bulk_timeout(struct remctl_bulk * const b) {
+    if (b->role == REMCTL_BULK_SEND) {
+        const unsigned char inflight = (unsigned char)(b->next - b->base);
+        unsigned char off;
+        unsigned char *st;
+
+        for (off=0;off < inflight;off++) {
+            st = &(b->state[bulk_slot_index(b,off)]);
+            if (*st == BULK_SENT) *st = BULK_RESEND;
+        }
+    }
+    else {
+        bulk_queue_ctl(b,REMCTL_SERIAL_BULK_NAK,b->window);
+    }
+}
+
+/* queue END, again if the answer never came */
+void remctl_bulk_end(struct remctl_bulk * const b) {
+    b->end_sent = 0;
+    bulk_queue_ctl(b,REMCTL_SERIAL_BULK_END,0);
+}
+
@@ -0,0 +1,78 @@
+
+/* windowed bulk transfer, shared by the client and REMSRV.EXE.
+ *
+ * One side sends (reads the file, keeps every frame it sent until it's acknowledged,
+ * resends only the frames the other side is missing), the other receives (holds frames
+ * that arrive out of order, writes them to the file in order). Serial lines and TCP
+ * don't reorder, so once the receiver has a frame that went out after one it doesn't
+ * have, that one was lost and is sent again right away without waiting. It's
+ * driven entirely by the caller: bytes in through remctl_bulk_rx(), bytes out through
+ * remctl_bulk_tx(), file I/O through remctl_bulk_pump() when it's safe to do so. Only
+ * the side with a clock (the client) calls remctl_bulk_timeout().
+ *
+ * Include proto.h first. */
+
+enum {
+    REMCTL_BULK_SEND=1,
+    REMCTL_BULK_RECV=2
+};
+
+/* memory needed for slots, caller provides it */
+#define remctl_bulk_slot_mem(window,payload) ((unsigned int)(window) * (REMCTL_SERIAL_BULK_HDR + (unsigned int)(payload)))
+
+struct remctl_bulk {
+    unsigned char               role;
+    unsigned char               window;
+    unsigned int                payload;
+    unsigned char*              slotmem;        /* window slots, each a whole frame */
+    unsigned char*              rx;             /* one whole frame */
+    unsigned char               state[REMCTL_SERIAL_BULK_WINDOW_MAX];
+    unsigned int                stamp[REMCTL_SERIAL_BULK_WINDOW_MAX];   /* send: when each slot last went out */
+    unsigned int                tx_stamp;
+
+    unsigned char               base;           /* oldest frame not acknowledged (send) or not written (recv) */
+    unsigned char               base_slot;      /* slot holding it */
+    unsigned char               next;           /* send: next frame to read in */
+    unsigned char               last;           /* send: LAST frame has been read in */
+
+    unsigned char               done;           /* whole file sent and acknowledged, or received and written */
+    unsigned char               error;          /* I/O error at either end */
+    unsigned char               end_sent;
+    unsigned char               end_seen;
+
+    unsigned long               remain;         /* send: bytes left to read */
+    unsigned long               count;          /* bytes acknowledged (send) or written (recv) */
+    unsigned long               resent;         /* frames sent again */
+    unsigned long               bad;            /* frames that failed CRC */
+    unsigned int                junk;           /* bytes in a row that couldn't start a frame */
+
+    unsigned char               ctl_type;       /* control frame to go out next, 0 if none */
+    unsigned char               ctl_limit;      /* NAK */
+    unsigned char               ctl[REMCTL_SERIAL_BULK_HDR+6];
+
+    const unsigned char*        tx_ptr;
+    unsigned int                tx_len;
+    unsigned int                tx_pos;
+    unsigned int                rx_pos;
+
+    int                         (*read)(unsigned char *buf,unsigned int len);
+    int                         (*write)(const unsigned char *buf,unsigned int len);
+};
+
+unsigned short remctl_crc16(unsigned short crc,const unsigned char *p,unsigned int len);
+
+void remctl_bulk_negotiate(unsigned char * const window,unsigned int * const payload,const unsigned int mem);
+void remctl_bulk_init(struct remctl_bulk * const b,const unsigned char role,const unsigned char window,const unsigned int payload,unsigned char *slotmem,unsigned char *rx);
+
+void remctl_bulk_pump(struct remctl_bulk * const b);
+unsigned int remctl_bulk_tx(struct remctl_bulk * const b,unsigned char *dst,unsigned int max);
+unsigned int remctl_bulk_rx(struct remctl_bulk * const b,const unsigned char *src,unsigned int len);
+void remctl_bulk_timeout(struct remctl_bulk * const b);
+void remctl_bulk_end(struct remctl_bulk * const b);
+
+/* the other end gave up on us, see REMCTL_SERIAL_BULK_ESCAPE */
+#define remctl_bulk_escaped(b) ((b)->junk >= REMCTL_SERIAL_BULK_ESCAPE)
+
+/* END went out and came back, bulk mode is over */
+#define remctl_bulk_closed(b) ((b)->end_sent && (b)->end_seen && (b)->tx_pos >= (b)->tx_len)
+
@@ -23,8 +23,8 @@ all: exe
 exe: $(REMSRV_EXE) .symbolic
 
 !ifdef REMSRV_EXE
-$(REMSRV_EXE): $(SUBDIR)$(HPS)remsrv.obj $(HW_DOS_LIB) $(HW_DOS_LIB_DEPENDENCIES) $(HW_CPU_LIB) $(HW_CPU_LIB_DEPENCIES) $(HW_8250_LIB) $(HW_8250_LIB_DEPENDENCIES) $(HW_8254_LIB) $(HW_8254_LIB_DEPENDENCIES) $(HW_8259_LIB) $(HW_8259_LIB_DEPENDENCIES) $(HW_ISAPNP_LIB) $(HW_ISAPNP_LIB_DEPENDENCIES) $(HW_8250PNP_LIB) $(HW_8250PNP_LIB_DEPENDENCIES) $(HW_FLATREAL_LIB) $(HW_8251_LIB) $(HW_8251_LIB_DEPENDENCIES)
-	%write tmp.cmd option quiet system $(WLINK_CON_SYSTEM) $(WLINK_FLAGS) file $(SUBDIR)$(HPS)remsrv.obj $(HW_DOS_LIB_WLINK_LIBRARIES) $(HW_CPU_LIB_WLINK_LIBRARIES) $(HW_8250_LIB_WLINK_LIBRARIES) $(HW_8254_LIB_WLINK_LIBRARIES) $(HW_8259_LIB_WLINK_LIBRARIES) $(HW_ISAPNP_LIB_WLINK_LIBRARIES) $(HW_8250PNP_LIB_WLINK_LIBRARIES) $(HW_FLATREAL_LIB_WLINK_LIBRARIES) $(HW_8251_LIB_WLINK_LIBRARIES)
+$(REMSRV_EXE): $(SUBDIR)$(HPS)remsrv.obj $(SUBDIR)$(HPS)bulk.obj $(SUBDIR)$(HPS)sync.obj $(HW_DOS_LIB) $(HW_DOS_LIB_DEPENDENCIES) $(HW_CPU_LIB) $(HW_CPU_LIB_DEPENCIES) $(HW_8250_LIB) $(HW_8250_LIB_DEPENDENCIES) $(HW_8254_LIB) $(HW_8254_LIB_DEPENDENCIES) $(HW_8259_LIB) $(HW_8259_LIB_DEPENDENCIES) $(HW_ISAPNP_LIB) $(HW_ISAPNP_LIB_DEPENDENCIES) $(HW_8250PNP_LIB) $(HW_8250PNP_LIB_DEPENDENCIES) $(HW_FLATREAL_LIB) $(HW_8251_LIB) $(HW_8251_LIB_DEPENDENCIES)
+	%write tmp.cmd option quiet system $(WLINK_CON_SYSTEM) $(WLINK_FLAGS) file $(SUBDIR)$(HPS)remsrv.obj file $(SUBDIR)$(HPS)bulk.obj file $(SUBDIR)$(HPS)sync.obj $(HW_DOS_LIB_WLINK_LIBRARIES) $(HW_CPU_LIB_WLINK_LIBRARIES) $(HW_8250_LIB_WLINK_LIBRARIES) $(HW_8254_LIB_WLINK_LIBRARIES) $(HW_8259_LIB_WLINK_LIBRARIES) $(HW_ISAPNP_LIB_WLINK_LIBRARIES) $(HW_8250PNP_LIB_WLINK_LIBRARIES) $(HW_FLATREAL_LIB_WLINK_LIBRARIES) $(HW_8251_LIB_WLINK_LIBRARIES)
 	%write tmp.cmd option map=$(REMSRV_EXE).map
 ! ifdef TARGET_WINDOWS
 !  ifeq TARGET_MSDOS 16
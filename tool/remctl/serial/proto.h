@@ -18,6 +18,7 @@ struct remctl_serial_packet {
 #define REMCTL_SERIAL_MARK      0x01
 
 enum {
+    REMCTL_SERIAL_TYPE_BATCH=0x42,      /* batched reads (see below) */
     REMCTL_SERIAL_TYPE_DOS=0x44,        /* MS-DOS specific */
     REMCTL_SERIAL_TYPE_ERROR=0x45,
     REMCTL_SERIAL_TYPE_FILE=0x46,       /* file I/O specific */
@@ -36,6 +37,25 @@ enum {
     REMCTL_SERIAL_TYPE_DOS_STUFF_BIOS_KEYBOARD=0x42 /* stuff scancode into BIOS keyboard buffer */
 };
 
+/* REMCTL_SERIAL_TYPE_BATCH
+ *
+ * data[0] is the kind of read, followed by a list of what to read:
+ *
+ *   BATCH_MEMREAD: 6 bytes each, address[4] and length[2] (1-65535), little endian
+ *   BATCH_INPORT:  4 bytes each, port[2], width (1, 2 or 4) and how many times to read it (1-255)
+ *
+ * The answer is a stream of BATCH packets sent back to back, each with data[0] the same as
+ * the request and then the next bytes of the result (everything read, in the order asked
+ * for, I/O port reads little endian at their width). A packet with data[0] = BATCH_FINISHED
+ * ends it. Sending another packet cancels the rest of the stream. */
+enum {
+    REMCTL_SERIAL_TYPE_BATCH_FINISHED=0x06,         /* end of results, CTRL+F */
+    REMCTL_SERIAL_TYPE_BATCH_INPORT=0x49,           /* read I/O ports */
+    REMCTL_SERIAL_TYPE_BATCH_MEMREAD=0x52           /* read memory */
+};
+
+#define REMCTL_SERIAL_BATCH_CHUNK       240     /* result bytes per packet, at most */
+
 /* REMCTL_SERIAL_TYPE_FILE */
 enum {
     REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY=0x02,     /* response code CTRL+B */
@@ -49,10 +69,85 @@ enum {
     REMCTL_SERIAL_TYPE_FILE_PWD=0x50,               /* get current directory */
     REMCTL_SERIAL_TYPE_FILE_RMDIR=0x52,             /* rmdir ASCIIZ */
     REMCTL_SERIAL_TYPE_FILE_TRUNCATE=0x54,          /* truncate open file to file pointer */
+    REMCTL_SERIAL_TYPE_FILE_BULK_READ=0x62,         /* start bulk transfer of the open file to the client (see below) */
     REMCTL_SERIAL_TYPE_FILE_CLOSE=0x63,             /* close the open file */
+    REMCTL_SERIAL_TYPE_FILE_HASH=0x68,              /* CRC-32 of blocks of the open file (see below) */
+    REMCTL_SERIAL_TYPE_FILE_BULK_PATCH=0x70,        /* start bulk transfer of a patch stream into the open file (see below) */
     REMCTL_SERIAL_TYPE_FILE_CREATE=0x72,            /* create a new file. will close prior file. */
+    REMCTL_SERIAL_TYPE_FILE_BULK_WRITE=0x77,        /* start bulk transfer from the client into the open file (see below) */
     REMCTL_SERIAL_TYPE_FILE_READ=0x79,              /* read file */
     REMCTL_SERIAL_TYPE_FILE_WRITE=0x7A,             /* write file */
     REMCTL_SERIAL_TYPE_FILE_SEEK=0x7B               /* seek file pointer */
 };
 
+/* Bulk transfer.
+ *
+ * FILE_BULK_READ/FILE_BULK_WRITE are sent as normal packets:
+ *
+ *   data[1-4] = byte count (read: stop here or at EOF. write: ignored, the LAST frame ends it)
+ *   data[5]   = window (frames in flight) the client would like
+ *   data[6-7] = frame payload size the client would like
+ *
+ * and the reply carries what the server can actually do in the same places. Once the
+ * reply has gone out both ends switch to the frames below, which are sent back to back
+ * without waiting for each other. The receiver acknowledges with ACK frames (cumulative,
+ * plus a bitmap of what it has beyond that) and asks for specific frames again with NAK.
+ * The client ends it with END, and the server answers END, after which normal packets
+ * resume. If END gets lost, REMCTL_SERIAL_BULK_ESCAPE bytes in a row that can't start a
+ * frame (the client floods 0xFF) also end it. */
+#pragma pack(push,1)
+struct remctl_serial_bulk_header {
+    unsigned char       mark;           /* REMCTL_SERIAL_BULK_MARK */
+    unsigned char       type;           /* REMCTL_SERIAL_BULK_* */
+    unsigned char       sequence;       /* DATA frame number, 0-255 and wraps around */
+    unsigned char       flags;
+    unsigned char       length[2];      /* payload length, little endian */
+    unsigned char       crc[2];         /* CRC-16/CCITT of type through length, then payload, little endian */
+};
+#pragma pack(pop)
+
+#define REMCTL_SERIAL_BULK_MARK         0x02
+#define REMCTL_SERIAL_BULK_HDR          (sizeof(struct remctl_serial_bulk_header))
+#define REMCTL_SERIAL_BULK_PAYLOAD_MAX  1024
+#define REMCTL_SERIAL_BULK_WINDOW_MAX   32
+#define REMCTL_SERIAL_BULK_ESCAPE       1536    /* more than the tail of one damaged frame */
+
+enum {
+    REMCTL_SERIAL_BULK_ACK=0x41,        /* data[0] = next frame wanted, data[1-4] = bitmap of frames after that already held */
+    REMCTL_SERIAL_BULK_DATA=0x44,       /* file data */
+    REMCTL_SERIAL_BULK_END=0x45,        /* end bulk mode */
+    REMCTL_SERIAL_BULK_NAK=0x4E,        /* same as ACK, data[5] = resend what's missing in the first N frames from data[0] (receiver timed out) */
+    REMCTL_SERIAL_BULK_ABORT=0x58       /* I/O error, nothing more is coming */
+};
+
+#define REMCTL_SERIAL_BULK_FLAG_LAST    0x01    /* DATA: last frame of the file */
+
+/* Delta sync.
+ *
+ * FILE_HASH asks for the CRC-32 (the usual one, as in zip) of consecutive blocks of the
+ * open file:
+ *
+ *   data[1-4] = first block number
+ *   data[5-6] = block size, REMCTL_SERIAL_SYNC_BLOCK_MIN to REMCTL_SERIAL_SYNC_BLOCK_MAX
+ *   data[7]   = how many blocks, up to REMCTL_SERIAL_SYNC_HASH_MAX, and no more than
+ *               REMCTL_SERIAL_SYNC_HASH_BYTES altogether
+ *
+ * The reply has the same, with data[7] the number of blocks actually hashed (fewer at the
+ * end of the file, the last one may be short), and the CRCs little endian from data[8].
+ * The file pointer is left wherever the hashing stopped.
+ *
+ * FILE_BULK_PATCH starts bulk mode the same way as FILE_BULK_WRITE (data[1-4] is the
+ * length of the patch stream) but the data is a series of records, each one a block to
+ * write somewhere in the file. See sync.h for the LZ format. */
+#define REMCTL_SERIAL_SYNC_BLOCK_MIN    64
+#define REMCTL_SERIAL_SYNC_BLOCK_MAX    32768U
+#define REMCTL_SERIAL_SYNC_HASH_MAX     32
+#define REMCTL_SERIAL_SYNC_HASH_BYTES   32768UL
+
+#pragma pack(push,1)
+struct remctl_serial_sync_record {
+    unsigned char       offset[4];      /* where the block goes in the file, little endian */
+    unsigned char       length[2];      /* block length */
+    unsigned char       stored[2];      /* bytes that follow. less than length if LZ compressed, else equal */
+};
+#pragma pack(pop)
@@ -24,6 +24,8 @@
 #include <time.h>
 
 #include "proto.h"
+#include "bulk.h"
+#include "sync.h"
 
 #ifndef O_BINARY
 #define O_BINARY (0)
@@ -46,6 +48,10 @@ static char*            memstr = NULL;
 static char*            input_file = NULL;
 static char*            output_file = NULL;
 static unsigned char    enterkey = 0;
+static unsigned char    bulk_window = 8;
+static unsigned int     bulk_payload = REMCTL_SERIAL_BULK_PAYLOAD_MAX;
+static unsigned int     sync_block = 1024;
+static unsigned char    sync_lz = 1;
 
 static int              conn_fd = -1;
 
@@ -69,6 +75,10 @@ static void help(void) {
     fprintf(stderr,"  -data <n>         data value\n");
     fprintf(stderr,"  -o <file>         Output file\n");
     fprintf(stderr,"  -i <file>         Input file\n");
+    fprintf(stderr,"  -bwin <n>         Bulk transfer window, in frames (default 8)\n");
+    fprintf(stderr,"  -bframe <n>       Bulk transfer frame size, in bytes (default 1024)\n");
+    fprintf(stderr,"  -sblock <n>       Sync block size, in bytes (default 1024)\n");
+    fprintf(stderr,"  -nolz             Sync without compressing changed blocks\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"Commands are:\n");
     fprintf(stderr,"   ping             Ping the server (test connection)\n");
@@ -86,6 +96,8 @@ static void help(void) {
     fprintf(stderr,"   memwrite -msz <n> -maddr <n> -data <n> Write server memory\n");
     fprintf(stderr,"   memwrite -maddr <n> -mstr <x> Write server memory with string\n");
     fprintf(stderr,"   memdump -msz <n> -maddr <n> -o <file> Dump memory starting at -maddr\n");
+    fprintf(stderr,"   bmemdump -msz <n> -maddr <n> -o <file> Dump memory, batched reads\n");
+    fprintf(stderr,"   binp -mstr <list> Read I/O ports in one go. list is port[:b|:w|:d][*count],...\n");
     fprintf(stderr,"   dos_lol          Report MS-DOS List of Lists location\n");
     fprintf(stderr,"   indos            Report MS-DOS InDOS flag\n");
     fprintf(stderr,"   pwd              Report current working path\n");
@@ -103,6 +115,9 @@ static void help(void) {
     fprintf(stderr,"   truncate          Truncate at file pointer\n");
     fprintf(stderr,"   upload -mstr <path> -i <path> Send file from -i to -mstr path\n");
     fprintf(stderr,"   download -mstr <path> -o <path> Download file from -mstr to -o locally\n");
+    fprintf(stderr,"   bupload -mstr <path> -i <path> Upload, windowed bulk transfer\n");
+    fprintf(stderr,"   bdownload -mstr <path> -o <path> Download, windowed bulk transfer\n");
+    fprintf(stderr,"   sync -mstr <path> -i <path> Upload only the blocks that differ\n");
     fprintf(stderr,"   stuffkey -data <code> Stuff code into BIOS keyboard buffer\n");
     fprintf(stderr,"   stuffkey -mstr <string> Stuff ASCII codes into BIOS keyboard buffer\n");
     fprintf(stderr,"   stuffkey -mstr <string> -enter Stuff ASCII codes, then send ENTER key\n");
@@ -168,6 +183,30 @@ static int parse_argv(int argc,char **argv) {
                 if (a == NULL) return 1;
                 memaddr = strtoul(a,NULL,0);
             }
+            else if (!strcmp(a,"bwin")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                bulk_window = (unsigned char)atoi(a);
+                if (bulk_window < 1) bulk_window = 1;
+                else if (bulk_window > REMCTL_SERIAL_BULK_WINDOW_MAX) bulk_window = REMCTL_SERIAL_BULK_WINDOW_MAX;
+            }
+            else if (!strcmp(a,"bframe")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                bulk_payload = strtoul(a,NULL,0);
+                if (bulk_payload < 16) bulk_payload = 16;
+                else if (bulk_payload > REMCTL_SERIAL_BULK_PAYLOAD_MAX) bulk_payload = REMCTL_SERIAL_BULK_PAYLOAD_MAX;
+            }
+            else if (!strcmp(a,"sblock")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                sync_block = strtoul(a,NULL,0);
+                if (sync_block < REMCTL_SERIAL_SYNC_BLOCK_MIN) sync_block = REMCTL_SERIAL_SYNC_BLOCK_MIN;
+                else if (sync_block > REMCTL_SERIAL_SYNC_BLOCK_MAX) sync_block = REMCTL_SERIAL_SYNC_BLOCK_MAX;
+            }
+            else if (!strcmp(a,"nolz")) {
+                sync_lz = 0;
+            }
             else if (!strcmp(a,"msz")) {
                 a = argv[i++];
                 if (a == NULL) return 1;
@@ -487,7 +526,8 @@ int write_persistent(const int fd,const void *p,int sz) {
 }
 
 void reset_packet_io(void) {
-    char tmp[300];
+    /* enough to also knock the server out of bulk mode, see REMCTL_SERIAL_BULK_ESCAPE */
+    char tmp[REMCTL_SERIAL_BULK_ESCAPE + REMCTL_SERIAL_BULK_HDR + REMCTL_SERIAL_BULK_PAYLOAD_MAX];
 
     cur_pkt_recv_seq = 0xFF;
     cur_pkt_seq=0xFF;
@@ -730,6 +770,72 @@ const unsigned char *do_memread(const unsigned char sz,const unsigned long addr)
     return &(cur_pkt.data[5]);
 }
 
+/* one batched read. results land in dst back to back, returns how many bytes came back,
+ * -1 if the link failed or the reply made no sense, -2 if the server refused the list */
+long do_batch(const unsigned char type,const unsigned char * const list,const unsigned int listlen,unsigned char * const dst,const unsigned long max,const char * const what) {
+    unsigned long got = 0;
+    time_t now,next = 0;
+    unsigned int len;
+
+    if (listlen == 0 || listlen > 254)
+        return -1;
+
+    remctl_serial_packet_begin(&cur_pkt,REMCTL_SERIAL_TYPE_BATCH);
+
+    cur_pkt.data[cur_pkt.hdr.length++] = type;
+    memcpy(cur_pkt.data+cur_pkt.hdr.length,list,listlen);
+    cur_pkt.hdr.length += listlen;
+
+    remctl_serial_packet_end(&cur_pkt);
+
+    if (do_send_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to send packet\n");
+        return -1;
+    }
+
+    do {
+        if (do_recv_packet(&cur_pkt) < 0) {
+            fprintf(stderr,"Failed to recv packet\n");
+            return -1;
+        }
+
+        if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_ERROR) {
+            fprintf(stderr,"Server returned an error for the batched read\n");
+            return -2;
+        }
+        if (cur_pkt.hdr.type != REMCTL_SERIAL_TYPE_BATCH) {
+            fprintf(stderr,"Batched reads not supported by server\n");
+            return -1;
+        }
+        if (cur_pkt.hdr.length == 0)
+            continue;
+        if (cur_pkt.data[0] == REMCTL_SERIAL_TYPE_BATCH_FINISHED)
+            break;
+        if (cur_pkt.data[0] != type) {
+            fprintf(stderr,"Unexpected batch reply\n");
+            return -1;
+        }
+
+        len = cur_pkt.hdr.length - 1U;
+        if ((got + len) > max) {
+            fprintf(stderr,"Server sent more than asked for\n");
+            return -1;
+        }
+
+        memcpy(dst + got,cur_pkt.data + 1,len);
+        got += len;
+
+        now = time(NULL);
+        if (what != NULL && now >= next) {
+            next = now + 1;
+            printf("\x0D" "%s, %lu / %lu bytes... ",what,got,max);
+            fflush(stdout);
+        }
+    } while (1);
+
+    return (long)got;
+}
+
 int do_memwrite(const unsigned char sz,const unsigned long addr,const unsigned char *str) {
     if (sz == 0 || sz > 192)
         return -1;
@@ -1464,6 +1570,279 @@ retry:
     return 0;
 }
 
+/* start bulk mode. the server answers with the window and frame size it can actually do */
+int do_file_bulk_begin(const unsigned char cmd,const unsigned long count,unsigned char * const window,unsigned int * const payload) {
+retry:
+    remctl_serial_packet_begin(&cur_pkt,REMCTL_SERIAL_TYPE_FILE);
+
+    cur_pkt.data[cur_pkt.hdr.length++] = cmd;
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(count >> 0UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(count >> 8UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(count >> 16UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(count >> 24UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = *window;
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(*payload & 0xFFU);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(*payload >> 8U);
+
+    remctl_serial_packet_end(&cur_pkt);
+
+    if (do_send_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to send packet\n");
+        return -1;
+    }
+
+    if (do_recv_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to recv packet\n");
+        return -1;
+    }
+
+    /* MS-DOS might be busy at this point... */
+    if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY) {
+        fprintf(stderr,"MS-DOS is busy...\n");
+        usleep(10000);
+        goto retry;
+    }
+
+    if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR) {
+        fprintf(stderr,"MS-DOS returned an error\n");
+        return -1;
+    }
+
+    if (cur_pkt.hdr.type != REMCTL_SERIAL_TYPE_FILE ||
+        cur_pkt.data[0] != cmd || cur_pkt.hdr.length < 8) {
+        fprintf(stderr,"Bulk transfer not supported by server\n");
+        return -1;
+    }
+
+    *window = cur_pkt.data[5];
+    *payload = (unsigned int)cur_pkt.data[6] + ((unsigned int)cur_pkt.data[7] << 8U);
+    if (*window < 1 || *window > REMCTL_SERIAL_BULK_WINDOW_MAX || *payload < 1 || *payload > REMCTL_SERIAL_BULK_PAYLOAD_MAX) {
+        fprintf(stderr,"Server returned bad bulk parameters\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* CRC-32 of up to count blocks from block number "block" of the open file. returns how many the server hashed */
+int do_file_hash(const unsigned long block,const unsigned int size,const unsigned char count,unsigned long * const crc) {
+    unsigned char got,i;
+
+retry:
+    remctl_serial_packet_begin(&cur_pkt,REMCTL_SERIAL_TYPE_FILE);
+
+    cur_pkt.data[cur_pkt.hdr.length++] = REMCTL_SERIAL_TYPE_FILE_HASH;
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(block >> 0UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(block >> 8UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(block >> 16UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(block >> 24UL);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(size & 0xFFU);
+    cur_pkt.data[cur_pkt.hdr.length++] = (unsigned char)(size >> 8U);
+    cur_pkt.data[cur_pkt.hdr.length++] = count;
+
+    remctl_serial_packet_end(&cur_pkt);
+
+    if (do_send_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to send packet\n");
+        return -1;
+    }
+
+    if (do_recv_packet(&cur_pkt) < 0) {
+        fprintf(stderr,"Failed to recv packet\n");
+        return -1;
+    }
+
+    /* MS-DOS might be busy at this point... */
+    if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_IS_BUSY) {
+        fprintf(stderr,"MS-DOS is busy...\n");
+        usleep(10000);
+        goto retry;
+    }
+
+    if (cur_pkt.hdr.type == REMCTL_SERIAL_TYPE_FILE &&
+        cur_pkt.data[0] == REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR) {
+        fprintf(stderr,"MS-DOS returned an error\n");
+        return -1;
+    }
+
+    if (cur_pkt.hdr.type != REMCTL_SERIAL_TYPE_FILE ||
+        cur_pkt.data[0] != REMCTL_SERIAL_TYPE_FILE_HASH || cur_pkt.hdr.length < 8) {
+        fprintf(stderr,"Block hashing not supported by server\n");
+        return -1;
+    }
+
+    got = cur_pkt.data[7];
+    if (got > count || cur_pkt.hdr.length < (8U + (got * 4U))) {
+        fprintf(stderr,"Server returned bad block hashes\n");
+        return -1;
+    }
+
+    for (i=0;i < got;i++) {
+        const unsigned char *p = cur_pkt.data + 8 + (i * 4U);
+
+        crc[i] =
+            ((unsigned long)p[0] << 0UL) +
+            ((unsigned long)p[1] << 8UL) +
+            ((unsigned long)p[2] << 16UL) +
+            ((unsigned long)p[3] << 24UL);
+    }
+
+    return got;
+}
+
+/* hashes of the first nblocks of the open file, all of which must exist */
+int do_sync_hashes(unsigned long * const crc,const unsigned long nblocks) {
+    unsigned long per = REMCTL_SERIAL_SYNC_HASH_BYTES / sync_block;
+    unsigned long blk = 0,want;
+    int got;
+
+    if (per > REMCTL_SERIAL_SYNC_HASH_MAX) per = REMCTL_SERIAL_SYNC_HASH_MAX;
+
+    while (blk < nblocks) {
+        want = nblocks - blk;
+        if (want > per) want = per;
+
+        got = do_file_hash(blk,sync_block,(unsigned char)want,crc + blk);
+        if (got < 0)
+            return -1;
+        if ((unsigned long)got != want) {
+            fprintf(stderr,"\nRemote file is shorter than it said it was\n");
+            return -1;
+        }
+
+        blk += want;
+        printf("\x0D" "Hashing, %lu / %lu blocks... ",blk,nblocks);
+        fflush(stdout);
+    }
+
+    if (nblocks != 0UL)
+        printf("\n");
+
+    return 0;
+}
+
+static int bulk_local_fd = -1;
+static const unsigned char *bulk_local_mem = NULL;
+static unsigned long bulk_local_mem_left = 0;
+
+static int bulk_local_mem_read(unsigned char *buf,unsigned int len) {
+    if ((unsigned long)len > bulk_local_mem_left) len = (unsigned int)bulk_local_mem_left;
+
+    memcpy(buf,bulk_local_mem,len);
+    bulk_local_mem += len;
+    bulk_local_mem_left -= len;
+    return (int)len;
+}
+
+static int bulk_local_read(unsigned char *buf,unsigned int len) {
+    return read(bulk_local_fd,buf,len);
+}
+
+static int bulk_local_write(const unsigned char *buf,unsigned int len) {
+    return write(bulk_local_fd,buf,len);
+}
+
+/* run bulk mode to the end, then END it. 0 if the whole file made it */
+int do_bulk_session(struct remctl_bulk * const b,const char * const what,const unsigned long total) {
+    unsigned char txbuf[4096],rxbuf[4096];
+    unsigned int txlen = 0,txpos = 0;
+    /* ms without a good frame before giving up on what's outstanding: long enough
+     * for a whole window to go out at the line rate, and the answer to come back */
+    const int wait = (int)((2UL * b->window * (REMCTL_SERIAL_BULK_HDR + b->payload) * 10UL * 1000UL) / (unsigned long)baud_rate) + 250;
+    int patience = wait;
+    int timeouts = 0;
+    int ending = 0;
+    time_t now,next = 0;
+    int rd,wd;
+
+    while (!remctl_bulk_closed(b)) {
+        remctl_bulk_pump(b);
+
+        if (!ending && (b->done || b->error)) {
+            remctl_bulk_end(b);
+            patience = wait;
+            timeouts = 0;
+            ending = 1;
+        }
+
+        if (txpos >= txlen) {
+            txlen = remctl_bulk_tx(b,txbuf,sizeof(txbuf));
+            txpos = 0;
+        }
+
+        wd = 0;
+        if (txpos < txlen) {
+            wd = write(conn_fd,txbuf+txpos,txlen-txpos);
+            if (wd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    fprintf(stderr,"\nSend failed, %s\n",strerror(errno));
+                    drop_connection();
+                    return -1;
+                }
+                wd = 0;
+            }
+            txpos += wd;
+        }
+
+        rd = read(conn_fd,rxbuf,sizeof(rxbuf));
+        if (rd == 0 || (rd < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            fprintf(stderr,"\nConnection lost\n");
+            drop_connection();
+            return -1;
+        }
+
+        if (rd > 0 && remctl_bulk_rx(b,rxbuf,rd) != 0) {
+            patience = wait;
+            timeouts = 0;
+        }
+        else if (wd <= 0) {
+            usleep(1000); /* 1ms */
+
+            if (--patience < 0) {
+                patience = wait;
+                if (++timeouts > (ending ? 3 : 10)) {
+                    fprintf(stderr,"\nBulk transfer timeout\n");
+                    /* the server may still be in bulk mode */
+                    reset_packet_io();
+                    break;
+                }
+
+                if (ending)
+                    remctl_bulk_end(b);
+                else
+                    remctl_bulk_timeout(b);
+            }
+        }
+
+        now = time(NULL);
+        if (now >= next && total != 0UL) {
+            unsigned long percent;
+
+            percent = (b->count >> 7UL) * 100UL;
+            percent /= ((total + 127UL) >> 7UL);
+
+            next = now + 1;
+            printf("\x0D" "%s, %lu%% %lu / %lu (resent %lu, bad %lu)... ",
+                what,percent,b->count,total,b->resent,b->bad);
+            fflush(stdout);
+        }
+    }
+
+    printf("\n");
+
+    if (b->error) {
+        fprintf(stderr,"I/O error during bulk transfer\n");
+        return -1;
+    }
+    if (!b->done)
+        return -1;
+
+    return 0;
+}
+
 void do_print_dir(void) {
     /* the contents are a MS-DOS FileInfoRec */
     unsigned char *p = cur_pkt.data + 1;
@@ -1691,6 +2070,160 @@ int main(int argc,char **argv) {
 
         close(fd);
     }
+    else if (!strcmp(command,"bmemdump")) {
+        /* as many memory reads per request as fit, 32KB each, all answered back to back */
+        const unsigned long per_entry = 0x8000UL;
+        const unsigned int entries = 8;
+        unsigned char list[6 * 8];
+        unsigned char *buf;
+        char what[32];
+        unsigned long addr,want,total;
+        unsigned int n;
+        long got;
+        int fd;
+
+        if (output_file == NULL)
+            return 1;
+        if (memsz <= 0)
+            return 1;
+
+        fd = open(output_file,O_BINARY|O_CREAT|O_TRUNC|O_WRONLY,0644);
+        if (fd < 0) {
+            fprintf(stderr,"Cannot open output file %s, %s\n",output_file,strerror(errno));
+            return 1;
+        }
+
+        buf = malloc(per_entry * entries);
+        if (buf == NULL)
+            return 1;
+
+        addr = memaddr;
+        while (memsz > 0) {
+            total = 0;
+            for (n=0;n < entries && total < (unsigned long)memsz;n++) {
+                want = (unsigned long)memsz - total;
+                if (want > per_entry) want = per_entry;
+
+                list[(n*6)+0] = (unsigned char)((addr + total) >> 0UL);
+                list[(n*6)+1] = (unsigned char)((addr + total) >> 8UL);
+                list[(n*6)+2] = (unsigned char)((addr + total) >> 16UL);
+                list[(n*6)+3] = (unsigned char)((addr + total) >> 24UL);
+                list[(n*6)+4] = (unsigned char)(want & 0xFFUL);
+                list[(n*6)+5] = (unsigned char)(want >> 8UL);
+                total += want;
+            }
+
+            sprintf(what,"Reading 0x%08lX",addr);
+            got = do_batch(REMCTL_SERIAL_TYPE_BATCH_MEMREAD,list,n * 6,buf,total,what);
+            if (got == -2) {
+                free(buf);
+                close(fd);
+                return 1;
+            }
+            if (got < 0 || (unsigned long)got != total) {
+                fprintf(stderr,"\nReconnecting...\n");
+                if (do_connect() < 0)
+                    return 1;
+                continue;
+            }
+            if (write(fd,buf,total) != (int)total)
+                break;
+
+            memsz -= (long)total;
+            addr += total;
+        }
+        printf("\n");
+
+        free(buf);
+        close(fd);
+    }
+    else if (!strcmp(command,"binp")) {
+        /* -mstr port[:b|:w|:d][*count],... */
+        unsigned char list[4 * 63],buf[63 * 255 * 4];
+        unsigned int n = 0,j,k,w,cnt,port;
+        unsigned long total = 0,v;
+        const char *p = memstr;
+        char *e;
+        long got;
+
+        if (p == NULL) {
+            fprintf(stderr,"binp needs -mstr with a list of ports\n");
+            return 1;
+        }
+
+        while (*p != 0) {
+            if (n >= 63) {
+                fprintf(stderr,"Too many ports\n");
+                return 1;
+            }
+
+            port = (unsigned int)strtoul(p,&e,0);
+            if (e == p || port > 65535) {
+                fprintf(stderr,"Bad port list at '%s'\n",p);
+                return 1;
+            }
+            p = e;
+
+            w = 1;
+            if (*p == ':') {
+                p++;
+                if (*p == 'b') w = 1;
+                else if (*p == 'w') w = 2;
+                else if (*p == 'd') w = 4;
+                else {
+                    fprintf(stderr,"Bad port width at '%s'\n",p);
+                    return 1;
+                }
+                p++;
+            }
+
+            cnt = 1;
+            if (*p == '*') {
+                p++;
+                cnt = (unsigned int)strtoul(p,&e,0);
+                if (e == p || cnt < 1 || cnt > 255) {
+                    fprintf(stderr,"Bad repeat count at '%s'\n",p);
+                    return 1;
+                }
+                p = e;
+            }
+
+            if (*p == ',') p++;
+            else if (*p != 0) {
+                fprintf(stderr,"Bad port list at '%s'\n",p);
+                return 1;
+            }
+
+            list[(n*4)+0] = (unsigned char)(port & 0xFFU);
+            list[(n*4)+1] = (unsigned char)(port >> 8U);
+            list[(n*4)+2] = (unsigned char)w;
+            list[(n*4)+3] = (unsigned char)cnt;
+            total += (unsigned long)w * cnt;
+            n++;
+        }
+
+        got = do_batch(REMCTL_SERIAL_TYPE_BATCH_INPORT,list,n * 4,buf,total,NULL);
+        if (got < 0)
+            return 1;
+        if ((unsigned long)got != total) {
+            fprintf(stderr,"Got %ld bytes, expected %lu\n",got,total);
+            return 1;
+        }
+
+        for (total=0,j=0;j < n;j++) {
+            port = (unsigned int)list[(j*4)+0] + ((unsigned int)list[(j*4)+1] << 8U);
+            w = list[(j*4)+2];
+
+            printf("I/O port 0x%X:",port);
+            for (k=0;k < list[(j*4)+3];k++) {
+                for (v=0,cnt=0;cnt < w;cnt++)
+                    v += (unsigned long)buf[total++] << (8UL * cnt);
+
+                printf(" 0x%0*lx",w * 2,v);
+            }
+            printf("\n");
+        }
+    }
     else if (!strcmp(command,"dos_lol")) {
         unsigned int sv,ov;
 
@@ -2066,6 +2599,262 @@ int main(int argc,char **argv) {
 
         close(ofd);
     }
+    else if (!strcmp(command,"bupload") || !strcmp(command,"bdownload")) {
+        const int up = !strcmp(command,"bupload");
+        unsigned int payload = bulk_payload;
+        unsigned char window = bulk_window;
+        unsigned char *slotmem,*rxmem;
+        struct remctl_bulk b;
+        long file_size;
+        int res;
+
+        if (memstr == NULL) {
+            fprintf(stderr,"need -mstr to contain remote path\n");
+            return 1;
+        }
+        if (up && input_file == NULL) {
+            fprintf(stderr,"need -i to specify source file\n");
+            return 1;
+        }
+        if (!up && output_file == NULL) {
+            fprintf(stderr,"need -o to specify local target file\n");
+            return 1;
+        }
+
+        if (up) {
+            bulk_local_fd = open(input_file,O_RDONLY|O_BINARY);
+            if (bulk_local_fd < 0) {
+                fprintf(stderr,"Failed to open source file\n");
+                return 1;
+            }
+            file_size = lseek(bulk_local_fd,0,SEEK_END);
+            if (file_size < 0L) {
+                fprintf(stderr,"Cannot determine source file size\n");
+                return 1;
+            }
+            lseek(bulk_local_fd,0,SEEK_SET);
+
+            if (do_file_create(memstr) < 0)
+                return 1;
+        }
+        else {
+            bulk_local_fd = open(output_file,O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644);
+            if (bulk_local_fd < 0) {
+                fprintf(stderr,"Failed to open target file\n");
+                return 1;
+            }
+
+            if (do_file_open(memstr) < 0)
+                return 1;
+            if (do_file_seek(&data,0,2/*SEEK_END*/) < 0)
+                return 1;
+            file_size = (long)data;
+            if (do_file_seek(&data,0,0/*SEEK_SET*/) < 0)
+                return 1;
+        }
+
+        if (do_file_bulk_begin(up ? REMCTL_SERIAL_TYPE_FILE_BULK_WRITE : REMCTL_SERIAL_TYPE_FILE_BULK_READ,
+            (unsigned long)file_size,&window,&payload) < 0)
+            return 1;
+
+        if (debug)
+            fprintf(stderr,"Bulk window %u frames of %u bytes\n",window,payload);
+
+        slotmem = malloc(remctl_bulk_slot_mem(window,payload));
+        rxmem = malloc(REMCTL_SERIAL_BULK_HDR + payload);
+        if (slotmem == NULL || rxmem == NULL)
+            return 1;
+
+        remctl_bulk_init(&b,up ? REMCTL_BULK_SEND : REMCTL_BULK_RECV,window,payload,slotmem,rxmem);
+        b.read = bulk_local_read;
+        b.write = bulk_local_write;
+        b.remain = (unsigned long)file_size;
+
+        res = do_bulk_session(&b,up ? "Uploading" : "Download",(unsigned long)file_size);
+
+        if (conn_fd < 0 && do_connect() < 0)
+            return 1;
+        if (do_file_close() < 0)
+            return 1;
+
+        if (res < 0 || b.count != (unsigned long)file_size) {
+            printf("%s incomplete\n",up ? "Upload" : "Download");
+        }
+        else {
+            printf("%s OK (%lu frames resent, %lu bad)\n",up ? "Upload" : "Download",b.resent,b.bad);
+        }
+
+        close(bulk_local_fd);
+        bulk_local_fd = -1;
+        free(rxmem);
+        free(slotmem);
+    }
+    else if (!strcmp(command,"sync")) {
+        unsigned int payload = bulk_payload;
+        unsigned char window = bulk_window;
+        unsigned long local_size,remote_size,lblocks,rblocks,blk,off;
+        unsigned long changed = 0,raw = 0,stream_len = 0;
+        unsigned long *remote_crc,crc;
+        unsigned char *local,*stream,*slotmem,*rxmem;
+        struct remctl_serial_sync_record *rec;
+        struct remctl_bulk b;
+        unsigned int len,stored;
+        long sz;
+        int fd,rd;
+
+        if (memstr == NULL) {
+            fprintf(stderr,"need -mstr to contain remote path\n");
+            return 1;
+        }
+        if (input_file == NULL) {
+            fprintf(stderr,"need -i to specify source file\n");
+            return 1;
+        }
+
+        fd = open(input_file,O_RDONLY|O_BINARY);
+        if (fd < 0) {
+            fprintf(stderr,"Failed to open source file\n");
+            return 1;
+        }
+        sz = lseek(fd,0,SEEK_END);
+        if (sz < 0L) {
+            fprintf(stderr,"Cannot determine source file size\n");
+            return 1;
+        }
+        lseek(fd,0,SEEK_SET);
+        local_size = (unsigned long)sz;
+
+        local = malloc(local_size + 1UL);
+        if (local == NULL)
+            return 1;
+        for (off=0;off < local_size;off += (unsigned long)rd) {
+            rd = read(fd,local + off,local_size - off);
+            if (rd <= 0) {
+                fprintf(stderr,"Failed to read source file\n");
+                return 1;
+            }
+        }
+        close(fd);
+
+        if (do_file_open(memstr) < 0) {
+            printf("Remote file not there, creating it\n");
+            if (do_file_create(memstr) < 0)
+                return 1;
+        }
+        if (do_file_seek(&remote_size,0,2/*SEEK_END*/) < 0)
+            return 1;
+
+        lblocks = (local_size + sync_block - 1UL) / sync_block;
+        rblocks = (remote_size + sync_block - 1UL) / sync_block;
+
+        remote_crc = malloc((lblocks + 1UL) * sizeof(unsigned long));
+        stream = malloc((lblocks * (sizeof(*rec) + sync_block)) + 1UL);
+        if (remote_crc == NULL || stream == NULL)
+            return 1;
+
+        if (do_sync_hashes(remote_crc,(rblocks < lblocks) ? rblocks : lblocks) < 0)
+            return 1;
+
+        /* patch stream: each block that differs (or isn't there yet), compressed if that helps */
+        for (blk=0;blk < lblocks;blk++) {
+            off = blk * sync_block;
+            len = ((local_size - off) < sync_block) ? (unsigned int)(local_size - off) : sync_block;
+
+            crc = remctl_crc32(0xFFFFFFFFUL,local + off,len) ^ 0xFFFFFFFFUL;
+            if (blk < rblocks && crc == remote_crc[blk])
+                continue;
+
+            rec = (struct remctl_serial_sync_record*)(stream + stream_len);
+            stored = sync_lz ? remctl_sync_lz_compress(stream + stream_len + sizeof(*rec),local + off,len) : 0;
+            if (stored == 0) {
+                memcpy(stream + stream_len + sizeof(*rec),local + off,len);
+                stored = len;
+            }
+
+            rec->offset[0] = (unsigned char)(off >> 0UL);
+            rec->offset[1] = (unsigned char)(off >> 8UL);
+            rec->offset[2] = (unsigned char)(off >> 16UL);
+            rec->offset[3] = (unsigned char)(off >> 24UL);
+            rec->length[0] = (unsigned char)(len & 0xFFU);
+            rec->length[1] = (unsigned char)(len >> 8U);
+            rec->stored[0] = (unsigned char)(stored & 0xFFU);
+            rec->stored[1] = (unsigned char)(stored >> 8U);
+            stream_len += sizeof(*rec) + stored;
+
+            changed++;
+            raw += len;
+        }
+
+        if (debug)
+            fprintf(stderr,"%lu of %lu blocks changed, %lu bytes, %lu bytes to send\n",changed,lblocks,raw,stream_len);
+
+        memset(&b,0,sizeof(b));
+        if (stream_len != 0UL) {
+            if (do_file_bulk_begin(REMCTL_SERIAL_TYPE_FILE_BULK_PATCH,stream_len,&window,&payload) < 0)
+                return 1;
+
+            slotmem = malloc(remctl_bulk_slot_mem(window,payload));
+            rxmem = malloc(REMCTL_SERIAL_BULK_HDR + payload);
+            if (slotmem == NULL || rxmem == NULL)
+                return 1;
+
+            remctl_bulk_init(&b,REMCTL_BULK_SEND,window,payload,slotmem,rxmem);
+            bulk_local_mem = stream;
+            bulk_local_mem_left = stream_len;
+            b.read = bulk_local_mem_read;
+            b.remain = stream_len;
+
+            rd = do_bulk_session(&b,"Patching",stream_len);
+
+            free(rxmem);
+            free(slotmem);
+
+            if (conn_fd < 0 && do_connect() < 0)
+                return 1;
+            if (rd < 0 || b.count != stream_len) {
+                printf("Sync incomplete\n");
+                do_file_close();
+                return 1;
+            }
+        }
+
+        if (remote_size > local_size) {
+            if (do_file_seek(&data,local_size,0/*SEEK_SET*/) < 0)
+                return 1;
+            if (do_file_truncate() < 0)
+                return 1;
+        }
+
+        /* check the whole thing. the patch stream is only checked frame by frame on the way */
+        if (do_file_seek(&remote_size,0,2/*SEEK_END*/) < 0)
+            return 1;
+        if (remote_size != local_size) {
+            fprintf(stderr,"Remote file is %lu bytes, should be %lu\n",remote_size,local_size);
+            do_file_close();
+            return 1;
+        }
+        if (do_sync_hashes(remote_crc,lblocks) < 0)
+            return 1;
+        for (blk=0;blk < lblocks;blk++) {
+            off = blk * sync_block;
+            len = ((local_size - off) < sync_block) ? (unsigned int)(local_size - off) : sync_block;
+            if ((remctl_crc32(0xFFFFFFFFUL,local + off,len) ^ 0xFFFFFFFFUL) != remote_crc[blk]) {
+                fprintf(stderr,"Block %lu differs after sync\n",blk);
+                do_file_close();
+                return 1;
+            }
+        }
+
+        if (do_file_close() < 0)
+            return 1;
+
+        printf("Sync OK: %lu of %lu blocks changed, sent %lu bytes for %lu (%lu frames resent, %lu bad)\n",
+            changed,lblocks,stream_len,raw,b.resent,b.bad);
+
+        free(stream);
+        free(remote_crc);
+        free(local);
+    }
     else if (!strcmp(command,"stuffkey")) {
         if (memstr != NULL) {
             unsigned int i;
@@ -28,6 +28,8 @@
 #include <hw/flatreal/flatreal.h>
 
 #include "proto.h"
+#include "bulk.h"
+#include "sync.h"
 
 #ifdef TARGET_PC98
 static struct uart_8251 *uart = NULL;
@@ -63,6 +65,26 @@ static struct remctl_serial_packet      cur_pkt_out = {0};
 static unsigned char                    cur_pkt_out_write = 0;      // from 0 to < sizeof(cur_pkt_out)
 static unsigned char                    cur_pkt_out_seq = 0xFF;
 
+/* bulk transfer. keep the window small, it all has to stay resident */
+#define BULK_WINDOW                     4
+
+static struct remctl_bulk               bulk;
+static unsigned char                    bulk_active = 0;
+static unsigned char                    bulk_mem[remctl_bulk_slot_mem(BULK_WINDOW,REMCTL_SERIAL_BULK_PAYLOAD_MAX)];
+static unsigned char                    bulk_rx[REMCTL_SERIAL_BULK_HDR + REMCTL_SERIAL_BULK_PAYLOAD_MAX];
+
+/* batched reads, see REMCTL_SERIAL_TYPE_BATCH */
+static unsigned char                    batch_active = 0;
+static unsigned char                    batch_type = 0;
+static unsigned char                    batch_list[256];
+static unsigned int                     batch_count = 0;    /* entries in the list */
+static unsigned int                     batch_entry = 0;    /* entry being read */
+static unsigned int                     batch_done = 0;     /* bytes (memory) or reads (I/O) of it done so far */
+
+/* delta sync. hashing borrows bulk_mem, it's never needed while bulk mode is running */
+static struct remctl_sync               patch;
+static unsigned char                    patch_ring[REMCTL_SYNC_LZ_WINDOW];
+
 #ifdef TARGET_PC98
 void pc98_uart_irq_update(void) {
     /* NTS: Unlike the IBM PC UARTs, we can't just leave all interrupt signals
@@ -1011,8 +1033,374 @@ l1:     pop     dx
     }
 }
 
+static int bulk_file_read(unsigned char *buf,unsigned int len) {
+    unsigned char far *p = (unsigned char far*)buf;
+    unsigned short length = len;
+    unsigned short fd = open_file_fd;
+    unsigned short retv = 0;
+
+    __asm {
+        push    ds
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ah,0x3F                 ; read
+        mov     bx,fd                   ; file handle
+        mov     cx,length
+        lds     dx,word ptr [p]
+        int     21h
+        jnc     l1
+        mov     retv,ax
+l1:     mov     length,ax
+        pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+        pop     ds
+    }
+
+    if (retv != 0)
+        return -1;
+
+    return (int)length;
+}
+
+static int bulk_file_write(const unsigned char *buf,unsigned int len) {
+    unsigned char far *p = (unsigned char far*)buf;
+    unsigned short length = len;
+    unsigned short fd = open_file_fd;
+    unsigned short retv = 0;
+
+    // write with length == 0 truncates the file
+    if (length == 0)
+        return 0;
+
+    __asm {
+        push    ds
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ah,0x40                 ; write
+        mov     bx,fd                   ; file handle
+        mov     cx,length
+        lds     dx,word ptr [p]
+        int     21h
+        jnc     l1
+        mov     retv,ax
+l1:     mov     length,ax
+        pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+        pop     ds
+    }
+
+    if (retv != 0)
+        return -1;
+
+    return (int)length;
+}
+
+static int bulk_file_seek(unsigned long offset) {
+    unsigned short fd = open_file_fd;
+    unsigned short retv = 0;
+
+    __asm {
+        push    ax
+        push    bx
+        push    cx
+        push    dx
+        mov     ax,0x4200               ; seek from start
+        mov     bx,fd                   ; file handle
+        mov     cx,word ptr offset + 2  ; CX:DX = file pointer
+        mov     dx,word ptr offset
+        int     21h
+        jnc     l1
+        mov     retv,ax
+l1:     pop     dx
+        pop     cx
+        pop     bx
+        pop     ax
+    }
+
+    if (retv != 0)
+        return -1;
+
+    return 0;
+}
+
+static int bulk_patch_write(const unsigned char *buf,unsigned int len) {
+    if (remctl_sync_feed(&patch,buf,len) < 0)
+        return -1;
+
+    return (int)len;
+}
+
+void do_file_hash_command(void) {
+    unsigned long block =
+        ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 24UL);
+    unsigned int size = cur_pkt_in.data[5] + (cur_pkt_in.data[6] << 8U);
+    unsigned char count = cur_pkt_in.data[7];
+    unsigned char *h = cur_pkt_out.data + 8;
+    unsigned int left,chunk;
+    unsigned char got = 0;
+    unsigned long crc;
+    int rd = 1;
+
+    if (open_file_fd < 0 || cur_pkt_in.hdr.length < 8 || size < REMCTL_SERIAL_SYNC_BLOCK_MIN || size > REMCTL_SERIAL_SYNC_BLOCK_MAX) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    /* this all happens in one go from the interrupt, keep it bounded */
+    if (count > REMCTL_SERIAL_SYNC_HASH_MAX)
+        count = REMCTL_SERIAL_SYNC_HASH_MAX;
+    if (((unsigned long)count * size) > REMCTL_SERIAL_SYNC_HASH_BYTES)
+        count = (unsigned char)(REMCTL_SERIAL_SYNC_HASH_BYTES / size);
+
+    if (bulk_file_seek(block * (unsigned long)size) < 0) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    while (got < count && rd > 0) {
+        crc = 0xFFFFFFFFUL;
+        left = size;
+
+        while (left != 0U) {
+            chunk = (left < sizeof(bulk_mem)) ? left : sizeof(bulk_mem);
+            rd = bulk_file_read(bulk_mem,chunk);
+            if (rd < 0) {
+                cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+                cur_pkt_out.hdr.length = 1;
+                return;
+            }
+
+            crc = remctl_crc32(crc,bulk_mem,(unsigned int)rd);
+            left -= (unsigned int)rd;
+            if ((unsigned int)rd < chunk) break;
+        }
+
+        /* nothing at all there, the file ended on the last block */
+        if (left == size)
+            break;
+
+        crc ^= 0xFFFFFFFFUL;
+        *h++ = (unsigned char)(crc >> 0UL);
+        *h++ = (unsigned char)(crc >> 8UL);
+        *h++ = (unsigned char)(crc >> 16UL);
+        *h++ = (unsigned char)(crc >> 24UL);
+        got++;
+
+        /* short block, that was the end of the file */
+        if (left != 0U)
+            break;
+    }
+
+    cur_pkt_out.data[7] = got;
+    cur_pkt_out.hdr.length = 8 + (got * 4U);
+}
+
+void do_file_bulk_command(void) {
+    unsigned long count =
+        ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 24UL);
+    unsigned char window = cur_pkt_in.data[5];
+    unsigned int payload = cur_pkt_in.data[6] + (cur_pkt_in.data[7] << 8U);
+
+    if (open_file_fd < 0 || cur_pkt_in.hdr.length < 8) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+        cur_pkt_out.hdr.length = 1;
+        return;
+    }
+
+    remctl_bulk_negotiate(&window,&payload,sizeof(bulk_mem));
+    remctl_bulk_init(&bulk,
+        cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_FILE_BULK_READ ? REMCTL_BULK_SEND : REMCTL_BULK_RECV,
+        window,payload,bulk_mem,bulk_rx);
+    bulk.read = bulk_file_read;
+    bulk.write = bulk_file_write;
+    bulk.remain = count;
+
+    /* patch stream: the records say where each block goes */
+    if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_FILE_BULK_PATCH) {
+        remctl_sync_init(&patch,patch_ring);
+        patch.seek = bulk_file_seek;
+        patch.write = bulk_file_write;
+        bulk.write = bulk_patch_write;
+    }
+
+    /* frames start going out once this reply has */
+    bulk_active = 1;
+
+    cur_pkt_out.data[5] = window;
+    cur_pkt_out.data[6] = (unsigned char)(payload & 0xFFU);
+    cur_pkt_out.data[7] = (unsigned char)(payload >> 8U);
+    cur_pkt_out.hdr.length = 8;
+}
+
+/* linear address to wherever it can be read from */
+static void read_memory(unsigned char *dst,const unsigned long memaddr,const unsigned int len) {
+#if TARGET_MSDOS == 16
+    unsigned int i;
+
+    /* if any byte in the range extends past FFFF:FFFF (1MB+64KB) then use flat real mode */
+    if ((memaddr+(unsigned long)len-1UL) > 0x10FFEFUL) {
+        if (cpu_basic_level >= 3 && !is_v86_mode()) {
+            if (flatrealmode_test() == 0 || flatrealmode_setup(FLATREALMODE_4GB)) {
+                for (i=0;i < len;i++)
+                    dst[i] = flatrealmode_readb((uint32_t)memaddr + (uint32_t)i);
+            }
+            else {
+                memset(dst,'F',len);
+            }
+        }
+        else {
+            memset(dst,'V',len);
+        }
+    }
+    else {
+        unsigned long segv = (unsigned long)memaddr >> 4UL;
+        unsigned int ofsv = (unsigned int)(memaddr & 0xFUL);
+
+        if (segv > 0xFFFFUL) {
+            ofsv = memaddr - 0xFFFF0UL;
+            segv = 0xFFFFUL;
+        }
+
+        /* use fmemcpy using linear to segmented conversion */
+        _fmemcpy(dst,MK_FP((unsigned int)segv,ofsv),len);
+    }
+#else
+    (void)memaddr;
+    memset(dst,0,len);
+#endif
+}
+
+/* returns how many bytes it stored, the width */
+static unsigned int read_port(unsigned char *dst,const unsigned int port,const unsigned char width) {
+    if (width == 4) {
+        // WARNING: no check is made whether your CPU is 386 or higher here!
+        unsigned long ldata = inpd(port);
+        dst[0] =  ldata & 0xFF;
+        dst[1] = (ldata >> 8UL) & 0xFF;
+        dst[2] = (ldata >> 16UL) & 0xFF;
+        dst[3] = (ldata >> 24UL) & 0xFF;
+        return 4;
+    }
+    else if (width == 2) {
+        unsigned int data = inpw(port);
+        dst[0] = data & 0xFF;
+        dst[1] = (data >> 8U) & 0xFF;
+        return 2;
+    }
+
+    dst[0] = inp(port);
+    return 1;
+}
+
+/* next packet of a batched read. the list is kept here, cur_pkt_in is reused as soon as we return */
+void batch_next_packet(void) {
+    unsigned int n = 1,take;
+
+    begin_output_packet(REMCTL_SERIAL_TYPE_BATCH);
+    cur_pkt_out.data[0] = batch_type;
+
+    while (n < (1 + REMCTL_SERIAL_BATCH_CHUNK) && batch_entry < batch_count) {
+        if (batch_type == REMCTL_SERIAL_TYPE_BATCH_MEMREAD) {
+            const unsigned char *e = batch_list + (batch_entry * 6U);
+            const unsigned long addr = (unsigned long)e[0] + ((unsigned long)e[1] << 8UL) +
+                ((unsigned long)e[2] << 16UL) + ((unsigned long)e[3] << 24UL);
+            const unsigned int len = (unsigned int)e[4] + ((unsigned int)e[5] << 8U);
+
+            take = len - batch_done;
+            if (take > ((1 + REMCTL_SERIAL_BATCH_CHUNK) - n)) take = (1 + REMCTL_SERIAL_BATCH_CHUNK) - n;
+
+            read_memory(cur_pkt_out.data + n,addr + batch_done,take);
+            n += take;
+            batch_done += take;
+            if (batch_done >= len) {
+                batch_entry++;
+                batch_done = 0;
+            }
+        }
+        else {
+            const unsigned char *e = batch_list + (batch_entry * 4U);
+
+            /* don't split a read across packets */
+            if ((n + e[2]) > (1 + REMCTL_SERIAL_BATCH_CHUNK))
+                break;
+
+            n += read_port(cur_pkt_out.data + n,(unsigned int)e[0] + ((unsigned int)e[1] << 8U),e[2]);
+            if ((++batch_done) >= e[3]) {
+                batch_entry++;
+                batch_done = 0;
+            }
+        }
+    }
+
+    if (n == 1) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_BATCH_FINISHED;
+        batch_active = 0;
+    }
+
+    cur_pkt_out.hdr.length = n;
+    end_output_packet();
+}
+
+void do_batch_command(void) {
+    const unsigned int len = cur_pkt_in.hdr.length - 1U;
+    unsigned int i,esz = 0;
+
+    if (cur_pkt_in.hdr.length != 0) {
+        if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_BATCH_MEMREAD)
+            esz = 6;
+        else if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_BATCH_INPORT)
+            esz = 4;
+    }
+
+    if (esz == 0 || len == 0 || (len % esz) != 0) {
+        begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+        cur_pkt_out_seq = 0xFF;
+        end_output_packet();
+        return;
+    }
+
+    memcpy(batch_list,cur_pkt_in.data + 1,len);
+    batch_count = len / esz;
+
+    /* no zero length reads, no odd port widths */
+    for (i=0;i < batch_count;i++) {
+        const unsigned char *e = batch_list + (i * esz);
+
+        if (esz == 6 ? (e[4] == 0 && e[5] == 0) : ((e[2] != 1 && e[2] != 2 && e[2] != 4) || e[3] == 0)) {
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            end_output_packet();
+            return;
+        }
+    }
+
+    batch_type = cur_pkt_in.data[0];
+    batch_entry = 0;
+    batch_done = 0;
+    batch_active = 1;
+
+    /* the first one goes out as the reply, the rest as fast as the UART takes them */
+    batch_next_packet();
+}
+
 void handle_packet(void) {
-    unsigned int port,data;
+    unsigned int port;
 
     switch (cur_pkt_in.hdr.type) {
         case REMCTL_SERIAL_TYPE_PING:
@@ -1021,6 +1409,9 @@ void handle_packet(void) {
             cur_pkt_out.hdr.length = 4;
             end_output_packet();
             break;
+        case REMCTL_SERIAL_TYPE_BATCH:
+            do_batch_command();
+            break;
         case REMCTL_SERIAL_TYPE_HALT:
             halt_system = cur_pkt_in.data[0];
             begin_output_packet(REMCTL_SERIAL_TYPE_HALT);
@@ -1063,25 +1454,7 @@ void handle_packet(void) {
             port = cur_pkt_in.data[0] + (cur_pkt_in.data[1] << 8U);
 
             // data[2] is the I/O width
-            if (cur_pkt_out.data[2] == 4) {
-                // WARNING: no check is made whether your CPU is 386 or higher here!
-                unsigned long ldata = inpd(port);
-                cur_pkt_out.data[3] =  ldata & 0xFF;
-                cur_pkt_out.data[4] = (ldata >> 8UL) & 0xFF;
-                cur_pkt_out.data[5] = (ldata >> 16UL) & 0xFF;
-                cur_pkt_out.data[6] = (ldata >> 24UL) & 0xFF;
-                cur_pkt_out.hdr.length = 7;
-            }
-            else if (cur_pkt_out.data[2] == 2) {
-                data = inpw(port);
-                cur_pkt_out.data[3] = data & 0xFF;
-                cur_pkt_out.data[4] = (data >> 8U) & 0xFF;
-                cur_pkt_out.hdr.length = 5;
-            }
-            else {
-                cur_pkt_out.data[3] = inp(port);
-                cur_pkt_out.hdr.length = 4;
-            }
+            cur_pkt_out.hdr.length = 3 + read_port(cur_pkt_out.data+3,port,cur_pkt_out.data[2]);
 
             end_output_packet();
             break;
@@ -1124,36 +1497,7 @@ void handle_packet(void) {
                     ((unsigned long)cur_pkt_in.data[2] << 16UL) +
                     ((unsigned long)cur_pkt_in.data[3] << 24UL);
 
-#if TARGET_MSDOS == 16
-                /* if any byte in the range extends past FFFF:FFFF (1MB+64KB) then use flat real mode */
-                if ((memaddr+(unsigned long)cur_pkt_in.data[4]-1UL) > 0x10FFEFUL) {
-                    if (cpu_basic_level >= 3 && !is_v86_mode()) {
-                        if (flatrealmode_test() == 0 || flatrealmode_setup(FLATREALMODE_4GB)) {
-                            for (port=0;port < (unsigned int)cur_pkt_in.data[4];port++)
-                                cur_pkt_out.data[5+port] = flatrealmode_readb((uint32_t)memaddr + (uint32_t)port);
-                        }
-                        else {
-                            memset(cur_pkt_out.data+5,'F',(unsigned int)cur_pkt_in.data[4]);
-                        }
-                    }
-                    else {
-                        memset(cur_pkt_out.data+5,'V',(unsigned int)cur_pkt_in.data[4]);
-                    }
-                }
-                else {
-                    unsigned long segv = (unsigned long)memaddr >> 4UL;
-                    unsigned int ofsv = (unsigned int)(memaddr & 0xFUL);
-
-                    if (segv > 0xFFFFUL) {
-                        ofsv = memaddr - 0xFFFF0UL;
-                        segv = 0xFFFFUL;
-                    }
-
-                    /* use fmemcpy using linear to segmented conversion */
-                    _fmemcpy(cur_pkt_out.data+5,
-                        MK_FP((unsigned int)segv,ofsv),(unsigned int)cur_pkt_in.data[4]);
-                }
-#endif
+                read_memory(cur_pkt_out.data+5,memaddr,(unsigned int)cur_pkt_in.data[4]);
             }
 
             end_output_packet();
@@ -1253,6 +1597,14 @@ void handle_packet(void) {
                     case REMCTL_SERIAL_TYPE_FILE_TRUNCATE:
                         do_file_truncate_command();
                         break;
+                    case REMCTL_SERIAL_TYPE_FILE_HASH:
+                        do_file_hash_command();
+                        break;
+                    case REMCTL_SERIAL_TYPE_FILE_BULK_READ:
+                    case REMCTL_SERIAL_TYPE_FILE_BULK_WRITE:
+                    case REMCTL_SERIAL_TYPE_FILE_BULK_PATCH:
+                        do_file_bulk_command();
+                        break;
                     default:
                         begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
                         cur_pkt_out_seq = 0xFF;
@@ -1307,6 +1659,9 @@ int process_input_packet(void) {
     if (in_packet_handling)
         return -1;
 
+    /* a new request cancels whatever is left of a batched read */
+    batch_active = 0;
+
     /* send an error packet if a packet doesn't validate */
     in_packet_handling = 1;
     if (inpkt_validate()) {
@@ -1335,18 +1690,28 @@ void process_input(void) {
     }
 
     do {
+        unsigned char c;
+
 #ifdef TARGET_PC98
         if (!uart_8251_rxready(uart))
             break;
 
-        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = uart_8251_read(uart);
+        c = uart_8251_read(uart);
 #else
         if (!uart_8250_can_read(uart))
             break;
 
-        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = uart_8250_read(uart);
+        c = uart_8250_read(uart);
 #endif
 
+        if (bulk_active) {
+            remctl_bulk_rx(&bulk,&c,1);
+            if (remctl_bulk_escaped(&bulk)) bulk_active = 0;
+            continue;
+        }
+
+        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = c;
+
         if (cur_pkt_in_write == 0 && cur_pkt_in.hdr.mark != REMCTL_SERIAL_MARK)
             continue;
 
@@ -1365,9 +1730,52 @@ void process_output(void) {
     do_process_output();
 }
 
+void do_process_bulk_output(void) {
+    unsigned char c;
+
+    /* file I/O under the same rules as the FILE commands */
+    if (!in_packet_handling && safe_to_use_msdos_fs_io()) {
+        in_packet_handling = 1;
+        save_and_switch_psp();
+        remctl_bulk_pump(&bulk);
+        restore_psp();
+        in_packet_handling = 0;
+    }
+
+    do {
+#ifdef TARGET_PC98
+        if (!uart_8251_txready(uart))
+            break;
+#else
+        if (!uart_8250_can_write(uart))
+            break;
+#endif
+        if (remctl_bulk_tx(&bulk,&c,1) == 0)
+            break;
+
+#ifdef TARGET_PC98
+        uart_8251_write(uart,c);
+#else
+        uart_8250_write(uart,c);
+#endif
+    } while (1);
+
+    if (remctl_bulk_closed(&bulk))
+        bulk_active = 0;
+}
+
 void do_process_output(void) {
-    if (cur_pkt_out.hdr.mark != REMCTL_SERIAL_MARK)
-        return;
+    if (cur_pkt_out.hdr.mark != REMCTL_SERIAL_MARK) {
+        if (bulk_active) {
+            do_process_bulk_output();
+            return;
+        }
+
+        if (!batch_active || in_packet_handling)
+            return;
+
+        batch_next_packet();
+    }
 
 #ifdef TARGET_PC98
     if (uart_8251_status(uart) & 0x38) /* if frame|overrun|parity error... */
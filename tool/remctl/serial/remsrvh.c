@@ -0,0 +1,651 @@
+/* Linux stand-in for REMSRV.EXE, listening on TCP instead of a serial port.
+ *
+ * Only the file commands (including delta sync) and ping, against the current directory,
+ * which is enough to exercise the client and the bulk transfer code without a DOS machine.
+ * Batched memory and I/O port reads are answered from a made up address space, see
+ * fake_memory():
+ *
+ *   remsrvh -p 2323 &
+ *   remctlclient -p 2323 -c bdownload -mstr somefile -o copy
+ *
+ * -noise N flips a bit in one byte out of N (on average) of bulk traffic, both ways,
+ * to exercise CRC checking and resend. */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "proto.h"
+#include "bulk.h"
+#include "sync.h"
+
+static int                              listen_port = 2323;
+static unsigned long                    noise = 0;
+
+static int                              conn_fd = -1;
+static int                              open_file_fd = -1;
+
+static struct remctl_serial_packet      cur_pkt_in;
+static unsigned int                     cur_pkt_in_write = 0;
+static unsigned char                    cur_pkt_in_seq = 0xFF;
+
+static struct remctl_serial_packet      cur_pkt_out;
+static unsigned char                    cur_pkt_out_seq = 0xFF;
+
+static struct remctl_bulk               bulk;
+static unsigned char                    bulk_active = 0;
+static unsigned char                    bulk_mem[remctl_bulk_slot_mem(REMCTL_SERIAL_BULK_WINDOW_MAX,REMCTL_SERIAL_BULK_PAYLOAD_MAX)];
+static unsigned char                    bulk_rx[REMCTL_SERIAL_BULK_HDR + REMCTL_SERIAL_BULK_PAYLOAD_MAX];
+
+static unsigned char                    batch_active = 0;
+static unsigned char                    batch_type = 0;
+static unsigned char                    batch_list[256];
+static unsigned int                     batch_count = 0;
+static unsigned int                     batch_entry = 0;
+static unsigned int                     batch_done = 0;
+
+static struct remctl_sync               patch;
+static unsigned char                    patch_ring[REMCTL_SYNC_LZ_WINDOW];
+
+static void help(void) {
+    fprintf(stderr,"remsrvh [options]\n");
+    fprintf(stderr,"Host (TCP) stand-in for REMSRV.EXE, file commands only.\n");
+    fprintf(stderr,"  -h --help         Show this help\n");
+    fprintf(stderr,"  -p <N>            Port to listen on (default 2323)\n");
+    fprintf(stderr,"  -noise <N>        Corrupt one in N bytes of bulk traffic\n");
+}
+
+static int parse_argv(int argc,char **argv) {
+    char *a;
+    int i=1;
+
+    while (i < argc) {
+        a = argv[i++];
+
+        if (*a == '-') {
+            do { a++; } while (*a == '-');
+
+            if (!strcmp(a,"h") || !strcmp(a,"help")) {
+                help();
+                return 1;
+            }
+            else if (!strcmp(a,"p")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                listen_port = atoi(a);
+            }
+            else if (!strcmp(a,"noise")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                noise = strtoul(a,NULL,0);
+            }
+            else {
+                fprintf(stderr,"Unknown switch %s\n",a);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr,"Unexpected argv\n");
+            return 1;
+        }
+    }
+
+    if (listen_port < 1 || listen_port > 65534) {
+        fprintf(stderr,"Invalid port\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static void add_noise(unsigned char *p,unsigned int len) {
+    if (noise == 0UL)
+        return;
+
+    while (len-- != 0) {
+        if (((unsigned long)rand() % noise) == 0UL)
+            *p ^= (unsigned char)(1U << ((unsigned int)rand() & 7U));
+        p++;
+    }
+}
+
+static void close_open_file(void) {
+    if (open_file_fd >= 0) {
+        close(open_file_fd);
+        open_file_fd = -1;
+    }
+}
+
+static void begin_output_packet(const unsigned char type) {
+    cur_pkt_out.hdr.mark = REMCTL_SERIAL_MARK;
+    cur_pkt_out.hdr.length = 0;
+    cur_pkt_out.hdr.sequence = cur_pkt_out_seq;
+    cur_pkt_out.hdr.type = type;
+    cur_pkt_out.hdr.chksum = 0;
+
+    if (cur_pkt_out_seq == 0xFF)
+        cur_pkt_out_seq = 0;
+    else
+        cur_pkt_out_seq = (cur_pkt_out_seq + 1) & 0x7F;
+}
+
+static void end_output_packet(void) {
+    unsigned char sum = 0;
+    unsigned int i;
+
+    for (i=0;i < cur_pkt_out.hdr.length;i++)
+        sum += cur_pkt_out.data[i];
+
+    cur_pkt_out.hdr.chksum = 0x100 - sum;
+}
+
+/* DOS path to something usable here: drop the drive letter, flip the slashes */
+static const char *host_path(void) {
+    char *p = (char*)cur_pkt_in.data + 1;
+    char *s;
+
+    cur_pkt_in.data[cur_pkt_in.hdr.length] = 0; // ASCIIZ snip
+
+    if (p[0] != 0 && p[1] == ':') p += 2;
+    for (s=p;*s != 0;s++) {
+        if (*s == '\\') *s = '/';
+    }
+
+    return p;
+}
+
+static void file_error(void) {
+    cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_FILE_MSDOS_ERROR;
+    cur_pkt_out.hdr.length = 1;
+}
+
+static int bulk_file_read(unsigned char *buf,unsigned int len) {
+    return read(open_file_fd,buf,len);
+}
+
+static int bulk_file_write(const unsigned char *buf,unsigned int len) {
+    return write(open_file_fd,buf,len);
+}
+
+static int bulk_file_seek(unsigned long offset) {
+    return (lseek(open_file_fd,(off_t)offset,SEEK_SET) < (off_t)0) ? -1 : 0;
+}
+
+static int bulk_patch_write(const unsigned char *buf,unsigned int len) {
+    if (remctl_sync_feed(&patch,buf,len) < 0)
+        return -1;
+
+    return (int)len;
+}
+
+static void do_file_hash_command(void) {
+    unsigned long block =
+        ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 24UL);
+    unsigned int size = cur_pkt_in.data[5] + (cur_pkt_in.data[6] << 8U);
+    unsigned char count = cur_pkt_in.data[7];
+    unsigned char *h = cur_pkt_out.data + 8;
+    unsigned char tmp[REMCTL_SERIAL_SYNC_BLOCK_MAX];
+    unsigned char got = 0;
+    unsigned long crc;
+    int rd;
+
+    if (open_file_fd < 0 || cur_pkt_in.hdr.length < 8 || size < REMCTL_SERIAL_SYNC_BLOCK_MIN || size > REMCTL_SERIAL_SYNC_BLOCK_MAX) {
+        file_error();
+        return;
+    }
+
+    if (count > REMCTL_SERIAL_SYNC_HASH_MAX)
+        count = REMCTL_SERIAL_SYNC_HASH_MAX;
+    if (((unsigned long)count * size) > REMCTL_SERIAL_SYNC_HASH_BYTES)
+        count = (unsigned char)(REMCTL_SERIAL_SYNC_HASH_BYTES / size);
+
+    if (bulk_file_seek(block * (unsigned long)size) < 0) {
+        file_error();
+        return;
+    }
+
+    while (got < count) {
+        rd = read(open_file_fd,tmp,size);
+        if (rd < 0) {
+            file_error();
+            return;
+        }
+        if (rd == 0)
+            break;
+
+        crc = remctl_crc32(0xFFFFFFFFUL,tmp,(unsigned int)rd) ^ 0xFFFFFFFFUL;
+        *h++ = (unsigned char)(crc >> 0UL);
+        *h++ = (unsigned char)(crc >> 8UL);
+        *h++ = (unsigned char)(crc >> 16UL);
+        *h++ = (unsigned char)(crc >> 24UL);
+        got++;
+
+        if ((unsigned int)rd < size)
+            break;
+    }
+
+    cur_pkt_out.data[7] = got;
+    cur_pkt_out.hdr.length = 8 + (got * 4U);
+}
+
+static void do_file_bulk_command(void) {
+    unsigned long count =
+        ((unsigned long)cur_pkt_in.data[1] << 0UL) +
+        ((unsigned long)cur_pkt_in.data[2] << 8UL) +
+        ((unsigned long)cur_pkt_in.data[3] << 16UL) +
+        ((unsigned long)cur_pkt_in.data[4] << 24UL);
+    unsigned char window = cur_pkt_in.data[5];
+    unsigned int payload = cur_pkt_in.data[6] + (cur_pkt_in.data[7] << 8U);
+
+    if (open_file_fd < 0 || cur_pkt_in.hdr.length < 8) {
+        file_error();
+        return;
+    }
+
+    remctl_bulk_negotiate(&window,&payload,sizeof(bulk_mem));
+    remctl_bulk_init(&bulk,
+        cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_FILE_BULK_READ ? REMCTL_BULK_SEND : REMCTL_BULK_RECV,
+        window,payload,bulk_mem,bulk_rx);
+    bulk.read = bulk_file_read;
+    bulk.write = bulk_file_write;
+    bulk.remain = count;
+    bulk_active = 1;
+
+    if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_FILE_BULK_PATCH) {
+        remctl_sync_init(&patch,patch_ring);
+        patch.seek = bulk_file_seek;
+        patch.write = bulk_file_write;
+        bulk.write = bulk_patch_write;
+    }
+
+    cur_pkt_out.data[5] = window;
+    cur_pkt_out.data[6] = (unsigned char)(payload & 0xFFU);
+    cur_pkt_out.data[7] = (unsigned char)(payload >> 8U);
+    cur_pkt_out.hdr.length = 8;
+}
+
+static void do_file_command(void) {
+    unsigned long poff;
+    off_t r;
+    int fd,len;
+
+    begin_output_packet(REMCTL_SERIAL_TYPE_FILE);
+    memcpy(cur_pkt_out.data,cur_pkt_in.data,8/*big enough*/);
+    cur_pkt_out.hdr.length = 1;
+
+    switch (cur_pkt_in.data[0]) {
+        case REMCTL_SERIAL_TYPE_FILE_OPEN:
+        case REMCTL_SERIAL_TYPE_FILE_CREATE:
+            close_open_file();
+            fd = open(host_path(),cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_FILE_CREATE ? (O_RDWR|O_CREAT|O_TRUNC) : O_RDWR,0644);
+            if (fd < 0) file_error();
+            else open_file_fd = fd;
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_CLOSE:
+            if (open_file_fd >= 0) close_open_file();
+            else file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_SEEK:
+            poff =
+                ((unsigned long)cur_pkt_in.data[2] << 0UL) +
+                ((unsigned long)cur_pkt_in.data[3] << 8UL) +
+                ((unsigned long)cur_pkt_in.data[4] << 16UL) +
+                ((unsigned long)cur_pkt_in.data[5] << 24UL);
+
+            /* the offset is signed 32-bit, same as INT 21h AH=42h */
+            r = lseek(open_file_fd,(off_t)((long)((int32_t)poff)),
+                cur_pkt_in.data[1] == 2 ? SEEK_END : (cur_pkt_in.data[1] == 1 ? SEEK_CUR : SEEK_SET));
+            if (r < (off_t)0) {
+                file_error();
+            }
+            else {
+                poff = (unsigned long)r;
+                cur_pkt_out.data[2] = (unsigned char)(poff >> 0UL);
+                cur_pkt_out.data[3] = (unsigned char)(poff >> 8UL);
+                cur_pkt_out.data[4] = (unsigned char)(poff >> 16UL);
+                cur_pkt_out.data[5] = (unsigned char)(poff >> 24UL);
+                cur_pkt_out.hdr.length = 6;
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_READ:
+            len = cur_pkt_in.data[1];
+            if (len > 252) len = 252;
+            len = read(open_file_fd,cur_pkt_out.data + 2,len);
+            if (len < 0) {
+                file_error();
+            }
+            else {
+                cur_pkt_out.data[1] = len;
+                cur_pkt_out.hdr.length = 2 + len;
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_WRITE:
+            len = cur_pkt_in.data[1];
+            if (len > (int)cur_pkt_in.hdr.length - 2) len = (int)cur_pkt_in.hdr.length - 2;
+            len = (len > 0) ? write(open_file_fd,cur_pkt_in.data + 2,len) : 0;
+            if (len < 0) {
+                file_error();
+            }
+            else {
+                cur_pkt_out.data[1] = len;
+                cur_pkt_out.hdr.length = 2;
+            }
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_TRUNCATE:
+            r = lseek(open_file_fd,0,SEEK_CUR);
+            if (r < (off_t)0 || ftruncate(open_file_fd,r) < 0)
+                file_error();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_HASH:
+            do_file_hash_command();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE_BULK_READ:
+        case REMCTL_SERIAL_TYPE_FILE_BULK_WRITE:
+        case REMCTL_SERIAL_TYPE_FILE_BULK_PATCH:
+            do_file_bulk_command();
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            break;
+    }
+
+    end_output_packet();
+}
+
+/* something recognizable that the client can check a dump against */
+static unsigned char fake_memory(const unsigned long addr) {
+    return (unsigned char)(addr ^ (addr >> 8UL) ^ (addr >> 16UL) ^ (addr >> 24UL));
+}
+
+static void batch_next_packet(void) {
+    unsigned int n = 1,i;
+
+    begin_output_packet(REMCTL_SERIAL_TYPE_BATCH);
+    cur_pkt_out.data[0] = batch_type;
+
+    while (n < (1 + REMCTL_SERIAL_BATCH_CHUNK) && batch_entry < batch_count) {
+        if (batch_type == REMCTL_SERIAL_TYPE_BATCH_MEMREAD) {
+            const unsigned char *e = batch_list + (batch_entry * 6U);
+            const unsigned long addr = (unsigned long)e[0] + ((unsigned long)e[1] << 8UL) +
+                ((unsigned long)e[2] << 16UL) + ((unsigned long)e[3] << 24UL);
+            const unsigned int len = (unsigned int)e[4] + ((unsigned int)e[5] << 8U);
+
+            cur_pkt_out.data[n++] = fake_memory(addr + batch_done);
+            if ((++batch_done) >= len) {
+                batch_entry++;
+                batch_done = 0;
+            }
+        }
+        else {
+            const unsigned char *e = batch_list + (batch_entry * 4U);
+
+            if ((n + e[2]) > (1 + REMCTL_SERIAL_BATCH_CHUNK))
+                break;
+
+            /* every port reads back as its own low byte */
+            for (i=0;i < e[2];i++)
+                cur_pkt_out.data[n++] = e[0];
+
+            if ((++batch_done) >= e[3]) {
+                batch_entry++;
+                batch_done = 0;
+            }
+        }
+    }
+
+    if (n == 1) {
+        cur_pkt_out.data[0] = REMCTL_SERIAL_TYPE_BATCH_FINISHED;
+        batch_active = 0;
+    }
+
+    cur_pkt_out.hdr.length = n;
+    end_output_packet();
+}
+
+static void do_batch_command(void) {
+    const unsigned int len = cur_pkt_in.hdr.length - 1U;
+    unsigned int i,esz = 0;
+
+    if (cur_pkt_in.hdr.length != 0) {
+        if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_BATCH_MEMREAD)
+            esz = 6;
+        else if (cur_pkt_in.data[0] == REMCTL_SERIAL_TYPE_BATCH_INPORT)
+            esz = 4;
+    }
+
+    if (esz == 0 || len == 0 || (len % esz) != 0) {
+        begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+        cur_pkt_out_seq = 0xFF;
+        end_output_packet();
+        return;
+    }
+
+    memcpy(batch_list,cur_pkt_in.data + 1,len);
+    batch_count = len / esz;
+
+    for (i=0;i < batch_count;i++) {
+        const unsigned char *e = batch_list + (i * esz);
+
+        if (esz == 6 ? (e[4] == 0 && e[5] == 0) : ((e[2] != 1 && e[2] != 2 && e[2] != 4) || e[3] == 0)) {
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            end_output_packet();
+            return;
+        }
+    }
+
+    batch_type = cur_pkt_in.data[0];
+    batch_entry = 0;
+    batch_done = 0;
+    batch_active = 1;
+    batch_next_packet();
+}
+
+static void handle_packet(void) {
+    switch (cur_pkt_in.hdr.type) {
+        case REMCTL_SERIAL_TYPE_PING:
+            begin_output_packet(REMCTL_SERIAL_TYPE_PING);
+            memcpy(cur_pkt_out.data,"PING",4);
+            cur_pkt_out.hdr.length = 4;
+            end_output_packet();
+            break;
+        case REMCTL_SERIAL_TYPE_FILE:
+            do_file_command();
+            break;
+        case REMCTL_SERIAL_TYPE_BATCH:
+            do_batch_command();
+            break;
+        default:
+            begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+            cur_pkt_out_seq = 0xFF;
+            end_output_packet();
+            break;
+    }
+}
+
+static int inpkt_validate(void) {
+    unsigned char sum = cur_pkt_in.hdr.chksum;
+    unsigned int i;
+
+    for (i=0;i < cur_pkt_in.hdr.length;i++)
+        sum += cur_pkt_in.data[i];
+    if (sum != 0)
+        return 0;
+
+    if (cur_pkt_in.hdr.sequence == 0xFF)
+        cur_pkt_in_seq = cur_pkt_in.hdr.sequence;
+    else if (cur_pkt_in.hdr.sequence != cur_pkt_in_seq)
+        return 0;
+
+    cur_pkt_in_seq = (cur_pkt_in.hdr.sequence + 1) & 0x7F;
+    return 1;
+}
+
+static int send_all(const unsigned char *p,unsigned int len) {
+    int wd;
+
+    while (len != 0) {
+        wd = write(conn_fd,p,len);
+        if (wd <= 0) return -1;
+        p += wd;
+        len -= (unsigned int)wd;
+    }
+
+    return 0;
+}
+
+static int process_input(const unsigned char *p,unsigned int len) {
+    unsigned char c;
+
+    while (len-- != 0) {
+        c = *p++;
+
+        if (bulk_active) {
+            add_noise(&c,1);
+            remctl_bulk_rx(&bulk,&c,1);
+            if (remctl_bulk_escaped(&bulk)) bulk_active = 0;
+            continue;
+        }
+
+        ((unsigned char*)(&cur_pkt_in))[cur_pkt_in_write] = c;
+
+        if (cur_pkt_in_write == 0 && cur_pkt_in.hdr.mark != REMCTL_SERIAL_MARK)
+            continue;
+
+        if ((++cur_pkt_in_write) >= (sizeof(cur_pkt_in.hdr)+cur_pkt_in.hdr.length)) {
+            batch_active = 0;
+
+            if (inpkt_validate()) {
+                handle_packet();
+            }
+            else {
+                begin_output_packet(REMCTL_SERIAL_TYPE_ERROR);
+                cur_pkt_out_seq = 0xFF;
+                end_output_packet();
+            }
+
+            cur_pkt_in.hdr.mark = 0;
+            cur_pkt_in_write = 0;
+
+            if (send_all((const unsigned char*)(&cur_pkt_out),sizeof(cur_pkt_out.hdr)+cur_pkt_out.hdr.length) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int process_bulk_output(void) {
+    unsigned char tmp[4096];
+    unsigned int len;
+
+    remctl_bulk_pump(&bulk);
+
+    while ((len=remctl_bulk_tx(&bulk,tmp,sizeof(tmp))) != 0) {
+        add_noise(tmp,len);
+        if (send_all(tmp,len) < 0)
+            return -1;
+    }
+
+    if (remctl_bulk_closed(&bulk))
+        bulk_active = 0;
+
+    return 0;
+}
+
+static int process_batch_output(void) {
+    batch_next_packet();
+    return send_all((const unsigned char*)(&cur_pkt_out),sizeof(cur_pkt_out.hdr)+cur_pkt_out.hdr.length);
+}
+
+static void serve(void) {
+    unsigned char tmp[4096];
+    fd_set rfd;
+    struct timeval tv;
+    int rd;
+
+    cur_pkt_in_write = 0;
+    cur_pkt_in_seq = 0xFF;
+    cur_pkt_out_seq = 0xFF;
+    bulk_active = 0;
+    batch_active = 0;
+
+    while (1) {
+        if (bulk_active && process_bulk_output() < 0)
+            break;
+        if (batch_active && process_batch_output() < 0)
+            break;
+
+        FD_ZERO(&rfd);
+        FD_SET(conn_fd,&rfd);
+        tv.tv_sec = 0;
+        tv.tv_usec = batch_active ? 0 : 10000;
+        if (select(conn_fd+1,&rfd,NULL,NULL,&tv) < 0)
+            break;
+        if (!FD_ISSET(conn_fd,&rfd))
+            continue;
+
+        rd = read(conn_fd,tmp,sizeof(tmp));
+        if (rd <= 0)
+            break;
+        if (process_input(tmp,(unsigned int)rd) < 0)
+            break;
+    }
+
+    close_open_file();
+}
+
+int main(int argc,char **argv) {
+    struct sockaddr_in sin;
+    int listen_fd,one = 1;
+
+    if (parse_argv(argc,argv))
+        return 1;
+
+    /* a client that goes away mid-transfer is a failed write, not the end of the server */
+    signal(SIGPIPE,SIG_IGN);
+
+    listen_fd = socket(AF_INET,SOCK_STREAM,0);
+    if (listen_fd < 0) {
+        fprintf(stderr,"Socket() failed, %s\n",strerror(errno));
+        return 1;
+    }
+    setsockopt(listen_fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+    memset(&sin,0,sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(listen_port);
+    sin.sin_addr.s_addr = htonl(0x7F000001UL); /* 127.0.0.1 */
+    if (bind(listen_fd,(const struct sockaddr*)(&sin),sizeof(sin)) < 0 || listen(listen_fd,1) < 0) {
+        fprintf(stderr,"Bind/listen failed, %s\n",strerror(errno));
+        return 1;
+    }
+
+    printf("Listening on port %d\n",listen_port);
+
+    while ((conn_fd=accept(listen_fd,NULL,NULL)) >= 0) {
+        serve();
+        close(conn_fd);
+        conn_fd = -1;
+    }
+
+    close(listen_fd);
+    return 0;
+}
+
@@ -0,0 +1,270 @@
+
+#include <string.h>
+
+#include "proto.h"
+#include "sync.h"
+
+static unsigned long crc32_table[256];
+static unsigned char crc32_table_init = 0;
+
+/* CRC-32 (polynomial 0xEDB88320, reflected). caller starts with 0xFFFFFFFF and inverts the result */
+unsigned long remctl_crc32(unsigned long crc,const unsigned char *p,unsigned int len) {
+    if (!crc32_table_init) {
+        unsigned long c;
+        unsigned int i,j;
+
+        for (i=0;i < 256;i++) {
+            c = (unsigned long)i;
+            for (j=0;j < 8;j++)
+                c = (c & 1UL) ? ((c >> 1UL) ^ 0xEDB88320UL) : (c >> 1UL);
+
+            crc32_table[i] = c;
+        }
+
+        crc32_table_init = 1;
+    }
+
+    while (len-- != 0)
+        crc = (crc >> 8UL) ^ crc32_table[(unsigned char)crc ^ (*p++)];
+
+    return crc & 0xFFFFFFFFUL;
+}
+
+void remctl_sync_init(struct remctl_sync * const s,unsigned char *ring) {
+    memset(s,0,sizeof(*s));
+    s->ring = ring;
+}
+
+static int sync_flush(struct remctl_sync * const s) {
+    const unsigned int len = s->ring_pos - s->ring_done;
+
+    if (len != 0U && s->write(s->ring + s->ring_done,len) != (int)len)
+        return -1;
+
+    s->ring_done = s->ring_pos;
+    return 0;
+}
+
+static int sync_put(struct remctl_sync * const s,const unsigned char c) {
+    if (s->out_left == 0U)
+        return -1;
+
+    s->ring[s->ring_pos++] = c;
+    s->decoded++;
+    s->out_left--;
+
+    if (s->ring_pos == REMCTL_SYNC_LZ_WINDOW) {
+        if (sync_flush(s) < 0)
+            return -1;
+
+        s->ring_pos = s->ring_done = 0;
+    }
+
+    return 0;
+}
+
+/* header of the next record is in, get ready for its data */
+static int sync_record(struct remctl_sync * const s) {
+    const struct remctl_serial_sync_record *r = (const struct remctl_serial_sync_record*)s->rec;
+    const unsigned long offset =
+        ((unsigned long)r->offset[0] << 0UL) +
+        ((unsigned long)r->offset[1] << 8UL) +
+        ((unsigned long)r->offset[2] << 16UL) +
+        ((unsigned long)r->offset[3] << 24UL);
+    const unsigned int length = (unsigned int)r->length[0] + ((unsigned int)r->length[1] << 8U);
+    const unsigned int stored = (unsigned int)r->stored[0] + ((unsigned int)r->stored[1] << 8U);
+
+    if (length == 0U || length > REMCTL_SERIAL_SYNC_BLOCK_MAX || stored == 0U || stored > length)
+        return -1;
+    if (s->seek(offset) < 0)
+        return -1;
+
+    s->in_left = stored;
+    s->out_left = length;
+    s->lz = (stored < length) ? 1 : 0;
+    s->ctrl_bits = 0;
+    s->tok_pos = 0;
+    s->ring_pos = s->ring_done = 0;
+    s->decoded = 0;
+    return 0;
+}
+
+static int sync_lz_byte(struct remctl_sync * const s,const unsigned char c) {
+    unsigned int v,dist,len,src;
+
+    if (s->ctrl_bits == 0) {
+        s->ctrl = c;
+        s->ctrl_bits = 8;
+        return 0;
+    }
+
+    if (s->ctrl & 1U) {
+        if (sync_put(s,c) < 0)
+            return -1;
+    }
+    else if (s->tok_pos == 0) {
+        s->tok = c;
+        s->tok_pos = 1;
+        return 0;
+    }
+    else {
+        v = (unsigned int)s->tok + ((unsigned int)c << 8U);
+        dist = (v & 0x3FFU) + 1U;
+        len = (v >> 10U) + REMCTL_SYNC_LZ_MIN;
+        s->tok_pos = 0;
+
+        if (dist > s->decoded || len > s->out_left)
+            return -1;
+
+        /* byte at a time, a match may overlap what it's producing */
+        src = (s->ring_pos - dist) & (REMCTL_SYNC_LZ_WINDOW - 1U);
+        while (len-- != 0U) {
+            if (sync_put(s,s->ring[src]) < 0)
+                return -1;
+
+            src = (src + 1U) & (REMCTL_SYNC_LZ_WINDOW - 1U);
+        }
+    }
+
+    s->ctrl >>= 1U;
+    s->ctrl_bits--;
+    return 0;
+}
+
+/* returns 0, or -1 if the stream is bad or the file couldn't be written (and stays that way) */
+int remctl_sync_feed(struct remctl_sync * const s,const unsigned char *p,unsigned int len) {
+    unsigned int n;
+
+    if (s->error)
+        return -1;
+
+    while (len != 0U) {
+        if (s->rec_pos < sizeof(s->rec)) {
+            s->rec[s->rec_pos++] = *p++;
+            len--;
+
+            if (s->rec_pos == sizeof(s->rec) && sync_record(s) < 0)
+                goto fail;
+
+            continue;
+        }
+
+        if (!s->lz) {
+            n = (len < s->in_left) ? len : s->in_left;
+            if (s->write(p,n) != (int)n)
+                goto fail;
+
+            s->in_left -= n;
+            s->out_left -= n;
+            p += n;
+            len -= n;
+        }
+        else {
+            s->in_left--;
+            len--;
+            if (sync_lz_byte(s,*p++) < 0)
+                goto fail;
+        }
+
+        if (s->in_left == 0U) {
+            if (s->out_left != 0U || sync_flush(s) < 0)
+                goto fail;
+
+            s->records++;
+            s->rec_pos = 0;
+        }
+    }
+
+    return 0;
+fail:
+    s->error = 1;
+    return -1;
+}
+
+#if !defined(TARGET_MSDOS)
+#define LZ_HASH_BITS                    12
+#define LZ_CHAIN_MAX                    64
+
+static int lz_head[1 << LZ_HASH_BITS];
+static int lz_prev[REMCTL_SERIAL_SYNC_BLOCK_MAX];
+
+static unsigned int lz_hash(const unsigned char *p) {
+    return ((((unsigned int)p[0] << 8U) ^ ((unsigned int)p[1] << 4U) ^ (unsigned int)p[2]) * 2654435761U) >> (32U - LZ_HASH_BITS);
+}
+
+static void lz_insert(const unsigned char *src,const unsigned int pos,const unsigned int len) {
+    unsigned int h;
+
+    if ((pos + REMCTL_SYNC_LZ_MIN) > len)
+        return;
+
+    h = lz_hash(src + pos) & ((1U << LZ_HASH_BITS) - 1U);
+    lz_prev[pos] = lz_head[h];
+    lz_head[h] = (int)pos;
+}
+
+unsigned int remctl_sync_lz_compress(unsigned char *dst,const unsigned char *src,unsigned int len) {
+    unsigned int i = 0,o = 0,cp = 0,bits = 8;
+    unsigned int best,bestd,l,max,depth,v;
+    int cand;
+
+    if (len > REMCTL_SERIAL_SYNC_BLOCK_MAX)
+        return 0;
+
+    for (i=0;i < (1U << LZ_HASH_BITS);i++)
+        lz_head[i] = -1;
+
+    i = 0;
+    while (i < len) {
+        if (bits == 8) {
+            if (o >= len) return 0;
+            cp = o++;
+            dst[cp] = 0;
+            bits = 0;
+        }
+
+        best = 0;
+        bestd = 0;
+        if ((i + REMCTL_SYNC_LZ_MIN) <= len) {
+            max = len - i;
+            if (max > REMCTL_SYNC_LZ_MAX) max = REMCTL_SYNC_LZ_MAX;
+
+            cand = lz_head[lz_hash(src + i) & ((1U << LZ_HASH_BITS) - 1U)];
+            for (depth=0;cand >= 0 && depth < LZ_CHAIN_MAX;depth++) {
+                if ((i - (unsigned int)cand) > REMCTL_SYNC_LZ_WINDOW)
+                    break;
+
+                for (l=0;l < max && src[(unsigned int)cand + l] == src[i + l];l++);
+                if (l > best) {
+                    best = l;
+                    bestd = i - (unsigned int)cand;
+                    if (l == max) break;
+                }
+
+                cand = lz_prev[cand];
+            }
+        }
+
+        if (best >= REMCTL_SYNC_LZ_MIN) {
+            if ((o + 2U) >= len) return 0;
+            v = (bestd - 1U) + ((best - REMCTL_SYNC_LZ_MIN) << 10U);
+            dst[o++] = (unsigned char)(v & 0xFFU);
+            dst[o++] = (unsigned char)(v >> 8U);
+
+            while (best-- != 0U)
+                lz_insert(src,i++,len);
+        }
+        else {
+            if (o >= (len - 1U)) return 0;
+            dst[o++] = src[i];
+            dst[cp] |= (unsigned char)(1U << bits);
+            lz_insert(src,i++,len);
+        }
+
+        bits++;
+    }
+
+    return (o < len) ? o : 0;
+}
+#endif
+
@@ -0,0 +1,58 @@
+
+/* delta sync: block hashes, and the patch stream that carries only the blocks that changed.
+ *
+ * The client asks the server for a CRC-32 of each block of the remote file (FILE_HASH),
+ * compares them against the local file, and sends what differs as a patch stream over
+ * bulk mode (FILE_BULK_PATCH). Each record in the stream is a remctl_serial_sync_record
+ * followed by the block, either as is or LZ compressed.
+ *
+ * The LZ format is plain LZSS: a control byte, then 8 items, bit 0 first. A 1 bit is a
+ * literal byte, a 0 bit is a match: 16 bits little endian, low 10 bits distance-1, high
+ * 6 bits length-3. Matches never reach back past the start of the record, so each record
+ * decodes on its own and the decoder only has to keep the last REMCTL_SYNC_LZ_WINDOW bytes.
+ *
+ * Include proto.h first. */
+
+#define REMCTL_SYNC_LZ_WINDOW           1024
+#define REMCTL_SYNC_LZ_MIN              3
+#define REMCTL_SYNC_LZ_MAX              (REMCTL_SYNC_LZ_MIN + 63)
+
+/* receiving end of a patch stream, fed in whatever pieces bulk mode hands over */
+struct remctl_sync {
+    unsigned char               rec[sizeof(struct remctl_serial_sync_record)];
+    unsigned char               rec_pos;
+    unsigned int                in_left;        /* bytes of this record's data still to come */
+    unsigned int                out_left;       /* bytes of this record still to decode */
+    unsigned char               lz;             /* record is compressed */
+
+    unsigned char               ctrl;           /* LZ control byte, and how many of its bits are left */
+    unsigned char               ctrl_bits;
+    unsigned char               tok;            /* first byte of a match */
+    unsigned char               tok_pos;
+
+    unsigned char*              ring;           /* REMCTL_SYNC_LZ_WINDOW bytes, caller provides it */
+    unsigned int                ring_pos;       /* bytes decoded into the ring */
+    unsigned int                ring_done;      /* of those, already written */
+    unsigned int                decoded;        /* bytes decoded in this record */
+
+    unsigned long               records;
+    unsigned char               error;
+
+    int                         (*seek)(unsigned long offset);
+    int                         (*write)(const unsigned char *buf,unsigned int len);
+};
+
+unsigned long remctl_crc32(unsigned long crc,const unsigned char *p,unsigned int len);
+
+void remctl_sync_init(struct remctl_sync * const s,unsigned char *ring);
+int remctl_sync_feed(struct remctl_sync * const s,const unsigned char *p,unsigned int len);
+
+/* stream ended on a record boundary */
+#define remctl_sync_complete(s) (!(s)->error && (s)->rec_pos == 0 && (s)->in_left == 0)
+
+#if !defined(TARGET_MSDOS)
+/* compress a block, returns the compressed length, or 0 if it doesn't get any smaller.
+ * dst must hold at least len bytes */
+unsigned int remctl_sync_lz_compress(unsigned char *dst,const unsigned char *src,unsigned int len);
+#endif
+
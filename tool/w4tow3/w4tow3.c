@@ -11,6 +11,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -19,6 +20,10 @@
 char*               src_file = NULL;
 char*               dst_file = NULL;
 
+int                 use_ref = 0;    // use the original bit-at-a-time decoder
+int                 verify = 0;     // decode with both, compare
+unsigned int        jobs = 1;       // -j, decode chunks on this many threads
+
 int                 src_fd = -1;
 int                 dst_fd = -1;
 
@@ -40,6 +45,18 @@ int parse_argv(int argc,char **argv) {
                 dst_file = argv[i++];
                 if (dst_file == NULL) return 1;
             }
+            else if (!strcmp(a,"ref")) {
+                use_ref = 1;
+            }
+            else if (!strcmp(a,"verify")) {
+                verify = 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                jobs = (unsigned int)strtoul(a,NULL,0);
+                if (jobs == 0u) jobs = 1u;
+            }
             else {
                 fprintf(stderr,"Unknown switch '%s'\n",a);
                 return 1;
@@ -66,10 +83,10 @@ int parse_argv(int argc,char **argv) {
 uint32_t*           chunkTable = NULL;
 uint32_t            chunkTableEntries = 0;
 
-uint8_t             file_temp[8192]; // also decompression output
-uint8_t             src_temp[8192]; // decompression input
+uint8_t*            src_image = NULL; // the whole source file
+uint8_t*            dst_image = NULL; // W3 output: the header, then chunk_size bytes per chunk
 
-void LoadMiniBuffer(uint32_t *pMiniBuffer,unsigned char **psrc,unsigned char *srcfence,uint16_t *pBitsUsed,uint16_t *pBitCount) {
+void LoadMiniBuffer(uint32_t *pMiniBuffer,const unsigned char **psrc,const unsigned char *srcfence,uint16_t *pBitsUsed,uint16_t *pBitCount) {
     while ((*pBitsUsed) != 0) {
         (*pBitsUsed)--;
         *pMiniBuffer >>= 1;
@@ -86,8 +103,8 @@ void LoadMiniBuffer(uint32_t *pMiniBuffer,unsigned char **psrc,unsigned char *sr
     }
 }
 
-uint32_t W4Decompress(unsigned char *dst,size_t dstmax,unsigned char *src,size_t srclen) {
-    unsigned char *srcfence = src + srclen;
+uint32_t W4Decompress(unsigned char *dst,size_t dstmax,const unsigned char *src,size_t srclen) {
+    const unsigned char *srcfence = src + srclen;
     unsigned char *dstfence = dst + dstmax;
     unsigned char *dstbase = dst;
     uint32_t minibuffer = 0;
@@ -210,6 +227,286 @@ uint32_t W4Decompress(unsigned char *dst,size_t dstmax,unsigned char *src,size_t
     return (uint32_t)(dst - dstbase);
 }
 
+/* Same decoder, but reading the bitstream through a 64-bit buffer refilled up to 8 bytes
+ * at a time, and decoding each symbol with a table lookup instead of testing it a bit
+ * pattern at a time. One refill per symbol is always enough: the longest depth (15 bits)
+ * plus the longest count (17 bits) is 32 bits. Past the end of the source the stream
+ * reads as zeros, the same as the original. */
+enum {
+    W4SYM_LITERAL=0,
+    W4SYM_DEPTH6,                   /* 00 + 6 bits, 0-63 */
+    W4SYM_DEPTH8,                   /* 011 + 8 bits, 64-319 */
+    W4SYM_DEPTH12,                  /* 111 + 12 bits, 320-4414 */
+    W4SYM_INVALID
+};
+
+struct w4sym {
+    uint8_t             kind;
+    uint8_t             bits;
+    uint8_t             value;      /* literal byte */
+};
+
+static struct w4sym     w4sym_table[512];       /* indexed by the next 9 bits */
+static uint8_t          w4count_table[512];     /* zeros before the first 1 of a count, 0xFF if more than 8 */
+static int              w4tables_init = 0;      /* main() sets them up before any threads start */
+
+static void W4InitTables(void) {
+    unsigned int i;
+
+    for (i=0;i < 512;i++) {
+        struct w4sym *t = &w4sym_table[i];
+
+        if ((i & 3U) == 1U || (i & 3U) == 2U) {
+            t->kind = W4SYM_LITERAL;
+            t->bits = 9;
+            t->value = (uint8_t)(((i & 0x1FCU) >> 2U) + ((i & 1U) << 7U));
+        }
+        else if ((i & 3U) == 0U) {
+            t->kind = W4SYM_DEPTH6;
+            t->bits = 8;
+        }
+        else if ((i & 7U) == 3U) {
+            t->kind = W4SYM_DEPTH8;
+            t->bits = 11;
+        }
+        else {
+            t->kind = W4SYM_DEPTH12;
+            t->bits = 15;
+        }
+
+        if (i == 0)
+            w4count_table[i] = 0xFF;
+        else
+            w4count_table[i] = (uint8_t)__builtin_ctz(i);
+    }
+
+    w4tables_init = 1;
+}
+
+uint32_t W4DecompressFast(unsigned char *dst,size_t dstmax,const unsigned char *src,size_t srclen) {
+    const unsigned char *srcfence = src + srclen;
+    unsigned char *dstfence = dst + dstmax;
+    unsigned char *dstbase = dst;
+    const unsigned char *srcp = src;
+    uint64_t buf = 0;
+    unsigned int bits = 0;          /* valid bits in buf, 64 once the source runs out */
+    size_t used = 0;                /* bits consumed so far */
+    unsigned int nDepth,nCount,tz;
+    const struct w4sym *sym;
+    size_t loaded;
+
+    if (!w4tables_init)
+        W4InitTables();
+
+    while (1) {
+        /* refill */
+        if (bits <= 56U) {
+            if ((size_t)(srcfence - srcp) >= 8U) {
+                const uint64_t v =
+                    ((uint64_t)srcp[0]      ) | ((uint64_t)srcp[1] <<  8) |
+                    ((uint64_t)srcp[2] << 16) | ((uint64_t)srcp[3] << 24) |
+                    ((uint64_t)srcp[4] << 32) | ((uint64_t)srcp[5] << 40) |
+                    ((uint64_t)srcp[6] << 48) | ((uint64_t)srcp[7] << 56);
+
+                buf |= v << bits;
+                srcp += (63U - bits) >> 3U;
+                bits |= 56U;
+            }
+            else {
+                while (bits <= 56U && srcp < srcfence) {
+                    buf |= (uint64_t)(*srcp++) << bits;
+                    bits += 8U;
+                }
+                if (srcp >= srcfence)
+                    bits = 64U;
+            }
+        }
+
+        sym = &w4sym_table[buf & 0x1FFU];
+
+        if (sym->kind == W4SYM_LITERAL) {
+            if (dst >= dstfence) break;
+            *dst++ = sym->value;
+            buf >>= 9U; bits -= 9U; used += 9U;
+            continue;
+        }
+
+        if (sym->kind == W4SYM_DEPTH6)
+            nDepth = (unsigned int)(buf >> 2U) & 0x3FU;
+        else if (sym->kind == W4SYM_DEPTH8)
+            nDepth = ((unsigned int)(buf >> 3U) & 0xFFU) + 0x40U;
+        else
+            nDepth = ((unsigned int)(buf >> 3U) & 0xFFFU) + 0x140U;
+
+        if (nDepth == 0U)
+            break;
+
+        if (nDepth == 0x113FU) { /* CheckBuffer */
+            /* the original stops here once it's loaded the last source byte, which it does
+             * 32 bits ahead of what it's decoding */
+            if ((4U + (used >> 3U)) >= srclen)
+                break;
+
+            buf >>= 15U; bits -= 15U; used += 15U;
+            continue;
+        }
+
+        buf >>= sym->bits; bits -= sym->bits; used += sym->bits;
+
+        tz = w4count_table[buf & 0x1FFU];
+        if (tz == 0xFFU) {
+            /* show what the original's minibuffer holds here: the next 32 - (used % 8)
+             * bits, the rest of its top byte has not been loaded yet */
+            fprintf(stderr,"Unexpected compressed code=0x%08lx\n",(unsigned long)(buf & (0xFFFFFFFFUL >> (used & 7U))));
+            break;
+        }
+        nCount = ((unsigned int)(buf >> (tz + 1U)) & ((1U << tz) - 1U)) + (1U << tz) + 1U;
+
+        if ((size_t)(dst - dstbase) < (size_t)nDepth) {
+            fprintf(stderr,"Unexpected nDepth too large, reaches back too far\n");
+            break;
+        }
+        if ((size_t)(dstfence - dst) < (size_t)nCount) {
+            fprintf(stderr,"Unexpected nCount too large, reaches too far forward into dest\n");
+            break;
+        }
+
+        buf >>= (2U * tz) + 1U; bits -= (2U * tz) + 1U; used += (2U * tz) + 1U;
+
+        if (nDepth >= nCount) {
+            memcpy(dst,dst - nDepth,nCount);
+            dst += nCount;
+        }
+        else {
+            /* overlapping, repeats the last nDepth bytes */
+            const unsigned char *sp = dst - nDepth;
+
+            do {  *dst++ = *sp++;
+            } while (--nCount != 0);
+        }
+    }
+
+    /* how far the original would have read by now */
+    loaded = 4U + (used >> 3U);
+    if (loaded < srclen)
+        fprintf(stderr,"Warning: %u bytes left\n",(unsigned int)(srclen - loaded));
+
+    return (uint32_t)(dst - dstbase);
+}
+
+/* One chunk of the W4 file. Each decodes straight into its own chunk_size slot of dst_image,
+ * which is why the decoders keep no state of their own, and main() closes up the gaps
+ * left by short chunks before writing. Workers don't print anything about the chunk,
+ * main() does that in chunk order, but with -j the decoders' own warnings come out as
+ * they happen. */
+struct w4chunk {
+    const unsigned char*    src;
+    size_t                  srclen;     /* == chunk_size: stored, not compressed */
+    unsigned char*          dst;
+    size_t                  dstmax;
+    uint32_t                dstsz;
+    char                    error[80];  /* -verify mismatch */
+    unsigned char           decoded;
+};
+
+struct w4chunk*     chunks = NULL;
+
+void W4DecodeChunk(struct w4chunk *c,size_t chunk) {
+    c->error[0] = 0;
+
+    if (c->srclen == c->dstmax) {
+        /* TODO: When does this happen? */
+        memcpy(c->dst,c->src,c->dstmax);
+        c->dstsz = (uint32_t)c->dstmax;
+    }
+    else {
+        memset(c->dst,0xE5,c->dstmax);
+        if (use_ref)
+            c->dstsz = W4Decompress(c->dst,c->dstmax,c->src,c->srclen);
+        else
+            c->dstsz = W4DecompressFast(c->dst,c->dstmax,c->src,c->srclen);
+
+        if (verify && c->dstsz != 0) {
+            uint8_t ref_temp[8192]; // the other decoder's output
+            uint32_t refsz;
+            size_t i;
+
+            assert(c->dstmax <= sizeof(ref_temp));
+            memset(ref_temp,0xE5,c->dstmax);
+            refsz = use_ref ?
+                W4DecompressFast(ref_temp,c->dstmax,c->src,c->srclen) :
+                W4Decompress(ref_temp,c->dstmax,c->src,c->srclen);
+            if (refsz != c->dstsz) {
+                snprintf(c->error,sizeof(c->error),"chunk %lu decodes to %lu and %lu bytes",
+                    (unsigned long)chunk,(unsigned long)c->dstsz,(unsigned long)refsz);
+            }
+            else {
+                for (i=0;i < (size_t)refsz;i++) {
+                    if (c->dst[i] != ref_temp[i]) {
+                        snprintf(c->error,sizeof(c->error),"chunk %lu differs at byte %lu",
+                            (unsigned long)chunk,(unsigned long)i);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    c->decoded = 1;
+}
+
+struct w4chunk_pool {
+    pthread_mutex_t         lock;
+    size_t                  next,end;
+};
+
+void *W4DecodeWorker(void *arg) {
+    struct w4chunk_pool *pool = (struct w4chunk_pool*)arg;
+    size_t chunk;
+
+    do {
+        pthread_mutex_lock(&pool->lock);
+        chunk = (pool->next < pool->end) ? pool->next++ : pool->end;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (chunk < pool->end)
+            W4DecodeChunk(&chunks[chunk],chunk);
+    } while (chunk < pool->end);
+
+    return NULL;
+}
+
+/* decode all chunks on -j threads. with -j 1 main() decodes each one as it gets to it */
+void W4DecodeChunks(size_t count) {
+    struct w4chunk_pool pool;
+    pthread_t *threads;
+    unsigned int n,j;
+
+    n = jobs;
+    if ((size_t)n > count) n = (unsigned int)count;
+
+    pthread_mutex_init(&pool.lock,NULL);
+    pool.next = 0;
+    pool.end = count;
+
+    j = 0;
+    if ((threads=malloc(sizeof(pthread_t) * n)) != NULL) {
+        for (j=0;j < n;j++) {
+            if (pthread_create(&threads[j],NULL,W4DecodeWorker,&pool) != 0)
+                break;
+        }
+    }
+
+    /* whatever the threads that did start leave, this thread decodes too */
+    W4DecodeWorker(&pool);
+
+    while (j > 0u)
+        pthread_join(threads[--j],NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+}
+
 int main(int argc,char **argv) {
     unsigned char tmp[16];
     uint16_t chunk_size;
@@ -217,7 +514,7 @@ int main(int argc,char **argv) {
     uint32_t le_offset;
     uint32_t file_size;
     uint32_t start,end;
-    size_t i,chunk;
+    size_t i,chunk,out;
 
     if (parse_argv(argc,argv))
         return 1;
@@ -226,11 +523,6 @@ int main(int argc,char **argv) {
         fprintf(stderr,"Cannot open source file %s, %s\n",src_file,strerror(errno));
         return 1;
     }
-    if ((dst_fd=open(dst_file,O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644)) < 0) {
-        fprintf(stderr,"Cannot open dest file %s, %s\n",dst_file,strerror(errno));
-        return 1;
-    }
-
     if (lseek(src_fd,0x3C,SEEK_SET) != 0x3C || read(src_fd,&le_offset,4) != 4) {
         fprintf(stderr,"Cannot read\n");
         return 1;
@@ -289,23 +581,26 @@ int main(int argc,char **argv) {
     fprintf(stderr,"}\n");
     fprintf(stderr,"File size (and end of last chunk): %lu\n",(unsigned long)file_size);
 
-    // okay, copy source to dest up to W4 header
-    lseek(src_fd,0,SEEK_SET);
-    lseek(dst_fd,0,SEEK_SET);
-    end = le_offset;
-    start = 0;
-
-    while (start < end) {
-        size_t cpy = (size_t)end - (size_t)start;
-        if (cpy > sizeof(file_temp)) cpy = sizeof(file_temp);
-
-        if ((size_t)read(src_fd,file_temp,cpy) != cpy)
-            return 1;
-        if ((size_t)write(dst_fd,file_temp,cpy) != cpy)
-            return 1;
-
-        start += cpy;
+    // read the whole source, and lay out the output: the W4 header is replaced by
+    // the decompressed chunks, each given a full chunk_size until they're all done
+    if (file_size < le_offset) {
+        fprintf(stderr,"Cannot read\n");
+        return 1;
+    }
+    src_image = (uint8_t*)malloc(file_size);
+    dst_image = (uint8_t*)malloc((size_t)le_offset + ((size_t)chunk_size * num_chunks));
+    chunks = (struct w4chunk*)calloc(num_chunks,sizeof(struct w4chunk));
+    if (src_image == NULL || dst_image == NULL || chunks == NULL) {
+        fprintf(stderr,"Cannot alloc\n");
+        return 1;
     }
+    if (lseek(src_fd,0,SEEK_SET) != 0 || (size_t)read(src_fd,src_image,file_size) != (size_t)file_size) {
+        fprintf(stderr,"Cannot read\n");
+        return 1;
+    }
+
+    // copy source to dest up to W4 header
+    memcpy(dst_image,src_image,le_offset);
 
     for (chunk=0;chunk < num_chunks;chunk++) {
         start = chunkTable[chunk];
@@ -314,35 +609,62 @@ int main(int argc,char **argv) {
         else
             end = chunkTable[chunk+1];
 
-        if (start >= end)
+        if (start >= end || end > file_size)
             return 1;
         if ((start+chunk_size) < end)
             return 1;
 
-        fprintf(stderr,"Decompressing chunk %lu/%lu: src sz=%lu\n",
-            (unsigned long)chunk,(unsigned long)num_chunks - 1UL,(unsigned long)(end-start));
+        chunks[chunk].src = src_image + start;
+        chunks[chunk].srclen = (size_t)(end-start);
+        chunks[chunk].dst = dst_image + le_offset + ((size_t)chunk_size * chunk);
+        chunks[chunk].dstmax = chunk_size;
+    }
 
-        if ((uint32_t)lseek(src_fd,start,SEEK_SET) != start)
-            return 1;
-        if ((size_t)read(src_fd,src_temp,(size_t)(end-start)) != (size_t)(end-start))
-            return 1;
+    W4InitTables();
+    if (jobs > 1u)
+        W4DecodeChunks(num_chunks);
+
+    out = le_offset;
+    for (chunk=0;chunk < num_chunks;chunk++) {
+        struct w4chunk *c = &chunks[chunk];
 
-        if ((start+chunk_size) != end) {
-            uint32_t dstsz;
+        fprintf(stderr,"Decompressing chunk %lu/%lu: src sz=%lu\n",
+            (unsigned long)chunk,(unsigned long)num_chunks - 1UL,(unsigned long)c->srclen);
 
-            memset(file_temp,0xE5,chunk_size);
-            dstsz = W4Decompress(file_temp,chunk_size,src_temp,(size_t)(end-start));
-            fprintf(stderr,"  Output: %lu\n",(unsigned long)dstsz);
-            if (dstsz == 0) return 1;
+        if (!c->decoded)
+            W4DecodeChunk(c,chunk);
 
-            write(dst_fd,file_temp,dstsz);
+        if (c->srclen != c->dstmax) {
+            fprintf(stderr,"  Output: %lu\n",(unsigned long)c->dstsz);
+            if (c->dstsz == 0) return 1;
         }
-        else {
-            /* TODO: When does this happen? */
-            write(dst_fd,src_temp,chunk_size);
+        if (c->error[0] != 0) {
+            fprintf(stderr,"Verify failed: %s\n",c->error);
+            return 1;
         }
+
+        // a short chunk leaves a gap before the next one
+        if (dst_image + out != c->dst)
+            memmove(dst_image + out,c->dst,c->dstsz);
+        out += c->dstsz;
+    }
+
+    // the dest file is only created once every chunk has decoded, so that a failure
+    // doesn't leave a partial or empty file behind
+    if ((dst_fd=open(dst_file,O_WRONLY|O_BINARY|O_CREAT|O_TRUNC,0644)) < 0) {
+        fprintf(stderr,"Cannot open dest file %s, %s\n",dst_file,strerror(errno));
+        return 1;
+    }
+    if ((size_t)write(dst_fd,dst_image,out) != out) {
+        fprintf(stderr,"Cannot write dest file, %s\n",strerror(errno));
+        close(dst_fd);
+        unlink(dst_file);
+        return 1;
     }
 
+    free(chunks);
+    free(dst_image);
+    free(src_image);
     free(chunkTable);
     close(dst_fd);
     close(src_fd);
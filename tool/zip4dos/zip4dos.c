@@ -23,6 +23,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "zlib.h"
 #include "iconv.h"
@@ -115,6 +116,9 @@ static void help(void) {
     fprintf(stderr,"  -oc <charset>            File names for target use this charset\n");
     fprintf(stderr,"  -t+                      Add trailing data descriptor\n");
     fprintf(stderr,"  -t-                      Don't write trailing descriptor\n");
+    fprintf(stderr,"  -j <n>                   Deflate on <n> threads\n");
+    fprintf(stderr,"  -a                       Store files that do not deflate well\n");
+    fprintf(stderr,"  -dedup                   Compress identical files only once\n");
     fprintf(stderr,"\n");
     fprintf(stderr,"Spanning size can be specified in bytes, or with K, M, G, suffix.\n");
     fprintf(stderr,"With spanning, the zip file must have .zip suffix, which will be changed\n");
@@ -220,7 +224,9 @@ struct in_file {
     unsigned long       disk_offset;    /* offset relative to starting disk of local file header */
     unsigned long       compressed_size;
     unsigned short      msdos_time,msdos_date;
+    unsigned short      compression_method; /* 0 = stored, 8 = deflate */
     uint32_t            crc32;
+    struct in_file*     dup_of;         /* same content as this earlier file, copy its compressed data */
     struct in_file*     next;
 
     _Bool               data_descriptor;/* write data descriptor after file */
@@ -283,6 +289,9 @@ _Bool recurse = 0;
 char *codepage_in = NULL;
 char *codepage_out = NULL;
 int trailing_data_descriptor = -1;
+int zip_jobs = 1; /* -j */
+_Bool adaptive = 0; /* -a */
+_Bool dedup = 0; /* -dedup */
 
 unsigned int fat_start = 0;
 unsigned int data_start = 0;
@@ -838,6 +847,535 @@ int zip_deflate(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
     return 0;
 }
 
+/* -j: files are deflated by worker threads into memory, in chunks of up to ZIP_CHUNK_SIZE.
+ * every chunk after the first is primed with the 32KB before it as the deflate dictionary, and
+ * every chunk but the last ends on a byte boundary (Z_SYNC_FLUSH), so that the chunks of a file
+ * concatenate into one deflate stream. the writer takes the chunks in order, so the archive
+ * layout is the same as without -j. */
+#define ZIP_CHUNK_SIZE          (1UL << 20UL)
+#define ZIP_CHUNK_DICT          (32768UL)
+
+struct zip_chunk {
+    struct in_file*     file;
+    unsigned long       offset;         /* offset of the chunk in the file */
+    unsigned long       length;
+    _Bool               last;           /* last chunk of the file, finishes the deflate stream */
+    unsigned char*      out;            /* deflated chunk */
+    size_t              out_len;
+    uint32_t            crc32;          /* CRC of this chunk alone */
+    int                 result;
+    _Bool               done;
+};
+
+struct zip_chunk*       zip_chunks = NULL;
+size_t                  zip_chunks_count = 0;
+size_t                  zip_chunks_alloc = 0;
+size_t                  zip_chunks_next = 0;        /* next chunk for a worker */
+size_t                  zip_chunks_written = 0;     /* chunks taken by the writer */
+size_t                  zip_chunks_window = 0;      /* how far workers may run ahead of the writer */
+pthread_mutex_t         zip_chunks_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t          zip_chunks_cond = PTHREAD_COND_INITIALIZER;
+pthread_t*              zip_threads = NULL;
+int                     zip_threads_count = 0;
+
+int zip_chunks_add(struct in_file *list) {
+    unsigned long ofs = 0;
+
+    do {
+        struct zip_chunk *c;
+
+        if (zip_chunks_count >= zip_chunks_alloc) {
+            size_t ns = zip_chunks_alloc * 2;
+            if (ns < 256) ns = 256;
+
+            c = (struct zip_chunk*)realloc(zip_chunks,ns * sizeof(struct zip_chunk));
+            if (c == NULL) return -1;
+            zip_chunks = c;
+            zip_chunks_alloc = ns;
+        }
+
+        c = &zip_chunks[zip_chunks_count++];
+        memset(c,0,sizeof(*c));
+        c->file = list;
+        c->offset = ofs;
+        c->length = list->file_size - ofs;
+        if (c->length > ZIP_CHUNK_SIZE) c->length = ZIP_CHUNK_SIZE;
+        ofs += c->length;
+        c->last = (ofs >= list->file_size);
+    } while (ofs < list->file_size);
+
+    return 0;
+}
+
+int zip_deflate_chunk(struct zip_chunk *c) {
+    unsigned long dict = (c->offset < ZIP_CHUNK_DICT) ? c->offset : ZIP_CHUNK_DICT;
+    unsigned char *inbuffer;
+    size_t outbuffer_sz;
+    ssize_t rd;
+    z_stream z;
+    int src_fd;
+    int x;
+
+    memset(&z,0,sizeof(z));
+
+    src_fd = open(c->file->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0) {
+        fprintf(stderr,"Cannot open %s, %s\n",c->file->in_path,strerror(errno));
+        return -1;
+    }
+
+    inbuffer = malloc(dict + c->length + 1);
+    if (inbuffer == NULL) {
+        fprintf(stderr,"out of memory\n");
+        close(src_fd);
+        return -1;
+    }
+
+    rd = pread(src_fd,inbuffer,dict + c->length,(off_t)(c->offset - dict));
+    close(src_fd);
+    if (rd < 0 || (unsigned long)rd != (dict + c->length)) {
+        fprintf(stderr,"Read error, %s\n",c->file->in_path);
+        free(inbuffer);
+        return -1;
+    }
+
+    c->crc32 = zipcrc_finalize(zipcrc_update(zipcrc_init(),inbuffer + dict,c->length));
+
+    if (deflateInit2(&z,deflate_mode,Z_DEFLATED,-15/*window, raw*/,8/*memlevel*/,Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr,"out of memory\n");
+        free(inbuffer);
+        return -1;
+    }
+
+    if (dict != 0 && deflateSetDictionary(&z,inbuffer,dict) != Z_OK) {
+        fprintf(stderr,"deflateSetDictionary() error\n");
+        deflateEnd(&z);
+        free(inbuffer);
+        return -1;
+    }
+
+    /* deflateBound() covers Z_FINISH, allow for the sync marker too */
+    outbuffer_sz = deflateBound(&z,c->length) + 16;
+    c->out = malloc(outbuffer_sz);
+    if (c->out == NULL) {
+        fprintf(stderr,"out of memory\n");
+        deflateEnd(&z);
+        free(inbuffer);
+        return -1;
+    }
+
+    z.next_in = inbuffer + dict;
+    z.avail_in = c->length;
+    z.next_out = c->out;
+    z.avail_out = outbuffer_sz;
+
+    x = deflate(&z,c->last ? Z_FINISH : Z_SYNC_FLUSH);
+    if (x != (c->last ? Z_STREAM_END : Z_OK) || z.avail_in != 0) {
+        fprintf(stderr,"deflate() error\n");
+        deflateEnd(&z);
+        free(inbuffer);
+        return -1;
+    }
+
+    c->out_len = outbuffer_sz - z.avail_out;
+    deflateEnd(&z);
+    free(inbuffer);
+    return 0;
+}
+
+void *zip_deflate_worker(void *arg) {
+    struct zip_chunk *c;
+
+    (void)arg;
+
+    do {
+        pthread_mutex_lock(&zip_chunks_lock);
+        while (zip_chunks_next < zip_chunks_count && zip_chunks_next >= (zip_chunks_written + zip_chunks_window))
+            pthread_cond_wait(&zip_chunks_cond,&zip_chunks_lock);
+        c = (zip_chunks_next < zip_chunks_count) ? &zip_chunks[zip_chunks_next++] : NULL;
+        pthread_mutex_unlock(&zip_chunks_lock);
+
+        if (c != NULL) {
+            int r = zip_deflate_chunk(c);
+
+            pthread_mutex_lock(&zip_chunks_lock);
+            c->result = r;
+            c->done = 1;
+            pthread_cond_broadcast(&zip_chunks_cond);
+            pthread_mutex_unlock(&zip_chunks_lock);
+        }
+    } while (c != NULL);
+
+    return NULL;
+}
+
+int zip_workers_start(void) {
+    zip_chunks_window = (size_t)zip_jobs * 4;
+
+    zip_threads = (pthread_t*)malloc(sizeof(pthread_t) * zip_jobs);
+    if (zip_threads == NULL) return -1;
+
+    for (zip_threads_count=0;zip_threads_count < zip_jobs;zip_threads_count++) {
+        if (pthread_create(&zip_threads[zip_threads_count],NULL,zip_deflate_worker,NULL) != 0) {
+            fprintf(stderr,"Cannot start worker thread\n");
+            return zip_threads_count > 0 ? 0 : -1;
+        }
+    }
+
+    return 0;
+}
+
+void zip_workers_stop(void) {
+    size_t i;
+
+    if (zip_threads != NULL) {
+        /* let any worker still waiting for the writer run through what is left, and exit */
+        pthread_mutex_lock(&zip_chunks_lock);
+        zip_chunks_written = zip_chunks_count;
+        pthread_cond_broadcast(&zip_chunks_cond);
+        pthread_mutex_unlock(&zip_chunks_lock);
+
+        while (zip_threads_count > 0)
+            pthread_join(zip_threads[--zip_threads_count],NULL);
+
+        free(zip_threads);
+        zip_threads = NULL;
+    }
+
+    if (zip_chunks != NULL) {
+        for (i=0;i < zip_chunks_count;i++) {
+            if (zip_chunks[i].out != NULL)
+                free(zip_chunks[i].out);
+        }
+
+        free(zip_chunks);
+        zip_chunks = NULL;
+        zip_chunks_count = zip_chunks_alloc = 0;
+        zip_chunks_next = zip_chunks_written = 0;
+    }
+}
+
+/* same as zip_deflate() but writes the chunks the workers deflated */
+int zip_deflate_pooled(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    unsigned long total = 0;
+    uLong crc32 = 0;
+    struct zip_chunk *c;
+
+    lfh->uncompressed_size = list->file_size;
+
+    do {
+        assert(zip_chunks_written < zip_chunks_count);
+        c = &zip_chunks[zip_chunks_written];
+        assert(c->file == list);
+
+        pthread_mutex_lock(&zip_chunks_lock);
+        while (!c->done)
+            pthread_cond_wait(&zip_chunks_cond,&zip_chunks_lock);
+        pthread_mutex_unlock(&zip_chunks_lock);
+
+        if (c->result)
+            return -1;
+
+        if (c->out_len > 0) {
+            if ((size_t)zip_write_and_span(zip_fd,c->out,c->out_len) != c->out_len) {
+                fprintf(stderr,"write error\n");
+                return -1;
+            }
+
+            total += c->out_len;
+        }
+
+        if (c->offset == 0)
+            crc32 = c->crc32;
+        else
+            crc32 = crc32_combine(crc32,c->crc32,(z_off_t)c->length);
+
+        free(c->out);
+        c->out = NULL;
+
+        pthread_mutex_lock(&zip_chunks_lock);
+        zip_chunks_written++;
+        pthread_cond_broadcast(&zip_chunks_cond);
+        pthread_mutex_unlock(&zip_chunks_lock);
+    } while (!c->last);
+
+    lfh->crc32 = list->crc32 = (uint32_t)crc32;
+    list->compressed_size = lfh->compressed_size = total;
+    return 0;
+}
+
+/* -a: deflate the start of the file, and store the file if that does not shrink it by at least 1/32.
+ * already compressed content (.ZIP, .GZ, JPEG, MP3...) then costs a 64KB trial instead of a full deflate. */
+#define ZIP_TRIAL_SIZE          (65536UL)
+
+int zip_trial_deflate(struct in_file *list) {
+    size_t inbuffer_sz = ZIP_TRIAL_SIZE,outbuffer_sz;
+    unsigned char *inbuffer,*outbuffer;
+    size_t out_len;
+    z_stream z;
+    int src_fd;
+    ssize_t rd;
+
+    memset(&z,0,sizeof(z));
+
+    src_fd = open(list->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0) {
+        fprintf(stderr,"Cannot open %s, %s\n",list->in_path,strerror(errno));
+        return -1;
+    }
+
+    inbuffer = malloc(inbuffer_sz);
+    if (inbuffer == NULL) {
+        close(src_fd);
+        return -1;
+    }
+
+    rd = read(src_fd,inbuffer,inbuffer_sz);
+    close(src_fd);
+    if (rd <= 0) {
+        free(inbuffer);
+        return rd < 0 ? -1 : 0;
+    }
+
+    if (deflateInit2(&z,deflate_mode,Z_DEFLATED,-15/*window, raw*/,8/*memlevel*/,Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(inbuffer);
+        return -1;
+    }
+
+    outbuffer_sz = deflateBound(&z,(uLong)rd);
+    outbuffer = malloc(outbuffer_sz);
+    if (outbuffer == NULL) {
+        deflateEnd(&z);
+        free(inbuffer);
+        return -1;
+    }
+
+    z.next_in = inbuffer;
+    z.avail_in = (uInt)rd;
+    z.next_out = outbuffer;
+    z.avail_out = outbuffer_sz;
+    deflate(&z,Z_FINISH);
+    out_len = outbuffer_sz - z.avail_out;
+    deflateEnd(&z);
+
+    if (out_len >= ((size_t)rd - ((size_t)rd >> 5)))
+        list->compression_method = 0; /* stored */
+
+    free(outbuffer);
+    free(inbuffer);
+    return 0;
+}
+
+int zip_same_content(const char *a,const char *b,unsigned long size) {
+    size_t buffer_sz = 32768;
+    unsigned char *ba,*bb;
+    int fa,fb,same = 1;
+    ssize_t ra,rb;
+
+    fa = open(a,O_RDONLY|O_BINARY);
+    fb = open(b,O_RDONLY|O_BINARY);
+    ba = malloc(buffer_sz);
+    bb = malloc(buffer_sz);
+    if (fa < 0 || fb < 0 || ba == NULL || bb == NULL)
+        same = 0;
+
+    while (same && size > 0) {
+        ra = read(fa,ba,buffer_sz);
+        rb = read(fb,bb,buffer_sz);
+        if (ra <= 0 || ra != rb || memcmp(ba,bb,(size_t)ra) != 0)
+            same = 0;
+        else
+            size -= (unsigned long)ra;
+    }
+
+    if (fa >= 0) close(fa);
+    if (fb >= 0) close(fb);
+    free(ba);
+    free(bb);
+    return same;
+}
+
+int zip_file_crc(struct in_file *list) {
+    size_t buffer_sz = 65536;
+    zipcrc_t crc32;
+    char *buffer;
+    int src_fd;
+    ssize_t rd;
+
+    src_fd = open(list->in_path,O_RDONLY|O_BINARY);
+    if (src_fd < 0) {
+        fprintf(stderr,"Cannot open %s, %s\n",list->in_path,strerror(errno));
+        return -1;
+    }
+
+    buffer = malloc(buffer_sz);
+    if (buffer == NULL) {
+        close(src_fd);
+        return -1;
+    }
+
+    crc32 = zipcrc_init();
+    while ((rd=read(src_fd,buffer,buffer_sz)) > 0)
+        crc32 = zipcrc_update(crc32,buffer,(size_t)rd);
+
+    list->crc32 = zipcrc_finalize(crc32);
+    close(src_fd);
+    free(buffer);
+    return 0;
+}
+
+struct zip_dedup_ent {
+    struct in_file*     file;
+    size_t              order;          /* position in the file list */
+};
+
+static int zip_dedup_compare(const void *a,const void *b) {
+    const struct zip_dedup_ent *ea = (const struct zip_dedup_ent*)a;
+    const struct zip_dedup_ent *eb = (const struct zip_dedup_ent*)b;
+
+    if (ea->file->file_size != eb->file->file_size)
+        return (ea->file->file_size < eb->file->file_size) ? -1 : 1;
+    if (ea->order != eb->order)
+        return (ea->order < eb->order) ? -1 : 1;
+
+    return 0;
+}
+
+/* -dedup: files of the same size and CRC are compared, and each later identical file is marked as a
+ * duplicate of the first. the writer copies the compressed data of the first instead of compressing
+ * again. the archive still has a full local entry for each file, PKUNZIP.EXE expects that. */
+int zip_dedup_files(void) {
+    struct zip_dedup_ent *files;
+    size_t count = 0,i,j,k,run;
+    struct in_file *list;
+
+    for (list=file_list_head;list;list=list->next) {
+        if (!(list->attr & ATTR_DOS_DIR) && list->file_size != 0)
+            count++;
+    }
+    if (count < 2)
+        return 0;
+
+    files = (struct zip_dedup_ent*)malloc(sizeof(struct zip_dedup_ent) * count);
+    if (files == NULL) return -1;
+
+    count = 0;
+    for (list=file_list_head;list;list=list->next) {
+        if (!(list->attr & ATTR_DOS_DIR) && list->file_size != 0) {
+            files[count].file = list;
+            files[count].order = count;
+            count++;
+        }
+    }
+
+    /* by size, then list order, so that the first of identical files comes first */
+    qsort(files,count,sizeof(struct zip_dedup_ent),zip_dedup_compare);
+
+    for (i=0;i < count;i=run) {
+        for (run=i+1;run < count && files[run].file->file_size == files[i].file->file_size;run++);
+        if ((run - i) < 2) continue;
+
+        for (j=i;j < run;j++) {
+            if (zip_file_crc(files[j].file)) {
+                free(files);
+                return -1;
+            }
+        }
+
+        for (j=i+1;j < run;j++) {
+            for (k=i;k < j;k++) {
+                if (files[k].file->dup_of == NULL && files[k].file->crc32 == files[j].file->crc32 &&
+                    zip_same_content(files[k].file->in_path,files[j].file->in_path,files[j].file->file_size)) {
+                    files[j].file->dup_of = files[k].file;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(files);
+    return 0;
+}
+
+/* pick how each file is stored, before anything is written */
+int zip_plan_files(void) {
+    struct in_file *list;
+
+    for (list=file_list_head;list;list=list->next) {
+        if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
+            list->compression_method = 8; /* deflate */
+        else
+            list->compression_method = 0; /* stored (no compression) */
+    }
+
+    if (dedup && zip_dedup_files())
+        return -1;
+
+    for (list=file_list_head;list;list=list->next) {
+        if (list->dup_of != NULL) {
+            /* the first file may be on a previous disk by the time the duplicate is written */
+            if (spanning_size > 0)
+                list->dup_of = NULL;
+            else
+                continue;
+        }
+
+        if (adaptive && list->compression_method == 8 && zip_trial_deflate(list))
+            return -1;
+    }
+
+    for (list=file_list_head;list;list=list->next) {
+        if (list->dup_of != NULL)
+            list->compression_method = list->dup_of->compression_method;
+    }
+
+    return 0;
+}
+
+/* copy the compressed data of the file this one duplicates, from earlier in the archive */
+int zip_copy_dup(struct pkzip_local_file_header_main *lfh,struct in_file *list) {
+    const struct in_file *orig = list->dup_of;
+    size_t buffer_sz = 32768;
+    unsigned long ofs,left;
+    char *buffer;
+    ssize_t rd;
+
+    assert(orig != NULL);
+    assert(spanning_size == 0);
+
+    buffer = malloc(buffer_sz);
+    if (buffer == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return -1;
+    }
+
+    ofs = orig->disk_offset + data_start + sizeof(struct pkzip_local_file_header_main) + strlen(orig->zip_name);
+    left = orig->compressed_size;
+    while (left > 0) {
+        rd = pread(zip_fd,buffer,left < buffer_sz ? left : buffer_sz,(off_t)ofs);
+        if (rd <= 0) {
+            fprintf(stderr,"Cannot read back %s from the archive\n",orig->zip_name);
+            free(buffer);
+            return -1;
+        }
+
+        if (zip_write_and_span(zip_fd,buffer,(size_t)rd) != rd) {
+            fprintf(stderr,"write error\n");
+            free(buffer);
+            return -1;
+        }
+
+        ofs += (unsigned long)rd;
+        left -= (unsigned long)rd;
+    }
+
+    lfh->uncompressed_size = list->file_size;
+    lfh->crc32 = list->crc32 = orig->crc32;
+    list->compressed_size = lfh->compressed_size = orig->compressed_size;
+    free(buffer);
+    return 0;
+}
+
 uint16_t stat2msdostime(struct stat *st) {
     struct tm *tm = localtime(&st->st_mtime);
     assert(tm != NULL);
@@ -930,6 +1468,18 @@ static int parse(int argc,char **argv) {
             else if (!strcmp(a,"t-")) {
                 trailing_data_descriptor = 0;
             }
+            else if (!strcmp(a,"a")) {
+                adaptive = 1;
+            }
+            else if (!strcmp(a,"dedup")) {
+                dedup = 1;
+            }
+            else if (!strcmp(a,"j")) {
+                a = argv[i++];
+                if (a == NULL) return 1;
+                zip_jobs = (int)strtol(a,NULL,10);
+                if (zip_jobs < 1) zip_jobs = 1;
+            }
             else if (isdigit(*a)) {
                 deflate_mode = (int)strtol(a,(char**)(&a),10);
                 if (deflate_mode < 0 || deflate_mode > 9) return 1;
@@ -1315,6 +1865,24 @@ static int parse(int argc,char **argv) {
         }
     }
 
+    if (zip_plan_files())
+        return 1;
+
+    if (zip_jobs > 1 && deflate_mode > 0) {
+        struct in_file *list;
+
+        /* hand every file to deflate to the workers up front */
+        for (list=file_list_head;list;list=list->next) {
+            if (list->compression_method == 8 && list->dup_of == NULL) {
+                if (zip_chunks_add(list))
+                    return 1;
+            }
+        }
+
+        if (zip_workers_start())
+            return 1;
+    }
+
     {
         struct pkzip_local_file_header_main lhdr;
         struct in_file *list;
@@ -1323,18 +1891,14 @@ static int parse(int argc,char **argv) {
             assert(list->in_path != NULL);
             assert(list->zip_name != NULL);
             printf("%s: %s\n",
-                deflate_mode==0?"Storing":"Deflating",list->in_path);
+                list->dup_of!=NULL?"Copying":(list->compression_method==0?"Storing":"Deflating"),list->in_path);
 
             memset(&lhdr,0,sizeof(lhdr));
             lhdr.sig = PKZIP_LOCAL_FILE_HEADER_SIG;
             lhdr.version_needed_to_extract = 20;        /* PKZIP 2.0 or higher */
             lhdr.general_purpose_bit_flag = (0 << 1);   /* just lie and say that "normal" deflate was used */
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                lhdr.compression_method = 8; /* deflate */
-            else
-                lhdr.compression_method = 0; /* stored (no compression) */
-
+            lhdr.compression_method = list->compression_method;
             lhdr.last_mod_file_time = list->msdos_time;
             lhdr.last_mod_file_date = list->msdos_date;
             /* some fields we'll go back and write later */
@@ -1379,10 +1943,20 @@ static int parse(int argc,char **argv) {
 
             /* store, if a file */
             if (!(list->attr & ATTR_DOS_DIR)) {
-                if (lhdr.compression_method == 8) {
-                    if (zip_deflate(&lhdr,list))
+                if (list->dup_of != NULL) {
+                    if (zip_copy_dup(&lhdr,list))
                         return 1;
                 }
+                else if (lhdr.compression_method == 8) {
+                    if (zip_threads != NULL) {
+                        if (zip_deflate_pooled(&lhdr,list))
+                            return 1;
+                    }
+                    else {
+                        if (zip_deflate(&lhdr,list))
+                            return 1;
+                    }
+                }
                 else if (lhdr.compression_method == 0) {
                     if (zip_store(&lhdr,list))
                         return 1;
@@ -1439,6 +2013,8 @@ static int parse(int argc,char **argv) {
         }
     }
 
+    zip_workers_stop();
+
     /* write central directory */
     {
         struct pkzip_central_directory_header_main chdr;
@@ -1482,10 +2058,7 @@ static int parse(int argc,char **argv) {
             if (list->data_descriptor)
                 chdr.general_purpose_bit_flag |= (1 << 3);
 
-            if (deflate_mode > 0 && !(list->attr & ATTR_DOS_DIR))
-                chdr.compression_method = 8; /* deflate */
-            else
-                chdr.compression_method = 0; /* stored (no compression) */
+            chdr.compression_method = list->compression_method;
 
             chdr.last_mod_file_time = list->msdos_time;
             chdr.last_mod_file_date = list->msdos_date;
@@ -63,6 +63,29 @@ static inline zipcrc_t zipcrc_init(void)
 zipcrc_t zipcrc_update(zipcrc_t crc, const void *data, size_t data_len);
 
 
+/**
+ * Update the crc value with new data, one byte at a time (the original
+ * pycrc table loop). Same result as zipcrc_update().
+ *****************************************************************************/
+zipcrc_t zipcrc_update_bytewise(zipcrc_t crc, const void *data, size_t data_len);
+
+
+/**
+ * Update the crc value with new data, 8 bytes per step (slice-by-8).
+ * Same result as zipcrc_update().
+ *****************************************************************************/
+zipcrc_t zipcrc_update_slice8(zipcrc_t crc, const void *data, size_t data_len);
+
+
+/**
+ * Whether zipcrc_update() uses carry-less multiply (PCLMULQDQ) folding on
+ * this CPU.
+ *
+ * \return     Nonzero if so.
+ *****************************************************************************/
+int zipcrc_have_pclmul(void);
+
+
 /**
  * Calculate the final crc value.
  *
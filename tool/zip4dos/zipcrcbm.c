@@ -0,0 +1,108 @@
+/* zipcrc benchmark.
+ *
+ * Checks that every zipcrc_update() variant agrees with the byte at a time loop and zlib's crc32(),
+ * over odd lengths and alignments, then reports throughput of each on a large buffer. */
+
+#include <sys/types.h>
+
+#include <time.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "zlib.h"
+
+#include "zipcrc.h"
+
+typedef zipcrc_t (*zipcrc_update_fn)(zipcrc_t crc, const void *data, size_t data_len);
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1000000000.0);
+}
+
+static zipcrc_t zlib_update(zipcrc_t crc, const void *data, size_t data_len) {
+    /* zlib takes and returns the finalized value */
+    return zipcrc_finalize(crc32(zipcrc_finalize(crc),(const Bytef*)data,(uInt)data_len));
+}
+
+static const struct {
+    const char*         name;
+    zipcrc_update_fn    fn;
+} variants[] = {
+    { "bytewise",       zipcrc_update_bytewise },
+    { "slice8",         zipcrc_update_slice8 },
+    { "zipcrc_update",  zipcrc_update },
+    { "zlib crc32",     zlib_update }
+};
+
+#define VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+int main(int argc,char **argv) {
+    size_t buf_sz = 64UL << 20UL; /* 64MB */
+    unsigned char *buf;
+    unsigned int v,rep,reps = 4;
+    size_t i,ofs,len;
+    zipcrc_t ref,crc;
+    double t;
+
+    if (argc > 1)
+        buf_sz = strtoul(argv[1],NULL,0) << 20UL;
+    if (buf_sz < 4096)
+        buf_sz = 4096;
+
+    buf = malloc(buf_sz + 16);
+    if (buf == NULL) {
+        fprintf(stderr,"out of memory\n");
+        return 1;
+    }
+
+    srand(1);
+    for (i=0;i < buf_sz + 16;i++)
+        buf[i] = (unsigned char)rand();
+
+    printf("PCLMULQDQ: %s\n",zipcrc_have_pclmul() ? "yes" : "no");
+
+    for (ofs=0;ofs < 16;ofs++) {
+        for (len=0;len < 1024;len += (len < 200 ? 1 : 37)) {
+            ref = zipcrc_finalize(zipcrc_update_bytewise(zipcrc_init(),buf+ofs,len));
+
+            for (v=1;v < VARIANTS;v++) {
+                crc = zipcrc_finalize(variants[v].fn(zipcrc_init(),buf+ofs,len));
+                if (crc != ref) {
+                    fprintf(stderr,"%s mismatch ofs=%zu len=%zu: 0x%08lx != 0x%08lx\n",
+                        variants[v].name,ofs,len,(unsigned long)crc,(unsigned long)ref);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    ref = 0;
+    for (v=0;v < VARIANTS;v++) {
+        /* the byte at a time loop is slow, one pass is enough */
+        const unsigned int r = (v == 0) ? 1 : reps;
+
+        t = now_sec();
+        for (rep=0;rep < r;rep++)
+            crc = zipcrc_finalize(variants[v].fn(zipcrc_init(),buf,buf_sz));
+        t = now_sec() - t;
+
+        if (v == 0)
+            ref = crc;
+        else if (crc != ref) {
+            fprintf(stderr,"%s mismatch on large buffer\n",variants[v].name);
+            return 1;
+        }
+
+        printf("%-16s %10.1f MB/s  0x%08lx\n",variants[v].name,
+            ((double)buf_sz * r) / (t * 1048576.0),(unsigned long)crc);
+    }
+
+    free(buf);
+    return 0;
+}
+